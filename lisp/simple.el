@@ -3108,7 +3108,7 @@ by `undo-auto-amalgamate'." )
 
 (defun undo-auto--needs-boundary-p ()
   "Return non-nil if `buffer-undo-list' needs a boundary at the start."
-  (car-safe buffer-undo-list))
+  (undo-needs-boundary-p))
 
 (defun undo-auto--last-boundary-amalgamating-number ()
   "Return the number of amalgamating last commands or nil.
@@ -3195,13 +3195,9 @@ behavior."
             (when (buffer-live-p b)
               (with-current-buffer
                   b
-                (when (and (consp buffer-undo-list)
-                           ;; `car-safe' doesn't work because
-                           ;; `buffer-undo-list' need not be a list!
-                           (null (car buffer-undo-list)))
-                  ;; The head of `buffer-undo-list' is nil.
-                  (setq buffer-undo-list
-                        (cdr buffer-undo-list))))))
+                ;; Unlike looking at `buffer-undo-list', this leaves
+                ;; the compact undo log alone.
+                (undo-remove-boundary))))
         (setq undo-auto--last-boundary-cause 0)))))
 
 (defun undo-auto--undoable-change ()
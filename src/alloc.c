@@ -1392,6 +1392,7 @@ make_interval (void)
   intervals_consed++;
   RESET_INTERVAL (val);
   val->gcmarkbit = 0;
+  val->priority = random_interval_priority ();
   return val;
 }
 
@@ -1912,9 +1913,6 @@ sweep_strings (void)
 		  /* String is live; unmark it and its intervals.  */
 		  XUNMARK_STRING (s);
 
-		  /* Do not use string_(set|get)_intervals here.  */
-		  s->u.s.intervals = balance_intervals (s->u.s.intervals);
-
 		  gcstat.total_strings++;
 		  gcstat.total_string_bytes += STRING_BYTES (s);
 		}
@@ -3492,11 +3490,12 @@ DEFUN ("make-marker", Fmake_marker, Smake_marker, 0, 0, 0,
   struct Lisp_Marker *p = ALLOCATE_PLAIN_PSEUDOVECTOR (struct Lisp_Marker,
 						       PVEC_MARKER);
   p->buffer = 0;
-  p->bytepos = 0;
-  p->charpos = 0;
-  p->next = NULL;
+  p->bytepos_ = 0;
+  p->charpos_ = 0;
   p->insertion_type = 0;
   p->need_adjustment = 0;
+  p->relative = 0;
+  p->recyclable = 0;
   return make_lisp_ptr (p, Lisp_Vectorlike);
 }
 
@@ -3514,13 +3513,11 @@ build_marker (struct buffer *buf, ptrdiff_t charpos, ptrdiff_t bytepos)
 
   struct Lisp_Marker *m = ALLOCATE_PLAIN_PSEUDOVECTOR (struct Lisp_Marker,
 						       PVEC_MARKER);
-  m->buffer = buf;
-  m->charpos = charpos;
-  m->bytepos = bytepos;
+  m->buffer = NULL;
   m->insertion_type = 0;
   m->need_adjustment = 0;
-  m->next = BUF_MARKERS (buf);
-  BUF_MARKERS (buf) = m;
+  m->recyclable = 0;
+  attach_marker (m, buf, charpos, bytepos);
   return make_lisp_ptr (m, Lisp_Vectorlike);
 }
 
@@ -5926,6 +5923,7 @@ garbage_collect (void)
   block_input ();
 
   shrink_regexp_cache ();
+  discard_recycled_markers ();
 
   gc_in_progress = 1;
 
@@ -6231,6 +6229,11 @@ mark_buffer (struct buffer *buffer)
   mark_overlay (buffer->overlays_before);
   mark_overlay (buffer->overlays_after);
 
+  if (buffer->syntax_ppss_cache)
+    mark_syntax_ppss_cache (buffer);
+  if (buffer->column_cache)
+    mark_column_cache (buffer);
+
   /* If this is an indirect buffer, mark its base buffer.  */
   if (buffer->base_buffer &&
       !vectorlike_marked_p (&buffer->base_buffer->header))
@@ -6964,21 +6967,19 @@ sweep_symbols (void)
   gcstat.total_free_symbols = num_free;
 }
 
+/* Return true if marker M is due to be swept.  */
+static bool
+dead_marker_p (struct Lisp_Marker *m, struct buffer *buffer)
+{
+  return !vectorlike_marked_p (&m->header);
+}
+
 /* Remove BUFFER's markers that are due to be swept.  This is needed since
-   we treat BUF_MARKERS and markers's `next' field as weak pointers.  */
+   we treat the marker index of a buffer as weak pointers.  */
 static void
 unchain_dead_markers (struct buffer *buffer)
 {
-  struct Lisp_Marker *this, **prev = &BUF_MARKERS (buffer);
-
-  while ((this = *prev))
-    if (vectorlike_marked_p (&this->header))
-      prev = &this->next;
-    else
-      {
-        this->buffer = NULL;
-        *prev = this->next;
-      }
+  unchain_markers_if (buffer, dead_marker_p);
 }
 
 NO_INLINE /* For better stack traces */
@@ -6998,8 +6999,6 @@ sweep_buffers (void)
       {
         if (!pdumper_object_p (buffer))
           XUNMARK_VECTOR (buffer);
-        /* Do not use buffer_(set|get)_intervals here.  */
-        buffer->text->intervals = balance_intervals (buffer->text->intervals);
         unchain_dead_markers (buffer);
 	gcstat.total_buffers++;
         bprev = &buffer->next;
@@ -30,6 +30,10 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 
 #include <verify.h>
 
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #include "lisp.h"
 #include "intervals.h"
 #include "process.h"
@@ -118,6 +122,17 @@ static void reset_buffer_local_variables (struct buffer *, bool);
    due to user rplac'ing this alist or its elements.  */
 Lisp_Object Vbuffer_alist;
 
+/* Hash table mapping the name of each buffer in Vbuffer_alist to the
+   buffer, so that `get-buffer' does not have to scan the alist.  It
+   must be updated whenever an element is added to or removed from
+   Vbuffer_alist, or a buffer is renamed.  */
+static Lisp_Object buffer_name_index;
+
+/* The last cons of Vbuffer_alist, or nil if not known.  Appending a
+   new buffer uses this to avoid walking the whole alist; any other
+   change to the alist's structure must reset it to nil.  */
+static Lisp_Object buffer_alist_tail;
+
 static Lisp_Object QSFundamental;	/* A string "Fundamental".  */
 
 static void alloc_buffer_text (struct buffer *, ptrdiff_t);
@@ -431,20 +446,71 @@ followed by the rest of the buffers.  */)
     return general;
 }
 
-/* Like Fassoc, but use Fstring_equal to compare
-   (which ignores text properties), and don't ever quit.  */
+/* Add NAME and BUFFER to the end of Vbuffer_alist and to the buffer
+   name index.  */
 
-static Lisp_Object
-assoc_ignore_text_properties (Lisp_Object key, Lisp_Object list)
+static void
+add_to_buffer_alist (Lisp_Object name, Lisp_Object buffer)
 {
-  Lisp_Object tail;
-  for (tail = list; CONSP (tail); tail = XCDR (tail))
+  Lisp_Object elt = list1 (Fcons (name, buffer));
+  struct Lisp_Hash_Table *h = XHASH_TABLE (buffer_name_index);
+  Lisp_Object hash;
+
+  if (NILP (Vbuffer_alist))
+    Vbuffer_alist = elt;
+  else
     {
-      Lisp_Object elt = XCAR (tail);
-      if (!NILP (Fstring_equal (Fcar (elt), key)))
-	return elt;
+      if (NILP (buffer_alist_tail))
+	for (buffer_alist_tail = Vbuffer_alist;
+	     CONSP (XCDR (buffer_alist_tail));
+	     buffer_alist_tail = XCDR (buffer_alist_tail))
+	  ;
+      XSETCDR (buffer_alist_tail, elt);
     }
-  return Qnil;
+  buffer_alist_tail = elt;
+
+  ptrdiff_t i = hash_lookup (h, name, &hash);
+  eassert (i < 0);
+  hash_put (h, name, buffer, hash);
+}
+
+/* Remove BUFFER from Vbuffer_alist and from the buffer name index.  */
+
+static void
+remove_from_buffer_alist (Lisp_Object buffer)
+{
+  Lisp_Object prev = Qnil;
+
+  for (Lisp_Object tail = Vbuffer_alist; CONSP (tail); tail = XCDR (tail))
+    {
+      if (EQ (XCDR (XCAR (tail)), buffer))
+	{
+	  if (NILP (prev))
+	    Vbuffer_alist = XCDR (tail);
+	  else
+	    XSETCDR (prev, XCDR (tail));
+	  if (EQ (tail, buffer_alist_tail))
+	    buffer_alist_tail = prev;
+	  hash_remove_from_table (XHASH_TABLE (buffer_name_index),
+				  XCAR (XCAR (tail)));
+	  return;
+	}
+      prev = tail;
+    }
+}
+
+/* Forget all live buffers: empty Vbuffer_alist and the buffer name
+   index.  */
+
+static void
+reset_buffer_alist (void)
+{
+  Vbuffer_alist = Qnil;
+  buffer_alist_tail = Qnil;
+  buffer_name_index
+    = make_hash_table (hashtest_equal, DEFAULT_HASH_SIZE,
+		       DEFAULT_REHASH_SIZE, DEFAULT_REHASH_THRESHOLD,
+		       Qnil, false);
 }
 
 DEFUN ("get-buffer", Fget_buffer, Sget_buffer, 1, 1, 0,
@@ -458,7 +524,11 @@ BUFFER-OR-NAME is a buffer, return it as given.  */)
     return buffer_or_name;
   CHECK_STRING (buffer_or_name);
 
-  return Fcdr (assoc_ignore_text_properties (buffer_or_name, Vbuffer_alist));
+  /* The index uses `equal', which like `string-equal' ignores text
+     properties.  */
+  struct Lisp_Hash_Table *h = XHASH_TABLE (buffer_name_index);
+  ptrdiff_t i = hash_lookup (h, buffer_or_name, NULL);
+  return i < 0 ? Qnil : HASH_VALUE (h, i);
 }
 
 DEFUN ("get-file-buffer", Fget_file_buffer, Sget_file_buffer, 1, 1, 0,
@@ -571,12 +641,18 @@ even if it is dead.  The return value is never nil.  */)
   BUF_END_UNCHANGED (b) = 0;
   BUF_BEG_UNCHANGED (b) = 0;
   *(BUF_GPT_ADDR (b)) = *(BUF_Z_ADDR (b)) = 0; /* Put an anchor '\0'.  */
+  b->text->mapped_bytes = 0;
+  b->text->property_index = NULL;
   b->text->inhibit_shrinking = false;
   b->text->redisplay = false;
 
   b->newline_cache = 0;
   b->width_run_cache = 0;
   b->bidi_paragraph_cache = 0;
+  b->syntax_ppss_cache = NULL;
+  b->column_cache = NULL;
+  b->undo_log = NULL;
+  b->suspended_undo_log = NULL;
   bset_width_table (b, Qnil);
   b->prevent_redisplay_optimizations_p = 1;
 
@@ -601,11 +677,14 @@ even if it is dead.  The return value is never nil.  */)
   reset_buffer_local_variables (b, 1);
 
   bset_mark (b, Fmake_marker ());
-  BUF_MARKERS (b) = NULL;
+  b->text->markers = NULL;
+  b->text->markers_size = 0;
+  b->text->markers_gpt = 0;
+  b->text->markers_gap_size = 0;
 
   /* Put this in the alist of all live buffers.  */
   XSETBUFFER (buffer, b);
-  Vbuffer_alist = nconc2 (Vbuffer_alist, list1 (Fcons (name, buffer)));
+  add_to_buffer_alist (name, buffer);
   /* And run buffer-list-update-hook.  */
   if (!NILP (Vrun_hooks) && !b->inhibit_buffer_hooks)
     call1 (Vrun_hooks, Qbuffer_list_update_hook);
@@ -629,12 +708,12 @@ copy_overlays (struct buffer *b, struct Lisp_Overlay *list)
 
       eassert (MARKERP (list->start));
       m = XMARKER (list->start);
-      start = build_marker (b, m->charpos, m->bytepos);
+      start = build_marker (b, marker_charpos (m), marker_bytepos (m));
       XMARKER (start)->insertion_type = m->insertion_type;
 
       eassert (MARKERP (list->end));
       m = XMARKER (list->end);
-      end = build_marker (b, m->charpos, m->bytepos);
+      end = build_marker (b, marker_charpos (m), marker_bytepos (m));
       XMARKER (end)->insertion_type = m->insertion_type;
 
       overlay = build_overlay (start, end, Fcopy_sequence (list->plist));
@@ -692,7 +771,7 @@ clone_per_buffer_values (struct buffer *from, struct buffer *to)
 	{
 	  struct Lisp_Marker *m = XMARKER (obj);
 
-	  obj = build_marker (to, m->charpos, m->bytepos);
+	  obj = build_marker (to, marker_charpos (m), marker_bytepos (m));
 	  XMARKER (obj)->insertion_type = m->insertion_type;
 	}
 
@@ -814,6 +893,10 @@ CLONE nil means the indirect buffer's state is reset to default values.  */)
   b->newline_cache = 0;
   b->width_run_cache = 0;
   b->bidi_paragraph_cache = 0;
+  b->syntax_ppss_cache = NULL;
+  b->column_cache = NULL;
+  b->undo_log = NULL;
+  b->suspended_undo_log = NULL;
   bset_width_table (b, Qnil);
 
   name = Fcopy_sequence (name);
@@ -821,6 +904,7 @@ CLONE nil means the indirect buffer's state is reset to default values.  */)
   bset_name (b, name);
 
   /* An indirect buffer shares undo list of its base (Bug#18180).  */
+  flush_undo_log (b->base_buffer);
   bset_undo_list (b, BVAR (b->base_buffer, undo_list));
 
   reset_buffer (b);
@@ -828,7 +912,7 @@ CLONE nil means the indirect buffer's state is reset to default values.  */)
 
   /* Put this in the alist of all live buffers.  */
   XSETBUFFER (buf, b);
-  Vbuffer_alist = nconc2 (Vbuffer_alist, list1 (Fcons (name, buf)));
+  add_to_buffer_alist (name, buf);
 
   bset_mark (b, Fmake_marker ());
 
@@ -909,8 +993,9 @@ delete_all_overlays (struct buffer *b)
 {
   struct Lisp_Overlay *ov, *next;
 
-  /* FIXME: Since each drop_overlay will scan BUF_MARKERS to unlink its
-     markers, we have an unneeded O(N^2) behavior here.  */
+  /* FIXME: Since each drop_overlay will search the marker index to
+     unlink its markers, we have an unneeded O(N log N) behavior
+     here.  */
   for (ov = b->overlays_before; ov; ov = next)
     {
       drop_overlay (b, ov);
@@ -1498,6 +1583,10 @@ This does not change the name of the visited file (if any).  */)
 	error ("Buffer name `%s' is in use", SDATA (newname));
     }
 
+  struct Lisp_Hash_Table *h = XHASH_TABLE (buffer_name_index);
+  Lisp_Object hash;
+  hash_remove_from_table (h, BVAR (current_buffer, name));
+  hash_lookup (h, newname, &hash);
   bset_name (current_buffer, newname);
 
   /* Catch redisplay's attention.  Unless we do this, the mode lines for
@@ -1506,6 +1595,7 @@ This does not change the name of the visited file (if any).  */)
 
   XSETBUFFER (buf, current_buffer);
   Fsetcar (Frassq (buf, Vbuffer_alist), newname);
+  hash_put (h, newname, buf, hash);
   if (NILP (BVAR (current_buffer, filename))
       && !NILP (BVAR (current_buffer, auto_save_file_name)))
     call0 (intern ("rename-auto-save-file"));
@@ -1676,6 +1766,14 @@ compact_buffer (struct buffer *buffer)
     }
 }
 
+/* Return true if marker M points into buffer B.  */
+
+static bool
+marker_of_buffer_p (struct Lisp_Marker *m, struct buffer *b)
+{
+  return m->buffer == b;
+}
+
 DEFUN ("kill-buffer", Fkill_buffer, Skill_buffer, 0, 1, "bKill buffer: ",
        doc: /* Kill the buffer specified by BUFFER-OR-NAME.
 The argument may be a buffer or the name of an existing buffer.
@@ -1697,7 +1795,6 @@ cleaning up all windows currently displaying the buffer to be killed. */)
   Lisp_Object buffer;
   struct buffer *b;
   Lisp_Object tem;
-  struct Lisp_Marker *m;
 
   if (NILP (buffer_or_name))
     buffer = Fcurrent_buffer ();
@@ -1834,7 +1931,7 @@ cleaning up all windows currently displaying the buffer to be killed. */)
   tem = Vinhibit_quit;
   Vinhibit_quit = Qt;
   /* Remove the buffer from the list of all buffers.  */
-  Vbuffer_alist = Fdelq (Frassq (buffer, Vbuffer_alist), Vbuffer_alist);
+  remove_from_buffer_alist (buffer);
   /* If replace_buffer_in_windows didn't do its job fix that now.  */
   replace_buffer_in_windows_safely (buffer);
   Vinhibit_quit = tem;
@@ -1863,17 +1960,7 @@ cleaning up all windows currently displaying the buffer to be killed. */)
       /* Unchain all markers that belong to this indirect buffer.
 	 Don't unchain the markers that belong to the base buffer
 	 or its other indirect buffers.  */
-      struct Lisp_Marker **mp = &BUF_MARKERS (b);
-      while ((m = *mp))
-	{
-	  if (m->buffer == b)
-	    {
-	      m->buffer = NULL;
-	      *mp = m->next;
-	    }
-	  else
-	    mp = &m->next;
-	}
+      unchain_markers_if (b, marker_of_buffer_p);
       /* Intervals should be owned by the base buffer (Bug#16502).  */
       i = buffer_intervals (b);
       if (i)
@@ -1887,15 +1974,9 @@ cleaning up all windows currently displaying the buffer to be killed. */)
     {
       /* Unchain all markers of this buffer and its indirect buffers.
 	 and leave them pointing nowhere.  */
-      for (m = BUF_MARKERS (b); m; )
-	{
-	  struct Lisp_Marker *next = m->next;
-	  m->buffer = 0;
-	  m->next = NULL;
-	  m = next;
-	}
-      BUF_MARKERS (b) = NULL;
+      free_marker_index (b);
       set_buffer_intervals (b, NULL);
+      free_text_property_index (b);
 
       /* Perhaps we should explicitly free the interval tree here...  */
     }
@@ -1945,8 +2026,11 @@ cleaning up all windows currently displaying the buffer to be killed. */)
       free_region_cache (b->bidi_paragraph_cache);
       b->bidi_paragraph_cache = 0;
     }
+  free_syntax_ppss_cache (b);
+  free_column_cache (b);
   bset_width_table (b, Qnil);
   unblock_input ();
+  free_undo_logs (b);
   bset_undo_list (b, Qnil);
 
   /* Run buffer-list-update-hook.  */
@@ -1985,6 +2069,7 @@ record_buffer (Lisp_Object buffer)
   Vbuffer_alist = Fdelq (aelt, Vbuffer_alist);
   XSETCDR (aelt_cons, Vbuffer_alist);
   Vbuffer_alist = aelt_cons;
+  buffer_alist_tail = Qnil;
   Vinhibit_quit = tem;
 
   /* Update buffer list of selected frame.  */
@@ -2023,6 +2108,7 @@ DEFUN ("bury-buffer-internal", Fbury_buffer_internal, Sbury_buffer_internal,
   Vbuffer_alist = Fdelq (aelt, Vbuffer_alist);
   XSETCDR (aelt_cons, Qnil);
   Vbuffer_alist = nconc2 (Vbuffer_alist, aelt_cons);
+  buffer_alist_tail = aelt_cons;
   Vinhibit_quit = tem;
 
   /* Update buffer lists of selected frame.  */
@@ -2136,7 +2222,10 @@ void set_buffer_internal_2 (register struct buffer *b)
   /* Get the undo list from the base buffer, so that it appears
      that an indirect buffer shares the undo list of its base.  */
   if (b->base_buffer)
-    bset_undo_list (b, BVAR (b->base_buffer, undo_list));
+    {
+      flush_undo_log (b->base_buffer);
+      bset_undo_list (b, BVAR (b->base_buffer, undo_list));
+    }
 
   /* If the new current buffer has markers to record PT, BEGV and ZV
      when it is not current, fetch them now.  */
@@ -2377,6 +2466,9 @@ results, see Info node `(elisp)Swapping Text'.  */)
   swapfield (newline_cache, struct region_cache *);
   swapfield (width_run_cache, struct region_cache *);
   swapfield (bidi_paragraph_cache, struct region_cache *);
+  swapfield (syntax_ppss_cache, struct syntax_ppss_cache *);
+  swapfield (column_cache, struct column_cache *);
+  swapfield (undo_log, struct undo_log *);
   current_buffer->prevent_redisplay_optimizations_p = 1;
   other_buffer->prevent_redisplay_optimizations_p = 1;
   swapfield (overlays_before, struct Lisp_Overlay *);
@@ -2409,20 +2501,18 @@ results, see Info node `(elisp)Swapping Text'.  */)
   other_buffer->text->end_unchanged = other_buffer->text->gpt;
   {
     struct Lisp_Marker *m;
-    for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-      if (m->buffer == other_buffer)
+    FOR_EACH_MARKER (current_buffer, m)
+      {
+	/* Since there's no indirect buffer in sight, markers in the
+	   marker index of buf should be for `buf'.  */
+	eassert (m->buffer == other_buffer);
 	m->buffer = current_buffer;
-      else
-	/* Since there's no indirect buffer in sight, markers on
-	   BUF_MARKERS(buf) should either be for `buf' or dead.  */
-	eassert (!m->buffer);
-    for (m = BUF_MARKERS (other_buffer); m; m = m->next)
-      if (m->buffer == current_buffer)
+      }
+    FOR_EACH_MARKER (other_buffer, m)
+      {
+	eassert (m->buffer == current_buffer);
 	m->buffer = other_buffer;
-      else
-	/* Since there's no indirect buffer in sight, markers on
-	   BUF_MARKERS(buf) should either be for `buf' or dead.  */
-	eassert (!m->buffer);
+      }
   }
   { /* Some of the C code expects that both window markers of a
        live window points to that window's buffer.  So since we
@@ -2484,11 +2574,12 @@ If the multibyte flag was really changed, undo information of the
 current buffer is cleared.  */)
   (Lisp_Object flag)
 {
-  struct Lisp_Marker *tail, *markers;
+  struct Lisp_Marker *tail;
   struct buffer *other;
   ptrdiff_t begv, zv;
   bool narrowed = (BEG != BEGV || Z != ZV);
   bool modified_p = !NILP (Fbuffer_modified_p (Qnil));
+  flush_undo_log (current_buffer);
   Lisp_Object old_undo = BVAR (current_buffer, undo_list);
 
   if (current_buffer->base_buffer)
@@ -2533,8 +2624,10 @@ current buffer is cleared.  */)
       TEMP_SET_PT_BOTH (PT_BYTE, PT_BYTE);
 
 
-      for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
-	tail->charpos = tail->bytepos;
+      /* This also works for the markers whose positions count from
+	 the end of the text, since Z is now Z_BYTE.  */
+      FOR_EACH_MARKER (current_buffer, tail)
+	tail->charpos_ = tail->bytepos_;
 
       /* Convert multibyte form of 8-bit characters to unibyte.  */
       pos = BEG;
@@ -2664,6 +2757,11 @@ current buffer is cleared.  */)
 	 set_intervals_multibyte needs it too.  */
       bset_enable_multibyte_characters (current_buffer, Qt);
 
+      /* Make the positions of all markers absolute before Z changes,
+	 so they can be converted below.  */
+      ptrdiff_t nmarkers = buf_markers_count (current_buffer);
+      move_marker_gap (current_buffer, nmarkers);
+
       GPT_BYTE = advance_to_char_boundary (GPT_BYTE);
       GPT = chars_in_text (BEG_ADDR, GPT_BYTE - BEG_BYTE) + BEG;
 
@@ -2692,25 +2790,27 @@ current buffer is cleared.  */)
 	TEMP_SET_PT_BOTH (position, byte);
       }
 
-      tail = markers = BUF_MARKERS (current_buffer);
-
       /* This prevents BYTE_TO_CHAR (that is, buf_bytepos_to_charpos) from
 	 getting confused by the markers that have not yet been updated.
 	 It is also a signal that it should never create a marker.  */
-      BUF_MARKERS (current_buffer) = NULL;
+      struct buffer_text *text = current_buffer->text;
+      text->markers_gpt = 0;
+      text->markers_gap_size = text->markers_size;
 
-      for (; tail; tail = tail->next)
+      for (ptrdiff_t i = 0; i < nmarkers; i++)
 	{
-	  tail->bytepos = advance_to_char_boundary (tail->bytepos);
-	  tail->charpos = BYTE_TO_CHAR (tail->bytepos);
+	  tail = text->markers[i];
+	  tail->bytepos_ = advance_to_char_boundary (tail->bytepos_);
+	  tail->charpos_ = BYTE_TO_CHAR (tail->bytepos_);
 	}
 
-      /* Make sure no markers were put on the chain
-	 while the chain value was incorrect.  */
-      if (BUF_MARKERS (current_buffer))
+      /* Make sure no markers were put in the index
+	 while its value was incorrect.  */
+      if (text->markers_gpt != 0)
 	emacs_abort ();
 
-      BUF_MARKERS (current_buffer) = markers;
+      text->markers_gpt = nmarkers;
+      text->markers_gap_size = text->markers_size - nmarkers;
 
       /* Do this last, so it can calculate the new correspondences
 	 between chars and bytes.  */
@@ -2787,6 +2887,10 @@ the normal hook `change-major-mode-hook'.  */)
 
   reset_buffer_local_variables (current_buffer, 0);
 
+  /* The states cached by syntax-ppss may depend on the variables.  */
+  free_syntax_ppss_cache (current_buffer->base_buffer
+			  ? current_buffer->base_buffer : current_buffer);
+
   /* Force mode-line redisplay.  Useful here because all major mode
      commands call this function.  */
   update_mode_lines = 12;
@@ -5041,7 +5145,10 @@ enlarge_buffer_text (struct buffer *b, ptrdiff_t delta)
     BUF_Z_BYTE (b) - BUF_BEG_BYTE (b) + BUF_GAP_SIZE (b) + 1;
   ptrdiff_t new_nbytes = old_nbytes + delta;
 
-  if (pdumper_object_p (old_beg))
+  /* Text in a dump file or in a mapped file is copied to new
+     storage.  */
+  ptrdiff_t mapped_bytes = b->text->mapped_bytes;
+  if (pdumper_object_p (old_beg) || mapped_bytes)
     b->text->beg = NULL;
   else
     old_beg = NULL;
@@ -5064,6 +5171,11 @@ enlarge_buffer_text (struct buffer *b, ptrdiff_t delta)
 
   if (old_beg)
     memcpy (p, old_beg, min (old_nbytes, new_nbytes));
+  if (mapped_bytes)
+    {
+      unmap_file_text (old_beg, mapped_bytes);
+      b->text->mapped_bytes = 0;
+    }
 
   BUF_BEG_ADDR (b) = p;
   unblock_input ();
@@ -5077,7 +5189,12 @@ free_buffer_text (struct buffer *b)
 {
   block_input ();
 
-  if (!pdumper_object_p (b->text->beg))
+  if (b->text->mapped_bytes)
+    {
+      unmap_file_text (b->text->beg, b->text->mapped_bytes);
+      b->text->mapped_bytes = 0;
+    }
+  else if (!pdumper_object_p (b->text->beg))
     {
 #if defined USE_MMAP_FOR_BUFFERS
       mmap_free ((void **) &b->text->beg);
@@ -5092,6 +5209,130 @@ free_buffer_text (struct buffer *b)
   unblock_input ();
 }
 
+/* Map the NBYTES bytes of the file open on FD privately into memory,
+   followed by a zero byte, and return their address.  Return NULL if
+   the file cannot be mapped, or the mapping cannot be guarded against
+   the file shrinking.  Changes to the mapped text are never written
+   to the file.  */
+
+unsigned char *
+map_file_text (int fd, ptrdiff_t nbytes)
+{
+#ifdef HAVE_MMAP
+  void *p;
+
+  /* Reserve anonymous memory for the text and the anchor, then map
+     the file over it, so that the anchor exists even if the file
+     ends exactly at a page boundary.  */
+  p = mmap (NULL, nbytes + 1, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    return NULL;
+  if (mmap (p, nbytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+	    fd, 0)
+      == MAP_FAILED
+      || !guard_file_mapping (p, nbytes))
+    {
+      munmap (p, nbytes + 1);
+      return NULL;
+    }
+  return p;
+#else
+  return NULL;
+#endif
+}
+
+/* Unmap TEXT, a mapping of a file of NBYTES bytes made by
+   map_file_text.  */
+
+void
+unmap_file_text (unsigned char *text, ptrdiff_t nbytes)
+{
+#ifdef HAVE_MMAP
+  unguard_file_mapping (text);
+  munmap (text, nbytes + 1);
+#else
+  emacs_abort ();
+#endif
+}
+
+/* Make TEXT, a mapping of a file of NBYTES bytes made by
+   map_file_text, the text of the empty buffer B.  The bytes are left
+   in the gap, for insert_from_gap to insert them.  */
+
+void
+set_buffer_text_mapped (struct buffer *b, unsigned char *text,
+			ptrdiff_t nbytes)
+{
+  eassert (BUF_Z (b) == BEG && b->base_buffer == NULL);
+  free_buffer_text (b);
+  block_input ();
+  BUF_BEG_ADDR (b) = text;
+  BUF_GAP_SIZE (b) = nbytes;
+  b->text->mapped_bytes = nbytes;
+  unblock_input ();
+}
+
+/* Delete the text of B, whose file was truncated while mapped, from
+   where the file can no longer be read, and copy the rest to ordinary
+   storage.  */
+
+static void
+truncate_mapped_text (struct buffer *b)
+{
+  ptrdiff_t readable = repair_file_mapping (b->text->beg,
+					    b->text->mapped_bytes);
+  struct buffer *old = current_buffer;
+  set_buffer_internal (b);
+
+  ptrdiff_t end_byte = (readable <= GPT_BYTE - BEG_BYTE
+			? BEG_BYTE + readable
+			: max (GPT_BYTE, BEG_BYTE + readable - GAP_SIZE));
+  enlarge_buffer_text (b, 0);
+  if (!NILP (BVAR (b, enable_multibyte_characters)))
+    while (end_byte < Z_BYTE && !CHAR_HEAD_P (FETCH_BYTE (end_byte)))
+      end_byte--;
+
+  if (end_byte < Z_BYTE)
+    {
+      /* The rest of the text is null bytes now, so count the
+	 characters before it.  */
+      ptrdiff_t end = BEG + chars_in_text (BEG_ADDR,
+					   min (end_byte, GPT_BYTE) - BEG_BYTE);
+      if (GPT_BYTE < end_byte)
+	end += chars_in_text (GAP_END_ADDR, end_byte - GPT_BYTE);
+
+      ptrdiff_t count = SPECPDL_INDEX ();
+      specbind (Qinhibit_quit, Qt);
+      Lisp_Object undo_list = BVAR (b, undo_list);
+      bset_undo_list (b, Qt);
+      bset_redisplay (b);
+      invalidate_buffer_caches (b, end, Z);
+      del_range_2 (end, end_byte, Z, Z_BYTE, false);
+      bset_undo_list (b, undo_list);
+      unbind_to (count, Qnil);
+    }
+
+  set_buffer_internal (old);
+}
+
+/* Give up the text that is gone in the buffers whose files were
+   truncated while mapped.  This is called by the command loop after
+   handle_sigbus returned to it.  */
+
+void
+recover_file_mappings (void)
+{
+  Lisp_Object tail, buffer;
+
+  FOR_EACH_LIVE_BUFFER (tail, buffer)
+    {
+      struct buffer *b = XBUFFER (buffer);
+      if (b->text->mapped_bytes && file_mapping_truncated (b->text->beg))
+	truncate_mapped_text (b);
+    }
+}
+
 
 
 /***********************************************************************
@@ -5307,7 +5548,7 @@ init_buffer_once (void)
   /* Nothing can work if this isn't true.  */
   { verify (sizeof (EMACS_INT) == word_size); }
 
-  Vbuffer_alist = Qnil;
+  reset_buffer_alist ();
   current_buffer = 0;
   pdumper_remember_lv_ptr_raw (&current_buffer, Lisp_Vectorlike);
   all_buffers = 0;
@@ -5327,7 +5568,7 @@ init_buffer_once (void)
 
   /* Super-magic invisible buffer.  */
   Vprin1_to_string_buffer = Fget_buffer_create (build_pure_c_string (" prin1"));
-  Vbuffer_alist = Qnil;
+  reset_buffer_alist ();
 
   Fset_buffer (Fget_buffer_create (build_pure_c_string ("*scratch*")));
 
@@ -5480,6 +5721,8 @@ syms_of_buffer (void)
 
   staticpro (&QSFundamental);
   staticpro (&Vbuffer_alist);
+  staticpro (&buffer_name_index);
+  staticpro (&buffer_alist_tail);
 
   DEFSYM (Qchoice, "choice");
   DEFSYM (Qleft, "left");
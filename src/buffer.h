@@ -130,9 +130,6 @@ enum { BEG = 1, BEG_BYTE = BEG };
 /* Compaction count.  */
 #define BUF_COMPACT(buf) ((buf)->text->compact)
 
-/* Marker chain of buffer.  */
-#define BUF_MARKERS(buf) ((buf)->text->markers)
-
 #define BUF_UNCHANGED_MODIFIED(buf) \
   ((buf)->text->unchanged_modified)
 
@@ -157,6 +154,11 @@ extern void temp_set_point_both (struct buffer *,
 				 ptrdiff_t, ptrdiff_t);
 extern void set_point_from_marker (Lisp_Object);
 extern void enlarge_buffer_text (struct buffer *, ptrdiff_t);
+extern unsigned char *map_file_text (int, ptrdiff_t);
+extern void unmap_file_text (unsigned char *, ptrdiff_t);
+extern void set_buffer_text_mapped (struct buffer *, unsigned char *,
+				    ptrdiff_t);
+extern void recover_file_mappings (void);
 
 INLINE void
 SET_PT (ptrdiff_t position)
@@ -262,14 +264,35 @@ struct buffer_text
     /* Properties of this buffer's text.  */
     INTERVAL intervals;
 
-    /* The markers that refer to this buffer.
-       This is actually a single marker ---
-       successive elements in its marker `chain'
-       are the other markers referring to this buffer.
-       This is a singly linked unordered list, which means that it's
-       very cheap to add a marker to the list and it's also very cheap
-       to move a marker within a buffer.  */
-    struct Lisp_Marker *markers;
+    /* The marker index: the markers that refer to this buffer,
+       ordered by position.  This is a gap array: the first
+       MARKERS_GPT slots hold markers whose positions count from the
+       beginning of the text, then come MARKERS_GAP_SIZE unused slots,
+       and the remaining slots hold markers whose positions count
+       backwards from the end of the text (their `relative' flag is
+       set).  Before an insertion or deletion, the marker gap is moved
+       to the place of the change; the markers after it then follow
+       the change of Z without being touched, so that only the markers
+       at the place of the change or inside the deleted text need to
+       be adjusted.  */
+    struct Lisp_Marker **markers;
+
+    /* Number of slots allocated for MARKERS.  */
+    ptrdiff_t markers_size;
+
+    /* Index in MARKERS of the marker gap, and its size.  */
+    ptrdiff_t markers_gpt;
+    ptrdiff_t markers_gap_size;
+
+    /* If nonzero, BEG is a private mapping of a file of this many
+       bytes made by map_file_text, which must be unmapped rather than
+       freed.  The text is copied to ordinary storage before it is
+       first changed.  */
+    ptrdiff_t mapped_bytes;
+
+    /* Where the values of frequently searched text properties change,
+       or NULL.  This is maintained by textprop.c.  */
+    struct text_property_index *property_index;
 
     /* Usually false.  Temporarily true in decode_coding_gap to
        prevent Fgarbage_collect from shrinking the gap and losing
@@ -662,6 +685,22 @@ struct buffer
   struct region_cache *width_run_cache;
   struct region_cache *bidi_paragraph_cache;
 
+  /* The states cached by syntax-ppss, see syntax.c.  Only base
+     buffers have them.  */
+  struct syntax_ppss_cache *syntax_ppss_cache;
+
+  /* The columns cached within long lines, see indent.c.  Only base
+     buffers have them.  */
+  struct column_cache *column_cache;
+
+  /* Changes recorded for undo in compact form, which logically precede
+     the elements of undo_list, or NULL.  See undo.c.  */
+  struct undo_log *undo_log;
+
+  /* The undo log set aside while undo_list is let-bound to t, or
+     NULL.  */
+  struct undo_log *suspended_undo_log;
+
   /* Non-zero means disable redisplay optimizations when rebuilding the glyph
      matrices (but not when redrawing).  */
   bool_bf prevent_redisplay_optimizations_p : 1;
@@ -1001,6 +1040,54 @@ SET_BUF_PT_BOTH (struct buffer *buf, ptrdiff_t charpos, ptrdiff_t byte)
   buf->pt_byte = byte;
 }
 
+/* Functions to access the markers of a buffer.  */
+
+/* Return the character position of marker M, which must point
+   somewhere.  */
+
+INLINE ptrdiff_t
+marker_charpos (struct Lisp_Marker const *m)
+{
+  return m->relative ? BUF_Z (m->buffer) - m->charpos_ : m->charpos_;
+}
+
+/* Return the byte position of marker M, which must point
+   somewhere.  */
+
+INLINE ptrdiff_t
+marker_bytepos (struct Lisp_Marker const *m)
+{
+  return m->relative ? BUF_Z_BYTE (m->buffer) - m->bytepos_ : m->bytepos_;
+}
+
+/* Return the number of markers in the marker index of BUF.  */
+
+INLINE ptrdiff_t
+buf_markers_count (struct buffer *buf)
+{
+  return buf->text->markers_size - buf->text->markers_gap_size;
+}
+
+/* Return the Ith marker, in order of position, of BUF.  */
+
+INLINE struct Lisp_Marker *
+buf_marker (struct buffer *buf, ptrdiff_t i)
+{
+  struct buffer_text *t = buf->text;
+  eassert (0 <= i && i < buf_markers_count (buf));
+  return t->markers[i < t->markers_gpt ? i : i + t->markers_gap_size];
+}
+
+/* Iterate over the markers of BUF in order of position, setting
+   MARKER to each of them.  The loop body must not add markers to BUF
+   or remove them from it.  */
+
+#define FOR_EACH_MARKER(buf, marker)					\
+  for (ptrdiff_t marker##_i_ = 0;					\
+       (marker##_i_ < buf_markers_count (buf)				\
+	&& ((marker) = buf_marker (buf, marker##_i_), true));		\
+       marker##_i_++)
+
 /* Functions to access a character or byte in the current buffer,
    or convert between a byte position and an address.
    These functions do not check that the position is in range.  */
@@ -1492,12 +1579,19 @@ set_per_buffer_default (int offset, Lisp_Object value)
 INLINE Lisp_Object
 per_buffer_value (struct buffer *b, int offset)
 {
+  /* The undo list is looked at as a whole, so its compact log must
+     be made part of it; and a new value replaces the log too.  */
+  if (offset == PER_BUFFER_VAR_OFFSET (undo_list) && b->undo_log)
+    flush_undo_log (b);
   return *(Lisp_Object *)(offset + (char *) b);
 }
 
 INLINE void
 set_per_buffer_value (struct buffer *b, int offset, Lisp_Object value)
 {
+  if (offset == PER_BUFFER_VAR_OFFSET (undo_list) && b->undo_log
+      && !EQ (BVAR (b, undo_list), Qt))
+    free_undo_log (b);
   *(Lisp_Object *)(offset + (char *) b) = value;
 }
 
@@ -54,6 +54,12 @@ struct casing_context
 
   /* Whether the context is within a word.  */
   bool inword;
+
+  /* 1 if flag is CASE_UP or CASE_DOWN and the case tables map the
+     ASCII letters to each other and leave the other ASCII characters
+     alone, so that ASCII text can be cased by case_ascii_run; 0 if
+     not; -1 if not known yet.  */
+  signed char ascii_casing;
 };
 
 /* Initialize CTX structure for casing characters.  */
@@ -64,6 +70,7 @@ prepare_casing_context (struct casing_context *ctx,
   ctx->flag = flag;
   ctx->inbuffer = inbuffer;
   ctx->inword = false;
+  ctx->ascii_casing = -1;
   ctx->titlecase_char_table
     = (flag < CASE_CAPITALIZE ? Qnil
        : uniprop_table (Qtitlecase));
@@ -220,6 +227,130 @@ case_character (struct casing_str_buf *buf, struct casing_context *ctx,
   return changed;
 }
 
+/* Texts shorter than this are not worth checking for ASCII casing.  */
+enum { ASCII_CASING_MIN = 64 };
+
+/* Return whether CTX allows case_ascii_run on ASCII text.  */
+static bool
+ascii_casing_p (struct casing_context *ctx)
+{
+  if (ctx->ascii_casing < 0)
+    {
+      ctx->ascii_casing = ctx->flag == CASE_UP || ctx->flag == CASE_DOWN;
+      Lisp_Object special = ctx->specialcase_char_tables[ctx->flag];
+      for (int c = 0; ctx->ascii_casing && c < 0x80; c++)
+	{
+	  int cased = ctx->flag == CASE_UP ? upcase (c) : downcase (c);
+	  int expected = (ctx->flag == CASE_UP
+			  ? ('a' <= c && c <= 'z' ? c - 'a' + 'A' : c)
+			  : ('A' <= c && c <= 'Z' ? c - 'A' + 'a' : c));
+	  if (cased != expected
+	      || (!NILP (special) && STRINGP (CHAR_TABLE_REF (special, c))))
+	    ctx->ascii_casing = 0;
+	}
+    }
+  return ctx->ascii_casing;
+}
+
+/* Set *FIRST to the offset of the first nonzero byte in the word
+   MASK, and *LAST to one past the offset of the last one, as they are
+   in memory.  */
+static void
+mask_byte_range (uint64_t mask, ptrdiff_t *first, ptrdiff_t *last)
+{
+  unsigned char bytes[sizeof mask];
+  memcpy (bytes, &mask, sizeof mask);
+  int i = 0, j = sizeof mask;
+  while (!bytes[i])
+    i++;
+  while (!bytes[j - 1])
+    j--;
+  *first = i;
+  *last = j;
+}
+
+/* Set the inword state of CTX as case_character would leave it after
+   the N > 0 ASCII characters at P.  */
+static void
+ascii_run_inword (struct casing_context *ctx, const unsigned char *p,
+		  ptrdiff_t n)
+{
+  /* The state after a character depends on the one before only if
+     it is a word constituent with the prefix flag.  */
+  ptrdiff_t i = n - 1;
+  while (0 < i && ctx->inbuffer && SYNTAX (p[i]) == Sword
+	 && syntax_prefix_flag_p (p[i]))
+    i--;
+  for (; i < n; i++)
+    ctx->inword = SYNTAX (p[i]) == Sword &&
+      (!ctx->inbuffer || ctx->inword || !syntax_prefix_flag_p (p[i]));
+}
+
+/* Based on CTX, case the ASCII characters at the start of the N bytes
+   at P, in place, to upper case if its flag is CASE_UP and to lower
+   case otherwise, and return how many they are.  Set *FIRST and *LAST
+   to the offsets of the first character changed and one past the last
+   one, or *FIRST to -1 if none changed.  Update the inword state of
+   CTX, which the final sigma rule of case_character depends on.
+
+   The bytes are taken eight at a time: in a word of ASCII characters,
+   a byte has its high bit set after adding 0x80 - 'a' to it if and
+   only if it is at least 'a', and so on, without carries from one
+   byte to the next.  */
+static ptrdiff_t
+case_ascii_run (struct casing_context *ctx, unsigned char *p, ptrdiff_t n,
+		ptrdiff_t *first, ptrdiff_t *last)
+{
+  enum case_action flag = ctx->flag;
+  const uint64_t ones = 0x0101010101010101, highs = 0x80 * ones;
+  int lo = flag == CASE_UP ? 'a' : 'A', hi = lo + 25;
+  ptrdiff_t i = 0, last_word = -1;
+  uint64_t last_mask = 0;
+
+  *first = -1;
+  for (; i + 8 <= n; i += 8)
+    {
+      uint64_t w;
+      memcpy (&w, p + i, sizeof w);
+      if (w & highs)
+	break;
+      uint64_t mask = (w + (0x80 - lo) * ones) & ~(w + (0x7f - hi) * ones);
+      mask &= highs;
+      if (mask)
+	{
+	  w ^= mask >> 2;
+	  memcpy (p + i, &w, sizeof w);
+	  if (*first < 0)
+	    {
+	      ptrdiff_t f, l;
+	      mask_byte_range (mask, &f, &l);
+	      *first = i + f;
+	    }
+	  last_word = i;
+	  last_mask = mask;
+	}
+    }
+  if (last_word >= 0)
+    {
+      ptrdiff_t f, l;
+      mask_byte_range (last_mask, &f, &l);
+      *last = last_word + l;
+    }
+
+  for (; i < n && p[i] < 0x80; i++)
+    if (lo <= p[i] && p[i] <= hi)
+      {
+	p[i] ^= 0x20;
+	if (*first < 0)
+	  *first = i;
+	*last = i + 1;
+      }
+
+  if (i > 0)
+    ascii_run_inword (ctx, p, i);
+  return i;
+}
+
 static Lisp_Object
 do_casify_natnum (struct casing_context *ctx, Lisp_Object obj)
 {
@@ -273,11 +404,25 @@ do_casify_multibyte_string (struct casing_context *ctx, Lisp_Object obj)
   unsigned char *o = dst;
 
   const unsigned char *src = SDATA (obj);
+  bool ascii = size >= ASCII_CASING_MIN && ascii_casing_p (ctx);
 
   for (n = 0; size; --size)
     {
       if (dst_end - o < sizeof (struct casing_str_buf))
 	string_overflow ();
+      if (ascii && *src < 0x80)
+	{
+	  /* Copy as many bytes as there are characters left, and case
+	     the ASCII characters at their start all at once.  */
+	  ptrdiff_t first, last, len = min (size, dst_end - o);
+	  memcpy (o, src, len);
+	  len = case_ascii_run (ctx, o, len, &first, &last);
+	  src += len;
+	  o += len;
+	  n += len;
+	  size -= len - 1;
+	  continue;
+	}
       int ch = STRING_CHAR_ADVANCE (src);
       case_character ((struct casing_str_buf *) o, ctx, ch,
 		      size > 1 ? src : NULL);
@@ -297,8 +442,16 @@ do_casify_unibyte_string (struct casing_context *ctx, Lisp_Object obj)
   int ch, cased;
 
   obj = Fcopy_sequence (obj);
+  bool ascii = size >= ASCII_CASING_MIN && ascii_casing_p (ctx);
   for (i = 0; i < size; i++)
     {
+      if (ascii && SREF (obj, i) < 0x80)
+	{
+	  ptrdiff_t first, last;
+	  i += case_ascii_run (ctx, SDATA (obj) + i, size - i,
+			       &first, &last) - 1;
+	  continue;
+	}
       ch = SREF (obj, i);
       MAKE_CHAR_MULTIBYTE (ch);
       cased = case_single_character (ctx, ch);
@@ -380,6 +533,29 @@ cased, e.g. ﬁ, are returned unchanged.  */)
   return casify_object (CASE_CAPITALIZE_UP, obj);
 }
 
+/* Case the ASCII characters from position POS (byte position POS_BYTE)
+   in the current buffer on, up to byte position END_BYTE at most, as
+   case_ascii_run does, and return how many they are.  If some were
+   changed, set *FIRST to the position of the first one, unless *FIRST
+   is already nonnegative, and *LAST to one past the last one.  */
+static ptrdiff_t
+case_ascii_region (struct casing_context *ctx, ptrdiff_t pos,
+		   ptrdiff_t pos_byte, ptrdiff_t end_byte,
+		   ptrdiff_t *first, ptrdiff_t *last)
+{
+  ptrdiff_t limit = pos_byte < GPT_BYTE ? min (GPT_BYTE, end_byte) : end_byte;
+  ptrdiff_t f, l;
+  ptrdiff_t len = case_ascii_run (ctx, BYTE_POS_ADDR (pos_byte),
+				  limit - pos_byte, &f, &l);
+  if (f >= 0)
+    {
+      if (*first < 0)
+	*first = pos + f;
+      *last = pos + l;
+    }
+  return len;
+}
+
 /* Based on CTX, case region in a unibyte buffer from *STARTP to *ENDP.
 
    Save first and last positions that has changed in *STARTP and *ENDP
@@ -394,9 +570,15 @@ do_casify_unibyte_region (struct casing_context *ctx,
 {
   ptrdiff_t first = -1, last = -1;  /* Position of first and last changes.  */
   ptrdiff_t end = *endp;
+  bool ascii = end - *startp >= ASCII_CASING_MIN && ascii_casing_p (ctx);
 
   for (ptrdiff_t pos = *startp; pos < end; ++pos)
     {
+      if (ascii && FETCH_BYTE (pos) < 0x80)
+	{
+	  pos += case_ascii_region (ctx, pos, pos, end, &first, &last) - 1;
+	  continue;
+	}
       int ch = FETCH_BYTE (pos);
       MAKE_CHAR_MULTIBYTE (ch);
 
@@ -430,9 +612,20 @@ do_casify_multibyte_region (struct casing_context *ctx,
   ptrdiff_t first = -1, last = -1;  /* Position of first and last changes.  */
   ptrdiff_t pos = *startp, pos_byte = CHAR_TO_BYTE (pos), size = *endp - pos;
   ptrdiff_t opoint = PT, added = 0;
+  bool ascii = size >= ASCII_CASING_MIN && ascii_casing_p (ctx);
 
   for (; size; --size)
     {
+      if (ascii && FETCH_BYTE (pos_byte) < 0x80)
+	{
+	  /* There are no more ASCII characters than SIZE.  */
+	  ptrdiff_t len = case_ascii_region (ctx, pos, pos_byte,
+					     pos_byte + size, &first, &last);
+	  pos += len;
+	  pos_byte += len;
+	  size -= len - 1;
+	  continue;
+	}
       int len;
       int ch = STRING_CHAR_AND_LENGTH (BYTE_POS_ADDR (pos_byte), len);
       struct casing_str_buf buf;
@@ -494,7 +687,8 @@ casify_region (enum case_action flag, Lisp_Object b, Lisp_Object e)
   prepare_casing_context (&ctx, flag, true);
 
   ptrdiff_t orig_end = end;
-  record_delete (start, make_buffer_string (start, end, true), false);
+  if (!EQ (BVAR (current_buffer, undo_list), Qt))
+    record_delete (start, make_buffer_string (start, end, true), false);
   if (NILP (BVAR (current_buffer, enable_multibyte_characters)))
     {
       record_insert (start, end - start);
@@ -30,6 +30,7 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include <stdio.h>
 
 #include <sys/types.h>
+#include <count-one-bits.h>
 #include <intprops.h>
 #include "lisp.h"
 #include "character.h"
@@ -323,6 +324,32 @@ usage: (char-width CHAR)  */)
   return make_fixnum (width);
 }
 
+/* Return the number of printable ASCII characters at the start of
+   the N bytes at P.  Without a display table, each of them occupies
+   one column.
+
+   The bytes are taken eight at a time: a word holds only printable
+   ASCII characters if no byte in it has its high bit set, nor gets
+   it by subtracting ' ' from it or by adding 1 to it.  */
+
+static ptrdiff_t
+printable_ascii_prefix (const unsigned char *p, ptrdiff_t n)
+{
+  const uint64_t ones = 0x0101010101010101, highs = 0x80 * ones;
+  ptrdiff_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    {
+      uint64_t w;
+      memcpy (&w, p + i, sizeof w);
+      if ((w | (w - ' ' * ones) | (w + ones)) & highs)
+	break;
+    }
+  while (i < n && ' ' <= p[i] && p[i] < 0x7f)
+    i++;
+  return i;
+}
+
 /* Return width of string STR of length LEN when displayed in the
    current buffer.  The width is measured by how many columns it
    occupies on the screen.  If PRECISION > 0, return the width of
@@ -340,6 +367,20 @@ c_string_width (const unsigned char *str, ptrdiff_t len, int precision,
 
   while (i_byte < len)
     {
+      if (!dp)
+	{
+	  ptrdiff_t run = printable_ascii_prefix (str + i_byte, len - i_byte);
+	  if (0 < precision)
+	    run = min (run, precision - width);
+	  if (run > 0)
+	    {
+	      width += run;
+	      i += run;
+	      i_byte += run;
+	      continue;
+	    }
+	}
+
       int bytes;
       int c = STRING_CHAR_AND_LENGTH (str + i_byte, bytes);
       ptrdiff_t thiswidth = char_width (c, dp);
@@ -395,6 +436,9 @@ lisp_string_width (Lisp_Object string, ptrdiff_t precision,
   ptrdiff_t i = 0, i_byte = 0;
   ptrdiff_t width = 0;
   struct Lisp_Char_Table *dp = buffer_display_table ();
+  /* Compositions are text properties, so a string without any has
+     none.  */
+  bool props = string_intervals (string) != NULL;
 
   while (i < len)
     {
@@ -403,7 +447,23 @@ lisp_string_width (Lisp_Object string, ptrdiff_t precision,
       ptrdiff_t cmp_id;
       ptrdiff_t ignore, end;
 
-      if (find_composition (i, -1, &ignore, &end, &val, string)
+      if (!dp && !props)
+	{
+	  ptrdiff_t run = printable_ascii_prefix (str + i_byte,
+						  SBYTES (string) - i_byte);
+	  if (0 < precision)
+	    run = min (run, precision - width);
+	  if (run > 0)
+	    {
+	      width += run;
+	      i += run;
+	      i_byte += run;
+	      continue;
+	    }
+	}
+
+      if (props
+	  && find_composition (i, -1, &ignore, &end, &val, string)
 	  && ((cmp_id = get_composition_id (i, i_byte, end - i, val, string))
 	      >= 0))
 	{
@@ -485,25 +545,30 @@ chars_in_text (const unsigned char *ptr, ptrdiff_t nbytes)
 /* Return the number of characters in the NBYTES bytes at PTR.
    This works by looking at the contents and checking for multibyte
    sequences while assuming that there's no invalid sequence.  It
-   ignores enable-multibyte-characters.  */
+   ignores enable-multibyte-characters.
+
+   Each character has exactly one byte that is not of the form
+   10xxxxxx, so count the bytes that are, eight at a time: those are
+   the bytes whose high bit is set and whose next bit, shifted into
+   the high bit, is not.  */
 
 ptrdiff_t
 multibyte_chars_in_text (const unsigned char *ptr, ptrdiff_t nbytes)
 {
-  const unsigned char *endp = ptr + nbytes;
-  ptrdiff_t chars = 0;
+  const uint64_t highs = 0x8080808080808080;
+  ptrdiff_t i = 0, continuations = 0;
 
-  while (ptr < endp)
+  for (; i + 8 <= nbytes; i += 8)
     {
-      int len = MULTIBYTE_LENGTH (ptr, endp);
-
-      if (len == 0)
-	emacs_abort ();
-      ptr += len;
-      chars++;
+      uint64_t w;
+      memcpy (&w, ptr + i, sizeof w);
+      if (w & highs)
+	continuations += count_one_bits_ll (w & ~(w << 1) & highs);
     }
+  for (; i < nbytes; i++)
+    continuations += (ptr[i] & 0xc0) == 0x80;
 
-  return chars;
+  return nbytes - continuations;
 }
 
 /* Parse unibyte text at STR of LEN bytes as a multibyte text, count
@@ -1237,6 +1237,125 @@ detect_coding_utf_8 (struct coding_system *coding,
 }
 
 
+/* Minimum number of bytes that can be copied directly which makes
+   decode_coding_utf_8 or consume_chars stop, so that the characters
+   already in charbuf are produced first.  */
+#define UTF_8_DIRECT_MIN 256
+
+/* Return the end of the longest prefix of the bytes in [SRC, SRC_END)
+   that is valid UTF-8 of Unicode range, and add the number of
+   characters in it to *NCHARS.  A sequence truncated by SRC_END is
+   not included.  Such text has the same byte sequence in a multibyte
+   buffer or string.  */
+
+const unsigned char *
+utf_8_valid_prefix (const unsigned char *src, const unsigned char *src_end,
+		    ptrdiff_t *nchars)
+{
+  const uintptr_t high_bits = UINTPTR_MAX / 0xFF * 0x80;
+  ptrdiff_t n = 0;
+
+  while (src < src_end)
+    {
+      int c = *src;
+
+      if (UTF_8_1_OCTET_P (c))
+	{
+	  const unsigned char *p = src + 1;
+
+	  /* Skip ASCII characters a word at a time.  */
+	  while (src_end - p >= sizeof (uintptr_t))
+	    {
+	      uintptr_t word;
+
+	      memcpy (&word, p, sizeof word);
+	      if (word & high_bits)
+		break;
+	      p += sizeof word;
+	    }
+	  while (p < src_end && UTF_8_1_OCTET_P (*p))
+	    p++;
+	  n += p - src;
+	  src = p;
+	  continue;
+	}
+      if (UTF_8_2_OCTET_LEADING_P (c))
+	{
+	  if (c < 0xC2		/* overlong sequence */
+	      || src_end - src < 2
+	      || ! UTF_8_EXTRA_OCTET_P (src[1]))
+	    break;
+	  src += 2;
+	}
+      else if (UTF_8_3_OCTET_LEADING_P (c))
+	{
+	  if (src_end - src < 3
+	      || ! (UTF_8_EXTRA_OCTET_P (src[1])
+		    && UTF_8_EXTRA_OCTET_P (src[2])))
+	    break;
+	  c = (((c & 0xF) << 12)
+	       | ((src[1] & 0x3F) << 6) | (src[2] & 0x3F));
+	  if (c < 0x800			      /* overlong sequence */
+	      || (c >= 0xd800 && c < 0xe000)) /* surrogates (invalid) */
+	    break;
+	  src += 3;
+	}
+      else if (UTF_8_4_OCTET_LEADING_P (c))
+	{
+	  if (src_end - src < 4
+	      || ! (UTF_8_EXTRA_OCTET_P (src[1])
+		    && UTF_8_EXTRA_OCTET_P (src[2])
+		    && UTF_8_EXTRA_OCTET_P (src[3])))
+	    break;
+	  c = (((c & 0x7) << 18) | ((src[1] & 0x3F) << 12)
+	       | ((src[2] & 0x3F) << 6) | (src[3] & 0x3F));
+	  if (c < 0x10000	/* overlong sequence */
+	      || c >= 0x110000)	/* non-Unicode character  */
+	    break;
+	  src += 4;
+	}
+      else
+	break;
+      n++;
+    }
+  *nchars += n;
+  return src;
+}
+
+/* Copy NBYTES bytes of valid UTF-8 text containing NCHARS characters
+   from SRC in the source of CODING to the end of its multibyte
+   destination.  Return the address just after the copied bytes, which
+   may differ from SRC + NBYTES if the source has been relocated.  */
+
+static const unsigned char *
+produce_chars_from_source (struct coding_system *coding,
+			   const unsigned char *src,
+			   ptrdiff_t nbytes, ptrdiff_t nchars)
+{
+  ptrdiff_t offset = src - coding->source;
+  unsigned char *dst;
+
+  /* When decoding in place, the room before the unconsumed part of
+     the source depends on coding->consumed.  Keep a byte of it free,
+     as insert_from_gap puts an anchor just after the inserted text.  */
+  coding->consumed = offset;
+  coding_set_destination (coding);
+  dst = coding->destination + coding->produced;
+  if (coding->dst_bytes - coding->produced <= nbytes)
+    {
+      eassert (growable_destination (coding));
+      dst = alloc_destination (coding, nbytes, dst);
+      coding_set_source (coding);
+      src = coding->source + offset;
+    }
+  memmove (dst, src, nbytes);
+  if (BUFFERP (coding->dst_object))
+    insert_from_gap (nchars, nbytes, 0);
+  coding->produced += nbytes;
+  coding->produced_char += nchars;
+  return src + nbytes;
+}
+
 static void
 decode_coding_utf_8 (struct coding_system *coding)
 {
@@ -1251,6 +1370,11 @@ decode_coding_utf_8 (struct coding_system *coding)
   bool eol_dos
     = !inhibit_eol_conversion && EQ (CODING_ID_EOL_TYPE (coding->id), Qdos);
   int byte_after_cr = -1;
+  /* Where to look for a run of valid text to copy directly, and
+     where such runs must end.  With DOS EOLs, keep the last byte for
+     the loop below, as it may be the CR of a CR LF pair.  */
+  const unsigned char *direct_from = src;
+  const unsigned char *direct_end = src_end - eol_dos;
 
   if (bom != utf_without_bom)
     {
@@ -1297,6 +1421,45 @@ decode_coding_utf_8 (struct coding_system *coding)
 	  break;
 	}
 
+      /* If the text at SRC is valid, its bytes are the result of
+	 decoding.  When nothing waits in charbuf, copy them to the
+	 destination; otherwise, stop here so that the caller
+	 produces the characters in charbuf first.  */
+      if (coding->direct_decoding && byte_after_cr < 0
+	  && direct_from <= src && src < direct_end)
+	{
+	  ptrdiff_t nchars = 0;
+	  const unsigned char *run_end;
+
+	  if (charbuf == coding->charbuf)
+	    {
+	      run_end = utf_8_valid_prefix (src, direct_end, &nchars);
+	      if (run_end > src)
+		{
+		  ptrdiff_t offset = direct_end - src_end;
+
+		  src = produce_chars_from_source (coding, src,
+						   run_end - src, nchars);
+		  src_end = coding->source + coding->src_bytes;
+		  direct_end = src_end + offset;
+		  consumed_chars += nchars;
+		  continue;
+		}
+	    }
+	  else
+	    {
+	      run_end = utf_8_valid_prefix (src, (direct_end - src
+						  < UTF_8_DIRECT_MIN
+						  ? direct_end
+						  : src + UTF_8_DIRECT_MIN),
+					    &nchars);
+	      if (run_end - src == UTF_8_DIRECT_MIN)
+		break;
+	    }
+	  /* Don't look again before the invalid byte at RUN_END.  */
+	  direct_from = run_end + 1;
+	}
+
       /* In the simple case, rapidly handle ordinary characters */
       if (multibytep && ! eol_dos
 	  && charbuf < charbuf_end - 6 && src < src_end - 6)
@@ -5465,6 +5628,317 @@ detect_coding_charset (struct coding_system *coding,
   return 1;
 }
 
+/* Minimum number of source bytes for which decode_coding_charset
+   tries decode_single_byte_direct.  */
+#define SINGLE_BYTE_DIRECT_MIN 1024
+
+/* Put the `charset' text property of ID on the characters of the
+   destination of CODING from FROM up to TO, both relative to its
+   start.  */
+
+static void
+put_charset_property (struct coding_system *coding, ptrdiff_t from,
+		      ptrdiff_t to, int id)
+{
+  if (! NILP (coding->dst_object) && from < to)
+    Fput_text_property (make_fixnum (coding->dst_pos + from),
+			make_fixnum (coding->dst_pos + to),
+			Qcharset, CHARSET_NAME (CHARSET_FROM_ID (id)),
+			coding->dst_object);
+}
+
+/* Single-byte text is handed out to the threads that help
+   decode_single_byte_direct this many bytes at a time, and decoded
+   at most SINGLE_BYTE_WINDOW chunks at a time.  */
+enum { SINGLE_BYTE_CHUNK = 256 * 1024, SINGLE_BYTE_WINDOW = 16 };
+
+struct single_byte_chunk
+{
+  /* The source bytes, and where to decode them.  */
+  const unsigned char *src;
+  ptrdiff_t nbytes;
+  unsigned char *dst;
+
+  /* The number of bytes decoded.  */
+  ptrdiff_t produced;
+
+  /* The index of the first byte of a charset other than ASCII, or -1,
+     and that charset.  MIXED is true if some later byte is of yet
+     another charset.  */
+  ptrdiff_t special;
+  int id;
+  bool mixed;
+};
+
+struct single_byte_job
+{
+  /* The character and charset ID of each byte.  */
+  const int *chars, *ids;
+
+  struct single_byte_chunk chunks[SINGLE_BYTE_WINDOW];
+  int nchunks;
+
+  /* The next chunk to be decoded.  */
+  sys_mutex_t mutex;
+  int next;
+};
+
+/* Decode CHUNK of JOB.  This may run in a helper thread, so it must
+   not use Lisp.  */
+
+static void
+decode_single_byte_chunk (struct single_byte_job *job,
+			  struct single_byte_chunk *chunk)
+{
+  const unsigned char *src = chunk->src, *src_end = src + chunk->nbytes;
+  unsigned char *dst = chunk->dst;
+  const int *chars = job->chars, *ids = job->ids;
+
+  chunk->special = -1;
+  chunk->mixed = false;
+  while (src < src_end)
+    {
+      int b = *src, c = chars[b];
+
+      if (ids[b] >= 0 && ids[b] != charset_ascii)
+	{
+	  if (chunk->special < 0)
+	    {
+	      chunk->special = src - chunk->src;
+	      chunk->id = ids[b];
+	    }
+	  else if (ids[b] != chunk->id)
+	    chunk->mixed = true;
+	}
+      src++;
+      if (ASCII_CHAR_P (c))
+	*dst++ = c;
+      else
+	CHAR_STRING_ADVANCE_NO_UNIFY (c, dst);
+    }
+  chunk->produced = dst - chunk->dst;
+}
+
+#ifdef THREADS_ENABLED
+
+/* Decode chunks of the single_byte_job ARG until none is left.  */
+
+static void
+decode_single_byte_chunks (void *arg)
+{
+  struct single_byte_job *job = arg;
+  sys_mutex_lock (&job->mutex);
+  while (job->next < job->nchunks)
+    {
+      struct single_byte_chunk *chunk = &job->chunks[job->next++];
+      sys_mutex_unlock (&job->mutex);
+      decode_single_byte_chunk (job, chunk);
+      sys_mutex_lock (&job->mutex);
+    }
+  sys_mutex_unlock (&job->mutex);
+}
+
+/* Decode the source of CODING from byte OFFSET towards END like
+   decode_single_byte_direct, whose tables of the character and charset
+   of each byte are CHARS and IDS, and the longest multibyte form of
+   whose characters has MAXLEN bytes.  Decode the text a window of
+   chunks at a time, each chunk into a separate buffer with helper
+   threads, and then copy the chunks to the destination in order.
+   *LAST_ID and *RUN_START are the charset of the current run of
+   characters and where it starts.  Stop before a chunk with bytes of
+   two charsets, whose runs need the sequential loop, and when less
+   than two chunks are left.  Return where decoding stopped.  */
+
+static ptrdiff_t
+decode_single_byte_parallel (struct coding_system *coding,
+			     const int *chars, const int *ids, int maxlen,
+			     ptrdiff_t offset, ptrdiff_t end,
+			     int *last_id, ptrdiff_t *run_start)
+{
+  struct single_byte_job job;
+  USE_SAFE_ALLOCA;
+  unsigned char *buf;
+  bool mixed = false;
+
+  job.chars = chars;
+  job.ids = ids;
+  sys_mutex_init (&job.mutex);
+  SAFE_NALLOCA (buf, maxlen * SINGLE_BYTE_CHUNK,
+		min ((end - offset) / SINGLE_BYTE_CHUNK, SINGLE_BYTE_WINDOW));
+  while (! mixed && 2 * SINGLE_BYTE_CHUNK <= end - offset)
+    {
+      /* Decoding the previous window may have relocated the
+	 source.  */
+      const unsigned char *src = coding->source + offset;
+
+      job.nchunks = min ((end - offset) / SINGLE_BYTE_CHUNK,
+			 SINGLE_BYTE_WINDOW);
+      for (int i = 0; i < job.nchunks; i++)
+	{
+	  job.chunks[i].src = src + i * SINGLE_BYTE_CHUNK;
+	  job.chunks[i].nbytes = SINGLE_BYTE_CHUNK;
+	  job.chunks[i].dst = buf + i * maxlen * SINGLE_BYTE_CHUNK;
+	}
+      /* Neither the source nor the destination can move while the
+	 helper threads are busy.  */
+      job.next = 0;
+      sys_run_helpers (decode_single_byte_chunks, &job,
+		       min (decode_coding_threads, job.nchunks - 1));
+
+      for (int i = 0; i < job.nchunks; i++)
+	{
+	  struct single_byte_chunk *chunk = &job.chunks[i];
+	  unsigned char *dst;
+	  ptrdiff_t chunk_start = coding->produced_char;
+
+	  if (chunk->mixed)
+	    {
+	      mixed = true;
+	      break;
+	    }
+
+	  /* As in decode_single_byte_direct, keep the destination
+	     before the unconsumed source.  */
+	  coding->consumed = offset;
+	  coding_set_destination (coding);
+	  dst = coding->destination + coding->produced;
+	  if (coding->dst_bytes - coding->produced <= chunk->produced)
+	    {
+	      dst = alloc_destination (coding, chunk->produced, dst);
+	      coding_set_source (coding);
+	    }
+	  memcpy (dst, chunk->dst, chunk->produced);
+	  if (BUFFERP (coding->dst_object))
+	    insert_from_gap (chunk->nbytes, chunk->produced, 0);
+	  coding->produced += chunk->produced;
+	  coding->produced_char += chunk->nbytes;
+	  offset += chunk->nbytes;
+
+	  if (chunk->special >= 0 && chunk->id != *last_id)
+	    {
+	      if (*last_id != charset_ascii)
+		put_charset_property (coding, *run_start,
+				      chunk_start + chunk->special, *last_id);
+	      *last_id = chunk->id;
+	      *run_start = chunk_start + chunk->special;
+	    }
+	}
+    }
+  sys_mutex_destroy (&job.mutex);
+  SAFE_FREE ();
+  return offset;
+}
+
+#endif /* THREADS_ENABLED */
+
+/* Decode NBYTES bytes at the start of the unconsumed source of CODING
+   straight into its multibyte destination, if every byte is either
+   invalid or a code of a one-dimensional charset according to VALIDS,
+   the valid codes of a charset coding system.  Put `charset' text
+   properties on the result as decode_coding_charset does.  Return
+   true if successful, and false without decoding anything if some
+   byte may start a longer code.  With `decode-coding-threads', decode
+   large text in chunks with helper threads.  */
+
+static bool
+decode_single_byte_direct (struct coding_system *coding, Lisp_Object valids,
+			   ptrdiff_t nbytes)
+{
+  int chars[256], ids[256];
+  int maxlen = 1, last_id = charset_ascii;
+  ptrdiff_t offset = coding->consumed, end = offset + nbytes;
+  ptrdiff_t run_start = 0;
+
+  for (int i = 0; i < 256; i++)
+    {
+      Lisp_Object val = AREF (valids, i);
+      int c = -1;
+
+      ids[i] = -1;
+      if (FIXNUMP (val))
+	{
+	  struct charset *charset = CHARSET_FROM_ID (XFIXNAT (val));
+
+	  if (CHARSET_DIMENSION (charset) != 1)
+	    return false;
+	  c = DECODE_CHAR (charset, i);
+	  if (c >= 0)
+	    ids[i] = charset->id;
+	}
+      else if (! NILP (val))
+	return false;
+      if (c < 0)
+	c = ASCII_CHAR_P (i) ? i : BYTE8_TO_CHAR (i);
+      chars[i] = c;
+      maxlen = max (maxlen, CHAR_BYTES (c));
+    }
+
+  /* Decoding the codes may have loaded charset maps and relocated the
+     source.  */
+  coding_set_source (coding);
+#ifdef THREADS_ENABLED
+  if (0 < decode_coding_threads)
+    offset = decode_single_byte_parallel (coding, chars, ids, maxlen,
+					  offset, end, &last_id, &run_start);
+#endif
+  while (offset < end)
+    {
+      ptrdiff_t n = min (end - offset, 0x10000);
+      const unsigned char *src, *src_end;
+      unsigned char *dst, *dst_base;
+      bool new_run = false;
+
+      /* Make sure that, when decoding in place, the destination
+	 stays before the unconsumed source.  */
+      coding->consumed = offset;
+      coding_set_destination (coding);
+      dst = coding->destination + coding->produced;
+      if (coding->dst_bytes - coding->produced <= n * maxlen)
+	{
+	  dst = alloc_destination (coding, n * maxlen, dst);
+	  coding_set_source (coding);
+	}
+      dst_base = dst;
+      src = coding->source + offset;
+      src_end = src + n;
+      while (src < src_end)
+	{
+	  int b = *src, c = chars[b];
+
+	  if (ids[b] != last_id && ids[b] >= 0 && ids[b] != charset_ascii)
+	    {
+	      new_run = true;
+	      break;
+	    }
+	  src++;
+	  if (ASCII_CHAR_P (c))
+	    *dst++ = c;
+	  else
+	    CHAR_STRING_ADVANCE_NO_UNIFY (c, dst);
+	}
+      n = src - (coding->source + offset);
+      if (BUFFERP (coding->dst_object) && n > 0)
+	insert_from_gap (n, dst - dst_base, 0);
+      coding->produced += dst - dst_base;
+      coding->produced_char += n;
+      offset += n;
+      if (new_run)
+	{
+	  if (last_id != charset_ascii)
+	    put_charset_property (coding, run_start, coding->produced_char,
+				  last_id);
+	  last_id = ids[*src];
+	  run_start = coding->produced_char;
+	}
+    }
+  if (last_id != charset_ascii)
+    put_charset_property (coding, run_start, coding->produced_char, last_id);
+  coding_set_source (coding);
+  coding->consumed = offset;
+  coding->consumed_char += nbytes;
+  return true;
+}
+
 static void
 decode_coding_charset (struct coding_system *coding)
 {
@@ -5489,6 +5963,19 @@ decode_coding_charset (struct coding_system *coding)
 
   valids = AREF (attrs, coding_attr_charset_valids);
 
+  /* Large text in a single-byte coding system need not go through
+     charbuf.  With DOS EOLs, leave the last byte, which may be the CR
+     of a CR LF pair, to the next call.  */
+  if (coding->direct_decoding
+      && charbuf == coding->charbuf
+      && src_end - src >= SINGLE_BYTE_DIRECT_MIN
+      && decode_single_byte_direct (coding, valids,
+				    src_end - src - eol_dos))
+    {
+      coding->charbuf_used = 0;
+      return;
+    }
+
   while (1)
     {
       int c;
@@ -7395,6 +7882,10 @@ decode_coding (struct coding_system *coding)
 
   attrs = CODING_ID_ATTRS (coding->id);
   translation_table = get_translation_table (attrs, 0, NULL);
+  coding->direct_decoding = (! disable_ascii_optimization
+			     && ! coding->src_multibyte
+			     && coding->dst_multibyte
+			     && NILP (translation_table));
 
   carryover = 0;
   if (coding->decoder == decode_coding_ccl)
@@ -7615,6 +8106,80 @@ handle_charset_annotation (ptrdiff_t pos, ptrdiff_t limit,
 }
 
 
+/* Return the end of the longest prefix of the multibyte text in
+   [SRC, SRC_END) that contains no eight-bit characters and, if
+   NEWLINE, no newline, and add the number of characters in it to
+   *NCHARS.  UTF-8 encodes such text to the same byte sequence.  */
+
+static const unsigned char *
+multibyte_utf_8_prefix (const unsigned char *src,
+			const unsigned char *src_end, bool newline,
+			ptrdiff_t *nchars)
+{
+  const uintptr_t ones = UINTPTR_MAX / 0xFF, high_bits = ones * 0x80;
+  const unsigned char *p = src;
+  ptrdiff_t ntrailing = 0;
+
+  /* Scan a word at a time.  A byte of X is zero iff the
+     corresponding bit of (X - ONES) & ~X & HIGH_BITS is set.  */
+  while (src_end - p >= sizeof (uintptr_t))
+    {
+      uintptr_t word, x;
+
+      memcpy (&word, p, sizeof word);
+      x = (word ^ (ones * 0xC0)) & (ones * 0xFE);
+      if ((x - ones) & ~x & high_bits)
+	break;
+      if (newline)
+	{
+	  x = word ^ (ones * '\n');
+	  if ((x - ones) & ~x & high_bits)
+	    break;
+	}
+      /* Count the bytes of the form 10xxxxxx, which don't start a
+	 character, by summing them into the top byte.  */
+      x = (word & ~(word << 1) & high_bits) >> 7;
+      ntrailing += (x * ones) >> ((sizeof x - 1) * CHAR_BIT);
+      p += sizeof word;
+    }
+  for (; p < src_end; p++)
+    {
+      if (CHAR_BYTE8_HEAD_P (*p) || (newline && *p == '\n'))
+	break;
+      ntrailing += ! CHAR_HEAD_P (*p);
+    }
+  *nchars += p - src - ntrailing;
+  return p;
+}
+
+/* Append NBYTES bytes at SRC in the source of CODING and then the
+   NEOL bytes at EOL to its unibyte destination.  Return the address
+   just after the copied source bytes, which may differ from SRC +
+   NBYTES if the source has been relocated.  */
+
+static const unsigned char *
+produce_bytes_from_source (struct coding_system *coding,
+			   const unsigned char *src, ptrdiff_t nbytes,
+			   const char *eol, int neol)
+{
+  ptrdiff_t offset = src - coding->source;
+  unsigned char *dst;
+
+  coding_set_destination (coding);
+  dst = coding->destination + coding->produced;
+  if (coding->dst_bytes - coding->produced <= nbytes + neol)
+    {
+      dst = alloc_destination (coding, nbytes + neol, dst);
+      coding_set_source (coding);
+      src = coding->source + offset;
+    }
+  memcpy (dst, src, nbytes);
+  memcpy (dst + nbytes, eol, neol);
+  coding->produced += nbytes + neol;
+  coding->produced_char += nbytes + neol;
+  return src + nbytes;
+}
+
 static void
 consume_chars (struct coding_system *coding, Lisp_Object translation_table,
 	       int max_lookup)
@@ -7641,6 +8206,20 @@ consume_chars (struct coding_system *coding, Lisp_Object translation_table,
   /* Note: composition handling is not yet implemented.  */
   coding->common_flags &= ~CODING_ANNOTATE_COMPOSITION_MASK;
 
+  /* If encoding to UTF-8, text without eight-bit characters can be
+     copied to the destination as is, except for newlines.  Do so when
+     nothing waits in charbuf; otherwise, stop at such text so that
+     the encoder produces the characters in charbuf first.  */
+  bool direct = (! disable_ascii_optimization
+		 && coding->encoder == encode_coding_utf_8
+		 && CODING_UTF_8_BOM (coding) != utf_with_bom
+		 && multibytep && ! coding->dst_multibyte
+		 && NILP (translation_table)
+		 && ! (coding->mode & CODING_MODE_SELECTIVE_DISPLAY)
+		 && ! (coding->common_flags & CODING_ANNOTATION_MASK));
+  bool newline = ! EQ (eol_type, Qunix);
+  const unsigned char *direct_from = src;
+
   if (NILP (coding->src_object))
     stop = stop_composition = stop_charset = end_pos;
   else
@@ -7675,6 +8254,50 @@ consume_chars (struct coding_system *coding, Lisp_Object translation_table,
 		  ? stop_composition : stop_charset);
 	}
 
+      if (direct && direct_from <= src && pos < end_pos)
+	{
+	  ptrdiff_t nchars = 0;
+	  const unsigned char *run_end;
+
+	  if (buf == coding->charbuf)
+	    {
+	      run_end = multibyte_utf_8_prefix (src, src_end, newline,
+						&nchars);
+	      if (run_end < src_end && *run_end == '\n')
+		{
+		  src = produce_bytes_from_source (coding, src,
+						   run_end - src,
+						   EQ (eol_type, Qdos)
+						   ? "\r\n" : "\r",
+						   EQ (eol_type, Qdos) ? 2 : 1);
+		  src++, nchars++;
+		}
+	      else if (run_end > src)
+		src = produce_bytes_from_source (coding, src, run_end - src,
+						 "", 0);
+	      else
+		goto no_run;
+	      src_end = coding->source + coding->src_bytes;
+	      pos += nchars;
+	      continue;
+	    }
+	  else
+	    {
+	      run_end = multibyte_utf_8_prefix (src, (src_end - src
+						      < UTF_8_DIRECT_MIN
+						      ? src_end
+						      : src + UTF_8_DIRECT_MIN),
+						newline, &nchars);
+	      if (run_end - src == UTF_8_DIRECT_MIN
+		  || (run_end < src_end && *run_end == '\n'))
+		break;
+	    }
+	no_run:
+	  /* Don't look again before the eight-bit character at
+	     RUN_END.  */
+	  direct_from = run_end + 1;
+	}
+
       if (! multibytep)
 	{
 	  int bytes;
@@ -8033,6 +8656,62 @@ decode_coding_gap (struct coding_system *coding, ptrdiff_t bytes)
   unbind_to (count, Qnil);
 }
 
+/* Mark the markers of the current buffer that must be moved after the
+   text from FROM to TO is replaced by its conversion: those at FROM
+   whose insertion-type is t, which would otherwise end up after the
+   converted text, and those at TO whose insertion-type is nil, which
+   would otherwise end up before it.  Return true if there are any.  */
+
+static bool
+mark_markers_for_conversion (ptrdiff_t from, ptrdiff_t to)
+{
+  bool need_marker_adjustment = false;
+  ptrdiff_t i = marker_index_from (current_buffer, from);
+  ptrdiff_t end = marker_index_from (current_buffer, to + 1);
+
+  for (; i < end; i++)
+    {
+      struct Lisp_Marker *tail = buf_marker (current_buffer, i);
+      tail->need_adjustment
+	= marker_charpos (tail) == (tail->insertion_type ? from : to);
+      need_marker_adjustment |= tail->need_adjustment;
+    }
+  return need_marker_adjustment;
+}
+
+/* Move the markers marked by mark_markers_for_conversion to the
+   beginning (FROM / FROM_BYTE) or the end (TO / TO_BYTE) of the
+   converted text.  */
+
+static void
+adjust_markers_for_conversion (ptrdiff_t from, ptrdiff_t from_byte,
+			       ptrdiff_t to, ptrdiff_t to_byte)
+{
+  ptrdiff_t start = marker_index_from (current_buffer, from);
+  ptrdiff_t end = marker_index_from (current_buffer, to + 1);
+
+  move_marker_gap (current_buffer, end);
+  for (ptrdiff_t i = start; i < end; i++)
+    {
+      struct Lisp_Marker *tail = buf_marker (current_buffer, i);
+      if (tail->need_adjustment)
+	{
+	  tail->need_adjustment = 0;
+	  if (tail->insertion_type)
+	    {
+	      tail->bytepos_ = from_byte;
+	      tail->charpos_ = from;
+	    }
+	  else
+	    {
+	      tail->bytepos_ = to_byte;
+	      tail->charpos_ = to;
+	    }
+	}
+    }
+  sort_markers (current_buffer, start, end);
+}
+
 
 /* Decode the text in the range FROM/FROM_BYTE and TO/TO_BYTE in
    SRC_OBJECT into DST_OBJECT by coding context CODING.
@@ -8105,14 +8784,7 @@ decode_coding_object (struct coding_system *coding,
 	move_gap_both (from, from_byte);
       if (EQ (src_object, dst_object))
 	{
-	  struct Lisp_Marker *tail;
-
-	  for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
-	    {
-	      tail->need_adjustment
-		= tail->charpos == (tail->insertion_type ? from : to);
-	      need_marker_adjustment |= tail->need_adjustment;
-	    }
+	  need_marker_adjustment = mark_markers_for_conversion (from, to);
 	  saved_pt = PT, saved_pt_byte = PT_BYTE;
 	  TEMP_SET_PT_BOTH (from, from_byte);
 	  current_buffer->text->inhibit_shrinking = 1;
@@ -8221,27 +8893,11 @@ decode_coding_object (struct coding_system *coding,
 			  saved_pt_byte + (coding->produced - bytes));
 
       if (need_marker_adjustment)
-	{
-	  struct Lisp_Marker *tail;
-
-	  for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
-	    if (tail->need_adjustment)
-	      {
-		tail->need_adjustment = 0;
-		if (tail->insertion_type)
-		  {
-		    tail->bytepos = from_byte;
-		    tail->charpos = from;
-		  }
-		else
-		  {
-		    tail->bytepos = from_byte + coding->produced;
-		    tail->charpos
-		      = (NILP (BVAR (current_buffer, enable_multibyte_characters))
-			 ? tail->bytepos : from + coding->produced_char);
-		  }
-	      }
-	}
+	adjust_markers_for_conversion
+	  (from, from_byte,
+	   (NILP (BVAR (current_buffer, enable_multibyte_characters))
+	    ? from_byte + coding->produced : from + coding->produced_char),
+	   from_byte + coding->produced);
     }
 
   Vdeactivate_mark = old_deactivate_mark;
@@ -8275,16 +8931,7 @@ encode_coding_object (struct coding_system *coding,
   attrs = CODING_ID_ATTRS (coding->id);
 
   if (EQ (src_object, dst_object))
-    {
-      struct Lisp_Marker *tail;
-
-      for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
-	{
-	  tail->need_adjustment
-	    = tail->charpos == (tail->insertion_type ? from : to);
-	  need_marker_adjustment |= tail->need_adjustment;
-	}
-    }
+    need_marker_adjustment = mark_markers_for_conversion (from, to);
 
   if (! NILP (CODING_ATTR_PRE_WRITE (attrs)))
     {
@@ -8424,27 +9071,11 @@ encode_coding_object (struct coding_system *coding,
 			  saved_pt_byte + (coding->produced - bytes));
 
       if (need_marker_adjustment)
-	{
-	  struct Lisp_Marker *tail;
-
-	  for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
-	    if (tail->need_adjustment)
-	      {
-		tail->need_adjustment = 0;
-		if (tail->insertion_type)
-		  {
-		    tail->bytepos = from_byte;
-		    tail->charpos = from;
-		  }
-		else
-		  {
-		    tail->bytepos = from_byte + coding->produced;
-		    tail->charpos
-		      = (NILP (BVAR (current_buffer, enable_multibyte_characters))
-			 ? tail->bytepos : from + coding->produced_char);
-		  }
-	      }
-	}
+	adjust_markers_for_conversion
+	  (from, from_byte,
+	   (NILP (BVAR (current_buffer, enable_multibyte_characters))
+	    ? from_byte + coding->produced : from + coding->produced_char),
+	   from_byte + coding->produced);
     }
 
   if (kill_src_buffer)
@@ -12069,6 +12700,13 @@ decode text as usual.  */);
 Internal use only.  Remove after the experimental optimizer becomes stable.  */);
   disable_ascii_optimization = 0;
 
+  DEFVAR_INT ("decode-coding-threads", decode_coding_threads,
+	      doc: /* Number of helper threads for decoding large text.
+They help the calling thread with text in a coding system of type
+`charset' that maps each byte to a character, such as `latin-1'.
+Zero means to do all the work in the calling thread.  */);
+  decode_coding_threads = 0;
+
   DEFVAR_LISP ("translation-table-for-input", Vtranslation_table_for_input,
 	       doc: /* Char table for translating self-inserting characters.
 This is applied to the result of input methods, not their input.
@@ -431,6 +431,11 @@ struct coding_system
   /* Set to true if charbuf contains an annotation.  */
   bool_bf annotated : 1;
 
+  /* True if the decoder may copy valid source bytes straight into
+     `destination' instead of passing them through `charbuf'.  Set by
+     decode_coding.  */
+  bool_bf direct_decoding : 1;
+
   /* Used internally in coding.c.  See the comment of detect_ascii.  */
   unsigned eol_seen : 3;
 
@@ -701,6 +706,9 @@ extern bool raw_text_coding_system_p (struct coding_system *);
 extern Lisp_Object coding_inherit_eol_type (Lisp_Object, Lisp_Object);
 extern Lisp_Object complement_process_encoding_system (Lisp_Object);
 extern Lisp_Object make_string_from_utf8 (const char *, ptrdiff_t);
+extern const unsigned char *utf_8_valid_prefix (const unsigned char *,
+						const unsigned char *,
+						ptrdiff_t *);
 
 extern void decode_coding_gap (struct coding_system *, ptrdiff_t);
 extern void decode_coding_object (struct coding_system *,
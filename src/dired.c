@@ -28,6 +28,7 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include <grp.h>
 
 #include <errno.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 
@@ -79,12 +80,15 @@ dirent_type (struct dirent *dp)
 #endif
 }
 
+/* Open the directory whose encoded name is NAME, and set *FDP to a
+   file descriptor for it.  Return a null pointer, with errno set, if
+   that fails.  Allow the user to quit only if QUIT.  */
+
 static DIR *
-open_directory (Lisp_Object dirname, Lisp_Object encoded_dirname, int *fdp)
+open_directory_1 (char const *name, int *fdp, bool quit)
 {
-  char *name = SSDATA (encoded_dirname);
   DIR *d;
-  int fd, opendir_errno;
+  int fd;
 
 #ifdef DOS_NT
   /* Directories cannot be opened.  The emulation assumes that any
@@ -92,29 +96,36 @@ open_directory (Lisp_Object dirname, Lisp_Object encoded_dirname, int *fdp)
      recently opened directory.  This hack is good enough for Emacs.  */
   fd = 0;
   d = opendir (name);
-  opendir_errno = errno;
 #else
-  fd = emacs_open (name, O_RDONLY | O_DIRECTORY, 0);
+  fd = (quit ? emacs_open : emacs_open_noquit) (name, O_RDONLY | O_DIRECTORY,
+						0);
   if (fd < 0)
-    {
-      opendir_errno = errno;
-      d = 0;
-    }
+    d = 0;
   else
     {
       d = fdopendir (fd);
-      opendir_errno = errno;
       if (! d)
-	emacs_close (fd);
+	{
+	  int opendir_errno = errno;
+	  emacs_close (fd);
+	  errno = opendir_errno;
+	}
     }
 #endif
 
-  if (!d)
-    report_file_errno ("Opening directory", dirname, opendir_errno);
   *fdp = fd;
   return d;
 }
 
+static DIR *
+open_directory (Lisp_Object dirname, Lisp_Object encoded_dirname, int *fdp)
+{
+  DIR *d = open_directory_1 (SSDATA (encoded_dirname), fdp, true);
+  if (!d)
+    report_file_errno ("Opening directory", dirname, errno);
+  return d;
+}
+
 #ifdef WINDOWSNT
 static void
 directory_files_internal_w32_unwind (Lisp_Object arg)
@@ -158,6 +169,354 @@ read_dirent (DIR *dir, Lisp_Object dirname)
     }
 }
 
+/* The file attribute cache.
+
+   When `file-attributes-cache-ttl' is a number, `directory-files',
+   `file-attributes', `file-exists-p' and `file-directory-p' remember
+   what they found out about a directory, so that they need not ask
+   the file system again.  FILE_CACHE maps the file name of each such
+   directory to a vector [TIME WATCH FILES ATTRS]:
+
+   TIME is when the data started to be collected, as a float.
+   WATCH is the inotify watch of the directory, or nil.
+   FILES is the list of the names in the directory, in the order in
+   which they were read, or t if they are not known.
+   ATTRS is a hash table mapping names in the directory to alists
+   (ID-FORMAT . ATTRIBUTES), t if no such table is needed yet, or nil
+   if nothing about the directory can be cached because changes to it
+   would not be noticed.
+
+   The data of a directory is discarded when inotify reports a change
+   in it, when Emacs itself changes one of its files, and once it is
+   older than `file-attributes-cache-ttl' seconds.  */
+
+static Lisp_Object file_cache;
+
+/* Statistics for `file-attributes-cache-statistics'.  */
+static EMACS_INT file_cache_hits, file_cache_misses;
+static EMACS_INT file_cache_invalidations;
+
+/* Incremented whenever cached data is discarded.  Data computed while
+   this changed may be stale already, and is not stored.  */
+static uintmax_t file_cache_generation;
+
+/* When the cache holds this many directories, it starts afresh.  */
+enum { FILE_CACHE_MAX_DIRECTORIES = 1000 };
+
+enum { FILE_CACHE_TIME, FILE_CACHE_WATCH, FILE_CACHE_FILES,
+       FILE_CACHE_ATTRS, FILE_CACHE_SIZE };
+
+/* Read the pending file notifications, which may invalidate parts of
+   the cache.  */
+
+static void
+file_cache_poll (void)
+{
+#ifdef HAVE_INOTIFY
+  inotify_poll ();
+#endif
+}
+
+/* Discard the data of ENTRY, keeping its watch.  */
+
+static void
+file_cache_clear_entry (Lisp_Object entry)
+{
+  ASET (entry, FILE_CACHE_FILES, Qt);
+  if (HASH_TABLE_P (AREF (entry, FILE_CACHE_ATTRS)))
+    ASET (entry, FILE_CACHE_ATTRS, Qt);
+}
+
+/* Remove the watch of ENTRY, if any.  */
+
+static void
+file_cache_release_entry (Lisp_Object entry)
+{
+#ifdef HAVE_INOTIFY
+  if (CONSP (AREF (entry, FILE_CACHE_WATCH)))
+    internal_condition_case_1 (Finotify_rm_watch,
+			       AREF (entry, FILE_CACHE_WATCH),
+			       Qt, Fidentity);
+#endif
+  ASET (entry, FILE_CACHE_WATCH, Qnil);
+}
+
+/* Return the cache entry of directory DIR, a directory file name,
+   creating it if need be.  Return nil if the cache is disabled.  */
+
+static Lisp_Object
+file_cache_entry (Lisp_Object dir)
+{
+  if (!NUMBERP (Vfile_attributes_cache_ttl))
+    return Qnil;
+
+  file_cache_poll ();
+  double now = timespectod (current_timespec ());
+  if (!HASH_TABLE_P (file_cache))
+    file_cache = CALLN (Fmake_hash_table, QCtest, Qequal);
+  struct Lisp_Hash_Table *h = XHASH_TABLE (file_cache);
+  Lisp_Object hash;
+  ptrdiff_t i = hash_lookup (h, dir, &hash);
+  if (0 <= i)
+    {
+      Lisp_Object entry = HASH_VALUE (h, i);
+      if (now <= (XFLOAT_DATA (AREF (entry, FILE_CACHE_TIME))
+		  + XFLOATINT (Vfile_attributes_cache_ttl)))
+	return entry;
+      if (!NILP (AREF (entry, FILE_CACHE_ATTRS)))
+	{
+	  file_cache_clear_entry (entry);
+	  file_cache_generation++;
+	  ASET (entry, FILE_CACHE_TIME, make_float (now));
+	  return entry;
+	}
+      /* Try again to watch a directory that could not be watched.  */
+      hash_remove_from_table (h, dir);
+    }
+
+  if (FILE_CACHE_MAX_DIRECTORIES <= h->count)
+    {
+      Ffile_attributes_cache_clear ();
+      h = XHASH_TABLE (file_cache);
+    }
+
+  Lisp_Object watch = Qt;
+#ifdef HAVE_INOTIFY
+  watch = inotify_watch_directory (dir);
+#endif
+  Lisp_Object entry = make_nil_vector (FILE_CACHE_SIZE);
+  ASET (entry, FILE_CACHE_TIME, make_float (now));
+  ASET (entry, FILE_CACHE_WATCH, EQ (watch, Qt) ? Qnil : watch);
+  ASET (entry, FILE_CACHE_FILES, Qt);
+  ASET (entry, FILE_CACHE_ATTRS, NILP (watch) ? Qnil : Qt);
+  hash_put (h, dir, entry, hash);
+  return entry;
+}
+
+/* Return true if data about the directory of ENTRY can be cached.  */
+
+static bool
+file_cache_usable (Lisp_Object entry)
+{
+  return VECTORP (entry) && !NILP (AREF (entry, FILE_CACHE_ATTRS));
+}
+
+/* Return the key under which attributes in ID_FORMAT are cached.  */
+
+static Lisp_Object
+file_cache_format (Lisp_Object id_format)
+{
+  return NILP (id_format) || EQ (id_format, Qinteger) ? Qinteger : Qstring;
+}
+
+/* Look for the attributes in ID_FORMAT of the file NAME in the
+   directory of ENTRY.  If found, set *ATTRS to them and return true.
+   The caller must not modify *ATTRS.  */
+
+static bool
+file_cache_lookup (Lisp_Object entry, Lisp_Object name,
+		   Lisp_Object id_format, Lisp_Object *attrs)
+{
+  Lisp_Object table = AREF (entry, FILE_CACHE_ATTRS);
+  if (HASH_TABLE_P (table))
+    {
+      struct Lisp_Hash_Table *h = XHASH_TABLE (table);
+      ptrdiff_t i = hash_lookup (h, name, NULL);
+      if (0 <= i)
+	{
+	  Lisp_Object cell = Fassq (file_cache_format (id_format),
+				    HASH_VALUE (h, i));
+	  if (CONSP (cell))
+	    {
+	      file_cache_hits++;
+	      *attrs = XCDR (cell);
+	      return true;
+	    }
+	}
+    }
+  file_cache_misses++;
+  return false;
+}
+
+/* Remember ATTRS as the attributes in ID_FORMAT of the file NAME in
+   the directory of ENTRY, unless the cache was invalidated since
+   GENERATION.  */
+
+static void
+file_cache_store (Lisp_Object entry, Lisp_Object name,
+		  Lisp_Object id_format, Lisp_Object attrs,
+		  uintmax_t generation)
+{
+  file_cache_poll ();
+  if (generation != file_cache_generation
+      || NILP (AREF (entry, FILE_CACHE_ATTRS)))
+    return;
+
+  Lisp_Object table = AREF (entry, FILE_CACHE_ATTRS);
+  if (!HASH_TABLE_P (table))
+    {
+      table = CALLN (Fmake_hash_table, QCtest, Qequal);
+      ASET (entry, FILE_CACHE_ATTRS, table);
+    }
+  struct Lisp_Hash_Table *h = XHASH_TABLE (table);
+  Lisp_Object hash;
+  ptrdiff_t i = hash_lookup (h, name, &hash);
+  Lisp_Object cell = Fcons (file_cache_format (id_format), attrs);
+  if (0 <= i)
+    set_hash_value_slot (h, i, Fcons (cell, HASH_VALUE (h, i)));
+  else
+    hash_put (h, name, list1 (cell), hash);
+}
+
+static Lisp_Object
+file_cache_compute (Lisp_Object file, Lisp_Object id_format)
+{
+  Lisp_Object encoded = ENCODE_FILE (file);
+  return file_attributes (AT_FDCWD, SSDATA (encoded), Qnil, file,
+			  id_format);
+}
+
+static Lisp_Object
+file_cache_compute_error (Lisp_Object err)
+{
+  return Qt;
+}
+
+/* Return the attributes in ID_FORMAT of FILE, an absolute file name
+   without a file name handler, as `file-attributes' would.  Use and
+   fill the cache.  Return t if the cache does not apply to FILE.
+   If PEEK, return t instead of signaling an error, and return the
+   cached list itself, which the caller must not modify.  */
+
+Lisp_Object
+file_cache_attributes (Lisp_Object file, Lisp_Object id_format, bool peek)
+{
+  if (!NUMBERP (Vfile_attributes_cache_ttl))
+    return Qt;
+
+  /* Split FILE at its last separator by hand, as this is done for
+     each lookup and FILE needs no file name handler.  */
+  ptrdiff_t nbytes = SBYTES (file), sep = nbytes;
+  while (0 < sep && !IS_DIRECTORY_SEP (SREF (file, sep - 1)))
+    sep--;
+  if (sep == 0 || sep == nbytes)
+    return Qt;
+  ptrdiff_t dirbytes = sep - 1;
+  while (0 < dirbytes && IS_DIRECTORY_SEP (SREF (file, dirbytes - 1)))
+    dirbytes--;
+  if (dirbytes == 0)
+    dirbytes = 1;
+#ifdef DOS_NT
+  else if (SREF (file, dirbytes - 1) == ':')
+    dirbytes++;
+#endif
+  bool multibyte = STRING_MULTIBYTE (file);
+  Lisp_Object dir = make_specified_string (SSDATA (file), -1, dirbytes,
+					   multibyte);
+  Lisp_Object name = make_specified_string (SSDATA (file) + sep, -1,
+					    nbytes - sep, multibyte);
+
+  Lisp_Object entry = file_cache_entry (dir);
+  if (!file_cache_usable (entry))
+    return Qt;
+
+  Lisp_Object attrs;
+  if (file_cache_lookup (entry, name, id_format, &attrs))
+    return peek ? attrs : Fcopy_sequence (attrs);
+
+  uintmax_t generation = file_cache_generation;
+  if (peek)
+    {
+      attrs = internal_condition_case_2 (file_cache_compute, file, id_format,
+					 Qfile_error,
+					 file_cache_compute_error);
+      if (EQ (attrs, Qt))
+	return Qt;
+    }
+  else
+    attrs = file_cache_compute (file, id_format);
+  file_cache_store (entry, name, id_format, attrs, generation);
+  return peek ? attrs : Fcopy_sequence (attrs);
+}
+
+/* Discard the cached data of directory DIR, and what its parent
+   directory knows about DIR itself.  If GONE, DIR can no longer be
+   watched.  If DIR is nil, discard all cached data.  */
+
+static void
+file_cache_invalidate (Lisp_Object dir, bool gone)
+{
+  if (!HASH_TABLE_P (file_cache))
+    return;
+  struct Lisp_Hash_Table *h = XHASH_TABLE (file_cache);
+  if (h->count == 0)
+    return;
+
+  file_cache_generation++;
+  if (NILP (dir))
+    {
+      for (ptrdiff_t i = 0; i < HASH_TABLE_SIZE (h); i++)
+	if (!EQ (HASH_KEY (h, i), Qunbound))
+	  file_cache_clear_entry (HASH_VALUE (h, i));
+      file_cache_invalidations++;
+      return;
+    }
+
+  ptrdiff_t i = hash_lookup (h, dir, NULL);
+  if (0 <= i)
+    {
+      Lisp_Object entry = HASH_VALUE (h, i);
+      file_cache_clear_entry (entry);
+      if (gone)
+	{
+	  /* The watch is invalid already, so just forget it.  Without
+	     a watch, changes of DIR would go unnoticed.  */
+	  ASET (entry, FILE_CACHE_WATCH, Qnil);
+	  ASET (entry, FILE_CACHE_ATTRS, Qnil);
+	}
+      file_cache_invalidations++;
+    }
+
+  Lisp_Object name = Ffile_name_nondirectory (dir);
+  if (SCHARS (name) != 0)
+    {
+      Lisp_Object parent = Fdirectory_file_name (Ffile_name_directory (dir));
+      i = hash_lookup (h, parent, NULL);
+      if (0 <= i)
+	{
+	  Lisp_Object table = AREF (HASH_VALUE (h, i), FILE_CACHE_ATTRS);
+	  if (HASH_TABLE_P (table))
+	    hash_remove_from_table (XHASH_TABLE (table), name);
+	}
+    }
+}
+
+/* Called by inotify when directory DIR changed, or when its watch
+   became invalid if GONE.  DIR nil means that events were lost.  */
+
+void
+file_cache_notify (Lisp_Object dir, bool gone)
+{
+  file_cache_invalidate (dir, gone);
+}
+
+/* Called when Emacs changed the file FILE, an absolute file name, or
+   the entries of FILE if it is a directory.  */
+
+void
+file_cache_forget (Lisp_Object file)
+{
+  if (!HASH_TABLE_P (file_cache) || XHASH_TABLE (file_cache)->count == 0)
+    return;
+  file = Fexpand_file_name (file, Qnil);
+  Lisp_Object dirfile = Fdirectory_file_name (file);
+  Lisp_Object dir = Ffile_name_directory (dirfile);
+  if (!NILP (dir))
+    file_cache_invalidate (Fdirectory_file_name (dir), false);
+  file_cache_invalidate (dirfile, false);
+}
+
+
 /* Function shared by Fdirectory_files and Fdirectory_files_and_attributes.
    If not ATTRS, return a list of directory filenames;
    if ATTRS, return a list of directory filenames and their attributes.
@@ -182,14 +541,32 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full,
      indirectly.  */
   Lisp_Object encoded_dirfilename = ENCODE_FILE (dirfilename);
 
-  int fd;
-  DIR *d = open_directory (dirfilename, encoded_dirfilename, &fd);
+  /* Use the names in the cache if possible, and otherwise read the
+     directory, collecting its names into ALLNAMES for the cache.  */
+  Lisp_Object entry = file_cache_entry (dirfilename);
+  bool cached = file_cache_usable (entry);
+  Lisp_Object names = cached ? AREF (entry, FILE_CACHE_FILES) : Qt;
+  Lisp_Object allnames = Qnil;
+  uintmax_t generation = file_cache_generation;
+  if (cached)
+    {
+      if (EQ (names, Qt))
+	file_cache_misses++;
+      else
+	file_cache_hits++;
+    }
+
+  int fd = AT_FDCWD;
+  DIR *d = NULL;
+  if (EQ (names, Qt))
+    d = open_directory (dirfilename, encoded_dirfilename, &fd);
 
   /* Unfortunately, we can now invoke expand-file-name and
      file-attributes on filenames, both of which can throw, so we must
      do a proper unwind-protect.  */
   ptrdiff_t count = SPECPDL_INDEX ();
-  record_unwind_protect_ptr (directory_files_internal_unwind, d);
+  if (d)
+    record_unwind_protect_ptr (directory_files_internal_unwind, d);
 
 #ifdef WINDOWSNT
   Lisp_Object w32_save = Qnil;
@@ -227,14 +604,30 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full,
 
   /* Read directory entries and accumulate them into LIST.  */
   Lisp_Object list = Qnil;
-  for (struct dirent *dp; (dp = read_dirent (d, directory)); )
+  while (true)
     {
-      ptrdiff_t len = dirent_namelen (dp);
-      Lisp_Object name = make_unibyte_string (dp->d_name, len);
-      Lisp_Object finalname = name;
+      struct dirent *dp = NULL;
+      Lisp_Object name, finalname;
+      if (d)
+	{
+	  dp = read_dirent (d, directory);
+	  if (!dp)
+	    break;
+	  ptrdiff_t len = dirent_namelen (dp);
+	  name = make_unibyte_string (dp->d_name, len);
 
-      /* This can GC.  */
-      name = DECODE_FILE (name);
+	  /* This can GC.  */
+	  name = DECODE_FILE (name);
+	  if (cached)
+	    allnames = Fcons (name, allnames);
+	}
+      else if (CONSP (names))
+	{
+	  name = XCAR (names);
+	  names = XCDR (names);
+	}
+      else
+	break;
 
       maybe_quit ();
 
@@ -245,8 +638,29 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full,
       Lisp_Object fileattrs UNINIT;
       if (attrs)
 	{
-	  fileattrs = file_attributes (fd, dp->d_name, directory, name,
-				       id_format);
+	  if (cached
+	      && file_cache_lookup (entry, name, id_format, &fileattrs))
+	    fileattrs = Fcopy_sequence (fileattrs);
+	  else
+	    {
+	      uintmax_t attrs_generation = file_cache_generation;
+	      if (dp)
+		fileattrs = file_attributes (fd, dp->d_name, directory, name,
+					     id_format);
+	      else
+		{
+		  Lisp_Object file = concat2 (Ffile_name_as_directory
+					      (dirfilename),
+					      name);
+		  Lisp_Object encoded = ENCODE_FILE (file);
+		  fileattrs = file_attributes (AT_FDCWD, SSDATA (encoded),
+					       Qnil, file, id_format);
+		}
+	      if (cached)
+		file_cache_store (entry, name, id_format,
+				  Fcopy_sequence (fileattrs),
+				  attrs_generation);
+	    }
 	  if (NILP (fileattrs))
 	    continue;
 	}
@@ -266,12 +680,22 @@ directory_files_internal (Lisp_Object directory, Lisp_Object full,
 		  SDATA (name), name_nbytes);
 	}
       else
-	finalname = name;
+	/* Do not let callers modify the names in the cache.  */
+	finalname = dp ? name : Fcopy_sequence (name);
 
       list = Fcons (attrs ? Fcons (finalname, fileattrs) : finalname, list);
     }
 
-  closedir (d);
+  if (d)
+    {
+      closedir (d);
+      if (cached)
+	{
+	  file_cache_poll ();
+	  if (generation == file_cache_generation)
+	    ASET (entry, FILE_CACHE_FILES, Fnreverse (allnames));
+	}
+    }
 #ifdef WINDOWSNT
   if (attrs)
     Vw32_get_true_file_attributes = w32_save;
@@ -351,6 +775,557 @@ which see.  */)
 }
 
 
+/* Recursive directory walks.  The names in a directory are read,
+   classified and sorted without creating Lisp objects, possibly by
+   helper threads that read subdirectories ahead of the main thread.
+   The main thread alone matches the names and makes Lisp strings of
+   those that are returned.  */
+
+/* The kinds of directory entries a walk distinguishes.  */
+enum walk_type { WALK_FILE, WALK_DIR, WALK_DIR_LINK };
+
+struct walk_entry
+{
+  /* The NUL-terminated name, and its length in bytes.  While the
+     directory is being read, NAME is an offset into the names.  */
+  char const *name;
+  ptrdiff_t len;
+  enum walk_type type;
+};
+
+/* A directory of a walk.  */
+struct walk_dir
+{
+  /* Next directory allocated by the walk.  */
+  struct walk_dir *all;
+
+  /* Neighbors in the queue of directories for the helpers.  */
+  struct walk_dir *prev, *next;
+
+  /* The encoded file name of the directory.  */
+  char *file;
+
+  /* The sorted entries, and the buffer holding their names.  */
+  struct walk_entry *entries;
+  ptrdiff_t nentries;
+  char *names;
+
+  /* If nonzero, the errno value of the failed operation WHAT.  */
+  int error;
+  char const *what;
+
+  /* Whether the directory was put into the queue, was taken out of it
+     by a helper, and was read.  */
+  bool queued, started, done;
+};
+
+/* Names are passed to the callback of a walk in batches of this many.  */
+enum { WALK_BATCH = 1000 };
+
+/* At most this many directories are queued for the helpers.  */
+enum { WALK_MAX_QUEUED = 4096 };
+
+struct walk
+{
+  Lisp_Object regexp, case_table, predicate, ignore, callback;
+  bool include_directories, follow_symlinks;
+
+  /* The names found and not yet passed to the callback, in reverse
+     order, and their number.  */
+  Lisp_Object found;
+  ptrdiff_t nfound;
+
+  /* All directories allocated, to be freed at the end.  */
+  struct walk_dir *all;
+
+  /* The tasks of the helper threads, and their number.  If it is
+     nonzero, the following synchronization objects were
+     initialized.  */
+  struct sys_task tasks[SYS_MAX_HELPERS];
+  int ntasks;
+
+  sys_mutex_t mutex;
+  sys_cond_t work_cond, done_cond;
+  struct walk_dir *queue_head, *queue_tail;
+  ptrdiff_t nqueued;
+  bool stop;
+};
+
+static int
+walk_entry_compare (void const *a, void const *b)
+{
+  struct walk_entry const *x = a, *y = b;
+  ptrdiff_t len = min (x->len, y->len);
+  int c = memcmp (x->name, y->name, len);
+  if (c != 0)
+    return c;
+
+  /* Compare like the names returned by `file-name-all-completions',
+     where directories end in a slash.  */
+  int xc = (len < x->len ? (unsigned char) x->name[len]
+	    : x->type == WALK_FILE ? -1 : '/');
+  int yc = (len < y->len ? (unsigned char) y->name[len]
+	    : y->type == WALK_FILE ? -1 : '/');
+  return (xc > yc) - (xc < yc);
+}
+
+/* Read the entries of WD, classify and sort them.  This may run in a
+   helper thread, so it must not use Lisp or signal errors.  */
+
+static void
+walk_read_dir (struct walk_dir *wd)
+{
+  int fd;
+  DIR *d = open_directory_1 (wd->file, &fd, false);
+  if (!d)
+    {
+      wd->error = errno;
+      wd->what = "Opening directory";
+      return;
+    }
+
+  ptrdiff_t entries_alloc = 0, names_alloc = 0, names_used = 0;
+  while (true)
+    {
+      errno = 0;
+      struct dirent *dp = readdir (d);
+      if (!dp)
+	{
+	  if (errno != 0 && errno != EINTR && errno != EAGAIN)
+	    {
+	      wd->error = errno;
+	      wd->what = "Reading directory";
+	    }
+	  if (errno == 0 || wd->error)
+	    break;
+	  continue;
+	}
+
+      char const *name = dp->d_name;
+      ptrdiff_t len = dirent_namelen (dp);
+      if (name[0] == '.'
+	  && (len == 1 || (len == 2 && name[1] == '.')))
+	continue;
+
+      /* Classify the entry like file_name_completion_dirp, which
+	 counts symbolic links to directories as directories.  */
+      int type = dirent_type (dp);
+      struct stat st;
+      if (type == DT_UNKNOWN
+	  && fstatat (fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+	type = (S_ISDIR (st.st_mode) ? DT_DIR
+		: S_ISLNK (st.st_mode) ? DT_LNK : -1);
+      enum walk_type kind = WALK_FILE;
+      if (type == DT_DIR)
+	kind = WALK_DIR;
+      else if (type == DT_LNK && fstatat (fd, name, &st, 0) == 0
+	       && S_ISDIR (st.st_mode))
+	kind = WALK_DIR_LINK;
+
+      if (wd->nentries == entries_alloc)
+	{
+	  entries_alloc = 2 * entries_alloc + 16;
+	  void *p = realloc (wd->entries, entries_alloc * sizeof *wd->entries);
+	  if (!p)
+	    {
+	      wd->error = ENOMEM;
+	      wd->what = "Reading directory";
+	      break;
+	    }
+	  wd->entries = p;
+	}
+      if (names_alloc - names_used <= len)
+	{
+	  names_alloc = 2 * names_alloc + len + 1024;
+	  void *p = realloc (wd->names, names_alloc);
+	  if (!p)
+	    {
+	      wd->error = ENOMEM;
+	      wd->what = "Reading directory";
+	      break;
+	    }
+	  wd->names = p;
+	}
+      memcpy (wd->names + names_used, name, len + 1);
+      struct walk_entry *e = &wd->entries[wd->nentries++];
+      e->name = (char const *) (uintptr_t) names_used;
+      e->len = len;
+      e->type = kind;
+      names_used += len + 1;
+    }
+  closedir (d);
+
+  for (ptrdiff_t i = 0; i < wd->nentries; i++)
+    wd->entries[i].name = wd->names + (uintptr_t) wd->entries[i].name;
+  qsort (wd->entries, wd->nentries, sizeof *wd->entries, walk_entry_compare);
+}
+
+/* Take the first directory out of the queue of the walk ARG and read
+   it, until the walk is stopped.  */
+
+static void
+walk_helper (void *arg)
+{
+  struct walk *w = arg;
+
+  sys_mutex_lock (&w->mutex);
+  while (true)
+    {
+      while (!w->queue_head && !w->stop)
+	sys_cond_wait (&w->work_cond, &w->mutex);
+      if (w->stop)
+	break;
+      struct walk_dir *wd = w->queue_head;
+      w->queue_head = wd->next;
+      if (w->queue_head)
+	w->queue_head->prev = NULL;
+      else
+	w->queue_tail = NULL;
+      w->nqueued--;
+      wd->started = true;
+      sys_mutex_unlock (&w->mutex);
+
+      walk_read_dir (wd);
+
+      sys_mutex_lock (&w->mutex);
+      wd->done = true;
+      sys_cond_broadcast (&w->done_cond);
+    }
+  sys_mutex_unlock (&w->mutex);
+}
+
+/* Return a new directory of W, whose encoded file name is the LEN
+   bytes of NAME in the directory of DIRLEN bytes at DIR.  */
+
+static struct walk_dir *
+walk_new_dir (struct walk *w, char const *dir, ptrdiff_t dirlen,
+	      char const *name, ptrdiff_t len)
+{
+  struct walk_dir *wd = xzalloc (sizeof *wd);
+  wd->all = w->all;
+  w->all = wd;
+  bool needsep = dirlen && !IS_DIRECTORY_SEP (dir[dirlen - 1]);
+  wd->file = xmalloc (dirlen + needsep + len + 1);
+  memcpy (wd->file, dir, dirlen);
+  wd->file[dirlen] = DIRECTORY_SEP;
+  memcpy (wd->file + dirlen + needsep, name, len);
+  wd->file[dirlen + needsep + len] = '\0';
+  return wd;
+}
+
+/* Let the helpers of W read WD ahead, if they are not too busy.  */
+
+static void
+walk_submit (struct walk *w, struct walk_dir *wd)
+{
+  if (w->ntasks == 0)
+    return;
+  sys_mutex_lock (&w->mutex);
+  if (WALK_MAX_QUEUED <= w->nqueued)
+    {
+      sys_mutex_unlock (&w->mutex);
+      return;
+    }
+  wd->queued = true;
+  wd->prev = w->queue_tail;
+  if (w->queue_tail)
+    w->queue_tail->next = wd;
+  else
+    w->queue_head = wd;
+  w->queue_tail = wd;
+  w->nqueued++;
+  sys_cond_signal (&w->work_cond);
+  sys_mutex_unlock (&w->mutex);
+}
+
+/* Make sure that WD has been read.  If no helper has started to read
+   it, read it right away instead of waiting.  */
+
+static void
+walk_await (struct walk *w, struct walk_dir *wd)
+{
+  if (wd->queued)
+    {
+      sys_mutex_lock (&w->mutex);
+      if (!wd->started)
+	{
+	  if (wd->prev)
+	    wd->prev->next = wd->next;
+	  else
+	    w->queue_head = wd->next;
+	  if (wd->next)
+	    wd->next->prev = wd->prev;
+	  else
+	    w->queue_tail = wd->prev;
+	  w->nqueued--;
+	  wd->queued = false;
+	}
+      else
+	while (!wd->done)
+	  sys_cond_wait (&w->done_cond, &w->mutex);
+      sys_mutex_unlock (&w->mutex);
+      if (wd->queued)
+	return;
+    }
+  walk_read_dir (wd);
+}
+
+/* Stop the helpers of W and free its directories.  */
+
+static void
+walk_cleanup (void *arg)
+{
+  struct walk *w = arg;
+
+  if (w->ntasks != 0)
+    {
+      sys_mutex_lock (&w->mutex);
+      w->stop = true;
+      sys_cond_broadcast (&w->work_cond);
+      sys_mutex_unlock (&w->mutex);
+      for (int i = 0; i < w->ntasks; i++)
+	sys_task_wait (&w->tasks[i]);
+      sys_cond_destroy (&w->work_cond);
+      sys_cond_destroy (&w->done_cond);
+      sys_mutex_destroy (&w->mutex);
+    }
+
+  while (w->all)
+    {
+      struct walk_dir *wd = w->all;
+      w->all = wd->all;
+      xfree (wd->file);
+      free (wd->entries);
+      free (wd->names);
+      xfree (wd);
+    }
+}
+
+/* Return true if NAME, of LEN bytes, matches the regexp of W.  */
+
+static bool
+walk_match (struct walk *w, char const *name, ptrdiff_t len,
+	    Lisp_Object decoded)
+{
+  if (SCHARS (w->regexp) == 0)
+    return true;
+  if (NILP (decoded))
+    return 0 <= fast_c_string_match_internal (w->regexp, name, len,
+					      w->case_table);
+  return 0 <= fast_string_match_internal (w->regexp, decoded, w->case_table);
+}
+
+/* Return the decoded form of the LEN bytes of NAME, or nil if it is
+   ASCII and needs no decoding.  */
+
+static Lisp_Object
+walk_decode (char const *name, ptrdiff_t len)
+{
+  for (ptrdiff_t i = 0; i < len; i++)
+    if (!ASCII_CHAR_P ((unsigned char) name[i]))
+      return DECODE_FILE (make_unibyte_string (name, len));
+  return Qnil;
+}
+
+/* Return the concatenation of PREFIX and NAME, of LEN bytes, whose
+   decoded form is DECODED, or nil if it is ASCII.  */
+
+static Lisp_Object
+walk_file_name (Lisp_Object prefix, char const *name, ptrdiff_t len,
+		Lisp_Object decoded)
+{
+  if (!NILP (decoded))
+    return concat2 (prefix, decoded);
+  ptrdiff_t prefix_nbytes = SBYTES (prefix);
+  Lisp_Object file
+    = (STRING_MULTIBYTE (prefix)
+       ? make_uninit_multibyte_string (SCHARS (prefix) + len,
+				       prefix_nbytes + len)
+       : make_uninit_string (prefix_nbytes + len));
+  memcpy (SDATA (file), SDATA (prefix), prefix_nbytes);
+  memcpy (SDATA (file) + prefix_nbytes, name, len);
+  return file;
+}
+
+/* Add FILE to the names found by W, passing a batch of them to its
+   callback if there are enough.  */
+
+static void
+walk_found (struct walk *w, Lisp_Object file)
+{
+  w->found = Fcons (file, w->found);
+  if (!NILP (w->callback) && WALK_BATCH <= ++w->nfound)
+    {
+      Lisp_Object batch = Fnreverse (w->found);
+      w->found = Qnil;
+      w->nfound = 0;
+      call1 (w->callback, batch);
+    }
+}
+
+/* Return true if the subdirectory NAME, of LEN bytes, is among the
+   directories that W ignores.  */
+
+static bool
+walk_ignored_p (struct walk *w, char const *name, ptrdiff_t len)
+{
+  for (Lisp_Object tail = w->ignore; CONSP (tail); tail = XCDR (tail))
+    if (SBYTES (XCAR (tail)) == len
+	&& memcmp (SDATA (XCAR (tail)), name, len) == 0)
+      return true;
+  return false;
+}
+
+/* Walk the directory WD, whose name is DIR.  */
+
+static void
+walk_directory (struct walk *w, Lisp_Object dir, struct walk_dir *wd,
+		bool top)
+{
+  walk_await (w, wd);
+  if (wd->error)
+    {
+      if (top || !EQ (w->predicate, Qt))
+	report_file_errno (wd->what, dir, wd->error);
+      return;
+    }
+
+  /* Decide which subdirectories to descend into, so that they can be
+     read ahead.  */
+  ptrdiff_t filelen = strlen (wd->file);
+  USE_SAFE_ALLOCA;
+  struct walk_dir **subdirs;
+  SAFE_NALLOCA (subdirs, 1, wd->nentries);
+  for (ptrdiff_t i = 0; i < wd->nentries; i++)
+    {
+      struct walk_entry *e = &wd->entries[i];
+      subdirs[i] = NULL;
+      if (e->type == WALK_DIR
+	  || (e->type == WALK_DIR_LINK && w->follow_symlinks))
+	if (!walk_ignored_p (w, e->name, e->len))
+	  {
+	    subdirs[i] = walk_new_dir (w, wd->file, filelen, e->name, e->len);
+	    walk_submit (w, subdirs[i]);
+	  }
+    }
+
+  Lisp_Object prefix = concat2 (dir, build_string ("/"));
+
+  /* First the subdirectories, each after its contents...  */
+  for (ptrdiff_t i = 0; i < wd->nentries; i++)
+    {
+      struct walk_entry *e = &wd->entries[i];
+      if (e->type == WALK_FILE)
+	continue;
+      maybe_quit ();
+      Lisp_Object decoded = walk_decode (e->name, e->len);
+      Lisp_Object file = Qnil;
+      if (subdirs[i])
+	{
+	  file = walk_file_name (prefix, e->name, e->len, decoded);
+	  if (NILP (w->predicate) || EQ (w->predicate, Qt)
+	      || !NILP (call1 (w->predicate, file)))
+	    walk_directory (w, file, subdirs[i], false);
+	}
+      if (w->include_directories && walk_match (w, e->name, e->len, decoded))
+	walk_found (w, (NILP (file)
+			? walk_file_name (prefix, e->name, e->len, decoded)
+			: file));
+    }
+
+  /* ...and then the files.  */
+  for (ptrdiff_t i = 0; i < wd->nentries; i++)
+    {
+      struct walk_entry *e = &wd->entries[i];
+      if (e->type != WALK_FILE)
+	continue;
+      Lisp_Object decoded = walk_decode (e->name, e->len);
+      if (walk_match (w, e->name, e->len, decoded))
+	walk_found (w, walk_file_name (prefix, e->name, e->len, decoded));
+    }
+
+  SAFE_FREE ();
+
+  /* The entries are no longer needed.  */
+  free (wd->entries);
+  free (wd->names);
+  wd->entries = NULL;
+  wd->names = NULL;
+  wd->nentries = 0;
+}
+
+DEFUN ("directory-files-walk", Fdirectory_files_walk, Sdirectory_files_walk,
+       2, 7, 0,
+       doc: /* Return the files under directory DIR whose names match REGEXP.
+This works like `directory-files-recursively' with the same DIR, REGEXP,
+INCLUDE-DIRECTORIES, PREDICATE and FOLLOW-SYMLINKS, but is faster, as it
+reads the directories without making Lisp objects for the names that
+are not returned.  DIR must not have a file name handler.
+
+IGNORE-DIRECTORIES is a list of names of subdirectories, such as
+\".git\", not to descend into anywhere under DIR.
+
+If CALLBACK is non-nil, call it with successive lists of the names
+found, in the order in which they would be returned, and return nil.
+
+When `directory-files-walk-threads' is positive, that many helper
+threads read directories ahead of the walk.  */)
+  (Lisp_Object dir, Lisp_Object regexp, Lisp_Object include_directories,
+   Lisp_Object predicate, Lisp_Object follow_symlinks,
+   Lisp_Object ignore_directories, Lisp_Object callback)
+{
+  CHECK_STRING (regexp);
+  dir = Fdirectory_file_name (dir);
+  Lisp_Object encoded_dir = ENCODE_FILE (Fexpand_file_name (dir, Qnil));
+
+  struct walk w = { .regexp = regexp, .predicate = predicate,
+		    .callback = callback, .found = Qnil, .ignore = Qnil,
+		    .include_directories = !NILP (include_directories),
+		    .follow_symlinks = !NILP (follow_symlinks) };
+  w.case_table = (!NILP (BVAR (current_buffer, case_fold_search))
+		  ? BVAR (current_buffer, case_canon_table) : Qnil);
+  for (Lisp_Object tail = ignore_directories; CONSP (tail);
+       tail = XCDR (tail))
+    {
+      CHECK_STRING (XCAR (tail));
+      w.ignore = Fcons (ENCODE_FILE (XCAR (tail)), w.ignore);
+    }
+
+  ptrdiff_t count = SPECPDL_INDEX ();
+  record_unwind_protect_ptr (walk_cleanup, &w);
+
+  /* On MS-Windows, reading directories isn't thread-safe, see
+     open_directory_1.  */
+#if defined THREADS_ENABLED && !defined WINDOWSNT
+  if (0 < directory_files_walk_threads)
+    {
+      sys_mutex_init (&w.mutex);
+      sys_cond_init (&w.work_cond);
+      sys_cond_init (&w.done_cond);
+      w.ntasks = min (directory_files_walk_threads, SYS_MAX_HELPERS);
+      for (int i = 0; i < w.ntasks; i++)
+	{
+	  w.tasks[i].func = walk_helper;
+	  w.tasks[i].arg = &w;
+	  sys_task_start (&w.tasks[i]);
+	}
+    }
+#endif
+
+  struct walk_dir *top = walk_new_dir (&w, "", 0, SSDATA (encoded_dir),
+				       SBYTES (encoded_dir));
+  walk_directory (&w, dir, top, true);
+
+  Lisp_Object result = Fnreverse (w.found);
+  w.found = Qnil;
+  unbind_to (count, Qnil);
+  if (NILP (callback))
+    return result;
+  if (!NILP (result))
+    call1 (callback, result);
+  return Qnil;
+}
+
 static Lisp_Object file_name_completion (Lisp_Object, Lisp_Object, bool,
 					 Lisp_Object);
 
@@ -916,6 +1891,10 @@ so last access time will always be midnight of that day.  */)
 	return call3 (handler, Qfile_attributes, filename, id_format);
     }
 
+  Lisp_Object attrs = file_cache_attributes (filename, id_format, false);
+  if (!EQ (attrs, Qt))
+    return attrs;
+
   encoded = ENCODE_FILE (filename);
   return file_attributes (AT_FDCWD, SSDATA (encoded), Qnil, filename,
 			  id_format);
@@ -1041,6 +2020,44 @@ Comparison is in lexicographic order and case is significant.  */)
 }
 
 
+DEFUN ("file-attributes-cache-clear", Ffile_attributes_cache_clear,
+       Sfile_attributes_cache_clear, 0, 0, 0,
+       doc: /* Discard all data of the file attribute cache.
+See `file-attributes-cache-ttl'.  */)
+  (void)
+{
+  if (HASH_TABLE_P (file_cache))
+    {
+      struct Lisp_Hash_Table *h = XHASH_TABLE (file_cache);
+      for (ptrdiff_t i = 0; i < HASH_TABLE_SIZE (h); i++)
+	if (!EQ (HASH_KEY (h, i), Qunbound))
+	  file_cache_release_entry (HASH_VALUE (h, i));
+      Fclrhash (file_cache);
+    }
+  file_cache_generation++;
+  return Qnil;
+}
+
+DEFUN ("file-attributes-cache-statistics", Ffile_attributes_cache_statistics,
+       Sfile_attributes_cache_statistics, 0, 0, 0,
+       doc: /* Return statistics about the file attribute cache.
+The value is a plist (:hits HITS :misses MISSES :invalidations
+INVALIDATIONS :directories DIRECTORIES).  HITS and MISSES count the
+lookups of directory listings and file attributes that found, or did
+not find, the data in the cache.  INVALIDATIONS counts the times data
+was discarded because of a change in the file system.  DIRECTORIES is
+the number of directories the cache currently knows about.
+See `file-attributes-cache-ttl'.  */)
+  (void)
+{
+  EMACS_INT directories
+    = HASH_TABLE_P (file_cache) ? XHASH_TABLE (file_cache)->count : 0;
+  return list (QChits, make_int (file_cache_hits),
+	       QCmisses, make_int (file_cache_misses),
+	       QCinvalidations, make_int (file_cache_invalidations),
+	       QCdirectories, make_int (directories));
+}
+
 DEFUN ("system-users", Fsystem_users, Ssystem_users, 0, 0, 0,
        doc: /* Return a list of user names currently registered in the system.
 If we don't know how to determine that on this platform, just
@@ -1090,13 +2107,21 @@ syms_of_dired (void)
   DEFSYM (Qfile_attributes_lessp, "file-attributes-lessp");
   DEFSYM (Qdefault_directory, "default-directory");
   DEFSYM (Qdecomposed_characters, "decomposed-characters");
+  DEFSYM (Qfile_attributes_cache, "file-attributes-cache");
+  DEFSYM (QChits, ":hits");
+  DEFSYM (QCmisses, ":misses");
+  DEFSYM (QCinvalidations, ":invalidations");
+  DEFSYM (QCdirectories, ":directories");
 
   defsubr (&Sdirectory_files);
   defsubr (&Sdirectory_files_and_attributes);
+  defsubr (&Sdirectory_files_walk);
   defsubr (&Sfile_name_completion);
   defsubr (&Sfile_name_all_completions);
   defsubr (&Sfile_attributes);
   defsubr (&Sfile_attributes_lessp);
+  defsubr (&Sfile_attributes_cache_clear);
+  defsubr (&Sfile_attributes_cache_statistics);
   defsubr (&Ssystem_users);
   defsubr (&Ssystem_groups);
 
@@ -1107,4 +2132,30 @@ these strings or when displaying a list of completions.
 It ignores directory names if they match any string in this list which
 ends in a slash.  */);
   Vcompletion_ignored_extensions = Qnil;
+
+  DEFVAR_INT ("directory-files-walk-threads", directory_files_walk_threads,
+	      doc: /* Number of helper threads for `directory-files-walk'.
+They read directories ahead of the walk.  If this is zero, or threads
+are not supported, as on MS-Windows, the walk reads each directory
+when it gets to it.  */);
+  directory_files_walk_threads = 0;
+
+  DEFVAR_LISP ("file-attributes-cache-ttl", Vfile_attributes_cache_ttl,
+	       doc: /* Maximum age in seconds of cached file attributes, or nil.
+If this is a number, `directory-files', `directory-files-and-attributes',
+`file-attributes', `file-exists-p' and `file-directory-p' cache what
+they find out about local directories, and answer from the cache when
+asked again.  Cached data is discarded when file notification reports
+a change of the directory, when Emacs changes a file in it, and when it
+is older than this many seconds.  Directories that file notification
+cannot watch, such as those under /proc, are not cached.  For those on
+network file systems, whose changes made elsewhere file notification
+misses, and if file notification is not available at all, only the
+age limits the use of the cache.
+
+If this is nil, the default, nothing is cached.  */);
+  Vfile_attributes_cache_ttl = Qnil;
+
+  file_cache = Qnil;
+  staticpro (&file_cache);
 }
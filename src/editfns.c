@@ -40,6 +40,7 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include <math.h>
 
 #include <c-ctype.h>
+#include <flexmember.h>
 #include <intprops.h>
 #include <stdlib.h>
 #include <verify.h>
@@ -782,7 +783,8 @@ void
 save_excursion_save (union specbinding *pdl)
 {
   eassert (pdl->unwind_excursion.kind == SPECPDL_UNWIND_EXCURSION);
-  pdl->unwind_excursion.marker = Fpoint_marker ();
+  pdl->unwind_excursion.marker
+    = make_recyclable_marker (current_buffer, PT, PT_BYTE);
   /* Selected window if current buffer is shown in it, nil otherwise.  */
   pdl->unwind_excursion.window
     = (EQ (XWINDOW (selected_window)->contents, Fcurrent_buffer ())
@@ -798,13 +800,16 @@ save_excursion_restore (Lisp_Object marker, Lisp_Object window)
   /* If we're unwinding to top level, saved buffer may be deleted.  This
      means that all of its markers are unchained and so BUFFER is nil.  */
   if (NILP (buffer))
-    return;
+    {
+      recycle_marker (marker);
+      return;
+    }
 
   Fset_buffer (buffer);
 
   /* Point marker.  */
   Fgoto_char (marker);
-  unchain_marker (XMARKER (marker));
+  recycle_marker (marker);
 
   /* If buffer was visible in a window, and a different window was
      selected, and the old selected window is still showing this
@@ -1953,6 +1958,288 @@ static bool compareseq_early_abort (struct context *);
 #include "minmax.h"
 #include "diffseq.h"
 
+/* Before diffing characters, replace-buffer-contents diffs lines with
+   the histogram algorithm, and then diffs characters only within the
+   runs of lines that differ.  */
+
+/* The lines of the accessible portion of a buffer.  */
+
+struct diff_lines
+{
+  /* A copy of the text.  */
+  unsigned char *text;
+
+  /* The number of lines, and for each line and the end, its offset in
+     TEXT and in characters.  The last line may lack a newline.  */
+  ptrdiff_t nlines;
+  ptrdiff_t *byte, *chr;
+
+  /* For each line, the hash of its text.  */
+  EMACS_UINT *hash;
+};
+
+/* Set up L for the accessible portion of buffer B.  The memory is
+   freed on unwinding.  */
+
+static void
+diff_lines_init (struct diff_lines *l, struct buffer *b)
+{
+  ptrdiff_t beg = BUF_BEGV_BYTE (b), gpt = BUF_GPT_BYTE (b);
+  ptrdiff_t end = BUF_ZV_BYTE (b);
+  ptrdiff_t nbytes = end - beg;
+  l->text = xmalloc (nbytes + 1);
+  record_unwind_protect_ptr (xfree, l->text);
+  if (beg < gpt && gpt < end)
+    {
+      memcpy (l->text, BUF_BYTE_ADDRESS (b, beg), gpt - beg);
+      memcpy (l->text + (gpt - beg), BUF_BYTE_ADDRESS (b, gpt), end - gpt);
+    }
+  else
+    memcpy (l->text, BUF_BYTE_ADDRESS (b, beg), nbytes);
+
+  ptrdiff_t nlines = 0;
+  for (unsigned char *p = l->text, *lim = p + nbytes;
+       (p = memchr (p, '\n', lim - p)); p++)
+    nlines++;
+  if (nbytes != 0 && l->text[nbytes - 1] != '\n')
+    nlines++;
+
+  l->nlines = nlines;
+  l->byte = xnmalloc (nlines + 1, 2 * sizeof *l->byte + sizeof *l->hash);
+  record_unwind_protect_ptr (xfree, l->byte);
+  l->chr = l->byte + nlines + 1;
+  l->hash = (EMACS_UINT *) (l->chr + nlines + 1);
+
+  bool multibyte = !NILP (BVAR (b, enable_multibyte_characters));
+  ptrdiff_t pos = 0, chr = 0;
+  for (ptrdiff_t i = 0; i < nlines; i++)
+    {
+      unsigned char *nl = memchr (l->text + pos, '\n', nbytes - pos);
+      ptrdiff_t next = nl ? nl - l->text + 1 : nbytes;
+      l->byte[i] = pos;
+      l->chr[i] = chr;
+      l->hash[i] = hash_string ((char *) l->text + pos, next - pos);
+      if (multibyte)
+	for (; pos < next; pos++)
+	  chr += CHAR_HEAD_P (l->text[pos]);
+      else
+	chr += next - pos;
+      pos = next;
+    }
+  l->byte[nlines] = nbytes;
+  l->chr[nlines] = chr;
+}
+
+/* Return true if line I of L and line J of M are equal.  */
+
+static bool
+diff_lines_equal (struct diff_lines const *l, ptrdiff_t i,
+		  struct diff_lines const *m, ptrdiff_t j)
+{
+  ptrdiff_t len = l->byte[i + 1] - l->byte[i];
+  return (l->hash[i] == m->hash[j]
+	  && len == m->byte[j + 1] - m->byte[j]
+	  && memcmp (l->text + l->byte[i], m->text + m->byte[j], len) == 0);
+}
+
+/* Lines that occur more often than this in a range are not used as
+   anchors of the histogram diff.  */
+enum { DIFF_MAX_CHAIN = 64 };
+
+/* The state of a histogram diff of the lines of A and B.  */
+
+struct diff_histogram
+{
+  struct diff_lines const *a, *b;
+
+  /* For each line of A, the line of B that it matches, or -1; and the
+     other way round.  */
+  ptrdiff_t *match_a, *match_b;
+
+  /* A hash table of the distinct lines of a range of A, with as many
+     buckets as lines.  Bucket H holds the first record with a hash of
+     H modulo the number of buckets, plus one, or zero.  Each record
+     has the last line of the range with its text, the number of such
+     lines, and the next record of its bucket.  SAME_A links each line
+     of A to the previous one with the same text in the range, or -1.  */
+  ptrdiff_t *buckets;
+  ptrdiff_t *rec_line, *rec_count, *rec_next;
+  ptrdiff_t *same_a;
+
+  /* The ranges that remain to be diffed, four offsets each.  */
+  ptrdiff_t *stack, nstack, stack_alloc;
+};
+
+static void
+diff_histogram_push (struct diff_histogram *h, ptrdiff_t a0, ptrdiff_t a1,
+		     ptrdiff_t b0, ptrdiff_t b1)
+{
+  if (a0 == a1 || b0 == b1)
+    return;
+  if (h->stack_alloc - h->nstack < 4)
+    h->stack = xpalloc (h->stack, &h->stack_alloc, 4, -1, sizeof *h->stack);
+  ptrdiff_t *p = h->stack + h->nstack;
+  p[0] = a0, p[1] = a1, p[2] = b0, p[3] = b1;
+  h->nstack += 4;
+}
+
+static void
+diff_histogram_match (struct diff_histogram *h, ptrdiff_t i, ptrdiff_t j)
+{
+  h->match_a[i] = j;
+  h->match_b[j] = i;
+}
+
+/* Diff the lines A0 to A1 of A with the lines B0 to B1 of B: match
+   their common prefix and suffix, and then the longest run of equal
+   lines around the line of B0 to B1 that is the rarest in A0 to A1.
+   Push the ranges around that run for diffing in turn.  */
+
+static void
+diff_histogram_range (struct diff_histogram *h, ptrdiff_t a0, ptrdiff_t a1,
+		      ptrdiff_t b0, ptrdiff_t b1)
+{
+  struct diff_lines const *a = h->a, *b = h->b;
+  for (; a0 < a1 && b0 < b1 && diff_lines_equal (a, a0, b, b0); a0++, b0++)
+    diff_histogram_match (h, a0, b0);
+  for (; a0 < a1 && b0 < b1 && diff_lines_equal (a, a1 - 1, b, b1 - 1);
+       a1--, b1--)
+    diff_histogram_match (h, a1 - 1, b1 - 1);
+  if (a0 == a1 || b0 == b1)
+    return;
+
+  /* Make the histogram of A0 to A1.  */
+  ptrdiff_t nbuckets = a1 - a0;
+  memclear (h->buckets, nbuckets * sizeof *h->buckets);
+  ptrdiff_t nrecs = 0;
+  for (ptrdiff_t i = a0; i < a1; i++)
+    {
+      ptrdiff_t *bucket = &h->buckets[a->hash[i] % nbuckets];
+      ptrdiff_t r = *bucket - 1;
+      while (0 <= r && !diff_lines_equal (a, h->rec_line[r], a, i))
+	r = h->rec_next[r];
+      if (r < 0)
+	{
+	  r = nrecs++;
+	  h->rec_count[r] = 0;
+	  h->rec_next[r] = *bucket - 1;
+	  *bucket = r + 1;
+	  h->same_a[i] = -1;
+	}
+      else
+	h->same_a[i] = h->rec_line[r];
+      h->rec_line[r] = i;
+      h->rec_count[r]++;
+    }
+
+  /* Find the best run of equal lines.  */
+  ptrdiff_t best_count = DIFF_MAX_CHAIN + 1, best_len = 0;
+  ptrdiff_t best_a = 0, best_b = 0;
+  for (ptrdiff_t j = b0; j < b1; )
+    {
+      ptrdiff_t next = j + 1;
+      ptrdiff_t r = h->buckets[b->hash[j] % nbuckets] - 1;
+      while (0 <= r && !diff_lines_equal (a, h->rec_line[r], b, j))
+	r = h->rec_next[r];
+      if (0 <= r && h->rec_count[r] <= best_count)
+	for (ptrdiff_t i = h->rec_line[r]; 0 <= i; i = h->same_a[i])
+	  {
+	    ptrdiff_t as = i, bs = j, ae = i + 1, be = j + 1;
+	    while (a0 < as && b0 < bs && diff_lines_equal (a, as - 1, b, bs - 1))
+	      as--, bs--;
+	    while (ae < a1 && be < b1 && diff_lines_equal (a, ae, b, be))
+	      ae++, be++;
+	    next = max (next, be);
+	    if (h->rec_count[r] < best_count || best_len < ae - as)
+	      {
+		best_count = h->rec_count[r];
+		best_len = ae - as;
+		best_a = as;
+		best_b = bs;
+	      }
+	  }
+      j = next;
+    }
+
+  /* Without such a run, the whole range is left to the character
+     diff.  */
+  if (best_len == 0)
+    return;
+  for (ptrdiff_t k = 0; k < best_len; k++)
+    diff_histogram_match (h, best_a + k, best_b + k);
+  diff_histogram_push (h, a0, best_a, b0, best_b);
+  diff_histogram_push (h, best_a + best_len, a1, best_b + best_len, b1);
+}
+
+/* Diff the characters of CTX, which are the accessible portions of its
+   buffers, as compareseq does, except that only the parts that differ
+   according to a histogram diff of their lines are diffed character
+   by character.  Return true if the diff was given up.  */
+
+static bool
+diff_by_lines (struct context *ctx)
+{
+  struct buffer *a = ctx->buffer_a, *b = ctx->buffer_b;
+  ptrdiff_t size_a = BUF_ZV (a) - ctx->beg_a, size_b = BUF_ZV (b) - ctx->beg_b;
+
+  /* Lines can be compared by their bytes only if the buffers are
+     alike.  */
+  if (NILP (BVAR (a, enable_multibyte_characters))
+      != NILP (BVAR (b, enable_multibyte_characters)))
+    return compareseq (0, size_a, 0, size_b, false, ctx);
+
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct diff_lines la, lb;
+  diff_lines_init (&la, a);
+  diff_lines_init (&lb, b);
+  ptrdiff_t na = la.nlines, nb = lb.nlines;
+
+  struct diff_histogram h = { .a = &la, .b = &lb };
+  h.match_a = xnmalloc (na + nb + 5 * max (na, 1), sizeof *h.match_a);
+  record_unwind_protect_ptr (xfree, h.match_a);
+  h.match_b = h.match_a + na;
+  h.buckets = h.match_b + nb;
+  h.rec_line = h.buckets + max (na, 1);
+  h.rec_count = h.rec_line + max (na, 1);
+  h.rec_next = h.rec_count + max (na, 1);
+  h.same_a = h.rec_next + max (na, 1);
+  for (ptrdiff_t i = 0; i < na + nb; i++)
+    h.match_a[i] = -1;
+  record_unwind_protect_ptr (xfree, NULL);
+  ptrdiff_t stack_count = SPECPDL_INDEX () - 1;
+
+  diff_histogram_push (&h, 0, na, 0, nb);
+  while (h.nstack != 0)
+    {
+      h.nstack -= 4;
+      ptrdiff_t *p = h.stack + h.nstack;
+      diff_histogram_range (&h, p[0], p[1], p[2], p[3]);
+      set_unwind_protect_ptr (stack_count, xfree, h.stack);
+      maybe_quit ();
+    }
+
+  /* Diff the characters of each run of lines that did not match.  */
+  bool early_abort = false;
+  for (ptrdiff_t i = 0, j = 0; !early_abort && (i < na || j < nb); )
+    {
+      if (i < na && j < nb && h.match_a[i] == j)
+	{
+	  i++, j++;
+	  continue;
+	}
+      ptrdiff_t i0 = i, j0 = j;
+      while (i < na && h.match_a[i] < 0)
+	i++;
+      while (j < nb && h.match_b[j] < 0)
+	j++;
+      early_abort = compareseq (la.chr[i0], la.chr[i], lb.chr[j0], lb.chr[j],
+				false, ctx);
+    }
+
+  unbind_to (count, Qnil);
+  return early_abort;
+}
+
 DEFUN ("replace-buffer-contents", Freplace_buffer_contents,
        Sreplace_buffer_contents, 1, 3, "bSource buffer: ",
        doc: /* Replace accessible portion of current buffer with that of SOURCE.
@@ -2075,7 +2362,7 @@ nil.  */)
      later.  */
   bool early_abort;
   if (! sys_setjmp (ctx.jmp))
-    early_abort = compareseq (0, size_a, 0, size_b, false, &ctx);
+    early_abort = diff_by_lines (&ctx);
   else
     early_abort = true;
 
@@ -2741,8 +3028,8 @@ save_restriction_save (void)
     {
       Lisp_Object beg, end;
 
-      beg = build_marker (current_buffer, BEGV, BEGV_BYTE);
-      end = build_marker (current_buffer, ZV, ZV_BYTE);
+      beg = make_recyclable_marker (current_buffer, BEGV, BEGV_BYTE);
+      end = make_recyclable_marker (current_buffer, ZV, ZV_BYTE);
 
       /* END must move forward if text is inserted at its exact location.  */
       XMARKER (end)->insertion_type = 1;
@@ -2776,27 +3063,30 @@ save_restriction_restore (Lisp_Object data)
       eassert (buf == end->buffer);
 
       if (buf /* Verify marker still points to a buffer.  */
-	  && (beg->charpos != BUF_BEGV (buf) || end->charpos != BUF_ZV (buf)))
+	  && (marker_charpos (beg) != BUF_BEGV (buf)
+	      || marker_charpos (end) != BUF_ZV (buf)))
 	/* The restriction has changed from the saved one, so restore
 	   the saved restriction.  */
 	{
 	  ptrdiff_t pt = BUF_PT (buf);
 
-	  SET_BUF_BEGV_BOTH (buf, beg->charpos, beg->bytepos);
-	  SET_BUF_ZV_BOTH (buf, end->charpos, end->bytepos);
+	  SET_BUF_BEGV_BOTH (buf, marker_charpos (beg), marker_bytepos (beg));
+	  SET_BUF_ZV_BOTH (buf, marker_charpos (end), marker_bytepos (end));
 
-	  if (pt < beg->charpos || pt > end->charpos)
+	  if (pt < marker_charpos (beg) || pt > marker_charpos (end))
 	    /* The point is outside the new visible range, move it inside. */
 	    SET_BUF_PT_BOTH (buf,
-			     clip_to_bounds (beg->charpos, pt, end->charpos),
-			     clip_to_bounds (beg->bytepos, BUF_PT_BYTE (buf),
-					     end->bytepos));
+			     clip_to_bounds (marker_charpos (beg), pt,
+					     marker_charpos (end)),
+			     clip_to_bounds (marker_bytepos (beg),
+					     BUF_PT_BYTE (buf),
+					     marker_bytepos (end)));
 
 	  buf->clip_changed = 1; /* Remember that the narrowing changed. */
 	}
-      /* Detach the markers, and free the cons instead of waiting for GC.  */
-      detach_marker (XCAR (data));
-      detach_marker (XCDR (data));
+      /* Recycle the markers, and free the cons instead of waiting for GC.  */
+      recycle_marker (XCAR (data));
+      recycle_marker (XCDR (data));
       free_cons (XCONS (data));
     }
   else
@@ -3009,6 +3299,342 @@ str2num (char *str, char **str_end)
   return n;
 }
 
+/* Format strings that are used over and over again are compiled into
+   a list of directives, which are cached, so that formatting with
+   them skips parsing and writes the result string directly.  This
+   covers format strings without text properties whose text is ASCII
+   and whose directives are %s, %S, %d, %c and %%, with no flags other
+   than - and 0, and no field numbers or precisions.  Anything else is
+   left to the general code in styled_format.  */
+
+enum
+  {
+    /* The number of cached format strings.  This is prime, as the
+       low bits of hash_string depend only on the last bytes.  */
+    FORMAT_CACHE_SIZE = 67,
+
+    /* The maximum number of directives of a compiled format.  */
+    FORMAT_DIRECTIVES_MAX = 16,
+
+    /* The maximum field width of a compiled format.  */
+    FORMAT_WIDTH_MAX = 1000
+  };
+
+/* A directive of a compiled format, with the text that precedes it.  */
+
+struct format_directive
+{
+  /* The start and end bytepos of the text in the format string.  */
+  ptrdiff_t beg, end;
+
+  /* The field width, or 0.  */
+  short width;
+
+  /* The conversion character.  */
+  char conversion;
+
+  bool_bf minus_flag : 1;
+  bool_bf zero_flag : 1;
+};
+
+struct format_spec
+{
+  /* The number of directives, or -1 if the format string is left to
+     styled_format.  */
+  int ndirectives;
+
+  /* The number of arguments used by the directives.  */
+  int nargs;
+
+  /* Whether the format string is multibyte.  */
+  bool_bf multibyte : 1;
+
+  /* Whether the format string contains grave accents or apostrophes,
+     which format-message might requote.  */
+  bool_bf quotes : 1;
+
+  /* The directives, and the start of the text after the last one.  */
+  struct format_directive directive[FORMAT_DIRECTIVES_MAX];
+  ptrdiff_t tail;
+
+  /* A copy of the format string, with its terminating null byte.  */
+  ptrdiff_t nbytes;
+  char text[FLEXIBLE_ARRAY_MEMBER];
+};
+
+/* The compiled formats, by the hash of their text.  The text, not the
+   string object, is the key, as C code formats with strings on the
+   stack, and Lisp code can modify strings.  */
+static struct format_spec *format_cache[FORMAT_CACHE_SIZE];
+
+/* Compile the format string FORMAT.  */
+
+static struct format_spec *
+format_compile (Lisp_Object format)
+{
+  ptrdiff_t nbytes = SBYTES (format);
+  struct format_spec *spec = xmalloc (FLEXSIZEOF (struct format_spec,
+						  text, nbytes + 1));
+  spec->ndirectives = spec->nargs = 0;
+  spec->multibyte = STRING_MULTIBYTE (format);
+  spec->quotes = false;
+  spec->nbytes = nbytes;
+  memcpy (spec->text, SDATA (format), nbytes + 1);
+
+  char *text = spec->text, *end = text + nbytes;
+  ptrdiff_t beg = 0;
+  for (char *p = text; p != end; )
+    {
+      unsigned char c = *p++;
+      if (!ASCII_CHAR_P (c))
+	goto fail;
+      spec->quotes |= c == '`' || c == '\'';
+      if (c != '%')
+	continue;
+      if (spec->ndirectives == FORMAT_DIRECTIVES_MAX)
+	goto fail;
+
+      struct format_directive *d = &spec->directive[spec->ndirectives++];
+      d->beg = beg;
+      d->end = p - 1 - text;
+      d->minus_flag = d->zero_flag = false;
+      for (; p != end && (*p == '-' || *p == '0'); p++)
+	if (*p == '-')
+	  d->minus_flag = true;
+	else
+	  d->zero_flag = true;
+      char *num_end;
+      ptrdiff_t width = str2num (p, &num_end);
+      p = num_end;
+      if (p == end || FORMAT_WIDTH_MAX < width)
+	goto fail;
+      d->width = width;
+      d->conversion = *p++;
+      d->zero_flag &= !d->minus_flag && d->conversion == 'd';
+      switch (d->conversion)
+	{
+	case 's': case 'S': case 'd': case 'c':
+	  spec->nargs++;
+	  break;
+	case '%':
+	  break;
+	default:
+	  goto fail;
+	}
+      beg = p - text;
+    }
+  spec->tail = beg;
+  return spec;
+
+ fail:
+  spec->ndirectives = -1;
+  return spec;
+}
+
+/* Return the compiled form of the format string FORMAT, or NULL if
+   it is left to styled_format.  */
+
+static struct format_spec *
+format_lookup (Lisp_Object format)
+{
+  if (string_intervals (format))
+    return NULL;
+  ptrdiff_t i = (hash_string (SSDATA (format), SBYTES (format))
+		 % FORMAT_CACHE_SIZE);
+  struct format_spec *spec = format_cache[i];
+  if (! (spec && spec->nbytes == SBYTES (format)
+	 && spec->multibyte == STRING_MULTIBYTE (format)
+	 && memcmp (spec->text, SDATA (format), spec->nbytes) == 0))
+    {
+      xfree (spec);
+      spec = format_cache[i] = format_compile (format);
+    }
+  return spec->ndirectives < 0 ? NULL : spec;
+}
+
+/* Return the number of bytes of the decimal representation of N.  */
+
+static int
+format_digits (EMACS_INT n)
+{
+  int len = n < 0;
+  do
+    len++;
+  while ((n /= 10) != 0);
+  return len;
+}
+
+/* Store in *VAL the result of formatting the NARGS arguments ARGS
+   with the format string ARGS[0] as `format-message' does if MESSAGE
+   is true, and `format' otherwise, if the format string is compiled
+   and fits the arguments.  Return true if it did.  */
+
+static bool
+format_cached (ptrdiff_t nargs, Lisp_Object *args, bool message,
+	       Lisp_Object *val)
+{
+  if (!STRINGP (args[0]))
+    return false;
+  struct format_spec *spec = format_lookup (args[0]);
+  if (!spec || nargs <= spec->nargs
+      || (message && spec->quotes
+	  && text_quoting_style () != GRAVE_QUOTING_STYLE))
+    return false;
+  if (spec->ndirectives == 0)
+    {
+      *val = args[0];
+      return true;
+    }
+
+  /* Converting arguments might run Lisp code that uses the cache, so
+     copy the compiled format.  */
+  int ndirectives = spec->ndirectives;
+  struct format_directive directive[FORMAT_DIRECTIVES_MAX];
+  memcpy (directive, spec->directive, ndirectives * sizeof *directive);
+  ptrdiff_t tail = spec->tail, formatbytes = spec->nbytes;
+
+  /* Check the arguments of numeric directives before converting any
+     argument.  */
+  for (int i = 0, n = 1; i < ndirectives; i++)
+    {
+      Lisp_Object arg = args[n];
+      switch (directive[i].conversion)
+	{
+	case '%':
+	  continue;
+	case 'd':
+	  if (!FIXNUMP (arg))
+	    return false;
+	  break;
+	case 'c':
+	  if (! (FIXNUMP (arg) && ASCII_CHAR_P (XFIXNUM (arg))))
+	    return false;
+	  break;
+	}
+      n++;
+    }
+
+  /* Convert the arguments of %s and %S to strings, unless they are
+     numbers.  */
+  bool multibyte = spec->multibyte;
+  for (ptrdiff_t i = 1; !multibyte && i < nargs; i++)
+    if (STRINGP (args[i]) && STRING_MULTIBYTE (args[i]))
+      multibyte = true;
+  Lisp_Object strings[FORMAT_DIRECTIVES_MAX];
+  for (int i = 0, n = 1; i < ndirectives; i++)
+    {
+      char conversion = directive[i].conversion;
+      Lisp_Object arg = conversion == '%' ? Qnil : args[n++];
+      if ((conversion == 's' || conversion == 'S') && !FIXNUMP (arg))
+	{
+	  if (conversion == 's' && SYMBOLP (arg))
+	    arg = SYMBOL_NAME (arg);
+	  else if (! (conversion == 's' && STRINGP (arg)))
+	    arg = Fprin1_to_string (arg, conversion == 's' ? Qt : Qnil);
+
+	  /* Strings with text properties, and multibyte strings that do
+	     not start with a whole character, which might combine with
+	     what precedes them, are left to styled_format.  */
+	  if (string_intervals (arg)
+	      || (STRING_MULTIBYTE (arg) && SBYTES (arg) != 0
+		  && !CHAR_HEAD_P (SREF (arg, 0))))
+	    return false;
+	  multibyte |= STRING_MULTIBYTE (arg);
+	}
+      strings[i] = arg;
+    }
+  if (SBYTES (args[0]) != formatbytes)
+    return false;
+
+  /* Add up the size of the result.  */
+  ptrdiff_t padding[FORMAT_DIRECTIVES_MAX];
+  ptrdiff_t nchars = formatbytes - tail, nbytes = formatbytes - tail;
+  for (int i = 0; i < ndirectives; i++)
+    {
+      struct format_directive *d = &directive[i];
+      Lisp_Object arg = strings[i];
+      ptrdiff_t argchars, argbytes, width;
+      if (d->conversion == 'c' || d->conversion == '%')
+	width = argchars = argbytes = 1;
+      else if (FIXNUMP (arg))
+	width = argchars = argbytes = format_digits (XFIXNUM (arg));
+      else
+	{
+	  argchars = SCHARS (arg);
+	  argbytes = (multibyte && !STRING_MULTIBYTE (arg)
+		      ? count_size_as_multibyte (SDATA (arg), SBYTES (arg))
+		      : SBYTES (arg));
+	  width = d->width ? lisp_string_width (arg, -1, NULL, NULL) : 0;
+	}
+      padding[i] = (d->conversion != '%' && width < d->width
+		    ? d->width - width : 0);
+      nchars += d->end - d->beg + argchars + padding[i];
+      nbytes += d->end - d->beg + argbytes + padding[i];
+    }
+
+  /* Write the result.  */
+  *val = (multibyte ? make_uninit_multibyte_string (nchars, nbytes)
+	  : make_uninit_string (nbytes));
+  unsigned char *format = SDATA (args[0]), *p = SDATA (*val);
+  for (int i = 0; i < ndirectives; i++)
+    {
+      struct format_directive *d = &directive[i];
+      memcpy (p, format + d->beg, d->end - d->beg);
+      p += d->end - d->beg;
+      if (d->conversion == '%')
+	{
+	  *p++ = '%';
+	  continue;
+	}
+
+      Lisp_Object arg = strings[i];
+      char numbuf[INT_BUFSIZE_BOUND (EMACS_INT)];
+      char const *src = numbuf;
+      ptrdiff_t srcbytes;
+      bool src_multibyte = false;
+      if (d->conversion == 'c')
+	{
+	  numbuf[0] = XFIXNUM (arg);
+	  srcbytes = 1;
+	}
+      else if (FIXNUMP (arg))
+	srcbytes = sprintf (numbuf, "%"pI"d", XFIXNUM (arg));
+      else
+	{
+	  src = SSDATA (arg);
+	  srcbytes = SBYTES (arg);
+	  src_multibyte = STRING_MULTIBYTE (arg);
+	}
+
+      if (d->zero_flag)
+	{
+	  /* Put the zeros after the sign.  */
+	  if (*src == '-')
+	    {
+	      *p++ = *src++;
+	      srcbytes--;
+	    }
+	  memset (p, '0', padding[i]);
+	  p += padding[i];
+	}
+      else if (!d->minus_flag)
+	{
+	  memset (p, ' ', padding[i]);
+	  p += padding[i];
+	}
+      p += copy_text ((unsigned char const *) src, p, srcbytes,
+		      src_multibyte, multibyte);
+      if (d->minus_flag)
+	{
+	  memset (p, ' ', padding[i]);
+	  p += padding[i];
+	}
+    }
+  memcpy (p, format + tail, formatbytes - tail);
+  eassert (p + formatbytes - tail == SDATA (*val) + nbytes);
+  return true;
+}
+
 DEFUN ("format", Fformat, Sformat, 1, MANY, 0,
        doc: /* Format a string out of a format-string and arguments.
 The first argument is a format control string.
@@ -3106,6 +3732,10 @@ usage: (format-message STRING &rest OBJECTS)  */)
 static Lisp_Object
 styled_format (ptrdiff_t nargs, Lisp_Object *args, bool message)
 {
+  Lisp_Object cached;
+  if (format_cached (nargs, args, message, &cached))
+    return cached;
+
   enum
   {
    /* Maximum precision for a %f conversion such that the trailing
@@ -4064,6 +4694,19 @@ Case is ignored if `case-fold-search' is non-nil in the current buffer.  */)
   return (downcase (i1) == downcase (i2) ? Qt :  Qnil);
 }
 
+/* Reverse the order of the N markers in V.  */
+
+static void
+reverse_markers (struct Lisp_Marker **v, ptrdiff_t n)
+{
+  for (ptrdiff_t i = 0; i < n / 2; i++)
+    {
+      struct Lisp_Marker *tem = v[i];
+      v[i] = v[n - 1 - i];
+      v[n - 1 - i] = tem;
+    }
+}
+
 /* Transpose the markers in two regions of the current buffer, and
    adjust the ones between them if necessary (i.e.: if the regions
    differ in size).
@@ -4073,7 +4716,7 @@ Case is ignored if `case-fold-search' is non-nil in the current buffer.  */)
    START2, END2 are the character positions of the second region.
    START2_BYTE, END2_BYTE are the byte positions.
 
-   Traverses the entire marker list of the buffer to do so, adding an
+   Traverses the markers from START1 to END2 to do so, adding an
    appropriate amount to some, subtracting from some, and leaving the
    rest untouched.  Most of this is copied from adjust_markers in insdel.c.
 
@@ -4121,31 +4764,44 @@ transpose_markers (ptrdiff_t start1, ptrdiff_t end1,
   amt1_byte = (end2_byte - start2_byte) + (start2_byte - end1_byte);
   amt2_byte = (end1_byte - start1_byte) + (start2_byte - end1_byte);
 
-  for (marker = BUF_MARKERS (current_buffer); marker; marker = marker->next)
+  /* Only the markers from START1 to END2 move; make their positions
+     absolute so we can change them directly.  */
+  ptrdiff_t from = marker_index_from (current_buffer, start1);
+  ptrdiff_t mid1 = marker_index_from (current_buffer, end1);
+  ptrdiff_t mid2 = marker_index_from (current_buffer, start2);
+  ptrdiff_t to = marker_index_from (current_buffer, end2);
+  struct Lisp_Marker **markers;
+
+  move_marker_gap (current_buffer, to);
+  markers = current_buffer->text->markers;
+
+  for (ptrdiff_t i = from; i < to; i++)
     {
-      mpos = marker->bytepos;
-      if (mpos >= start1_byte && mpos < end2_byte)
-	{
-	  if (mpos < end1_byte)
-	    mpos += amt1_byte;
-	  else if (mpos < start2_byte)
-	    mpos += diff_byte;
-	  else
-	    mpos -= amt2_byte;
-	  marker->bytepos = mpos;
-	}
-      mpos = marker->charpos;
-      if (mpos >= start1 && mpos < end2)
-	{
-	  if (mpos < end1)
-	    mpos += amt1;
-	  else if (mpos < start2)
-	    mpos += diff;
-	  else
-	    mpos -= amt2;
-	}
-      marker->charpos = mpos;
+      marker = markers[i];
+      mpos = marker->bytepos_;
+      if (mpos < end1_byte)
+	mpos += amt1_byte;
+      else if (mpos < start2_byte)
+	mpos += diff_byte;
+      else
+	mpos -= amt2_byte;
+      marker->bytepos_ = mpos;
+      mpos = marker->charpos_;
+      if (mpos < end1)
+	mpos += amt1;
+      else if (mpos < start2)
+	mpos += diff;
+      else
+	mpos -= amt2;
+      marker->charpos_ = mpos;
     }
+
+  /* The markers of the first region now come last and those of the
+     second region first; swap them around in the marker index too.  */
+  reverse_markers (markers + from, to - from);
+  reverse_markers (markers + from, to - mid2);
+  reverse_markers (markers + from + (to - mid2), mid2 - mid1);
+  reverse_markers (markers + to - (mid1 - from), mid1 - from);
 }
 
 DEFUN ("transpose-regions", Ftranspose_regions, Stranspose_regions, 4, 5,
@@ -3310,7 +3310,13 @@ specbind (Lisp_Object symbol, Lisp_Object value)
     case SYMBOL_LOCALIZED:
     case SYMBOL_FORWARDED:
       {
-	Lisp_Object ovalue = find_symbol_value (symbol);
+	/* Binding the undo list to t, as `with-silent-modifications'
+	   does, needn't make its compact log list elements.  */
+	Lisp_Object ovalue
+	  = (EQ (symbol, Qbuffer_undo_list) && EQ (value, Qt)
+	     && suspend_undo_log (SPECPDL_INDEX ())
+	     ? BVAR (current_buffer, undo_list)
+	     : find_symbol_value (symbol));
 	specpdl_ptr->let.kind = SPECPDL_LET_LOCAL;
 	specpdl_ptr->let.symbol = symbol;
 	specpdl_ptr->let.old_value = ovalue;
@@ -3498,6 +3504,8 @@ do_one_unbind (union specbinding *this_binding, bool unwinding,
 	   buffer, but only if that buffer's binding still exists.  */
 	if (!NILP (Flocal_variable_p (symbol, where)))
           set_internal (symbol, old_value, where, bindflag);
+	if (bindflag == SET_INTERNAL_UNBIND && EQ (symbol, Qbuffer_undo_list))
+	  resume_undo_log (XBUFFER (where), SPECPDL_INDEX ());
       }
       break;
     }
@@ -20,6 +20,7 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include <config.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include "sysstdio.h"
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -108,6 +109,9 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #endif
 
 #include "commands.h"
+#include "keyboard.h"
+#include "process.h"
+#include "termhooks.h"
 
 /* True during writing of auto-save files.  */
 static bool auto_saving;
@@ -713,6 +717,7 @@ This function does not grok magic file names.  */)
       ptrdiff_t count = SPECPDL_INDEX ();
       record_unwind_protect_int (close_file_unwind, fd);
       val = DECODE_FILE (val);
+      file_cache_forget (val);
       if (STRINGP (text) && SBYTES (text) != 0)
 	write_region (text, Qnil, val, Qnil, Qnil, Qnil, Qnil, fd);
       failed = NILP (dir_flag) && emacs_close (fd) != 0;
@@ -2275,6 +2280,7 @@ permissions.  */)
   /* Discard the unwind protects.  */
   specpdl_ptr = specpdl + count;
 
+  file_cache_forget (newname);
   return Qnil;
 }
 
@@ -2300,6 +2306,7 @@ DEFUN ("make-directory-internal", Fmake_directory_internal,
 
   if (mkdir (dir, 0777 & ~auto_saving_dir_umask) != 0)
     report_file_error ("Creating directory", directory);
+  file_cache_forget (directory);
 
   return Qnil;
 }
@@ -2319,6 +2326,7 @@ DEFUN ("delete-directory-internal", Fdelete_directory_internal,
 
   if (rmdir (dir) != 0)
     report_file_error ("Removing directory", directory);
+  file_cache_forget (directory);
 
   return Qnil;
 }
@@ -2359,6 +2367,7 @@ With a prefix argument, TRASH is nil.  */)
 
   if (unlink (SSDATA (encoded_file)) != 0 && errno != ENOENT)
     report_file_error ("Removing old name", filename);
+  file_cache_forget (filename);
   return Qnil;
 }
 
@@ -2539,6 +2548,8 @@ This is what happens in interactive use with M-x.  */)
 
   if (plain_rename)
     {
+      file_cache_forget (file);
+      file_cache_forget (newname);
       if (rename (SSDATA (encoded_file), SSDATA (encoded_newname)) == 0)
 	return Qnil;
       rename_errno = errno;
@@ -2617,6 +2628,7 @@ This is what happens in interactive use with M-x.  */)
   encoded_file = ENCODE_FILE (file);
   encoded_newname = ENCODE_FILE (newname);
 
+  file_cache_forget (newname);
   if (link (SSDATA (encoded_file), SSDATA (encoded_newname)) == 0)
     return Qnil;
 
@@ -2626,6 +2638,7 @@ This is what happens in interactive use with M-x.  */)
 	  || FIXNUMP (ok_if_already_exists))
 	barf_or_query_if_file_exists (newname, true, "make it a new name",
 				      FIXNUMP (ok_if_already_exists), false);
+      file_cache_forget (newname);
       unlink (SSDATA (newname));
       if (link (SSDATA (encoded_file), SSDATA (encoded_newname)) == 0)
 	return Qnil;
@@ -2670,6 +2683,7 @@ This happens for interactive use with M-x.  */)
   encoded_target = ENCODE_FILE (target);
   encoded_linkname = ENCODE_FILE (linkname);
 
+  file_cache_forget (linkname);
   if (symlink (SSDATA (encoded_target), SSDATA (encoded_linkname)) == 0)
     return Qnil;
 
@@ -2683,6 +2697,7 @@ This happens for interactive use with M-x.  */)
 	  || FIXNUMP (ok_if_already_exists))
 	barf_or_query_if_file_exists (linkname, true, "make it a link",
 				      FIXNUMP (ok_if_already_exists), false);
+      file_cache_forget (linkname);
       unlink (SSDATA (encoded_linkname));
       if (symlink (SSDATA (encoded_target), SSDATA (encoded_linkname)) == 0)
 	return Qnil;
@@ -2731,6 +2746,20 @@ check_file_access (Lisp_Object file, Lisp_Object operation, int amode)
       return ok;
     }
 
+  if (amode == F_OK)
+    {
+      /* The cache does not follow symbolic links, so leave them to
+	 the file system.  */
+      Lisp_Object attrs = file_cache_attributes (file, Qnil, true);
+      if (NILP (attrs))
+	{
+	  errno = ENOENT;
+	  return Qnil;
+	}
+      if (CONSP (attrs) && !STRINGP (XCAR (attrs)))
+	return Qt;
+    }
+
   char *encoded_file = SSDATA (ENCODE_FILE (file));
   return file_access_p (encoded_file, amode) ? Qt : Qnil;
 }
@@ -2911,6 +2940,12 @@ See `file-symlink-p' to distinguish symlinks.  */)
   if (!NILP (handler))
     return call2 (handler, Qfile_directory_p, absname);
 
+  Lisp_Object attrs = file_cache_attributes (absname, Qnil, true);
+  if (NILP (attrs))
+    return Qnil;
+  if (CONSP (attrs) && !STRINGP (XCAR (attrs)))
+    return XCAR (attrs);
+
   return file_directory_p (ENCODE_FILE (absname)) ? Qt : Qnil;
 }
 
@@ -3371,6 +3406,7 @@ symbolic notation, like the `chmod' command from GNU Coreutils.  */)
 
   if (chmod (SSDATA (encoded_absname), XFIXNUM (mode) & 07777) < 0)
     report_file_error ("Doing chmod", absname);
+  file_cache_forget (absname);
 
   return Qnil;
 }
@@ -3448,6 +3484,7 @@ Use the current time if TIMESTAMP is nil.  TIMESTAMP is in the format of
       }
   }
 
+  file_cache_forget (absname);
   return Qt;
 }
 
@@ -3752,6 +3789,7 @@ by calling `format-decode', which see.  */)
   bool read_quit = false;
   /* If the undo log only contains the insertion, there's no point
      keeping it.  It's typically when we first fill a file-buffer.  */
+  flush_undo_log (current_buffer);
   bool empty_undo_list_p
     = (!NILP (visit) && NILP (BVAR (current_buffer, undo_list))
        && BEG == Z);
@@ -4648,7 +4686,10 @@ by calling `format-decode', which see.  */)
   if (!NILP (visit))
     {
       if (empty_undo_list_p)
-	bset_undo_list (current_buffer, Qnil);
+	{
+	  free_undo_log (current_buffer);
+	  bset_undo_list (current_buffer, Qnil);
+	}
 
       if (NILP (handler))
 	{
@@ -4696,6 +4737,7 @@ by calling `format-decode', which see.  */)
       specbind (Qinhibit_modification_hooks, Qt);
 
       /* Save old undo list and don't record undo for decoding.  */
+      flush_undo_log (current_buffer);
       old_undo = BVAR (current_buffer, undo_list);
       bset_undo_list (current_buffer, Qt);
 
@@ -4799,9 +4841,12 @@ by calling `format-decode', which see.  */)
 	    }
 	}
       else
-	/* If undo_list was Qt before, keep it that way.
-	   Otherwise start with an empty undo_list.  */
-	bset_undo_list (current_buffer, EQ (old_undo, Qt) ? Qt : Qnil);
+	{
+	  /* If undo_list was Qt before, keep it that way.
+	     Otherwise start with an empty undo_list.  */
+	  free_undo_log (current_buffer);
+	  bset_undo_list (current_buffer, EQ (old_undo, Qt) ? Qt : Qnil);
+	}
 
       unbind_to (count1, Qnil);
     }
@@ -4834,6 +4879,138 @@ by calling `format-decode', which see.  */)
   return unbind_to (count, val);
 }
 
+/* Return whether the first NBYTES bytes of the file open on FD are
+   valid UTF-8, adding the number of characters in them to *NCHARS if
+   so.  The file is read rather than mapped, so that the pages of a
+   mapping of it are read only when they are first used.  */
+
+static bool
+file_valid_utf_8_p (int fd, ptrdiff_t nbytes, ptrdiff_t *nchars)
+{
+  unsigned char buf[READ_BUF_SIZE];
+  ptrdiff_t carry = 0;
+
+  if (lseek (fd, 0, SEEK_SET) != 0)
+    return false;
+  while (0 < nbytes)
+    {
+      ptrdiff_t n = emacs_read_quit (fd, buf + carry,
+				     min (sizeof buf - carry, nbytes));
+      if (n <= 0)
+	return false;
+      nbytes -= n;
+
+      /* Keep a sequence cut short by the end of the buffer for the
+	 next read.  */
+      unsigned char *end = buf + carry + n;
+      unsigned char const *p = utf_8_valid_prefix (buf, end, nchars);
+      carry = end - p;
+      if (MAX_MULTIBYTE_LENGTH <= carry)
+	return false;
+      memmove (buf, p, carry);
+    }
+  return carry == 0;
+}
+
+DEFUN ("insert-file-contents-mapped", Finsert_file_contents_mapped,
+       Sinsert_file_contents_mapped, 1, 1, 0,
+       doc: /* Insert the contents of file FILENAME into the empty current buffer.
+The text of the buffer is made a private memory mapping of the file,
+so that parts of the file are read only when they are first used.
+The buffer is not otherwise changed; it is usually made read-only by
+the caller.  The text is copied to ordinary storage before it is first
+changed, but not when only its text properties change, and changes are
+never written to the file.
+
+The file is not decoded.  In a multibyte buffer, the file must consist
+of valid UTF-8 text, which is inserted as is.
+
+Return the number of characters inserted, or nil if the file cannot be
+mapped, for instance because it is not a regular file, it is empty, it
+is handled by a file name handler, or it is not valid UTF-8 and the
+buffer is multibyte, or it changes while it is mapped.  In that case
+the buffer is left unchanged, and the caller can use
+`insert-file-contents' instead.
+
+The text is a snapshot of the file only from the first change to it
+on: until then, changes that other programs make to the file may show
+in the buffer, so the file should not be changed meanwhile.  If the
+file is truncated, the first use of the part of the text that is gone
+returns to top level, and that part is deleted from the buffer.  */)
+  (Lisp_Object filename)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  Lisp_Object orig_filename;
+  struct stat st;
+  unsigned char *text;
+  ptrdiff_t nbytes, nchars;
+  int fd;
+
+  if (current_buffer->base_buffer)
+    error ("Cannot map a file into an indirect buffer");
+  if (BEG < Z)
+    error ("Cannot map a file into a non-empty buffer");
+  if (!NILP (BVAR (current_buffer, read_only)))
+    Fbarf_if_buffer_read_only (Qnil);
+
+  CHECK_STRING (filename);
+  filename = Fexpand_file_name (filename, Qnil);
+  if (!NILP (Ffind_file_name_handler (filename, Qinsert_file_contents)))
+    return Qnil;
+
+  orig_filename = filename;
+  filename = ENCODE_FILE (filename);
+  fd = emacs_open (SSDATA (filename), O_RDONLY, 0);
+  if (fd < 0)
+    report_file_error ("Opening input file", orig_filename);
+  record_unwind_protect_int (close_file_unwind, fd);
+
+  if (fstat (fd, &st) != 0)
+    report_file_error ("Input file status", orig_filename);
+  if (!S_ISREG (st.st_mode) || st.st_size <= 0
+      || BUF_BYTES_MAX - 1 < st.st_size)
+    return unbind_to (count, Qnil);
+  nbytes = st.st_size;
+
+  /* A multibyte buffer needs the number of characters before it can
+     take the text, so the whole file is checked now.  */
+  bool multibyte = !NILP (BVAR (current_buffer, enable_multibyte_characters));
+  nchars = nbytes;
+  if (multibyte)
+    {
+      nchars = 0;
+      if (!file_valid_utf_8_p (fd, nbytes, &nchars))
+	return unbind_to (count, Qnil);
+    }
+
+  prepare_to_modify_buffer (BEG, BEG, NULL);
+  if (BEG < Z)
+    error ("Cannot map a file into a non-empty buffer");
+  if (multibyte != !NILP (BVAR (current_buffer, enable_multibyte_characters)))
+    return unbind_to (count, Qnil);
+
+  text = map_file_text (fd, nbytes);
+  if (!text)
+    return unbind_to (count, Qnil);
+
+  /* Give up if the file was changed since it was checked.  */
+  struct stat st1;
+  if (fstat (fd, &st1) != 0 || st1.st_size != st.st_size
+      || timespec_cmp (get_stat_mtime (&st1), get_stat_mtime (&st)) != 0
+      || timespec_cmp (get_stat_ctime (&st1), get_stat_ctime (&st)) != 0)
+    {
+      unmap_file_text (text, nbytes);
+      return unbind_to (count, Qnil);
+    }
+
+  set_buffer_text_mapped (current_buffer, text, nbytes);
+  insert_from_gap (nchars, nbytes, false);
+  signal_after_change (BEG, 0, nchars);
+  update_compositions (BEG, Z, CHECK_BORDER);
+
+  return unbind_to (count, make_fixnum (nchars));
+}
+
 static Lisp_Object build_annotations (Lisp_Object, Lisp_Object);
 
 static void
@@ -5304,6 +5481,8 @@ write_region (Lisp_Object start, Lisp_Object end, Lisp_Object filename,
   if (file_locked)
     unlock_file (lockname);
 
+  file_cache_forget (filename);
+
   /* Do this before reporting IO error
      to avoid a "file has changed on disk" warning on
      next attempt to save.  */
@@ -5351,6 +5530,491 @@ write_region (Lisp_Object start, Lisp_Object end, Lisp_Object filename,
   return Qnil;
 }
 
+/* Asynchronous file I/O.
+
+   write-region-async and read-file-async do the system calls of a
+   write or a read in a task for a helper thread, so that a slow disk
+   or network file system does not block the command loop.  All the
+   Lisp work (encoding, decoding, locking, changing buffers) is done
+   in the main thread: the text to write is encoded into a private
+   snapshot before the task starts, and the bytes read are turned
+   into a string after it ends.  Each finished job writes a byte to
+   a pipe that is watched by wait_reading_process_output, whose
+   callback completes the job and queues a file-io-event that calls
+   the job's Lisp callback.  Without helper threads, the system calls
+   are done at once, but completion is delivered the same way.
+
+   On MS-DOS and MS-Windows, where pipes cannot be watched that way
+   and the emulation of file descriptors is not thread-safe, a job is
+   run and completed at once; its Lisp callback is still called from
+   the command loop.  */
+
+struct file_io_job
+{
+  /* Next job in file_io_done.  */
+  struct file_io_job *next;
+
+  /* The task that runs the job, whose function is null if the job is
+     run without one.  */
+  struct sys_task task;
+
+  /* The key of the Lisp data of this job in file_io_jobs.  */
+  EMACS_INT id;
+
+  /* The encoded name of the file, and the flags and mode to open it
+     with.  The job writes if O_WRONLY is in OPEN_FLAGS.  */
+  char *filename;
+  int open_flags, mode;
+
+  /* Whether to fsync the file after writing it.  */
+  bool fsync;
+
+  /* The bytes to write, or the bytes read, allocated with malloc
+     since the thread cannot use xmalloc.  */
+  char *data;
+  ptrdiff_t nbytes;
+
+  /* Zero if the job succeeded.  Otherwise the errno value, and
+     WHAT says which system call failed.  */
+  int error;
+  char const *what;
+
+  /* The modification time and size of the file after writing.  */
+  struct timespec mtime;
+  off_t size;
+};
+
+#ifndef DOS_NT
+/* Finished jobs, protected by file_io_mutex.  */
+static struct file_io_job *file_io_done;
+static sys_mutex_t file_io_mutex;
+
+/* The pipe through which finished jobs wake up the main thread, or
+   -1 if not yet made.  */
+static int file_io_pipe[2] = { -1, -1 };
+#endif
+
+/* An alist of (ID . [CALLBACK FILENAME BUFFER LOCKNAME VISIT MODIFF
+   SAVE-LENGTH]) for the jobs not yet completed.  */
+static Lisp_Object file_io_jobs;
+static EMACS_INT file_io_last_id;
+
+/* Do the system calls of JOB.  This may run in a helper thread, so it
+   must not use the Lisp machine, including quitting and xmalloc.  */
+
+static void
+run_file_io_job (struct file_io_job *job)
+{
+  bool writing = (job->open_flags & O_ACCMODE) == O_WRONLY;
+  int fd = emacs_open_noquit (job->filename, job->open_flags, job->mode);
+  if (fd < 0)
+    {
+      job->error = errno;
+      job->what = writing ? "Opening output file" : "Opening input file";
+      return;
+    }
+
+  if (writing)
+    {
+      for (ptrdiff_t done = 0; done < job->nbytes; )
+	{
+	  ssize_t n = write (fd, job->data + done,
+			     min (job->nbytes - done, MAX_RW_COUNT));
+	  if (n < 0 && errno != EINTR)
+	    {
+	      job->error = errno;
+	      job->what = "Write error";
+	      break;
+	    }
+	  done += max (n, 0);
+	}
+      if (!job->error && job->fsync)
+	while (fsync (fd) != 0)
+	  if (errno != EINTR)
+	    {
+	      if (errno != EINVAL)
+		job->error = errno, job->what = "Write error";
+	      break;
+	    }
+      struct stat st;
+      if (!job->error)
+	{
+	  if (fstat (fd, &st) == 0)
+	    {
+	      job->mtime = get_stat_mtime (&st);
+	      job->size = st.st_size;
+	    }
+	  else
+	    job->error = errno, job->what = "Write error";
+	}
+    }
+  else
+    {
+      ptrdiff_t size = READ_BUF_SIZE;
+      job->data = malloc (size);
+      while (job->data)
+	{
+	  if (job->nbytes == size)
+	    {
+	      char *data = (size <= PTRDIFF_MAX / 2
+			    ? realloc (job->data, size * 2) : NULL);
+	      if (!data)
+		{
+		  job->error = ENOMEM;
+		  job->what = "Read error";
+		  break;
+		}
+	      job->data = data;
+	      size *= 2;
+	    }
+	  ssize_t n = read (fd, job->data + job->nbytes,
+			    min (size - job->nbytes, MAX_RW_COUNT));
+	  if (n == 0)
+	    break;
+	  if (n < 0 && errno != EINTR)
+	    {
+	      job->error = errno;
+	      job->what = "Read error";
+	      break;
+	    }
+	  job->nbytes += max (n, 0);
+	}
+      if (!job->data)
+	job->error = ENOMEM, job->what = "Read error";
+    }
+
+  if (close (fd) < 0 && !job->error && errno != EINTR)
+    job->error = errno, job->what = writing ? "Write error" : "Read error";
+}
+
+#ifndef DOS_NT
+
+/* Run the job ARG and hand it over to the main thread.  */
+
+static void
+file_io_task (void *arg)
+{
+  struct file_io_job *job = arg;
+
+  run_file_io_job (job);
+
+  sys_mutex_lock (&file_io_mutex);
+  job->next = file_io_done;
+  file_io_done = job;
+  sys_mutex_unlock (&file_io_mutex);
+
+  while (write (file_io_pipe[1], "", 1) < 0 && errno == EINTR)
+    continue;
+}
+
+#endif
+
+static Lisp_Object
+unlock_file_io_job (Lisp_Object lockname)
+{
+  unlock_file (lockname);
+  return Qnil;
+}
+
+static Lisp_Object
+file_io_job_error (Lisp_Object error)
+{
+  return error;
+}
+
+/* Complete JOB in the main thread and queue its event.  */
+
+static void
+complete_file_io_job (struct file_io_job *job)
+{
+  Lisp_Object entry = assq_no_quit (make_fixnum (job->id), file_io_jobs);
+  Lisp_Object info = XCDR (entry);
+  Lisp_Object callback = AREF (info, 0), filename = AREF (info, 1);
+  Lisp_Object buffer = AREF (info, 2), lockname = AREF (info, 3);
+  Lisp_Object visit_file = AREF (info, 4);
+  Lisp_Object error = Qnil, args;
+  file_io_jobs = Fdelq (entry, file_io_jobs);
+
+  /* The task may not have returned yet after handing JOB over.  */
+  if (job->task.func)
+    sys_task_wait (&job->task);
+
+  if (job->error)
+    error = get_file_errno_data (job->what, filename, job->error);
+
+  if ((job->open_flags & O_ACCMODE) == O_WRONLY)
+    {
+      struct buffer *b = XBUFFER (buffer);
+      bool live = BUFFER_LIVE_P (b);
+      intmax_t modiff;
+      integer_to_intmax (AREF (info, 5), &modiff);
+      bool visiting = STRINGP (visit_file);
+
+      /* Keep the lock if the buffer was changed again while it was
+	 being saved, since it is still modified.  This must not
+	 signal, as it is called from wait_reading_process_output.  */
+      if (!(visiting && live && BUF_MODIFF (b) != modiff))
+	{
+	  Lisp_Object unlock_error
+	    = internal_condition_case_1 (unlock_file_io_job, lockname,
+					 Qerror, file_io_job_error);
+	  if (NILP (error))
+	    error = unlock_error;
+	}
+
+      file_cache_forget (filename);
+
+      if (visiting && live && !job->error)
+	{
+	  b->modtime = job->mtime;
+	  b->modtime_size = job->size;
+	  BUF_SAVE_MODIFF (b) = modiff;
+	  XSETFASTINT (BVAR (b, save_length), XFIXNAT (AREF (info, 6)));
+	  bset_filename (b, visit_file);
+	  update_mode_lines = 14;
+	}
+      if (!job->error && !noninteractive
+	  && (visiting || NILP (visit_file)))
+	message_with_string ("Wrote %s",
+			     visiting ? visit_file : filename, 1);
+      args = list1 (error);
+    }
+  else
+    {
+      Lisp_Object contents = Qnil;
+      if (!job->error)
+	contents = make_unibyte_string (job->data, job->nbytes);
+      args = list2 (contents, error);
+    }
+
+  free (job->data);
+  xfree (job->filename);
+  xfree (job);
+
+  struct input_event event;
+  EVENT_INIT (event);
+  event.kind = FILE_IO_EVENT;
+  event.frame_or_window = Qnil;
+  event.arg = list2 (callback, args);
+  kbd_buffer_store_event (&event);
+}
+
+#ifndef DOS_NT
+
+/* Called by wait_reading_process_output when a job has finished.  */
+
+static void
+file_io_callback (int fd, void *data)
+{
+  char buf[64];
+  struct file_io_job *jobs;
+
+  while (read (fd, buf, sizeof buf) < 0 && errno == EINTR)
+    continue;
+
+  sys_mutex_lock (&file_io_mutex);
+  jobs = file_io_done;
+  file_io_done = NULL;
+  sys_mutex_unlock (&file_io_mutex);
+
+  while (jobs)
+    {
+      struct file_io_job *next = jobs->next;
+      complete_file_io_job (jobs);
+      jobs = next;
+    }
+}
+
+#endif
+
+/* Start JOB, whose Lisp data is INFO, and return its id.  */
+
+static Lisp_Object
+start_file_io_job (struct file_io_job *job, Lisp_Object info)
+{
+#ifndef DOS_NT
+  if (file_io_pipe[0] < 0)
+    {
+      if (emacs_pipe (file_io_pipe) != 0)
+	report_file_error ("Creating pipe", Qnil);
+      sys_mutex_init (&file_io_mutex);
+      add_read_fd (file_io_pipe[0], file_io_callback, NULL);
+    }
+#endif
+
+  job->id = ++file_io_last_id;
+  file_io_jobs = Fcons (Fcons (make_fixnum (job->id), info), file_io_jobs);
+
+#ifdef DOS_NT
+  run_file_io_job (job);
+  complete_file_io_job (job);
+#else
+  job->task.func = file_io_task;
+  job->task.arg = job;
+  if (!sys_task_start (&job->task))
+    sys_task_wait (&job->task);
+#endif
+  return make_fixnum (job->id);
+}
+
+DEFUN ("write-region-async", Fwrite_region_async, Swrite_region_async,
+       4, 6, 0,
+       doc: /* Write current region into file FILENAME in the background.
+START, END, FILENAME, APPEND and VISIT are as in `write-region', except
+that APPEND cannot be a file position and START cannot be a string.  The
+region is encoded at once, as `write-region' would, and the resulting
+bytes are written to the file by a helper thread, so that a slow file
+system does not make Emacs wait.  Changes made to the buffer meanwhile
+are not written.  On MS-DOS and MS-Windows, the file is written at once.
+
+When the write is done, CALLBACK is called from the command loop with
+one argument: nil if the write succeeded, or the error data, a list
+\(ERROR-SYMBOL . DATA) as `signal' would take, if it failed.
+
+The file is locked until the write is done.  If VISIT is t or a
+string, the buffer is then marked as saved as of the time of the call:
+it is left modified, and the file left locked, if it was changed
+meanwhile.
+
+Unlike `write-region', this function does not call
+`write-region-annotate-functions' nor `write-region-post-annotation-function'.
+Return nil without writing if FILENAME or VISIT has a file name handler,
+in which case the caller should use `write-region'; otherwise, return
+an identifier of the write.  */)
+  (Lisp_Object start, Lisp_Object end, Lisp_Object filename,
+   Lisp_Object callback, Lisp_Object append, Lisp_Object visit)
+{
+  Lisp_Object visit_file, lockname, encoded_filename;
+  struct coding_system coding;
+  struct file_io_job *job;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  bool visiting = (EQ (visit, Qt) || STRINGP (visit));
+
+  if (current_buffer->base_buffer && visiting)
+    error ("Cannot do file visiting in an indirect buffer");
+
+  if (NUMBERP (append))
+    wrong_type_argument (Qsymbolp, append);
+  if (NILP (start))
+    {
+      XSETFASTINT (start, BEG);
+      XSETFASTINT (end, Z);
+    }
+  validate_region (&start, &end);
+  filename = Fexpand_file_name (filename, Qnil);
+  visit_file = STRINGP (visit) ? Fexpand_file_name (visit, Qnil) : filename;
+
+  if (!NILP (Ffind_file_name_handler (filename, Qwrite_region))
+      || (STRINGP (visit)
+	  && !NILP (Ffind_file_name_handler (visit, Qwrite_region))))
+    return Qnil;
+
+  Vlast_coding_system_used
+    = choose_write_coding_system (start, end, filename, append, visit,
+				  visit_file, &coding);
+
+  /* Encode the region into the snapshot, which the thread writes and
+     complete_file_io_job frees with free in the main thread.  */
+  ptrdiff_t from = XFIXNUM (start), to = XFIXNUM (end);
+  ptrdiff_t from_byte = CHAR_TO_BYTE (from), to_byte = CHAR_TO_BYTE (to);
+  unsigned char *src = NULL;
+  ptrdiff_t nbytes;
+  coding.src_multibyte = to - from < to_byte - from_byte;
+  coding.mode |= CODING_MODE_LAST_BLOCK;
+  if (CODING_REQUIRE_ENCODING (&coding))
+    {
+      coding.raw_destination = 1;
+      encode_coding_object (&coding, Fcurrent_buffer (), from, from_byte,
+			    to, to_byte, Qt);
+      nbytes = coding.produced;
+      if (STRINGP (coding.dst_object))
+	src = SDATA (coding.dst_object);
+      else
+	{
+	  src = coding.destination;
+	  record_unwind_protect_ptr (xfree, src);
+	}
+    }
+  else
+    nbytes = to_byte - from_byte;
+
+  char *data = malloc (max (nbytes, 1));
+  if (!data)
+    memory_full (nbytes);
+  ptrdiff_t data_count = SPECPDL_INDEX ();
+  record_unwind_protect_ptr (free, data);
+  if (src)
+    memcpy (data, src, nbytes);
+  else
+    {
+      ptrdiff_t gap = clip_to_bounds (from_byte, GPT_BYTE, to_byte);
+      memcpy (data, BYTE_POS_ADDR (from_byte), gap - from_byte);
+      memcpy (data + (gap - from_byte), BYTE_POS_ADDR (gap), to_byte - gap);
+    }
+
+  lockname = visit_file;
+  lock_file (lockname);
+
+  encoded_filename = ENCODE_FILE (filename);
+  job = xzalloc (sizeof *job);
+  job->filename = xstrdup (SSDATA (encoded_filename));
+  job->open_flags = O_WRONLY | O_CREAT | (NILP (append) ? O_TRUNC : O_APPEND);
+#ifdef DOS_NT
+  job->mode = S_IREAD | S_IWRITE;
+#else
+  job->mode = 0666;
+#endif
+  job->fsync = !write_region_inhibit_fsync;
+  job->data = data;
+  job->nbytes = nbytes;
+  set_unwind_protect_ptr (data_count, free, NULL);
+  unbind_to (count, Qnil);
+
+  Lisp_Object info = make_nil_vector (7);
+  ASET (info, 0, callback);
+  ASET (info, 1, filename);
+  ASET (info, 2, Fcurrent_buffer ());
+  ASET (info, 3, lockname);
+  ASET (info, 4, visiting ? visit_file : visit);
+  ASET (info, 5, modiff_to_integer (MODIFF));
+  ASET (info, 6, make_fixnum (Z - BEG));
+  return start_file_io_job (job, info);
+}
+
+DEFUN ("read-file-async", Fread_file_async, Sread_file_async, 2, 2, 0,
+       doc: /* Read the contents of file FILENAME in the background.
+The file is read by a helper thread, so that a slow file system does
+not make Emacs wait; on MS-DOS and MS-Windows, it is read at once.
+When the read is done, CALLBACK is called from the command loop with
+two arguments: a unibyte string of the contents of the file and nil,
+or nil and the error data, a list \(ERROR-SYMBOL . DATA) as `signal'
+would take, if the read failed.
+The contents are not decoded; `insert-file-contents-async' decodes them.
+
+Return nil without reading if FILENAME has a file name handler, in
+which case the caller should use `insert-file-contents'; otherwise,
+return an identifier of the read.  */)
+  (Lisp_Object filename, Lisp_Object callback)
+{
+  Lisp_Object encoded_filename;
+  struct file_io_job *job;
+
+  CHECK_STRING (filename);
+  filename = Fexpand_file_name (filename, Qnil);
+  if (!NILP (Ffind_file_name_handler (filename, Qinsert_file_contents)))
+    return Qnil;
+
+  encoded_filename = ENCODE_FILE (filename);
+  job = xzalloc (sizeof *job);
+  job->filename = xstrdup (SSDATA (encoded_filename));
+  job->open_flags = O_RDONLY;
+
+  Lisp_Object info = make_nil_vector (7);
+  ASET (info, 0, callback);
+  ASET (info, 1, filename);
+  return start_file_io_job (job, info);
+}
+
 DEFUN ("car-less-than-car", Fcar_less_than_car, Scar_less_than_car, 2, 2, 0,
        doc: /* Return t if (car A) is numerically less than (car B).  */)
   (Lisp_Object a, Lisp_Object b)
@@ -6359,6 +7023,7 @@ each of those additional buffers as well, in addition to the original
 buffer.  The relevant buffer is current during each function call.  */);
   Vwrite_region_post_annotation_function = Qnil;
   staticpro (&Vwrite_region_annotation_buffers);
+  staticpro (&file_io_jobs);
 
   DEFVAR_LISP ("write-region-annotations-so-far",
 	       Vwrite_region_annotations_so_far,
@@ -6467,6 +7132,9 @@ This includes interactive calls to `delete-file' and
   defsubr (&Sdefault_file_modes);
   defsubr (&Sfile_newer_than_file_p);
   defsubr (&Sinsert_file_contents);
+  defsubr (&Sinsert_file_contents_mapped);
+  defsubr (&Swrite_region_async);
+  defsubr (&Sread_file_async);
   defsubr (&Swrite_region);
   defsubr (&Scar_less_than_car);
   defsubr (&Sverify_visited_file_modtime);
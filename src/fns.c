@@ -176,22 +176,195 @@ If STRING is multibyte, this may be greater than the length of STRING.  */)
   return make_fixnum (SBYTES (string));
 }
 
-DEFUN ("string-distance", Fstring_distance, Sstring_distance, 2, 3, 0,
-       doc: /* Return Levenshtein distance between STRING1 and STRING2.
-The distance is the number of deletions, insertions, and substitutions
-required to transform STRING1 into STRING2.
-If BYTECOMPARE is nil or omitted, compute distance in terms of characters.
-If BYTECOMPARE is non-nil, compute distance in terms of bytes.
-Letter-case is significant, but text properties are ignored. */)
-  (Lisp_Object string1, Lisp_Object string2, Lisp_Object bytecompare)
+/* Computing Levenshtein distances with the bit-parallel algorithm of
+   Myers, extended to patterns longer than a word as by Hyyrö.  The
+   columns of the distance table are kept as bit vectors of vertical
+   deltas, 64 rows per word, so that each character of the text takes
+   a few operations per block of the pattern.  */
+
+struct string_distance_pattern
+{
+  /* The length of the pattern, in characters or bytes, and the number
+     of words for its rows.  */
+  ptrdiff_t len, nblocks;
+
+  /* The row of PEQ for each ASCII character, or 0 if the character is
+     not in the pattern.  The other characters of the pattern are the
+     NOTHERS elements of the sorted array OTHERS, and their rows follow
+     those of ASCII characters, from OTHERS_ROW.  */
+  int ascii[128];
+  int const *others;
+  ptrdiff_t nothers, others_row;
+
+  /* For each row, NBLOCKS words whose bits say where its character
+     occurs in the pattern.  Row 0 is all zeros.  */
+  uint64_t *peq;
+
+  /* The positive and negative vertical deltas of the current column.  */
+  uint64_t *pv, *mv;
+};
+
+/* The largest table of rows, in bytes, for which the bit-parallel
+   algorithm is used.  */
+enum { STRING_DISTANCE_MAX_TABLE = 1 << 24 };
 
+static int
+string_distance_unit_cmp (void const *a, void const *b)
 {
-  CHECK_STRING (string1);
-  CHECK_STRING (string2);
+  int x = *(int const *) a, y = *(int const *) b;
+  return (x > y) - (x < y);
+}
 
-  bool use_byte_compare =
-    !NILP (bytecompare)
-    || (!STRING_MULTIBYTE (string1) && !STRING_MULTIBYTE (string2));
+/* Set up P for computing distances from PATTERN, whose units are its
+   bytes if BYTES, and its characters otherwise.  Memory is freed on
+   unwinding.  Return false if the tables would be too big.  */
+
+static bool
+string_distance_setup (struct string_distance_pattern *p,
+		       Lisp_Object pattern, bool bytes)
+{
+  ptrdiff_t m = bytes ? SBYTES (pattern) : SCHARS (pattern);
+  p->len = m;
+  p->nblocks = max (1, m / 64 + (m % 64 != 0));
+
+  int *units = xnmalloc (max (m, 1), 2 * sizeof *units);
+  record_unwind_protect_ptr (xfree, units);
+  int *others = units + m;
+  ptrdiff_t nothers = 0;
+  for (ptrdiff_t k = 0, i = 0, i_byte = 0; k < m; k++)
+    {
+      if (bytes)
+	units[k] = SREF (pattern, k);
+      else
+	FETCH_STRING_CHAR_ADVANCE (units[k], pattern, i, i_byte);
+      if (!ASCII_CHAR_P (units[k]))
+	others[nothers++] = units[k];
+    }
+  qsort (others, nothers, sizeof *others, string_distance_unit_cmp);
+  ptrdiff_t distinct = 0;
+  for (ptrdiff_t i = 0; i < nothers; i++)
+    if (i == 0 || others[i] != others[distinct - 1])
+      others[distinct++] = others[i];
+  p->others = others;
+  p->nothers = distinct;
+
+  int rows = 1;
+  memset (p->ascii, 0, sizeof p->ascii);
+  for (ptrdiff_t k = 0; k < m; k++)
+    if (ASCII_CHAR_P (units[k]) && p->ascii[units[k]] == 0)
+      p->ascii[units[k]] = rows++;
+  p->others_row = rows;
+
+  ptrdiff_t nrows = rows + distinct;
+  if (STRING_DISTANCE_MAX_TABLE / sizeof *p->peq / p->nblocks - 2 < nrows)
+    return false;
+  p->peq = xzalloc ((nrows + 2) * p->nblocks * sizeof *p->peq);
+  record_unwind_protect_ptr (xfree, p->peq);
+  p->pv = p->peq + nrows * p->nblocks;
+  p->mv = p->pv + p->nblocks;
+
+  for (ptrdiff_t k = 0; k < m; k++)
+    {
+      int c = units[k];
+      ptrdiff_t row;
+      if (ASCII_CHAR_P (c))
+	row = p->ascii[c];
+      else
+	row = (p->others_row
+	       + ((int *) bsearch (&c, others, distinct, sizeof *others,
+				   string_distance_unit_cmp)
+		  - others));
+      p->peq[row * p->nblocks + k / 64] |= (uint64_t) 1 << (k % 64);
+    }
+  return true;
+}
+
+/* Return the row of P for the unit C.  */
+
+static ptrdiff_t
+string_distance_row (struct string_distance_pattern const *p, int c)
+{
+  if (ASCII_CHAR_P (c))
+    return p->ascii[c];
+  ptrdiff_t lo = 0, hi = p->nothers;
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      if (p->others[mid] < c)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo < p->nothers && p->others[lo] == c ? p->others_row + lo : 0;
+}
+
+/* Return the distance between the pattern of P and TEXT, whose units
+   are its bytes if BYTES, and its characters otherwise.  Return -1 if
+   the distance is greater than LIMIT; give up as soon as that is
+   known.  */
+
+static ptrdiff_t
+string_distance_compute (struct string_distance_pattern *p,
+			 Lisp_Object text, bool bytes, ptrdiff_t limit)
+{
+  ptrdiff_t m = p->len, n = bytes ? SBYTES (text) : SCHARS (text);
+  if (limit < (m < n ? n - m : m - n))
+    return -1;
+  if (m == 0)
+    return n;
+
+  ptrdiff_t nblocks = p->nblocks;
+  uint64_t *pv = p->pv, *mv = p->mv;
+  uint64_t last = (uint64_t) 1 << ((m - 1) % 64);
+  for (ptrdiff_t b = 0; b < nblocks; b++)
+    pv[b] = -1, mv[b] = 0;
+
+  ptrdiff_t score = m;
+  for (ptrdiff_t j = 0, i = 0, i_byte = 0; j < n; j++)
+    {
+      int c;
+      if (bytes)
+	c = SREF (text, j);
+      else
+	FETCH_STRING_CHAR_ADVANCE (c, text, i, i_byte);
+      uint64_t const *peq = p->peq + string_distance_row (p, c) * nblocks;
+
+      /* The horizontal delta entering each block from above; the first
+	 row of the table grows by one in each column.  */
+      int h = 1;
+      for (ptrdiff_t b = 0; b < nblocks; b++)
+	{
+	  uint64_t high = b == nblocks - 1 ? last : (uint64_t) 1 << 63;
+	  uint64_t eq = peq[b], v = eq | mv[b];
+	  if (h < 0)
+	    eq |= 1;
+	  uint64_t x = (((eq & pv[b]) + pv[b]) ^ pv[b]) | eq;
+	  uint64_t ph = mv[b] | ~(x | pv[b]);
+	  uint64_t mh = pv[b] & x;
+	  int hout = ph & high ? 1 : mh & high ? -1 : 0;
+	  ph = ph << 1 | (h > 0);
+	  mh = mh << 1 | (h < 0);
+	  pv[b] = mh | ~(v | ph);
+	  mv[b] = ph & v;
+	  h = hout;
+	}
+      score += h;
+
+      /* The distance can decrease by at most one per remaining unit.  */
+      if (limit < score - (n - 1 - j))
+	return -1;
+    }
+  return score;
+}
+
+/* Return the distance between STRING1 and STRING2 computed with the
+   classic dynamic-programming table, for patterns too long for
+   string_distance_setup.  */
+
+static ptrdiff_t
+string_distance_table (Lisp_Object string1, Lisp_Object string2,
+		       bool use_byte_compare)
+{
   ptrdiff_t len1 = use_byte_compare ? SBYTES (string1) : SCHARS (string1);
   ptrdiff_t len2 = use_byte_compare ? SBYTES (string2) : SCHARS (string2);
   ptrdiff_t x, y, lastdiag, olddiag;
@@ -238,8 +411,96 @@ Letter-case is significant, but text properties are ignored. */)
         }
     }
 
+  ptrdiff_t distance = column[len1];
   SAFE_FREE ();
-  return make_fixnum (column[len1]);
+  return distance;
+}
+
+static ptrdiff_t
+string_distance_limit (Lisp_Object max)
+{
+  if (NILP (max))
+    return PTRDIFF_MAX;
+  CHECK_FIXNAT (max);
+  return min (XFIXNAT (max), PTRDIFF_MAX);
+}
+
+DEFUN ("string-distance", Fstring_distance, Sstring_distance, 2, 4, 0,
+       doc: /* Return Levenshtein distance between STRING1 and STRING2.
+The distance is the number of deletions, insertions, and substitutions
+required to transform STRING1 into STRING2.
+If BYTECOMPARE is nil or omitted, compute distance in terms of characters.
+If BYTECOMPARE is non-nil, compute distance in terms of bytes.
+If MAX is non-nil, it is the largest distance of interest: return nil
+if the distance is greater, which can be found out faster.
+Letter-case is significant, but text properties are ignored. */)
+  (Lisp_Object string1, Lisp_Object string2, Lisp_Object bytecompare,
+   Lisp_Object max)
+{
+  CHECK_STRING (string1);
+  CHECK_STRING (string2);
+  ptrdiff_t limit = string_distance_limit (max);
+
+  bool use_byte_compare =
+    !NILP (bytecompare)
+    || (!STRING_MULTIBYTE (string1) && !STRING_MULTIBYTE (string2));
+  ptrdiff_t len1 = use_byte_compare ? SBYTES (string1) : SCHARS (string1);
+  ptrdiff_t len2 = use_byte_compare ? SBYTES (string2) : SCHARS (string2);
+
+  /* The shorter string makes for fewer blocks.  */
+  Lisp_Object pattern = len1 <= len2 ? string1 : string2;
+  Lisp_Object text = len1 <= len2 ? string2 : string1;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct string_distance_pattern p;
+  ptrdiff_t distance
+    = (string_distance_setup (&p, pattern, use_byte_compare)
+       ? string_distance_compute (&p, text, use_byte_compare, limit)
+       : string_distance_table (string1, string2, use_byte_compare));
+  unbind_to (count, Qnil);
+
+  return 0 <= distance && distance <= limit ? make_fixnum (distance) : Qnil;
+}
+
+DEFUN ("string-distances", Fstring_distances, Sstring_distances, 2, 4, 0,
+       doc: /* Return the Levenshtein distances from STRING to CANDIDATES.
+CANDIDATES is a vector of strings.  Return a vector of the distances
+between STRING and each candidate, as computed by `string-distance'
+with the same BYTECOMPARE and MAX; this is faster than calling
+`string-distance' for each candidate.  */)
+  (Lisp_Object string, Lisp_Object candidates, Lisp_Object bytecompare,
+   Lisp_Object max)
+{
+  CHECK_STRING (string);
+  CHECK_VECTOR (candidates);
+  ptrdiff_t limit = string_distance_limit (max);
+  ptrdiff_t ncandidates = ASIZE (candidates);
+  for (ptrdiff_t i = 0; i < ncandidates; i++)
+    CHECK_STRING (AREF (candidates, i));
+
+  /* The units of a unibyte STRING are the same, bytes or characters.  */
+  bool pattern_bytes = !NILP (bytecompare) || !STRING_MULTIBYTE (string);
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct string_distance_pattern p;
+  bool bitparallel = string_distance_setup (&p, string, pattern_bytes);
+
+  Lisp_Object result = make_nil_vector (ncandidates);
+  for (ptrdiff_t i = 0; i < ncandidates; i++)
+    {
+      Lisp_Object candidate = AREF (candidates, i);
+      bool use_byte_compare =
+	!NILP (bytecompare)
+	|| (!STRING_MULTIBYTE (string) && !STRING_MULTIBYTE (candidate));
+      ptrdiff_t distance
+	= (bitparallel
+	   ? string_distance_compute (&p, candidate, use_byte_compare, limit)
+	   : string_distance_table (string, candidate, use_byte_compare));
+      if (0 <= distance && distance <= limit)
+	ASET (result, i, make_fixnum (distance));
+      rarely_quit (i);
+    }
+
+  unbind_to (count, Qnil);
+  return result;
 }
 
 DEFUN ("string-equal", Fstring_equal, Sstring_equal, 2, 2, 0,
@@ -2451,7 +2712,8 @@ internal_equal (Lisp_Object o1, Lisp_Object o2, enum equal_kind equal_kind,
 	  {
 	    return (XMARKER (o1)->buffer == XMARKER (o2)->buffer
 		    && (XMARKER (o1)->buffer == 0
-			|| XMARKER (o1)->bytepos == XMARKER (o2)->bytepos));
+			|| (marker_bytepos (XMARKER (o1))
+			    == marker_bytepos (XMARKER (o2)))));
 	  }
 	/* Boolvectors are compared much like strings.  */
 	if (BOOL_VECTOR_P (o1))
@@ -5595,6 +5857,7 @@ this variable.  */);
   defsubr (&Sproper_list_p);
   defsubr (&Sstring_bytes);
   defsubr (&Sstring_distance);
+  defsubr (&Sstring_distances);
   defsubr (&Sstring_equal);
   defsubr (&Scompare_strings);
   defsubr (&Sstring_lessp);
@@ -299,6 +299,171 @@ skip_invisible (ptrdiff_t pos, ptrdiff_t *next_boundary_p, ptrdiff_t to, Lisp_Ob
       }									\
   } while (0)
 
+/* Columns of some positions within long lines are kept here, so that
+   finding the column of a position far from the start of its line
+   needn't scan the whole line.  Scanning a line for columns records
+   where it is every COLUMN_CACHE_INTERVAL characters or so, and later
+   scans of the line start from the last such checkpoint before where
+   they are asked to go.  The column at a checkpoint depends on the
+   text before it in its line, so a change of the text or of its
+   properties discards the checkpoints after the change (see
+   invalidate_buffer_caches); the cache as a whole is good for one
+   buffer and one set of the variables that affect columns, and any
+   change of the overlays discards it.  The cache hangs off the base
+   buffer, which it shares with the indirect buffers, and since their
+   overlays are their own, a scan in one of them discards the
+   checkpoints of the others.  It is used only if `cache-long-scans'
+   is non-nil.  */
+
+enum { COLUMN_CACHE_INTERVAL = 2048 };
+
+struct column_checkpoint
+{
+  /* Where the scan was, its column, and the column of the previous
+     position.  */
+  ptrdiff_t pos, pos_byte, col, prev_col;
+
+  /* The beginning of the line.  */
+  ptrdiff_t line_start;
+};
+
+struct column_cache
+{
+  /* What the columns depend on, besides the text.  BUFFER is the
+     buffer whose overlays and variables were used.  */
+  Lisp_Object buffer, display_table, window;
+  Lisp_Object invisibility_spec, selective_display;
+  int tab_width;
+  bool_bf ctl_arrow : 1;
+  bool_bf multibyte : 1;
+  modiff_count overlay_modiff;
+
+  /* NCHECKPOINTS checkpoints, in increasing order of position.  */
+  struct column_checkpoint *checkpoints;
+  ptrdiff_t ncheckpoints, checkpoints_size;
+};
+
+/* Return the number of checkpoints in cache C at or before POS.  */
+
+static ptrdiff_t
+column_checkpoints_upto (struct column_cache *c, ptrdiff_t pos)
+{
+  ptrdiff_t lo = 0, hi = c->ncheckpoints;
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      if (c->checkpoints[mid].pos <= pos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Return the column cache of the current buffer for DP, WINDOW and
+   the current buffer's settings, emptying it if they have changed
+   since it was last used, or NULL if `cache-long-scans' is nil.  */
+
+static struct column_cache *
+get_column_cache (struct Lisp_Char_Table *dp, Lisp_Object window)
+{
+  struct buffer *b = (current_buffer->base_buffer
+		      ? current_buffer->base_buffer : current_buffer);
+  Lisp_Object display_table = Qnil;
+  int tab_width = SANE_TAB_WIDTH (current_buffer);
+  bool ctl_arrow = !NILP (BVAR (current_buffer, ctl_arrow));
+  bool multibyte = !NILP (BVAR (current_buffer, enable_multibyte_characters));
+  struct column_cache *c = b->column_cache;
+  Lisp_Object buffer;
+
+  if (NILP (BVAR (current_buffer, cache_long_scans)))
+    return NULL;
+  if (dp)
+    XSETCHAR_TABLE (display_table, dp);
+  XSETBUFFER (buffer, current_buffer);
+
+  if (!c)
+    c = b->column_cache = xzalloc (sizeof *c);
+  else if (EQ (c->buffer, buffer)
+	   && EQ (c->display_table, display_table)
+	   && EQ (c->window, window)
+	   && EQ (c->invisibility_spec,
+		  BVAR (current_buffer, invisibility_spec))
+	   && EQ (c->selective_display,
+		  BVAR (current_buffer, selective_display))
+	   && c->tab_width == tab_width
+	   && c->ctl_arrow == ctl_arrow
+	   && c->multibyte == multibyte
+	   && c->overlay_modiff == OVERLAY_MODIFF)
+    return c;
+
+  c->buffer = buffer;
+  c->display_table = display_table;
+  c->window = window;
+  c->invisibility_spec = BVAR (current_buffer, invisibility_spec);
+  c->selective_display = BVAR (current_buffer, selective_display);
+  c->tab_width = tab_width;
+  c->ctl_arrow = ctl_arrow;
+  c->multibyte = multibyte;
+  c->overlay_modiff = OVERLAY_MODIFF;
+  c->ncheckpoints = 0;
+  return c;
+}
+
+/* Record checkpoint CP in cache C, unless it is there already.  */
+
+static void
+record_column_checkpoint (struct column_cache *c,
+			  const struct column_checkpoint *cp)
+{
+  ptrdiff_t i = column_checkpoints_upto (c, cp->pos);
+  if (i > 0 && c->checkpoints[i - 1].pos == cp->pos)
+    return;
+  if (c->ncheckpoints == c->checkpoints_size)
+    c->checkpoints = xpalloc (c->checkpoints, &c->checkpoints_size, 1, -1,
+			      sizeof *c->checkpoints);
+  memmove (c->checkpoints + i + 1, c->checkpoints + i,
+	   (c->ncheckpoints - i) * sizeof *c->checkpoints);
+  c->checkpoints[i] = *cp;
+  c->ncheckpoints++;
+}
+
+/* Discard the column checkpoints of the base buffer B after POS.  */
+
+void
+invalidate_column_cache (struct buffer *b, ptrdiff_t pos)
+{
+  struct column_cache *c = b->column_cache;
+  if (c)
+    c->ncheckpoints = column_checkpoints_upto (c, pos);
+}
+
+/* Free the column cache of the base buffer B.  */
+
+void
+free_column_cache (struct buffer *b)
+{
+  if (b->column_cache)
+    {
+      xfree (b->column_cache->checkpoints);
+      xfree (b->column_cache);
+      b->column_cache = NULL;
+    }
+}
+
+/* Mark the Lisp objects in the column cache of B.  */
+
+void
+mark_column_cache (struct buffer *b)
+{
+  struct column_cache *c = b->column_cache;
+  mark_object (c->buffer);
+  mark_object (c->display_table);
+  mark_object (c->window);
+  mark_object (c->invisibility_spec);
+  mark_object (c->selective_display);
+}
+
 
 DEFUN ("current-column", Fcurrent_column, Scurrent_column, 0, 0, 0,
        doc: /* Return the horizontal position of point.  Beginning of line is column 0.
@@ -365,12 +530,18 @@ current_column (void)
     stop = GAP_END_ADDR;
 
   col = 0, tab_seen = 0, post_tab = 0;
+  ptrdiff_t nscanned = 0;
 
   while (1)
     {
       ptrdiff_t i, n;
       Lisp_Object charvec;
 
+      /* On a long line, scanning forward from a checkpoint is faster.  */
+      if (++nscanned > COLUMN_CACHE_INTERVAL
+	  && !NILP (BVAR (current_buffer, cache_long_scans)))
+	return current_column_1 ();
+
       if (ptr == stop)
 	{
 	  /* We stopped either for the beginning of the buffer
@@ -545,11 +716,34 @@ scan_for_column (ptrdiff_t *endpos, EMACS_INT *goalcol, ptrdiff_t *prevcol)
   ptrdiff_t scan, scan_byte, next_boundary;
 
   scan = find_newline (PT, PT_BYTE, BEGV, BEGV_BYTE, -1, NULL, &scan_byte, 1);
-  next_boundary = scan;
 
   window = Fget_buffer_window (Fcurrent_buffer (), Qnil);
   w = ! NILP (window) ? XWINDOW (window) : NULL;
 
+  /* Start from the last checkpoint of this line before END, if it is
+     before GOAL too.  */
+  struct column_cache *cache = get_column_cache (dp, window);
+  struct column_checkpoint cp;
+  cp.line_start = scan;
+  if (cache)
+    {
+      for (ptrdiff_t i = column_checkpoints_upto (cache, end);
+	   i > 0 && cache->checkpoints[i - 1].pos > cp.line_start; i--)
+	{
+	  struct column_checkpoint *p = &cache->checkpoints[i - 1];
+	  if (p->line_start == cp.line_start && p->col < goal)
+	    {
+	      scan = p->pos;
+	      scan_byte = p->pos_byte;
+	      col = p->col;
+	      prev_col = p->prev_col;
+	      break;
+	    }
+	}
+    }
+  ptrdiff_t next_checkpoint = scan + COLUMN_CACHE_INTERVAL;
+  next_boundary = scan;
+
   memset (&cmp_it, 0, sizeof cmp_it);
   cmp_it.id = -1;
   composition_compute_stop_pos (&cmp_it, scan, scan_byte, end, Qnil);
@@ -572,6 +766,19 @@ scan_for_column (ptrdiff_t *endpos, EMACS_INT *goalcol, ptrdiff_t *prevcol)
 	    goto endloop;
 	}
 
+      /* Record a checkpoint now and then, where no composition is
+	 under way.  */
+      if (cache && scan >= next_checkpoint
+	  && cmp_it.id < 0 && scan < cmp_it.stop_pos)
+	{
+	  cp.pos = scan;
+	  cp.pos_byte = scan_byte;
+	  cp.col = col;
+	  cp.prev_col = prev_col;
+	  record_column_checkpoint (cache, &cp);
+	  next_checkpoint = scan + COLUMN_CACHE_INTERVAL;
+	}
+
       /* Test reaching the goal column.  We do this after skipping
 	 invisible characters, so that we put point before the
 	 character on which the cursor will appear.  */
@@ -28,6 +28,7 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include <errno.h>
 #include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/vfs.h>
 
 /* Ignore bits that might be undefined on old GNU/Linux systems.  */
 #ifndef IN_EXCL_UNLINK
@@ -332,13 +333,25 @@ inotify_callback (int fd, void *_)
       Lisp_Object descriptor = INT_TO_INTEGER (ev->wd);
       Lisp_Object prevtail = find_descriptor (descriptor);
 
+      if (ev->mask & IN_Q_OVERFLOW)
+	file_cache_notify (Qnil, false);
+
       if (! NILP (prevtail))
         {
 	  Lisp_Object tail = CONSP (prevtail) ? XCDR (prevtail) : watch_list;
 	  for (Lisp_Object watches = XCDR (XCAR (tail)); ! NILP (watches);
 	       watches = XCDR (watches))
             {
-              event.arg = inotifyevent_to_event (XCAR (watches), ev);
+	      Lisp_Object watch = XCAR (watches);
+	      if (EQ (Fnth (make_fixnum (2), watch), Qfile_attributes_cache))
+		{
+		  /* Watches of the file attribute cache are handled
+		     at once, instead of through an event.  */
+		  file_cache_notify (XCAR (XCDR (watch)),
+				     ev->mask & IN_IGNORED);
+		  continue;
+		}
+              event.arg = inotifyevent_to_event (watch, ev);
               if (!NILP (event.arg))
                 kbd_buffer_store_event (&event);
             }
@@ -352,6 +365,83 @@ inotify_callback (int fd, void *_)
   SAFE_FREE ();
 }
 
+/* Read the pending events now, if any.  The file attribute cache
+   calls this before using its data, so that changes made just before
+   are taken into account.  */
+
+void
+inotify_poll (void)
+{
+  int to_read;
+  if (0 <= inotifyfd && ioctl (inotifyfd, FIONREAD, &to_read) == 0
+      && 0 < to_read)
+    inotify_callback (inotifyfd, NULL);
+}
+
+/* Watch directory DIR for changes of its entries, and call
+   file_cache_notify with DIR when one occurs.  Return the watch
+   descriptor, nil if DIR cannot be watched, or t if file notification
+   is not available for it.  Directories of pseudo file systems whose
+   contents change without inotify noticing, such as /proc, cannot be
+   watched.  Neither can those of network file systems, whose files
+   other machines change without inotify noticing either, but for them
+   the age of what is cached is a good enough limit, so return t.  */
+
+Lisp_Object
+inotify_watch_directory (Lisp_Object dir)
+{
+  uint32_t imask = (IN_ATTRIB | IN_CREATE | IN_DELETE | IN_DELETE_SELF
+		    | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO
+		    | IN_ONLYDIR);
+
+  if (inotifyfd < 0)
+    {
+      inotifyfd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+      if (inotifyfd < 0)
+	return Qt;
+      watch_list = Qnil;
+      add_read_fd (inotifyfd, &inotify_callback, NULL);
+    }
+
+  Lisp_Object encoded_dir = ENCODE_FILE (dir);
+  struct statfs st;
+  if (statfs (SSDATA (encoded_dir), &st) != 0)
+    return Qnil;
+  switch (st.f_type)
+    {
+    case 0x9fa0:		/* PROC_SUPER_MAGIC */
+    case 0x62656572:		/* SYSFS_MAGIC */
+    case 0x27e0eb:		/* CGROUP_SUPER_MAGIC */
+    case 0x63677270:		/* CGROUP2_SUPER_MAGIC */
+    case 0x64626720:		/* DEBUGFS_MAGIC */
+    case 0x74726163:		/* TRACEFS_MAGIC */
+      return Qnil;
+    case 0x65735546:		/* FUSE_SUPER_MAGIC */
+    case 0x6969:		/* NFS_SUPER_MAGIC */
+    case 0xff534d42:		/* CIFS_MAGIC_NUMBER */
+    case 0xfe534d42:		/* SMB2_MAGIC_NUMBER */
+    case 0x564c:		/* NCP_SUPER_MAGIC */
+    case 0x517b:		/* SMB_SUPER_MAGIC */
+    case 0x6b414653:		/* AFS_FS_MAGIC */
+    case 0x5346414f:		/* AFS_SUPER_MAGIC */
+    case 0x73757245:		/* CODA_SUPER_MAGIC */
+    case 0x01021997:		/* V9FS_MAGIC */
+    case 0x47504653:		/* GPFS_SUPER_MAGIC */
+    case 0x00c36400:		/* CEPH_SUPER_MAGIC */
+    case 0x013111a8:		/* IBRIX_SUPER_MAGIC */
+    case 0x19830326:		/* FHGFS_SUPER_MAGIC */
+    case 0x0bd00bd0:		/* LUSTRE_SUPER_MAGIC */
+      return Qt;
+    }
+
+  int wd = inotify_add_watch (inotifyfd, SSDATA (encoded_dir),
+			      imask | IN_MASK_ADD | IN_EXCL_UNLINK);
+  if (wd < 0)
+    return Qnil;
+
+  return add_watch (wd, dir, imask, Qfile_attributes_cache);
+}
+
 DEFUN ("inotify-add-watch", Finotify_add_watch, Sinotify_add_watch, 3, 3, 0,
        doc: /* Add a watch for FILE-NAME to inotify.
 
@@ -62,18 +62,20 @@ static void
 check_markers (void)
 {
   struct Lisp_Marker *tail;
+  ptrdiff_t prev = BEG;
   bool multibyte = ! NILP (BVAR (current_buffer, enable_multibyte_characters));
 
-  for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
+  FOR_EACH_MARKER (current_buffer, tail)
     {
       if (tail->buffer->text != current_buffer->text)
 	emacs_abort ();
-      if (tail->charpos > Z)
+      if (marker_charpos (tail) > Z || marker_charpos (tail) < prev)
 	emacs_abort ();
-      if (tail->bytepos > Z_BYTE)
+      if (marker_bytepos (tail) > Z_BYTE)
 	emacs_abort ();
-      if (multibyte && ! CHAR_HEAD_P (FETCH_BYTE (tail->bytepos)))
+      if (multibyte && ! CHAR_HEAD_P (FETCH_BYTE (marker_bytepos (tail))))
 	emacs_abort ();
+      prev = marker_charpos (tail);
     }
 }
 
@@ -227,8 +229,8 @@ adjust_suspend_auto_hscroll (ptrdiff_t from, ptrdiff_t to)
 
       if (BUFFERP (w->contents)
 	  && XBUFFER (w->contents) == current_buffer
-	  && XMARKER (w->old_pointm)->charpos >= from
-	  && XMARKER (w->old_pointm)->charpos <= to)
+	  && marker_charpos (XMARKER (w->old_pointm)) >= from
+	  && marker_charpos (XMARKER (w->old_pointm)) <= to)
 	w->suspend_auto_hscroll = 0;
     }
 }
@@ -239,35 +241,15 @@ adjust_suspend_auto_hscroll (ptrdiff_t from, ptrdiff_t to)
    The range in charpos is FROM to TO.
 
    This function assumes that the gap is adjacent to
-   or inside of the range being deleted.  */
+   or inside of the range being deleted, and must be called
+   before Z is updated for the deletion.  */
 
 void
 adjust_markers_for_delete (ptrdiff_t from, ptrdiff_t from_byte,
 			   ptrdiff_t to, ptrdiff_t to_byte)
 {
-  struct Lisp_Marker *m;
-  ptrdiff_t charpos;
-
   adjust_suspend_auto_hscroll (from, to);
-  for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-    {
-      charpos = m->charpos;
-      eassert (charpos <= Z);
-
-      /* If the marker is after the deletion,
-	 relocate by number of chars / bytes deleted.  */
-      if (charpos > to)
-	{
-	  m->charpos -= to - from;
-	  m->bytepos -= to_byte - from_byte;
-	}
-      /* Here's the case where a marker is inside text being deleted.  */
-      else if (charpos > from)
-	{
-	  m->charpos = from;
-	  m->bytepos = from_byte;
-	}
-    }
+  relocate_markers_for_delete (current_buffer, from, from_byte, to, to_byte);
 }
 
 
@@ -277,39 +259,19 @@ adjust_markers_for_delete (ptrdiff_t from, ptrdiff_t from_byte,
 
    When a marker points at the insertion point,
    we advance it if either its insertion-type is t
-   or BEFORE_MARKERS is true.  */
+   or BEFORE_MARKERS is true.
+
+   This must be called after Z is updated for the insertion.  */
 
 static void
 adjust_markers_for_insert (ptrdiff_t from, ptrdiff_t from_byte,
 			   ptrdiff_t to, ptrdiff_t to_byte, bool before_markers)
 {
-  struct Lisp_Marker *m;
-  bool adjusted = 0;
-  ptrdiff_t nchars = to - from;
-  ptrdiff_t nbytes = to_byte - from_byte;
+  bool adjusted;
 
   adjust_suspend_auto_hscroll (from, to);
-  for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-    {
-      eassert (m->bytepos >= m->charpos
-	       && m->bytepos - m->charpos <= Z_BYTE - Z);
-
-      if (m->bytepos == from_byte)
-	{
-	  if (m->insertion_type || before_markers)
-	    {
-	      m->bytepos = to_byte;
-	      m->charpos = to;
-	      if (m->insertion_type)
-		adjusted = 1;
-	    }
-	}
-      else if (m->bytepos > from_byte)
-	{
-	  m->bytepos += nbytes;
-	  m->charpos += nchars;
-	}
-    }
+  adjusted = relocate_markers_for_insert (current_buffer, from, from_byte,
+					  to, to_byte, before_markers);
 
   /* Adjusting only markers whose insertion-type is t may result in
      - disordered start and end in overlays, and
@@ -342,32 +304,17 @@ adjust_point (ptrdiff_t nchars, ptrdiff_t nbytes)
 /* Adjust markers for a replacement of a text at FROM (FROM_BYTE) of
    length OLD_CHARS (OLD_BYTES) to a new text of length NEW_CHARS
    (NEW_BYTES).  It is assumed that OLD_CHARS > 0, i.e., this is not
-   an insertion.  */
+   an insertion.  This must be called after Z is updated for the
+   replacement.  */
 
 static void
 adjust_markers_for_replace (ptrdiff_t from, ptrdiff_t from_byte,
 			    ptrdiff_t old_chars, ptrdiff_t old_bytes,
 			    ptrdiff_t new_chars, ptrdiff_t new_bytes)
 {
-  register struct Lisp_Marker *m;
-  ptrdiff_t prev_to_byte = from_byte + old_bytes;
-  ptrdiff_t diff_chars = new_chars - old_chars;
-  ptrdiff_t diff_bytes = new_bytes - old_bytes;
-
   adjust_suspend_auto_hscroll (from, from + old_chars);
-  for (m = BUF_MARKERS (current_buffer); m; m = m->next)
-    {
-      if (m->bytepos >= prev_to_byte)
-	{
-	  m->charpos += diff_chars;
-	  m->bytepos += diff_bytes;
-	}
-      else if (m->bytepos > from_byte)
-	{
-	  m->charpos = from;
-	  m->bytepos = from_byte;
-	}
-    }
+  relocate_markers_for_replace (current_buffer, from, from_byte,
+				old_chars, old_bytes, new_chars, new_bytes);
 
   check_markers ();
 }
@@ -405,38 +352,36 @@ adjust_markers_bytepos (ptrdiff_t from, ptrdiff_t from_byte,
 {
   register struct Lisp_Marker *m;
   ptrdiff_t beg = from, begbyte = from_byte;
+  ptrdiff_t i = marker_index_from (current_buffer, from + 1);
+  ptrdiff_t end = (to_z ? buf_markers_count (current_buffer)
+		   : marker_index_from (current_buffer, to + 1));
 
   adjust_suspend_auto_hscroll (from, to);
 
+  /* The markers are in order of position, so the affected ones are
+     those from I to END; make their positions absolute so we can
+     change them directly.  */
+  move_marker_gap (current_buffer, end);
+
   if (Z == Z_BYTE || (!to_z && to == to_byte))
     {
       /* Make sure each affected marker's bytepos is equal to
 	 its charpos.  */
-      for (m = BUF_MARKERS (current_buffer); m; m = m->next)
+      for (; i < end; i++)
 	{
-	  if (m->bytepos > from_byte
-	      && (to_z || m->bytepos <= to_byte))
-	    m->bytepos = m->charpos;
+	  m = buf_marker (current_buffer, i);
+	  m->bytepos_ = m->charpos_;
 	}
     }
   else
     {
-      for (m = BUF_MARKERS (current_buffer); m; m = m->next)
+      for (; i < end; i++)
 	{
 	  /* Recompute each affected marker's bytepos.  */
-	  if (m->bytepos > from_byte
-	      && (to_z || m->bytepos <= to_byte))
-	    {
-	      if (m->charpos < beg
-		  && beg - m->charpos > m->charpos - from)
-		{
-		  beg = from;
-		  begbyte = from_byte;
-		}
-	      m->bytepos = count_bytes (beg, begbyte, m->charpos);
-	      beg = m->charpos;
-	      begbyte = m->bytepos;
-	    }
+	  m = buf_marker (current_buffer, i);
+	  m->bytepos_ = count_bytes (beg, begbyte, m->charpos_);
+	  beg = m->charpos_;
+	  begbyte = m->bytepos_;
 	}
     }
 
@@ -1077,14 +1022,11 @@ insert_from_string_1 (Lisp_Object string, ptrdiff_t pos, ptrdiff_t pos_byte,
   check_markers ();
 }
 
-/* Insert a sequence of NCHARS chars which occupy NBYTES bytes
-   starting at GAP_END_ADDR - NBYTES (if text_at_gap_tail) and at
-   GPT_ADDR (if not text_at_gap_tail).
-   Contrary to insert_from_gap, this does not invalidate any cache,
-   nor update any markers, nor record any buffer modification information
-   of any sort.  */
-void
-insert_from_gap_1 (ptrdiff_t nchars, ptrdiff_t nbytes, bool text_at_gap_tail)
+/* Make the NCHARS chars which occupy NBYTES bytes in the gap part of
+   the buffer text, as described for insert_from_gap_1, leaving the
+   markers for the caller to adjust.  */
+static void
+insert_from_gap_2 (ptrdiff_t nchars, ptrdiff_t nbytes, bool text_at_gap_tail)
 {
   eassert (NILP (BVAR (current_buffer, enable_multibyte_characters))
            ? nchars == nbytes : nchars <= nbytes);
@@ -1105,6 +1047,21 @@ insert_from_gap_1 (ptrdiff_t nchars, ptrdiff_t nbytes, bool text_at_gap_tail)
   eassert (GPT <= GPT_BYTE);
 }
 
+/* Insert a sequence of NCHARS chars which occupy NBYTES bytes
+   starting at GAP_END_ADDR - NBYTES (if text_at_gap_tail) and at
+   GPT_ADDR (if not text_at_gap_tail).
+   Contrary to insert_from_gap, this does not invalidate any cache,
+   nor update any markers, nor record any buffer modification information
+   of any sort.  */
+void
+insert_from_gap_1 (ptrdiff_t nchars, ptrdiff_t nbytes, bool text_at_gap_tail)
+{
+  /* Markers after the marker gap would follow the change of Z, so
+     make all their positions absolute to leave them where they are.  */
+  move_marker_gap (current_buffer, buf_markers_count (current_buffer));
+  insert_from_gap_2 (nchars, nbytes, text_at_gap_tail);
+}
+
 /* Insert a sequence of NCHARS chars which occupy NBYTES bytes
    starting at GAP_END_ADDR - NBYTES (if text_at_gap_tail) and at
    GPT_ADDR (if not text_at_gap_tail).  */
@@ -1125,7 +1082,7 @@ insert_from_gap (ptrdiff_t nchars, ptrdiff_t nbytes, bool text_at_gap_tail)
   record_insert (GPT, nchars);
   modiff_incr (&MODIFF);
 
-  insert_from_gap_1 (nchars, nbytes, text_at_gap_tail);
+  insert_from_gap_2 (nchars, nbytes, text_at_gap_tail);
 
   adjust_overlays_for_insert (ins_charpos, nchars);
   adjust_markers_for_insert (ins_charpos, ins_bytepos,
@@ -1429,6 +1386,11 @@ replace_range (ptrdiff_t from, ptrdiff_t to, Lisp_Object new,
   if (nbytes_del <= 0 && insbytes == 0)
     return;
 
+  /* If we are not to relocate markers, make all their positions
+     absolute, so they stay put while Z changes.  */
+  if (!markers)
+    move_marker_gap (current_buffer, buf_markers_count (current_buffer));
+
   /* Make OUTGOING_INSBYTES describe the text
      as it will be inserted in this buffer.  */
 
@@ -1585,6 +1547,11 @@ replace_range_2 (ptrdiff_t from, ptrdiff_t from_byte,
   if (nbytes_del <= 0 && insbytes == 0)
     return;
 
+  /* If we are not to relocate markers, make all their positions
+     absolute, so they stay put while Z changes.  */
+  if (!markers)
+    move_marker_gap (current_buffer, buf_markers_count (current_buffer));
+
   /* Make sure the gap is somewhere in or next to what we are deleting.  */
   if (from > GPT)
     gap_right (from, from_byte);
@@ -2016,6 +1983,12 @@ prepare_to_modify_buffer (ptrdiff_t start, ptrdiff_t end,
 			  ptrdiff_t *preserve_ptr)
 {
   prepare_to_modify_buffer_1 (start, end, preserve_ptr);
+
+  /* Likewise for the contents of a mapped file, but only when the text
+     itself changes, as the file can be large.  */
+  if (current_buffer->text->mapped_bytes)
+    enlarge_buffer_text (current_buffer, 0);
+
   invalidate_buffer_caches (current_buffer, start, end);
 }
 
@@ -2071,6 +2044,10 @@ invalidate_buffer_caches (struct buffer *buf, ptrdiff_t start, ptrdiff_t end)
     invalidate_region_cache (buf,
                              buf->width_run_cache,
                              start - BUF_BEG (buf), BUF_Z (buf) - end);
+  if (buf->syntax_ppss_cache)
+    invalidate_syntax_ppss_cache (buf, start);
+  if (buf->column_cache)
+    invalidate_column_cache (buf, start);
 }
 
 /* These macros work with an argument named `preserve_ptr'
@@ -23,9 +23,6 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
    Have to ensure that we can't put symbol nil on a plist, or some
    functions may work incorrectly.
 
-   An idea:  Have the owner of the tree keep count of splits and/or
-   insertion lengths (in intervals), and balance after every N.
-
    Need to call *_left_hook when buffer is killed.
 
    Scan for zero-length, or 0-length to see notes about handling
@@ -73,7 +70,7 @@ set_interval_right (INTERVAL i, INTERVAL right)
 }
 
 /* Make the parent of D be whatever the parent of S is, regardless
-   of the type.  This is used when balancing an interval tree.  */
+   of the type.  This is used when rotating an interval tree.  */
 
 static void
 copy_interval_parent (INTERVAL d, INTERVAL s)
@@ -360,109 +357,183 @@ rotate_left (INTERVAL A)
   return B;
 }
 
-/* Balance an interval tree with the assumption that the subtrees
-   themselves are already balanced.  */
+/* The intervals of a tree form a treap: besides being ordered by
+   position, every interval has a random priority that is no greater
+   than that of its parent.  The shape of the tree is then that of a
+   tree made by inserting its intervals in random order, whatever the
+   order in which they were actually made, as when text is appended
+   again and again at the end of a buffer, so that its height stays
+   logarithmic in the number of intervals with high probability.  */
 
-static INTERVAL
-balance_an_interval (INTERVAL i)
+static uint32_t interval_priority_state = 2463534242;
+
+/* Return a priority for a new interval.  */
+
+uint32_t
+random_interval_priority (void)
 {
-  register ptrdiff_t old_diff, new_diff;
+  /* Marsaglia's xorshift generator.  */
+  uint32_t x = interval_priority_state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return interval_priority_state = x;
+}
 
-  eassert (LENGTH (i) > 0);
-  eassert (TOTAL_LENGTH (i) >= LENGTH (i));
+/* Make the root interval I the interval tree of its buffer or string,
+   if any.  */
 
-  while (1)
+static void
+store_root_interval (INTERVAL i)
+{
+  if (INTERVAL_HAS_OBJECT (i))
     {
-      old_diff = LEFT_TOTAL_LENGTH (i) - RIGHT_TOTAL_LENGTH (i);
-      if (old_diff > 0)
-	{
-	  /* Since the left child is longer, there must be one.  */
-	  new_diff = i->total_length - i->left->total_length
-	    + RIGHT_TOTAL_LENGTH (i->left) - LEFT_TOTAL_LENGTH (i->left);
-	  if (eabs (new_diff) >= old_diff)
-	    break;
-	  i = rotate_right (i);
-	  balance_an_interval (i->right);
-	}
-      else if (old_diff < 0)
-	{
-	  /* Since the right child is longer, there must be one.  */
-	  new_diff = i->total_length - i->right->total_length
-	    + LEFT_TOTAL_LENGTH (i->right) - RIGHT_TOTAL_LENGTH (i->right);
-	  if (eabs (new_diff) >= -old_diff)
-	    break;
-	  i = rotate_left (i);
-	  balance_an_interval (i->left);
-	}
+      Lisp_Object owner;
+      GET_INTERVAL_OBJECT (owner, i);
+      if (BUFFERP (owner))
+	set_buffer_intervals (XBUFFER (owner), i);
+      else if (STRINGP (owner))
+	set_string_intervals (owner, i);
+    }
+}
+
+/* Rotate the interval I, which has just been added to its tree, up
+   above the intervals with a lower priority.  */
+
+static void
+sift_up_interval (INTERVAL i)
+{
+  while (INTERVAL_HAS_PARENT (i)
+	 && INTERVAL_PARENT (i)->priority < i->priority)
+    {
+      if (AM_LEFT_CHILD (i))
+	rotate_right (INTERVAL_PARENT (i));
       else
-	break;
+	rotate_left (INTERVAL_PARENT (i));
     }
-  return i;
+  if (ROOT_INTERVAL_P (i))
+    store_root_interval (i);
 }
 
-/* Balance INTERVAL, potentially stuffing it back into its parent
-   Lisp Object.  */
+/* Merge the subtrees LEFT and RIGHT, all of whose text precedes that
+   of RIGHT, into one subtree, which is returned.  Caller is
+   responsible for storing it into its parent.  */
 
 static INTERVAL
-balance_possible_root_interval (INTERVAL interval)
+merge_subtrees (INTERVAL left, INTERVAL right)
 {
-  Lisp_Object parent;
-  bool have_parent = false;
+  if (!left)
+    return right;
+  if (!right)
+    return left;
 
-  if (INTERVAL_HAS_OBJECT (interval))
+  if (left->priority >= right->priority)
     {
-      have_parent = true;
-      GET_INTERVAL_OBJECT (parent, interval);
+      left->total_length += right->total_length;
+      INTERVAL sub = merge_subtrees (left->right, right);
+      set_interval_right (left, sub);
+      set_interval_parent (sub, left);
+      return left;
     }
-  else if (!INTERVAL_HAS_PARENT (interval))
-    return interval;
+  else
+    {
+      right->total_length += left->total_length;
+      INTERVAL sub = merge_subtrees (left, right->left);
+      set_interval_left (right, sub);
+      set_interval_parent (sub, right);
+      return right;
+    }
+}
 
-  interval = balance_an_interval (interval);
+/* Split the subtree TREE at OFFSET characters from its start, which
+   must be a boundary between intervals, into the subtree *LEFT of
+   the intervals before OFFSET and the subtree *RIGHT of the others.
+   Caller is responsible for storing them into their parents.  */
 
-  if (have_parent)
+static void
+split_subtree (INTERVAL tree, ptrdiff_t offset,
+	       INTERVAL *left, INTERVAL *right)
+{
+  if (!tree)
     {
-      if (BUFFERP (parent))
-	set_buffer_intervals (XBUFFER (parent), interval);
-      else if (STRINGP (parent))
-	set_string_intervals (parent, interval);
+      *left = *right = NULL;
+      return;
     }
 
-  return interval;
+  ptrdiff_t left_length = LEFT_TOTAL_LENGTH (tree);
+  INTERVAL sub;
+
+  if (offset <= left_length)
+    {
+      split_subtree (tree->left, offset, left, &sub);
+      tree->total_length -= left_length - TOTAL_LENGTH (sub);
+      set_interval_left (tree, sub);
+      if (sub)
+	set_interval_parent (sub, tree);
+      *right = tree;
+    }
+  else
+    {
+      ptrdiff_t skip = left_length + LENGTH (tree);
+      ptrdiff_t right_length = RIGHT_TOTAL_LENGTH (tree);
+      eassert (offset >= skip);
+      split_subtree (tree->right, offset - skip, &sub, right);
+      tree->total_length -= right_length - TOTAL_LENGTH (sub);
+      set_interval_right (tree, sub);
+      if (sub)
+	set_interval_parent (sub, tree);
+      *left = tree;
+    }
 }
 
-/* Balance the interval tree TREE.  Balancing is by weight
-   (the amount of text).  */
+/* Make a tree of the N intervals NODES, which have no children, whose
+   total_length is their own length, and which are in order.  Return
+   its root, whose parent is NULL.  This takes linear time: the tree is
+   built from left to right, keeping the intervals on its right edge in
+   NODES, whose slots are no longer needed for the intervals already
+   added.  */
 
 static INTERVAL
-balance_intervals_internal (register INTERVAL tree)
+build_interval_tree (INTERVAL *nodes, ptrdiff_t n)
 {
-  /* Balance within each side.  */
-  if (tree->left)
-    balance_intervals_internal (tree->left);
-  if (tree->right)
-    balance_intervals_internal (tree->right);
-  return balance_an_interval (tree);
-}
+  ptrdiff_t depth = 0;
 
-/* Advertised interface to balance intervals.  */
+  for (ptrdiff_t k = 0; k < n; k++)
+    {
+      INTERVAL i = nodes[k], last = NULL;
 
-INTERVAL
-balance_intervals (INTERVAL tree)
-{
-  return tree ? balance_intervals_internal (tree) : NULL;
-}
+      /* The intervals taken off the right edge are complete.  */
+      while (depth > 0 && nodes[depth - 1]->priority < i->priority)
+	{
+	  last = nodes[--depth];
+	  last->total_length += RIGHT_TOTAL_LENGTH (last);
+	}
 
-/* Rebalance text properties of B.  */
+      set_interval_left (i, last);
+      if (last)
+	{
+	  set_interval_parent (last, i);
+	  i->total_length += last->total_length;
+	}
+      if (depth > 0)
+	{
+	  set_interval_right (nodes[depth - 1], i);
+	  set_interval_parent (i, nodes[depth - 1]);
+	}
+      nodes[depth++] = i;
+    }
 
-static void
-buffer_balance_intervals (struct buffer *b)
-{
-  INTERVAL i;
+  while (depth > 1)
+    {
+      INTERVAL last = nodes[--depth];
+      last->total_length += RIGHT_TOTAL_LENGTH (last);
+    }
 
-  eassert (b != NULL);
-  i = buffer_intervals (b);
-  if (i)
-    set_buffer_intervals (b, balance_an_interval (i));
+  if (n == 0)
+    return NULL;
+  nodes[0]->total_length += RIGHT_TOTAL_LENGTH (nodes[0]);
+  set_interval_parent (nodes[0], NULL);
+  return nodes[0];
 }
 
 /* Split INTERVAL into two pieces, starting the second piece at
@@ -475,36 +546,39 @@ buffer_balance_intervals (struct buffer *b)
    is reset, thus it is up to the caller to do the right thing with the
    result.
 
-   Note that this does not change the position of INTERVAL;  if it is a root,
-   it is still a root after this operation.  */
+   Note that this does not change the position of INTERVAL, but the
+   new interval may become the root of the tree in its place.  */
 
 INTERVAL
 split_interval_right (INTERVAL interval, ptrdiff_t offset)
 {
   INTERVAL new = make_interval ();
-  ptrdiff_t position = interval->position;
   ptrdiff_t new_length = LENGTH (interval) - offset;
 
-  new->position = position + offset;
-  set_interval_parent (new, interval);
+  new->position = interval->position + offset;
+  new->total_length = new_length;
+  eassert (LENGTH (new) > 0);
 
   if (NULL_RIGHT_CHILD (interval))
     {
       set_interval_right (interval, new);
-      new->total_length = new_length;
-      eassert (LENGTH (new) > 0);
+      set_interval_parent (new, interval);
     }
   else
     {
-      /* Insert the new node between INTERVAL and its right child.  */
-      set_interval_right (new, interval->right);
-      set_interval_parent (interval->right, new);
-      set_interval_right (interval, new);
-      new->total_length = new_length + new->right->total_length;
-      balance_an_interval (new);
+      /* Make NEW the first interval of the right subtree.  */
+      INTERVAL i = interval->right;
+      i->total_length += new_length;
+      while (i->left)
+	{
+	  i = i->left;
+	  i->total_length += new_length;
+	}
+      set_interval_left (i, new);
+      set_interval_parent (new, i);
     }
 
-  balance_possible_root_interval (interval);
+  sift_up_interval (new);
 
   return new;
 }
@@ -519,8 +593,8 @@ split_interval_right (INTERVAL interval, ptrdiff_t offset)
    is reset, thus it is up to the caller to do the right thing with the
    result.
 
-   Note that this does not change the position of INTERVAL;  if it is a root,
-   it is still a root after this operation.  */
+   Note that the new interval may become the root of the tree in place
+   of INTERVAL.  */
 
 INTERVAL
 split_interval_left (INTERVAL interval, ptrdiff_t offset)
@@ -530,29 +604,33 @@ split_interval_left (INTERVAL interval, ptrdiff_t offset)
 
   new->position = interval->position;
   interval->position = interval->position + offset;
-  set_interval_parent (new, interval);
+  new->total_length = new_length;
+  eassert (LENGTH (new) > 0);
 
   if (NULL_LEFT_CHILD (interval))
     {
       set_interval_left (interval, new);
-      new->total_length = new_length;
-      eassert (LENGTH (new) > 0);
+      set_interval_parent (new, interval);
     }
   else
     {
-      /* Insert the new node between INTERVAL and its left child.  */
-      set_interval_left (new, interval->left);
-      set_interval_parent (new->left, new);
-      set_interval_left (interval, new);
-      new->total_length = new_length + new->left->total_length;
-      balance_an_interval (new);
+      /* Make NEW the last interval of the left subtree.  */
+      INTERVAL i = interval->left;
+      i->total_length += new_length;
+      while (i->right)
+	{
+	  i = i->right;
+	  i->total_length += new_length;
+	}
+      set_interval_right (i, new);
+      set_interval_parent (new, i);
     }
 
-  balance_possible_root_interval (interval);
+  sift_up_interval (new);
 
   return new;
 }
-
+
 /* Return the proper position for the first character
    described by the interval tree SOURCE.
    This is 1 if the parent is a buffer,
@@ -608,8 +686,6 @@ find_interval (register INTERVAL tree, register ptrdiff_t position)
 
   eassert (relative_position <= TOTAL_LENGTH (tree));
 
-  tree = balance_possible_root_interval (tree);
-
   while (1)
     {
       eassert (tree);
@@ -909,10 +985,7 @@ adjust_intervals_for_insertion (INTERVAL tree,
 	 to the left one if it exists.  We extend it now and split
 	 off a part later, if stickiness demands it.  */
       for (temp = prev ? prev : i; temp; temp = INTERVAL_PARENT_OR_NULL (temp))
-	{
-	  temp->total_length += length;
-	  temp = balance_possible_root_interval (temp);
-	}
+	temp->total_length += length;
 
       /* If at least one interval has sticky properties,
 	 we check the stickiness property by property.
@@ -964,10 +1037,7 @@ adjust_intervals_for_insertion (INTERVAL tree,
   else
     {
       for (temp = i; temp; temp = INTERVAL_PARENT_OR_NULL (temp))
-	{
-	  temp->total_length += length;
-	  temp = balance_possible_root_interval (temp);
-	}
+	temp->total_length += length;
     }
 
   return tree;
@@ -1150,29 +1220,7 @@ merge_properties_sticky (Lisp_Object pleft, Lisp_Object pright)
 static INTERVAL
 delete_node (register INTERVAL i)
 {
-  register INTERVAL migrate, this;
-  register ptrdiff_t migrate_amt;
-
-  if (!i->left)
-    return i->right;
-  if (!i->right)
-    return i->left;
-
-  migrate = i->left;
-  migrate_amt = i->left->total_length;
-  this = i->right;
-  this->total_length += migrate_amt;
-  while (this->left)
-    {
-      this = this->left;
-      this->total_length += migrate_amt;
-    }
-  set_interval_left (this, migrate);
-  set_interval_parent (migrate, this);
-  eassert (LENGTH (this) > 0);
-  eassert (LENGTH (i->right) > 0);
-
-  return i->right;
+  return merge_subtrees (i->left, i->right);
 }
 
 /* Delete interval I from its tree by calling `delete_node'
@@ -1484,6 +1532,7 @@ reproduce_interval (INTERVAL source)
 
   target->total_length = source->total_length;
   target->position = source->position;
+  target->priority = source->priority;
 
   copy_properties (source, target);
 
@@ -1517,6 +1566,66 @@ reproduce_tree_obj (INTERVAL source, Lisp_Object parent)
   return target;
 }
 
+/* Below this many intervals, graft_intervals_into_buffer splits the
+   intervals of the buffer for each of them.  */
+
+enum { GRAFT_BULK_MIN = 8 };
+
+/* Replace the first LENGTH characters of UNDER, an interval of BUFFER
+   which starts at POSITION, by copies of the intervals from SOURCE
+   on, as graft_intervals_into_buffer does.  */
+
+static void
+graft_intervals_bulk (INTERVAL source, INTERVAL under, ptrdiff_t position,
+		      ptrdiff_t length, struct buffer *buffer, bool inherit)
+{
+  ptrdiff_t n = 0, got = 0;
+  INTERVAL i, left, middle, right;
+  Lisp_Object buf;
+
+  for (i = source; got < length; i = next_interval (i))
+    {
+      got += LENGTH (i);
+      n++;
+    }
+
+  USE_SAFE_ALLOCA;
+  INTERVAL *nodes;
+  SAFE_NALLOCA (nodes, 1, n);
+
+  i = source;
+  for (ptrdiff_t k = 0; k < n; k++)
+    {
+      INTERVAL new = make_interval ();
+      new->total_length = LENGTH (i);
+      if (inherit)
+	{
+	  copy_properties (under, new);
+	  merge_properties (i, new);
+	}
+      else
+	copy_properties (i, new);
+      nodes[k] = new;
+      i = next_interval (i);
+    }
+
+  if (LENGTH (under) > length)
+    copy_properties (under, split_interval_left (under, length));
+
+  /* Take the new text out of the tree, and put the new intervals in
+     its place.  */
+  split_subtree (buffer_intervals (buffer), position - BUF_BEG (buffer),
+		 &left, &middle);
+  split_subtree (middle, length, &middle, &right);
+  eassert (TOTAL_LENGTH (middle) == length);
+  middle = build_interval_tree (nodes, n);
+  middle = merge_subtrees (merge_subtrees (left, middle), right);
+  XSETBUFFER (buf, buffer);
+  set_interval_object (middle, buf);
+  set_buffer_intervals (buffer, middle);
+  SAFE_FREE ();
+}
+
 /* Insert the intervals of SOURCE into BUFFER at POSITION.
    LENGTH is the length of the text in SOURCE.
 
@@ -1578,8 +1687,6 @@ graft_intervals_into_buffer (INTERVAL source, ptrdiff_t position,
 				 Qnil, buf,
 				 find_interval (tree, position));
 	}
-      /* Shouldn't be necessary.  --Stef  */
-      buffer_balance_intervals (buffer);
       return;
     }
 
@@ -1642,6 +1749,23 @@ graft_intervals_into_buffer (INTERVAL source, ptrdiff_t position,
 
   /* Insertion is now at beginning of UNDER.  */
 
+  /* When the new text lies in UNDER, as after offset_intervals, and
+     comes with many intervals, cut it out of the tree and put in its
+     place a tree of the copies of these intervals built at once,
+     rather than splitting UNDER for each of them.  */
+  if (LENGTH (under) >= length)
+    {
+      ptrdiff_t n = 0;
+      for (INTERVAL i = over; i && n <= GRAFT_BULK_MIN; i = next_interval (i))
+	n++;
+      if (n > GRAFT_BULK_MIN)
+	{
+	  graft_intervals_bulk (over, under, position, length, buffer,
+				inherit);
+	  return;
+	}
+    }
+
   /* The inserted text "sticks" to the interval `under',
      which means it gets those properties.
      The properties of under are the result of
@@ -1685,8 +1809,6 @@ graft_intervals_into_buffer (INTERVAL source, ptrdiff_t position,
       /* Always advance to a new target interval.  */
       under = next_interval (this);
     }
-
-  buffer_balance_intervals (buffer);
 }
 
 /* Get the value of property PROP from PLIST,
@@ -2218,13 +2340,13 @@ get_local_map (ptrdiff_t position, struct buffer *buffer, Lisp_Object type)
 INTERVAL
 copy_intervals (INTERVAL tree, ptrdiff_t start, ptrdiff_t length)
 {
-  register INTERVAL i, new, t;
-  register ptrdiff_t got, prevlen;
+  register INTERVAL i, first, new;
+  register ptrdiff_t got, n;
 
   if (!tree || length <= 0)
     return NULL;
 
-  i = find_interval (tree, start);
+  first = i = find_interval (tree, start);
   eassert (i && LENGTH (i) > 0);
 
   /* If there is only one interval and it's the default, return nil.  */
@@ -2232,25 +2354,36 @@ copy_intervals (INTERVAL tree, ptrdiff_t start, ptrdiff_t length)
       && DEFAULT_INTERVAL_P (i))
     return NULL;
 
-  new = make_interval ();
-  new->position = 0;
-  got = (LENGTH (i) - (start - i->position));
-  new->total_length = length;
-  eassert (TOTAL_LENGTH (new) >= 0);
-  copy_properties (i, new);
+  /* Count the intervals to copy, then build their tree at once.  */
+  got = LENGTH (i) - (start - i->position);
+  for (n = 1; got < length; n++)
+    {
+      i = next_interval (i);
+      got += LENGTH (i);
+    }
 
-  t = new;
-  prevlen = got;
-  while (got < length)
+  USE_SAFE_ALLOCA;
+  INTERVAL *nodes;
+  SAFE_NALLOCA (nodes, 1, n);
+
+  i = first;
+  got = 0;
+  for (ptrdiff_t k = 0; k < n; k++)
     {
+      new = make_interval ();
+      new->total_length = min (length - got,
+			       k == 0 ? LENGTH (i) - (start - i->position)
+			       : LENGTH (i));
+      got += new->total_length;
+      copy_properties (i, new);
+      nodes[k] = new;
       i = next_interval (i);
-      t = split_interval_right (t, prevlen);
-      copy_properties (i, t);
-      prevlen = LENGTH (i);
-      got += prevlen;
     }
 
-  return balance_an_interval (new);
+  new = build_interval_tree (nodes, n);
+  new->position = 0;
+  SAFE_FREE ();
+  return new;
 }
 
 /* Give STRING the properties of BUFFER from POSITION to LENGTH.  */
@@ -2401,4 +2534,5 @@ set_intervals_multibyte (bool multi_flag)
 
   if (i)
     set_intervals_multibyte_1 (i, multi_flag, BEG, BEG_BYTE, Z, Z_BYTE);
+  invalidate_text_property_index (current_buffer);
 }
@@ -62,6 +62,11 @@ struct interval
   bool_bf front_sticky : 1;	    /* True means text inserted just
 				       before this interval goes into it.  */
   bool_bf rear_sticky : 1;	    /* Likewise for just after it.  */
+
+  /* Random priority, never greater than that of the parent, which
+     keeps the tree balanced; see intervals.c.  */
+  uint32_t priority;
+
   Lisp_Object plist;		    /* Other properties.  */
 };
 
@@ -238,6 +243,7 @@ extern INTERVAL make_interval (void);
 
 /* Declared in intervals.c.  */
 
+extern uint32_t random_interval_priority (void);
 extern INTERVAL create_root_interval (Lisp_Object);
 extern void copy_properties (INTERVAL, INTERVAL);
 extern bool intervals_equal (INTERVAL, INTERVAL);
@@ -257,7 +263,6 @@ extern void graft_intervals_into_buffer (INTERVAL, ptrdiff_t, ptrdiff_t,
                                          struct buffer *, bool);
 extern void verify_interval_modification (struct buffer *,
 					  ptrdiff_t, ptrdiff_t);
-extern INTERVAL balance_intervals (INTERVAL);
 extern void copy_intervals_to_string (Lisp_Object, struct buffer *,
                                              ptrdiff_t, ptrdiff_t);
 extern INTERVAL copy_intervals (INTERVAL, ptrdiff_t, ptrdiff_t);
@@ -295,6 +300,8 @@ Lisp_Object get_char_property_and_overlay (Lisp_Object, Lisp_Object,
                                            Lisp_Object, Lisp_Object *);
 extern int text_property_stickiness (Lisp_Object prop, Lisp_Object pos,
                                      Lisp_Object buffer);
+extern void invalidate_text_property_index (struct buffer *);
+extern void free_text_property_index (struct buffer *);
 
 extern void syms_of_textprop (void);
 
@@ -143,6 +143,10 @@ sigjmp_buf return_to_command_loop;
 /* Message displayed by Vtop_level when recovering from C stack overflow.  */
 static Lisp_Object recover_top_level_message;
 
+/* Message displayed by Vtop_level when recovering from the truncation
+   of a file mapped into a buffer.  */
+static Lisp_Object truncated_file_top_level_message;
+
 #endif /* HAVE_STACK_OVERFLOW_HANDLING */
 
 /* Message normally displayed by Vtop_level.  */
@@ -1043,8 +1047,13 @@ command_loop (void)
 {
 #ifdef HAVE_STACK_OVERFLOW_HANDLING
   /* At least on GNU/Linux, saving signal mask is important here.  */
-  if (sigsetjmp (return_to_command_loop, 1) != 0)
+  switch (sigsetjmp (return_to_command_loop, 1))
     {
+    case 0:
+      Vinternal__top_level_message = regular_top_level_message;
+      break;
+
+    case 1:
       /* Comes here from handle_sigsegv (see sysdep.c) and
 	 stack_overflow_handler (see w32fns.c).  */
 #ifdef WINDOWSNT
@@ -1052,9 +1061,15 @@ command_loop (void)
 #endif
       init_eval ();
       Vinternal__top_level_message = recover_top_level_message;
+      break;
+
+    default:
+      /* Comes here from handle_sigbus (see sysdep.c).  */
+      init_eval ();
+      recover_file_mappings ();
+      Vinternal__top_level_message = truncated_file_top_level_message;
+      break;
     }
-  else
-    Vinternal__top_level_message = regular_top_level_message;
 #endif /* HAVE_STACK_OVERFLOW_HANDLING */
   if (command_loop_level > 0 || minibuf_level > 0)
     {
@@ -2893,6 +2908,7 @@ read_char (int commandflag, Lisp_Object map,
 #ifdef THREADS_ENABLED
 	      || EQ (XCAR (c), Qthread_event)
 #endif
+	      || EQ (XCAR (c), Qfile_io_event)
 	      || EQ (XCAR (c), Qconfig_changed_event))
           && !end_time)
 	/* We stopped being idle for this event; undo that.  This
@@ -3956,6 +3972,7 @@ kbd_buffer_get_event (KBOARD **kbp,
 #ifdef HAVE_XWIDGETS
       case XWIDGET_EVENT:
 #endif
+      case FILE_IO_EVENT:
       case BUFFER_SWITCH_EVENT:
       case SAVE_SESSION_EVENT:
       case NO_EVENT:
@@ -6042,6 +6059,9 @@ make_lispy_event (struct input_event *event)
       }
 #endif /* THREADS_ENABLED */
 
+    case FILE_IO_EVENT:
+      return Fcons (Qfile_io_event, event->arg);
+
 #ifdef HAVE_XWIDGETS
     case XWIDGET_EVENT:
       {
@@ -11515,6 +11535,10 @@ syms_of_keyboard (void)
   recover_top_level_message
     = build_pure_c_string ("Re-entering top level after C stack overflow");
   staticpro (&recover_top_level_message);
+  truncated_file_top_level_message
+    = build_pure_c_string ("Re-entering top level after a file mapped"
+			   " into a buffer was truncated");
+  staticpro (&truncated_file_top_level_message);
 #endif
   DEFVAR_LISP ("internal--top-level-message", Vinternal__top_level_message,
 	       doc: /* Message displayed by `normal-top-level'.  */);
@@ -11588,6 +11612,8 @@ syms_of_keyboard (void)
   DEFSYM (Qxwidget_event, "xwidget-event");
 #endif
 
+  DEFSYM (Qfile_io_event, "file-io-event");
+
 #ifdef USE_FILE_NOTIFY
   DEFSYM (Qfile_notify, "file-notify");
 #endif /* USE_FILE_NOTIFY */
@@ -12495,6 +12521,11 @@ keys_of_keyboard (void)
                             "file-notify-handle-event");
 #endif /* USE_FILE_NOTIFY */
 
+  /* Define a special event which is raised when an asynchronous file
+     operation finishes.  */
+  initial_define_lispy_key (Vspecial_event_map, "file-io-event",
+			    "file-io-handle-event");
+
   initial_define_lispy_key (Vspecial_event_map, "config-changed-event",
 			    "ignore");
 #if defined (WINDOWSNT)
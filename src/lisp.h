@@ -2470,13 +2470,13 @@ struct Lisp_Marker
   union vectorlike_header header;
 
   /* This is the buffer that the marker points into, or 0 if it points nowhere.
-     Note: a chain of markers can contain markers pointing into different
-     buffers (the chain is per buffer_text rather than per buffer, so it's
+     Note: a marker index can contain markers pointing into different
+     buffers (the index is per buffer_text rather than per buffer, so it's
      shared between indirect buffers).  */
   /* This is used for (other than NULL-checking):
      - Fmarker_buffer
      - Fset_marker: check eq(oldbuf, newbuf) to avoid unchain+rechain.
-     - unchain_marker: to find the list from which to unchain.
+     - unchain_marker: to find the index from which to unchain.
      - Fkill_buffer: to only unchain the markers of current indirect buffer.
      */
   struct buffer *buffer;
@@ -2488,24 +2488,28 @@ struct Lisp_Marker
   /* True means normal insertion at the marker's position
      leaves the marker after the inserted text.  */
   bool_bf insertion_type : 1;
+  /* True means CHARPOS_ and BYTEPOS_ count backwards from the end of
+     the buffer text rather than forwards from its beginning.  This is
+     the case for the markers after the gap of the buffer's marker
+     index, see the comment of `markers' in struct buffer_text.  */
+  bool_bf relative : 1;
+  /* True means the marker was made by make_recyclable_marker for
+     save-excursion or save-restriction, and is not visible to Lisp,
+     so it can be reused once they exit.  */
+  bool_bf recyclable : 1;
 
   /* The remaining fields are meaningless in a marker that
      does not point anywhere.  */
 
-  /* For markers that point somewhere,
-     this is used to chain of all the markers in a given buffer.
-     The chain does not preserve markers from garbage collection;
-     instead, markers are removed from the chain when freed by GC.  */
-  /* We could remove it and use an array in buffer_text instead.
-     That would also allow us to preserve it ordered.  */
-  struct Lisp_Marker *next;
-  /* This is the char position where the marker points.  */
-  ptrdiff_t charpos;
+  /* This is the char position where the marker points.
+     Use marker_charpos to get it.  */
+  ptrdiff_t charpos_;
   /* This is the byte position.
      It's mostly used as a charpos<->bytepos cache (i.e. it's not directly
      used to implement the functionality of markers, but rather to (ab)use
-     markers as a cache for char<->byte mappings).  */
-  ptrdiff_t bytepos;
+     markers as a cache for char<->byte mappings).
+     Use marker_bytepos to get it.  */
+  ptrdiff_t bytepos_;
 } GCALIGNED_STRUCT;
 
 /* START and END are markers in the overlay's buffer, and
@@ -3642,6 +3646,9 @@ extern void syms_of_charset (void);
 struct charset;
 
 /* Defined in syntax.c.  */
+extern void invalidate_syntax_ppss_cache (struct buffer *, ptrdiff_t);
+extern void free_syntax_ppss_cache (struct buffer *);
+extern void mark_syntax_ppss_cache (struct buffer *);
 extern void init_syntax_once (void);
 extern void syms_of_syntax (void);
 
@@ -4293,7 +4300,26 @@ extern void clear_charpos_cache (struct buffer *);
 extern ptrdiff_t buf_charpos_to_bytepos (struct buffer *, ptrdiff_t);
 extern ptrdiff_t buf_bytepos_to_charpos (struct buffer *, ptrdiff_t);
 extern void detach_marker (Lisp_Object);
+extern Lisp_Object make_recyclable_marker (struct buffer *, ptrdiff_t,
+					   ptrdiff_t);
+extern void recycle_marker (Lisp_Object);
+extern void discard_recycled_markers (void);
 extern void unchain_marker (struct Lisp_Marker *);
+extern void attach_marker (struct Lisp_Marker *, struct buffer *,
+			   ptrdiff_t, ptrdiff_t);
+extern ptrdiff_t marker_index_from (struct buffer *, ptrdiff_t);
+extern void move_marker_gap (struct buffer *, ptrdiff_t);
+extern void sort_markers (struct buffer *, ptrdiff_t, ptrdiff_t);
+extern bool relocate_markers_for_insert (struct buffer *, ptrdiff_t, ptrdiff_t,
+					 ptrdiff_t, ptrdiff_t, bool);
+extern void relocate_markers_for_delete (struct buffer *, ptrdiff_t, ptrdiff_t,
+					 ptrdiff_t, ptrdiff_t);
+extern void relocate_markers_for_replace (struct buffer *, ptrdiff_t, ptrdiff_t,
+					  ptrdiff_t, ptrdiff_t,
+					  ptrdiff_t, ptrdiff_t);
+extern void unchain_markers_if (struct buffer *,
+				bool (*) (struct Lisp_Marker *, struct buffer *));
+extern void free_marker_index (struct buffer *);
 extern Lisp_Object set_marker_restricted (Lisp_Object, Lisp_Object, Lisp_Object);
 extern Lisp_Object set_marker_both (Lisp_Object, Lisp_Object, ptrdiff_t, ptrdiff_t);
 extern Lisp_Object set_marker_restricted_both (Lisp_Object, Lisp_Object,
@@ -4347,6 +4373,8 @@ fast_string_match_ignore_case (Lisp_Object regexp, Lisp_Object string)
   return fast_string_match_internal (regexp, string, Vascii_canon_table);
 }
 
+extern ptrdiff_t fast_c_string_match_internal (Lisp_Object, const char *,
+					       ptrdiff_t, Lisp_Object);
 extern ptrdiff_t fast_c_string_match_ignore_case (Lisp_Object, const char *,
 						  ptrdiff_t);
 extern ptrdiff_t fast_looking_at (Lisp_Object, ptrdiff_t, ptrdiff_t,
@@ -4419,6 +4447,9 @@ extern void keys_of_keyboard (void);
 /* Defined in indent.c.  */
 extern ptrdiff_t current_column (void);
 extern void invalidate_current_column (void);
+extern void invalidate_column_cache (struct buffer *, ptrdiff_t);
+extern void free_column_cache (struct buffer *);
+extern void mark_column_cache (struct buffer *);
 extern bool indented_beyond_p (ptrdiff_t, ptrdiff_t, EMACS_INT);
 extern void syms_of_indent (void);
 
@@ -4554,6 +4585,11 @@ extern void init_macros (void);
 extern void syms_of_macros (void);
 
 /* Defined in undo.c.  */
+extern void flush_undo_log (struct buffer *);
+extern void free_undo_log (struct buffer *);
+extern void free_undo_logs (struct buffer *);
+extern bool suspend_undo_log (ptrdiff_t);
+extern void resume_undo_log (struct buffer *, ptrdiff_t);
 extern void truncate_undo_list (struct buffer *);
 extern void record_insert (ptrdiff_t, ptrdiff_t);
 extern void record_delete (ptrdiff_t, Lisp_Object, bool);
@@ -4605,8 +4641,25 @@ extern EMACS_INT get_random (void);
 extern void seed_random (void *, ptrdiff_t);
 extern void init_random (void);
 extern void emacs_backtrace (int);
+extern bool guard_file_mapping (void *, size_t);
+extern void unguard_file_mapping (void *);
+extern void catch_file_mapping_faults (void *, sigjmp_buf *);
+extern bool file_mapping_truncated (void *);
+extern size_t repair_file_mapping (void *, size_t);
 extern AVOID emacs_abort (void) NO_INLINE;
+/* Maximum number of bytes to read or write in a single system call.
+   This works around a serious bug in Linux kernels before 2.6.16; see
+   <https://bugzilla.redhat.com/show_bug.cgi?format=multiple&id=612839>.
+   It's likely to work around similar bugs in other operating systems, so do it
+   on all platforms.  Round INT_MAX down to a page size, with the conservative
+   assumption that page sizes are at most 2**18 bytes (any kernel with a
+   page size larger than that shouldn't have the bug).  */
+#ifndef MAX_RW_COUNT
+# define MAX_RW_COUNT (INT_MAX >> 18 << 18)
+#endif
+
 extern int emacs_open (const char *, int, int);
+extern int emacs_open_noquit (const char *, int, int);
 extern int emacs_pipe (int[2]);
 extern int emacs_close (int);
 extern ptrdiff_t emacs_read (int, void *, ptrdiff_t);
@@ -4642,6 +4695,9 @@ extern void syms_of_dired (void);
 extern Lisp_Object directory_files_internal (Lisp_Object, Lisp_Object,
                                              Lisp_Object, Lisp_Object,
                                              bool, Lisp_Object);
+extern Lisp_Object file_cache_attributes (Lisp_Object, Lisp_Object, bool);
+extern void file_cache_notify (Lisp_Object, bool);
+extern void file_cache_forget (Lisp_Object);
 
 /* Defined in term.c.  */
 extern int *char_ins_del_vector;
@@ -4662,6 +4718,8 @@ extern void syms_of_fontset (void);
 
 /* Defined in inotify.c */
 #ifdef HAVE_INOTIFY
+extern void inotify_poll (void);
+extern Lisp_Object inotify_watch_directory (Lisp_Object);
 extern void syms_of_inotify (void);
 #endif
 
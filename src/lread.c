@@ -273,8 +273,8 @@ readchar (Lisp_Object readcharfun, bool *multibyte)
 	  bytepos++;
 	}
 
-      XMARKER (readcharfun)->bytepos = bytepos;
-      XMARKER (readcharfun)->charpos++;
+      attach_marker (XMARKER (readcharfun), inbuffer,
+		     marker_charpos (XMARKER (readcharfun)) + 1, bytepos);
 
       return c;
     }
@@ -442,15 +442,15 @@ unreadchar (Lisp_Object readcharfun, int c)
   else if (MARKERP (readcharfun))
     {
       struct buffer *b = XMARKER (readcharfun)->buffer;
-      ptrdiff_t bytepos = XMARKER (readcharfun)->bytepos;
+      ptrdiff_t bytepos = marker_bytepos (XMARKER (readcharfun));
 
-      XMARKER (readcharfun)->charpos--;
       if (! NILP (BVAR (b, enable_multibyte_characters)))
 	BUF_DEC_POS (b, bytepos);
       else
 	bytepos--;
 
-      XMARKER (readcharfun)->bytepos = bytepos;
+      attach_marker (XMARKER (readcharfun), b,
+		     marker_charpos (XMARKER (readcharfun)) - 1, bytepos);
     }
   else if (STRINGP (readcharfun))
     {
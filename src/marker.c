@@ -23,6 +23,7 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "lisp.h"
 #include "character.h"
 #include "buffer.h"
+#include "pdumper.h"
 
 /* Record one cached position found recently by
    buf_charpos_to_bytepos or buf_bytepos_to_charpos.  */
@@ -32,6 +33,14 @@ static ptrdiff_t cached_bytepos;
 static struct buffer *cached_buffer;
 static modiff_count cached_modiff;
 
+/* Markers given back by recycle_marker, ready to be reused by
+   make_recyclable_marker.  Nothing else references them, so the pool
+   is simply emptied by garbage collection.  */
+
+enum { RECYCLED_MARKERS_MAX = 64 };
+static Lisp_Object recycled_markers[RECYCLED_MARKERS_MAX];
+static int recycled_markers_count;
+
 /* Juanma Barranquero <lekktu@gmail.com> reported ~3x increased
    bootstrap time when byte_char_debug_check is enabled; so this
    is never turned on by --enable-checking configure option.  */
@@ -76,6 +85,433 @@ clear_charpos_cache (struct buffer *b)
     cached_buffer = 0;
 }
 
+/* The marker index.
+
+   The markers of a buffer text are kept in an array sorted by
+   position, with a gap in it like the one in the text itself (see the
+   comment of `markers' in struct buffer_text).  Markers before the gap
+   hold their positions as usual; markers after it have `relative' set
+   and hold their distances from the end of the text, so they keep
+   their place relative to it when the text before them grows or
+   shrinks.  To adjust the markers for an insertion or deletion, we
+   move the gap to the place of the change, which only touches the
+   markers it crosses, and fix up the markers at that place; the rest
+   of the markers follow the change of Z for free.
+
+   The functions below that take a Z or Z_BYTE argument use it in
+   place of the current end of the text, which is needed while the
+   text has already been changed but the markers not yet adjusted.  */
+
+/* Return the char position of marker M in the index, taking Z to be
+   the end of its text.  */
+
+static ptrdiff_t
+index_charpos (struct Lisp_Marker *m, ptrdiff_t z)
+{
+  return m->relative ? z - m->charpos_ : m->charpos_;
+}
+
+/* Return the slot of the marker index of T that holds its Ith
+   marker.  */
+
+static struct Lisp_Marker **
+marker_slot (struct buffer_text *t, ptrdiff_t i)
+{
+  return &t->markers[i < t->markers_gpt ? i : i + t->markers_gap_size];
+}
+
+/* Return the index of the first marker of T whose position is at least
+   CHARPOS or, if AFTER, greater than CHARPOS.  */
+
+static ptrdiff_t
+search_marker_index (struct buffer_text *t, ptrdiff_t charpos, bool after,
+		     ptrdiff_t z)
+{
+  ptrdiff_t lo = 0, hi = t->markers_size - t->markers_gap_size;
+
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      ptrdiff_t pos = index_charpos (*marker_slot (t, mid), z);
+
+      if (pos < charpos || (after && pos == charpos))
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Like search_marker_index, but look for the first marker whose byte
+   position is at least BYTEPOS.  */
+
+static ptrdiff_t
+search_marker_index_byte (struct buffer_text *t, ptrdiff_t bytepos,
+			  ptrdiff_t z_byte)
+{
+  ptrdiff_t lo = 0, hi = t->markers_size - t->markers_gap_size;
+
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      struct Lisp_Marker *m = *marker_slot (t, mid);
+
+      if ((m->relative ? z_byte - m->bytepos_ : m->bytepos_) < bytepos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Switch marker M between holding positions counted from the beginning
+   and from the end of a text whose end is at Z and Z_BYTE.  */
+
+static void
+flip_marker (struct Lisp_Marker *m, ptrdiff_t z, ptrdiff_t z_byte)
+{
+  m->charpos_ = z - m->charpos_;
+  m->bytepos_ = z_byte - m->bytepos_;
+  m->relative = !m->relative;
+}
+
+/* Move the gap of the marker index of T so that it comes before its
+   Ith marker.  */
+
+static void
+move_marker_gap_1 (struct buffer_text *t, ptrdiff_t i,
+		   ptrdiff_t z, ptrdiff_t z_byte)
+{
+  struct Lisp_Marker **markers = t->markers;
+  ptrdiff_t gpt = t->markers_gpt, gap = t->markers_gap_size;
+
+  if (i < gpt)
+    {
+      for (ptrdiff_t j = i; j < gpt; j++)
+	flip_marker (markers[j], z, z_byte);
+      memmove (markers + i + gap, markers + i, (gpt - i) * sizeof *markers);
+    }
+  else if (i > gpt)
+    {
+      for (ptrdiff_t j = gpt + gap; j < i + gap; j++)
+	flip_marker (markers[j], z, z_byte);
+      memmove (markers + gpt, markers + gpt + gap,
+	       (i - gpt) * sizeof *markers);
+    }
+  t->markers_gpt = i;
+}
+
+/* Make room for more markers in the marker index of T.  */
+
+static void
+enlarge_marker_index (struct buffer_text *t)
+{
+  struct Lisp_Marker **markers = t->markers;
+  ptrdiff_t old_size = t->markers_size, size = old_size;
+  ptrdiff_t after = old_size - t->markers_gpt - t->markers_gap_size;
+
+  if (pdumper_object_p (markers))
+    {
+      /* Buffer markers allocated in the dump can't be realloc'd;
+	 copy them out first.  */
+      struct Lisp_Marker **copy = xmalloc (old_size * sizeof *copy);
+      memcpy (copy, markers, old_size * sizeof *copy);
+      markers = copy;
+    }
+  markers = xpalloc (markers, &size, 1, -1, sizeof *markers);
+  memmove (markers + size - after, markers + old_size - after,
+	   after * sizeof *markers);
+  t->markers = markers;
+  t->markers_size = size;
+  t->markers_gap_size += size - old_size;
+}
+
+/* Add marker M to the marker index of T at CHARPOS and BYTEPOS.  */
+
+static void
+index_marker (struct buffer_text *t, struct Lisp_Marker *m,
+	      ptrdiff_t charpos, ptrdiff_t bytepos)
+{
+  if (t->markers_gap_size == 0)
+    enlarge_marker_index (t);
+
+  struct Lisp_Marker **markers = t->markers;
+  ptrdiff_t gpt = t->markers_gpt, gap = t->markers_gap_size;
+
+  /* M can go anywhere among the markers already at CHARPOS; put it
+     as close to the gap as possible, to move the fewest markers.  */
+  ptrdiff_t i = search_marker_index (t, charpos, false, t->z);
+  if (i < gpt)
+    i = min (gpt, search_marker_index (t, charpos, true, t->z));
+
+  if (i <= gpt)
+    {
+      memmove (markers + i + 1, markers + i, (gpt - i) * sizeof *markers);
+      markers[i] = m;
+      m->charpos_ = charpos;
+      m->bytepos_ = bytepos;
+      m->relative = false;
+      t->markers_gpt++;
+    }
+  else
+    {
+      memmove (markers + gpt + gap - 1, markers + gpt + gap,
+	       (i - gpt) * sizeof *markers);
+      markers[i + gap - 1] = m;
+      m->charpos_ = t->z - charpos;
+      m->bytepos_ = t->z_byte - bytepos;
+      m->relative = true;
+    }
+  t->markers_gap_size--;
+}
+
+/* Return the index of marker M in the marker index of T.  */
+
+static ptrdiff_t
+marker_index (struct buffer_text *t, struct Lisp_Marker *m)
+{
+  ptrdiff_t n = t->markers_size - t->markers_gap_size;
+  ptrdiff_t charpos = index_charpos (m, t->z);
+
+  for (ptrdiff_t i = search_marker_index (t, charpos, false, t->z);
+       i < n; i++)
+    {
+      struct Lisp_Marker *tail = *marker_slot (t, i);
+      if (tail == m)
+	return i;
+      /* Error if the marker was not in its index.  */
+      if (index_charpos (tail, t->z) != charpos)
+	break;
+    }
+  emacs_abort ();
+}
+
+/* Remove the Ith marker from the marker index of T, leaving it with
+   positions counted from the beginning of the text.  */
+
+static void
+unindex_marker (struct buffer_text *t, ptrdiff_t i)
+{
+  struct Lisp_Marker **markers = t->markers;
+  ptrdiff_t gpt = t->markers_gpt, gap = t->markers_gap_size;
+  struct Lisp_Marker *m = *marker_slot (t, i);
+
+  if (i < gpt)
+    {
+      memmove (markers + i, markers + i + 1,
+	       (gpt - i - 1) * sizeof *markers);
+      t->markers_gpt--;
+    }
+  else
+    {
+      memmove (markers + gpt + gap + 1, markers + gpt + gap,
+	       (i - gpt) * sizeof *markers);
+      flip_marker (m, t->z, t->z_byte);
+    }
+  t->markers_gap_size++;
+}
+
+/* Return the index of the first marker of B whose position is at
+   least CHARPOS.  */
+
+ptrdiff_t
+marker_index_from (struct buffer *b, ptrdiff_t charpos)
+{
+  return search_marker_index (b->text, charpos, false, BUF_Z (b));
+}
+
+/* Move the gap of the marker index of B so that it comes before its
+   Ith marker.  The markers before I then hold their positions counted
+   from the beginning of the text, and can be changed directly.  */
+
+void
+move_marker_gap (struct buffer *b, ptrdiff_t i)
+{
+  eassert (0 <= i && i <= buf_markers_count (b));
+  move_marker_gap_1 (b->text, i, BUF_Z (b), BUF_Z_BYTE (b));
+}
+
+/* Restore the order of the markers of B from index FROM to index TO
+   (exclusive), after their positions have been changed directly.  All
+   of them must be before the gap of the marker index.  */
+
+void
+sort_markers (struct buffer *b, ptrdiff_t from, ptrdiff_t to)
+{
+  struct Lisp_Marker **markers = b->text->markers;
+
+  eassert (0 <= from && to <= b->text->markers_gpt);
+  for (ptrdiff_t i = from + 1; i < to; i++)
+    {
+      struct Lisp_Marker *m = markers[i];
+      ptrdiff_t j;
+
+      for (j = i; j > from && markers[j - 1]->charpos_ > m->charpos_; j--)
+	markers[j] = markers[j - 1];
+      markers[j] = m;
+    }
+}
+
+/* Relocate the markers of B for an insertion that stretches from FROM
+   / FROM_BYTE to TO / TO_BYTE, and which is already counted in Z and
+   Z_BYTE.  A marker at FROM advances to TO if its insertion-type is t
+   or BEFORE_MARKERS is true.  Return true if any marker whose
+   insertion-type is t was at FROM.  */
+
+bool
+relocate_markers_for_insert (struct buffer *b,
+			     ptrdiff_t from, ptrdiff_t from_byte,
+			     ptrdiff_t to, ptrdiff_t to_byte,
+			     bool before_markers)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t z = BUF_Z (b) - (to - from);
+  ptrdiff_t z_byte = BUF_Z_BYTE (b) - (to_byte - from_byte);
+  ptrdiff_t i = search_marker_index (t, from, false, z);
+  ptrdiff_t n = buf_markers_count (b);
+  struct Lisp_Marker **markers = t->markers;
+  bool adjusted = false;
+
+  /* Once the gap is before the markers at FROM, every marker after it
+     advances with the end of the text.  */
+  move_marker_gap_1 (t, i, z, z_byte);
+
+  ptrdiff_t gap = t->markers_gap_size;
+  for (; i < n; i++)
+    {
+      struct Lisp_Marker *m = markers[i + gap];
+
+      if (z - m->charpos_ != from)
+	break;
+      if (m->insertion_type)
+	adjusted = true;
+      else if (!before_markers)
+	{
+	  /* M stays at FROM, so move it before the gap, by swapping it
+	     with the first marker after the gap, which is at FROM too.  */
+	  ptrdiff_t gpt = t->markers_gpt;
+	  markers[i + gap] = markers[gpt + gap];
+	  markers[gpt] = m;
+	  m->charpos_ = from;
+	  m->bytepos_ = from_byte;
+	  m->relative = false;
+	  t->markers_gpt++;
+	}
+    }
+
+  return adjusted;
+}
+
+/* Relocate the markers of B for a deletion of the text from FROM /
+   FROM_BYTE to TO / TO_BYTE, which is not yet counted in Z and
+   Z_BYTE.  */
+
+void
+relocate_markers_for_delete (struct buffer *b,
+			     ptrdiff_t from, ptrdiff_t from_byte,
+			     ptrdiff_t to, ptrdiff_t to_byte)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t z = BUF_Z (b), z_byte = BUF_Z_BYTE (b);
+  ptrdiff_t i = search_marker_index (t, from, true, z);
+  ptrdiff_t n = buf_markers_count (b);
+
+  move_marker_gap_1 (t, i, z, z_byte);
+
+  /* The markers inside the deleted text end up at FROM, which is where
+     the end of the deletion will be.  */
+  for (struct Lisp_Marker **mp = t->markers + i + t->markers_gap_size;
+       i < n && z - (*mp)->charpos_ <= to; i++, mp++)
+    {
+      (*mp)->charpos_ = z - to;
+      (*mp)->bytepos_ = z_byte - to_byte;
+    }
+}
+
+/* Relocate the markers of B for a replacement of the text at FROM /
+   FROM_BYTE of length OLD_CHARS / OLD_BYTES by a text of length
+   NEW_CHARS / NEW_BYTES, which is already counted in Z and Z_BYTE.  */
+
+void
+relocate_markers_for_replace (struct buffer *b,
+			      ptrdiff_t from, ptrdiff_t from_byte,
+			      ptrdiff_t old_chars, ptrdiff_t old_bytes,
+			      ptrdiff_t new_chars, ptrdiff_t new_bytes)
+{
+  struct buffer_text *t = b->text;
+  ptrdiff_t z = BUF_Z (b) - new_chars + old_chars;
+  ptrdiff_t z_byte = BUF_Z_BYTE (b) - new_bytes + old_bytes;
+  ptrdiff_t i = search_marker_index (t, from, true, z);
+  ptrdiff_t n = buf_markers_count (b);
+
+  move_marker_gap_1 (t, i, z, z_byte);
+
+  for (struct Lisp_Marker **mp = t->markers + i + t->markers_gap_size;
+       i < n && z - (*mp)->charpos_ < from + old_chars; i++, mp++)
+    {
+      (*mp)->charpos_ = BUF_Z (b) - from;
+      (*mp)->bytepos_ = BUF_Z_BYTE (b) - from_byte;
+    }
+}
+
+/* Remove from the marker index of B, and leave pointing nowhere, all
+   markers for which PRED returns true.  This is called during garbage
+   collection, so PRED must be careful to ignore and preserve mark
+   bits.  */
+
+void
+unchain_markers_if (struct buffer *b,
+		    bool (*pred) (struct Lisp_Marker *, struct buffer *))
+{
+  struct buffer_text *t = b->text;
+  struct Lisp_Marker **markers = t->markers;
+  ptrdiff_t gpt = t->markers_gpt, size = t->markers_size;
+  ptrdiff_t before = 0, after = size;
+
+  for (ptrdiff_t i = 0; i < gpt; i++)
+    {
+      struct Lisp_Marker *m = markers[i];
+      if (pred (m, b))
+	m->buffer = NULL;
+      else
+	markers[before++] = m;
+    }
+  for (ptrdiff_t i = size; gpt + t->markers_gap_size < i--; )
+    {
+      struct Lisp_Marker *m = markers[i];
+      if (pred (m, b))
+	{
+	  m->buffer = NULL;
+	  flip_marker (m, t->z, t->z_byte);
+	}
+      else
+	markers[--after] = m;
+    }
+  t->markers_gpt = before;
+  t->markers_gap_size = after - before;
+}
+
+/* Leave all markers of B, and of its indirect buffers, pointing
+   nowhere, and free its marker index.  */
+
+void
+free_marker_index (struct buffer *b)
+{
+  struct buffer_text *t = b->text;
+  struct Lisp_Marker *m;
+
+  FOR_EACH_MARKER (b, m)
+    {
+      if (m->relative)
+	flip_marker (m, t->z, t->z_byte);
+      m->buffer = NULL;
+    }
+  if (!pdumper_object_p (t->markers))
+    xfree (t->markers);
+  t->markers = NULL;
+  t->markers_size = t->markers_gpt = t->markers_gap_size = 0;
+}
+
 /* Converting between character positions and byte positions.  */
 
 /* There are several places in the buffer where we know
@@ -133,28 +569,6 @@ CHECK_MARKER (Lisp_Object x)
   CHECK_TYPE (MARKERP (x), Qmarkerp, x);
 }
 
-/* When converting bytes from/to chars, we look through the list of
-   markers to try and find a good starting point (since markers keep
-   track of both bytepos and charpos at the same time).
-   But if there are many markers, it can take too much time to find a "good"
-   marker from which to start.  Worse yet: if it takes a long time and we end
-   up finding a nearby markers, we won't add a new marker to cache this
-   result, so next time around we'll have to go through this same long list
-   to (re)find this best marker.  So the further down the list of
-   markers we go, the less demanding we are w.r.t what is a good marker.
-
-   The previous code used INITIAL=50 and INCREMENT=0 and this lead to
-   really poor performance when there are many markers.
-   I haven't tried to tweak INITIAL, but experiments on my trusty Thinkpad
-   T61 using various artificial test cases seem to suggest that INCREMENT=50
-   might be "the best compromise": it significantly improved the
-   worst case and it was rarely slower and never by much.
-
-   The asymptotic behavior is still poor, tho, so in largish buffers with many
-   overlays (e.g. 300KB and 30K overlays), it can still be a bottleneck.  */
-#define BYTECHAR_DISTANCE_INITIAL 50
-#define BYTECHAR_DISTANCE_INCREMENT 50
-
 /* Return the byte position corresponding to CHARPOS in B.  */
 
 ptrdiff_t
@@ -163,7 +577,7 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
   struct Lisp_Marker *tail;
   ptrdiff_t best_above, best_above_byte;
   ptrdiff_t best_below, best_below_byte;
-  ptrdiff_t distance = BYTECHAR_DISTANCE_INITIAL;
+  ptrdiff_t i;
 
   eassert (BUF_BEG (b) <= charpos && charpos <= BUF_Z (b));
 
@@ -196,18 +610,18 @@ buf_charpos_to_bytepos (struct buffer *b, ptrdiff_t charpos)
   if (b == cached_buffer && BUF_MODIFF (b) == cached_modiff)
     CONSIDER (cached_charpos, cached_bytepos);
 
-  for (tail = BUF_MARKERS (b); tail; tail = tail->next)
+  /* The markers are sorted, so the nearest ones are those on either
+     side of CHARPOS in the marker index.  */
+  i = search_marker_index (b->text, charpos, false, BUF_Z (b));
+  if (i < buf_markers_count (b))
     {
-      CONSIDER (tail->charpos, tail->bytepos);
-
-      /* If we are down to a range of 50 chars,
-	 don't bother checking any other markers;
-	 scan the intervening chars directly now.  */
-      if (best_above - charpos < distance
-          || charpos - best_below < distance)
-	break;
-      else
-        distance += BYTECHAR_DISTANCE_INCREMENT;
+      tail = buf_marker (b, i);
+      CONSIDER (marker_charpos (tail), marker_bytepos (tail));
+    }
+  if (i > 0)
+    {
+      tail = buf_marker (b, i - 1);
+      CONSIDER (marker_charpos (tail), marker_bytepos (tail));
     }
 
   /* We get here if we did not exactly hit one of the known places.
@@ -319,7 +733,7 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
   struct Lisp_Marker *tail;
   ptrdiff_t best_above, best_above_byte;
   ptrdiff_t best_below, best_below_byte;
-  ptrdiff_t distance = BYTECHAR_DISTANCE_INITIAL;
+  ptrdiff_t i;
 
   eassert (BUF_BEG_BYTE (b) <= bytepos && bytepos <= BUF_Z_BYTE (b));
 
@@ -347,18 +761,16 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
   if (b == cached_buffer && BUF_MODIFF (b) == cached_modiff)
     CONSIDER (cached_bytepos, cached_charpos);
 
-  for (tail = BUF_MARKERS (b); tail; tail = tail->next)
+  i = search_marker_index_byte (b->text, bytepos, BUF_Z_BYTE (b));
+  if (i < buf_markers_count (b))
     {
-      CONSIDER (tail->bytepos, tail->charpos);
-
-      /* If we are down to a range of 50 chars,
-	 don't bother checking any other markers;
-	 scan the intervening chars directly now.  */
-      if (best_above - bytepos < distance
-          || bytepos - best_below < distance)
-	break;
-      else
-        distance += BYTECHAR_DISTANCE_INCREMENT;
+      tail = buf_marker (b, i);
+      CONSIDER (marker_bytepos (tail), marker_charpos (tail));
+    }
+  if (i > 0)
+    {
+      tail = buf_marker (b, i - 1);
+      CONSIDER (marker_bytepos (tail), marker_charpos (tail));
     }
 
   /* We get here if we did not exactly hit one of the known places.
@@ -378,9 +790,9 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
       /* If this position is quite far from the nearest known position,
 	 cache the correspondence by creating a marker here.
 	 It will last until the next GC.
-	 But don't do it if BUF_MARKERS is nil;
+	 But don't do it if the buffer has no markers;
 	 that is a signal from Fset_buffer_multibyte.  */
-      if (record && BUF_MARKERS (b))
+      if (record && buf_markers_count (b))
 	build_marker (b, best_below, best_below_byte);
 
       byte_char_debug_check (b, best_below, best_below_byte);
@@ -405,9 +817,9 @@ buf_bytepos_to_charpos (struct buffer *b, ptrdiff_t bytepos)
       /* If this position is quite far from the nearest known position,
 	 cache the correspondence by creating a marker here.
 	 It will last until the next GC.
-	 But don't do it if BUF_MARKERS is nil;
+	 But don't do it if the buffer has no markers;
 	 that is a signal from Fset_buffer_multibyte.  */
-      if (record && BUF_MARKERS (b))
+      if (record && buf_markers_count (b))
 	build_marker (b, best_above, best_above_byte);
 
       byte_char_debug_check (b, best_above, best_above_byte);
@@ -451,17 +863,19 @@ DEFUN ("marker-position", Fmarker_position, Smarker_position, 1, 1, 0,
 {
   CHECK_MARKER (marker);
   if (XMARKER (marker)->buffer)
-    return make_fixnum (XMARKER (marker)->charpos);
+    return make_fixnum (marker_charpos (XMARKER (marker)));
 
   return Qnil;
 }
 
 /* Change M so it points to B at CHARPOS and BYTEPOS.  */
 
-static void
+void
 attach_marker (struct Lisp_Marker *m, struct buffer *b,
 	       ptrdiff_t charpos, ptrdiff_t bytepos)
 {
+  struct buffer_text *t = b->text;
+
   /* In a single-byte buffer, two positions must be equal.
      Otherwise, every character is at least one byte.  */
   if (BUF_Z (b) == BUF_Z_BYTE (b))
@@ -469,16 +883,29 @@ attach_marker (struct Lisp_Marker *m, struct buffer *b,
   else
     eassert (charpos <= bytepos);
 
-  m->charpos = charpos;
-  m->bytepos = bytepos;
-
-  if (m->buffer != b)
+  if (m->buffer && m->buffer->text == t)
     {
-      unchain_marker (m);
-      m->buffer = b;
-      m->next = BUF_MARKERS (b);
-      BUF_MARKERS (b) = m;
+      ptrdiff_t i = marker_index (t, m);
+
+      /* If M stays in order, just store its new position.  */
+      if ((i == 0
+	   || index_charpos (*marker_slot (t, i - 1), t->z) <= charpos)
+	  && (i + 1 == buf_markers_count (b)
+	      || charpos <= index_charpos (*marker_slot (t, i + 1), t->z)))
+	{
+	  bool relative = i >= t->markers_gpt;
+	  m->charpos_ = relative ? t->z - charpos : charpos;
+	  m->bytepos_ = relative ? t->z_byte - bytepos : bytepos;
+	  m->buffer = b;
+	  return;
+	}
+      unindex_marker (t, i);
     }
+  else
+    unchain_marker (m);
+
+  m->buffer = b;
+  index_marker (t, m, charpos, bytepos);
 }
 
 /* If BUFFER is nil, return current buffer pointer.  Next, check
@@ -516,10 +943,8 @@ set_marker_internal (Lisp_Object marker, Lisp_Object position,
      an existing marker, and MARKER is already in the same buffer.  */
   else if (MARKERP (position) && b == XMARKER (position)->buffer
 	   && b == m->buffer)
-    {
-      m->bytepos = XMARKER (position)->bytepos;
-      m->charpos = XMARKER (position)->charpos;
-    }
+    attach_marker (m, b, marker_charpos (XMARKER (position)),
+		   marker_bytepos (XMARKER (position)));
 
   else
     {
@@ -543,8 +968,8 @@ set_marker_internal (Lisp_Object marker, Lisp_Object position,
 	}
       else if (MARKERP (position))
 	{
-	  charpos = XMARKER (position)->charpos;
-	  bytepos = XMARKER (position)->bytepos;
+	  charpos = marker_charpos (XMARKER (position));
+	  bytepos = marker_bytepos (XMARKER (position));
 	}
       else
 	wrong_type_argument (Qinteger_or_marker_p, position);
@@ -640,10 +1065,55 @@ detach_marker (Lisp_Object marker)
   Fset_marker (marker, Qnil, Qnil);
 }
 
-/* Remove MARKER from the chain of whatever buffer it is in,
-   leaving it points to nowhere.  This is called during garbage
-   collection, so we must be careful to ignore and preserve
-   mark bits, including those in chain fields of markers.  */
+/* Return a marker pointing at CHARPOS and BYTEPOS in BUF, for the
+   private use of save-excursion or save-restriction.  Reuse a marker
+   from the pool if there is one.  The marker must not be made visible
+   to Lisp; give it back with recycle_marker when done.  */
+
+Lisp_Object
+make_recyclable_marker (struct buffer *buf, ptrdiff_t charpos,
+			ptrdiff_t bytepos)
+{
+  if (recycled_markers_count == 0)
+    {
+      Lisp_Object marker = build_marker (buf, charpos, bytepos);
+      XMARKER (marker)->recyclable = 1;
+      excursion_markers_consed++;
+      return marker;
+    }
+
+  Lisp_Object marker = recycled_markers[--recycled_markers_count];
+  struct Lisp_Marker *m = XMARKER (marker);
+  eassert (m->recyclable && !m->buffer);
+  m->insertion_type = 0;
+  attach_marker (m, buf, charpos, bytepos);
+  excursion_markers_recycled++;
+  return marker;
+}
+
+/* Detach MARKER, made by make_recyclable_marker, and keep it for
+   reuse unless it got into an undo list meanwhile.  */
+
+void
+recycle_marker (Lisp_Object marker)
+{
+  struct Lisp_Marker *m = XMARKER (marker);
+  unchain_marker (m);
+  if (m->recyclable && recycled_markers_count < RECYCLED_MARKERS_MAX)
+    recycled_markers[recycled_markers_count++] = marker;
+}
+
+/* Forget the recycled markers, so that garbage collection can free
+   them.  */
+
+void
+discard_recycled_markers (void)
+{
+  recycled_markers_count = 0;
+}
+
+/* Remove MARKER from the marker index of whatever buffer it is in,
+   leaving it points to nowhere.  */
 
 void
 unchain_marker (register struct Lisp_Marker *marker)
@@ -652,34 +1122,11 @@ unchain_marker (register struct Lisp_Marker *marker)
 
   if (b)
     {
-      register struct Lisp_Marker *tail, **prev;
-
       /* No dead buffers here.  */
       eassert (BUFFER_LIVE_P (b));
 
+      unindex_marker (b->text, marker_index (b->text, marker));
       marker->buffer = NULL;
-      prev = &BUF_MARKERS (b);
-
-      for (tail = BUF_MARKERS (b); tail; prev = &tail->next, tail = *prev)
-	if (marker == tail)
-	  {
-	    if (*prev == BUF_MARKERS (b))
-	      {
-		/* Deleting first marker from the buffer's chain.  Crash
-		   if new first marker in chain does not say it belongs
-		   to the same buffer, or at least that they have the same
-		   base buffer.  */
-		if (tail->next && b->text != tail->next->buffer->text)
-		  emacs_abort ();
-	      }
-	    *prev = tail->next;
-	    /* We have removed the marker from the chain;
-	       no need to scan the rest of the chain.  */
-	    break;
-	  }
-
-      /* Error if marker was not in it's chain.  */
-      eassert (tail != NULL);
     }
 }
 
@@ -694,9 +1141,10 @@ marker_position (Lisp_Object marker)
   if (!buf)
     error ("Marker does not point anywhere");
 
-  eassert (BUF_BEG (buf) <= m->charpos && m->charpos <= BUF_Z (buf));
+  ptrdiff_t charpos = marker_charpos (m);
+  eassert (BUF_BEG (buf) <= charpos && charpos <= BUF_Z (buf));
 
-  return m->charpos;
+  return charpos;
 }
 
 /* Return the byte position of marker MARKER, as a C integer.  */
@@ -710,9 +1158,10 @@ marker_byte_position (Lisp_Object marker)
   if (!buf)
     error ("Marker does not point anywhere");
 
-  eassert (BUF_BEG_BYTE (buf) <= m->bytepos && m->bytepos <= BUF_Z_BYTE (buf));
+  ptrdiff_t bytepos = marker_bytepos (m);
+  eassert (BUF_BEG_BYTE (buf) <= bytepos && bytepos <= BUF_Z_BYTE (buf));
 
-  return m->bytepos;
+  return bytepos;
 }
 
 DEFUN ("copy-marker", Fcopy_marker, Scopy_marker, 0, 2, 0,
@@ -764,14 +1213,15 @@ DEFUN ("buffer-has-markers-at", Fbuffer_has_markers_at, Sbuffer_has_markers_at,
        doc: /* Return t if there are markers pointing at POSITION in the current buffer.  */)
   (Lisp_Object position)
 {
-  register struct Lisp_Marker *tail;
   register ptrdiff_t charpos;
+  ptrdiff_t i;
 
   charpos = clip_to_bounds (BEG, XFIXNUM (position), Z);
+  i = marker_index_from (current_buffer, charpos);
 
-  for (tail = BUF_MARKERS (current_buffer); tail; tail = tail->next)
-    if (tail->charpos == charpos)
-      return Qt;
+  if (i < buf_markers_count (current_buffer)
+      && marker_charpos (buf_marker (current_buffer, i)) == charpos)
+    return Qt;
 
   return Qnil;
 }
@@ -783,13 +1233,7 @@ DEFUN ("buffer-has-markers-at", Fbuffer_has_markers_at, Sbuffer_has_markers_at,
 int
 count_markers (struct buffer *buf)
 {
-  int total = 0;
-  struct Lisp_Marker *tail;
-
-  for (tail = BUF_MARKERS (buf); tail; tail = tail->next)
-    total++;
-
-  return total;
+  return buf_markers_count (buf);
 }
 
 /* For debugging -- recompute the bytepos corresponding
@@ -822,4 +1266,11 @@ syms_of_marker (void)
   defsubr (&Smarker_insertion_type);
   defsubr (&Sset_marker_insertion_type);
   defsubr (&Sbuffer_has_markers_at);
+
+  DEFVAR_INT ("excursion-markers-consed", excursion_markers_consed,
+	      doc: /* Number of markers consed so far by `save-excursion' and `save-restriction'.  */);
+
+  DEFVAR_INT ("excursion-markers-recycled", excursion_markers_recycled,
+	      doc: /* Number of times `save-excursion' and `save-restriction' reused a marker.
+Each reuse saves consing a marker.  */);
 }
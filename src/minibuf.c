@@ -20,6 +20,7 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 
 #include <config.h>
 #include <errno.h>
+#include <stdlib.h>
 
 #include <binary-io.h>
 
@@ -63,6 +64,10 @@ static Lisp_Object minibuf_prompt;
 
 static ptrdiff_t minibuf_prompt_width;
 
+/* The matches of the last call of `all-flex-completions'.  */
+
+static Lisp_Object flex_cache;
+
 
 /* Put minibuf on currently selected frame's minibuffer.
    We do this whenever the user starts a new minibuffer
@@ -659,6 +664,7 @@ read_minibuf (Lisp_Object map, Lisp_Object initial, Lisp_Object prompt,
   run_hook (Qminibuffer_setup_hook);
 
   /* Don't allow the user to undo past this point.  */
+  free_undo_log (current_buffer);
   bset_undo_list (current_buffer, Qnil);
 
   recursive_edit_1 ();
@@ -1592,6 +1598,531 @@ with a space are ignored unless STRING itself starts with a space.  */)
 
   return Fnreverse (allmatches);
 }
+
+/* Flex completion.  A completion matches a string if it contains the
+   characters of the string in order, possibly with others in
+   between.  Matching and scoring work on the text of the completions
+   only, so that they can be spread over worker threads.  */
+
+/* The characters of the string to match, each with its other cases
+   if case is ignored, or repeated otherwise.  */
+
+struct flex_query
+{
+  ptrdiff_t len;
+  int (*chars)[3];
+};
+
+/* The text of a completion.  */
+
+struct flex_text
+{
+  unsigned char const *data;
+  ptrdiff_t nbytes;
+  bool multibyte;
+};
+
+/* The score of a completion that does not match.  */
+#define FLEX_NO_MATCH PTRDIFF_MIN
+
+/* The work of scoring completions, and the threads sharing it.  */
+
+struct flex_job
+{
+  struct flex_query const *query;
+  struct flex_text const *texts;
+  ptrdiff_t ntexts;
+
+  /* The score of each text, or FLEX_NO_MATCH.  */
+  ptrdiff_t *scores;
+
+  /* True if a thread ran out of memory.  */
+  bool failed;
+
+  /* The next text to be scored.  */
+  sys_mutex_t mutex;
+  ptrdiff_t next;
+};
+
+/* Texts are handed out to the threads this many at a time.  */
+enum { FLEX_CHUNK = 4096 };
+
+/* Decode the text T into *BUF, an array of *SIZE characters, which is
+   grown as needed.  Return the number of characters, or -1 if memory
+   is exhausted.  This may run in a worker thread.  */
+
+static ptrdiff_t
+flex_decode (struct flex_text const *t, int **buf, ptrdiff_t *size)
+{
+  if (*size < t->nbytes)
+    {
+      int *p = realloc (*buf, t->nbytes * sizeof **buf);
+      if (!p)
+	return -1;
+      *buf = p;
+      *size = t->nbytes;
+    }
+  ptrdiff_t n = 0;
+  for (unsigned char const *p = t->data, *end = p + t->nbytes; p < end; )
+    {
+      int c, len;
+      if (t->multibyte)
+	{
+	  c = STRING_CHAR_AND_LENGTH (p, len);
+	  p += len;
+	}
+      else
+	{
+	  c = *p++;
+	  MAKE_CHAR_MULTIBYTE (c);
+	}
+      (*buf)[n++] = c;
+    }
+  return n;
+}
+
+/* Return true if the N characters of TEXT match Q.  Then set POS to
+   the first positions of the characters of Q in TEXT within the
+   shortest part of TEXT that ends where the first match ends.  */
+
+static bool
+flex_match (struct flex_query const *q, int const *text, ptrdiff_t n,
+	    ptrdiff_t *pos)
+{
+  ptrdiff_t m = q->len, k = 0, i;
+  if (m == 0)
+    return true;
+  for (i = 0; i < n; i++)
+    {
+      int const *c = q->chars[k];
+      if ((text[i] == c[0] || text[i] == c[1] || text[i] == c[2])
+	  && ++k == m)
+	break;
+    }
+  if (k < m)
+    return false;
+  for (k = m - 1; 0 <= k; i--)
+    {
+      int const *c = q->chars[k];
+      if (text[i] == c[0] || text[i] == c[1] || text[i] == c[2])
+	k--;
+    }
+  for (k = 0, i++; k < m; i++)
+    {
+      int const *c = q->chars[k];
+      if (text[i] == c[0] || text[i] == c[1] || text[i] == c[2])
+	pos[k++] = i;
+    }
+  return true;
+}
+
+static bool
+flex_separator_p (int c)
+{
+  return c == ' ' || c == '-' || c == '_' || c == '/' || c == '.' || c == ':';
+}
+
+/* Return the score of the match at positions POS of the M characters
+   of a string in the N characters of TEXT.  */
+
+static ptrdiff_t
+flex_score (int const *text, ptrdiff_t n, ptrdiff_t const *pos, ptrdiff_t m)
+{
+  ptrdiff_t score = 0;
+  for (ptrdiff_t k = 0; k < m; k++)
+    {
+      ptrdiff_t p = pos[k];
+      score += 16;
+      if (p == 0 || flex_separator_p (text[p - 1]))
+	score += 8;
+      else if ('a' <= text[p - 1] && text[p - 1] <= 'z'
+	       && 'A' <= text[p] && text[p] <= 'Z')
+	score += 7;
+      if (0 < k)
+	{
+	  ptrdiff_t gap = p - pos[k - 1] - 1;
+	  score += gap == 0 ? 4 : -3 - min (gap - 1, 20);
+	}
+    }
+  return score - min (n - m, 100) / 4;
+}
+
+/* Score the texts of JOB from FROM to TO.  This may run in a worker
+   thread.  */
+
+static void
+flex_score_range (struct flex_job *job, ptrdiff_t from, ptrdiff_t to)
+{
+  struct flex_query const *q = job->query;
+  ptrdiff_t *pos = malloc (max (q->len, 1) * sizeof *pos);
+  int *buf = NULL;
+  ptrdiff_t size = 0;
+  if (!pos)
+    {
+      job->failed = true;
+      return;
+    }
+
+  for (ptrdiff_t i = from; i < to; i++)
+    {
+      struct flex_text const *t = &job->texts[i];
+      job->scores[i] = FLEX_NO_MATCH;
+      if (t->nbytes < q->len)
+	continue;
+      ptrdiff_t n = flex_decode (t, &buf, &size);
+      if (n < 0)
+	{
+	  job->failed = true;
+	  break;
+	}
+      if (flex_match (q, buf, n, pos))
+	job->scores[i] = flex_score (buf, n, pos, q->len);
+    }
+
+  free (buf);
+  free (pos);
+}
+
+/* Score chunks of the texts of the flex_job ARG until none is left.  */
+
+static void
+flex_score_chunks (void *arg)
+{
+  struct flex_job *job = arg;
+  sys_mutex_lock (&job->mutex);
+  while (job->next < job->ntexts)
+    {
+      ptrdiff_t from = job->next;
+      ptrdiff_t to = from + min (FLEX_CHUNK, job->ntexts - from);
+      job->next = to;
+      sys_mutex_unlock (&job->mutex);
+      flex_score_range (job, from, to);
+      sys_mutex_lock (&job->mutex);
+    }
+  sys_mutex_unlock (&job->mutex);
+}
+
+/* Score all the texts of JOB, with helper threads if there are enough
+   of them.  */
+
+static void
+flex_score_all (struct flex_job *job)
+{
+  if (0 < completion_flex_threads && 2 * FLEX_CHUNK <= job->ntexts)
+    {
+      sys_mutex_init (&job->mutex);
+      job->next = 0;
+      /* The text of the completions cannot move while this thread
+	 is busy too.  */
+      sys_run_helpers (flex_score_chunks, job,
+		       min (completion_flex_threads,
+			    job->ntexts / FLEX_CHUNK - 1));
+      sys_mutex_destroy (&job->mutex);
+    }
+  else
+    flex_score_range (job, 0, job->ntexts);
+
+  if (job->failed)
+    memory_full (SIZE_MAX);
+}
+
+/* Store in *STRINGS a vector of the possible completions in
+   COLLECTION, of completion type TYPE as in `all-completions', and in
+   *ELTS the elements to pass to the predicate: the alist elements or
+   symbols, or the indices of hash table entries.  */
+
+static void
+flex_collect (Lisp_Object collection, int type,
+	      Lisp_Object *strings, Lisp_Object *elts)
+{
+  ptrdiff_t n = 0;
+  for (int pass = 0; pass < 2; pass++)
+    {
+      if (pass == 1)
+	{
+	  *strings = make_nil_vector (n);
+	  *elts = make_nil_vector (n);
+	  n = 0;
+	}
+      if (type == 1)
+	for (Lisp_Object tail = collection; CONSP (tail); tail = XCDR (tail))
+	  {
+	    Lisp_Object elt = XCAR (tail);
+	    Lisp_Object eltstring = CONSP (elt) ? XCAR (elt) : elt;
+	    if (SYMBOLP (eltstring))
+	      eltstring = SYMBOL_NAME (eltstring);
+	    if (STRINGP (eltstring))
+	      {
+		if (pass == 1)
+		  {
+		    ASET (*strings, n, eltstring);
+		    ASET (*elts, n, elt);
+		  }
+		n++;
+	      }
+	  }
+      else if (type == 2)
+	for (ptrdiff_t i = 0; i < ASIZE (collection); i++)
+	  {
+	    Lisp_Object bucket = AREF (collection, i);
+	    if (!SYMBOLP (bucket))
+	      continue;
+	    for (struct Lisp_Symbol *s = XSYMBOL (bucket); s; s = s->u.s.next)
+	      {
+		if (pass == 1)
+		  {
+		    Lisp_Object symbol = make_lisp_symbol (s);
+		    ASET (*strings, n, SYMBOL_NAME (symbol));
+		    ASET (*elts, n, symbol);
+		  }
+		n++;
+	      }
+	  }
+      else
+	{
+	  struct Lisp_Hash_Table *h = XHASH_TABLE (collection);
+	  for (ptrdiff_t i = 0; i < HASH_TABLE_SIZE (h); i++)
+	    {
+	      Lisp_Object key = HASH_KEY (h, i);
+	      if (SYMBOLP (key) && !EQ (key, Qunbound))
+		key = SYMBOL_NAME (key);
+	      if (STRINGP (key))
+		{
+		  if (pass == 1)
+		    {
+		      ASET (*strings, n, key);
+		      ASET (*elts, n, make_fixnum (i));
+		    }
+		  n++;
+		}
+	    }
+	}
+    }
+}
+
+/* A match to be sorted by score.  */
+
+struct flex_result
+{
+  ptrdiff_t score, index;
+};
+
+static int
+flex_result_cmp (void const *a, void const *b)
+{
+  struct flex_result const *x = a, *y = b;
+  return (x->score != y->score
+	  ? (x->score < y->score) - (x->score > y->score)
+	  : (x->index > y->index) - (x->index < y->index));
+}
+
+DEFUN ("all-flex-completions", Fall_flex_completions,
+       Sall_flex_completions, 2, 3, 0,
+       doc: /* Return the flex matches of STRING in COLLECTION, best first.
+A possible completion matches if it contains the characters of STRING
+in order, possibly with other characters between them.  The value is
+a list of elements (COMPLETION SCORE POSITIONS), where POSITIONS is the
+list of the indices in COMPLETION of the characters matching STRING.
+The SCORE, an integer, is higher for matches at the start of
+COMPLETION, after a separator or at a change to upper case, and for
+consecutive characters; it is lower for gaps between the characters
+and for long completions.  Matches of equal score come in the order
+of COLLECTION.
+
+COLLECTION, PREDICATE, `completion-ignore-case' and
+`completion-regexp-list' are as for `all-completions'.  If COLLECTION
+is a function, STRING is split at the start of its completion field,
+as given by `completion-boundaries': the completions of the part
+before it are matched against the field, as for file names.
+
+If COLLECTION is a list, the matches are remembered for the next
+call: if STRING then extends STRING of this call, with the same
+COLLECTION, PREDICATE, `completion-ignore-case' and
+`completion-regexp-list', only these matches are examined.  So the
+list and PREDICATE should not be changed in between.
+
+When `completion-flex-threads' is positive, that many helper threads
+help match large collections.  */)
+  (Lisp_Object string, Lisp_Object collection, Lisp_Object predicate)
+{
+  CHECK_STRING (string);
+  int type = HASH_TABLE_P (collection) ? 3
+    : VECTORP (collection) ? 2
+    : NILP (collection) || (CONSP (collection) && !FUNCTIONP (collection));
+  Lisp_Object ignore_case = completion_ignore_case ? Qt : Qnil;
+  if (type == 2)
+    collection = check_obarray (collection);
+
+  /* Obarrays and hash tables can change in ways that nothing keeps
+     count of, and functions can return anything, so only the matches
+     in a list are remembered.  */
+  Lisp_Object strings, elts = Qnil;
+  bool cached = (type == 1
+		 && VECTORP (flex_cache)
+		 && EQ (AREF (flex_cache, 1), collection)
+		 && EQ (AREF (flex_cache, 2), predicate)
+		 && EQ (AREF (flex_cache, 3), ignore_case)
+		 && EQ (AREF (flex_cache, 4), Vcompletion_regexp_list)
+		 && SCHARS (AREF (flex_cache, 0)) <= SCHARS (string)
+		 && EQ (Fcompare_strings (AREF (flex_cache, 0), Qnil, Qnil,
+					  string, make_fixnum (0),
+					  make_fixnum (SCHARS (AREF (flex_cache,
+								     0))),
+					  Qnil),
+			Qt));
+  /* Whether STRINGS have been through the predicate and regexps.  */
+  bool filtered = cached;
+  if (cached)
+    strings = AREF (flex_cache, 5);
+  else if (type == 0)
+    {
+      Lisp_Object boundaries
+	= call3 (collection, string, predicate,
+		 Fcons (Qboundaries, empty_unibyte_string));
+      ptrdiff_t start = 0;
+      if (CONSP (boundaries) && EQ (XCAR (boundaries), Qboundaries)
+	  && CONSP (XCDR (boundaries)) && FIXNATP (XCAR (XCDR (boundaries))))
+	start = min (XFIXNAT (XCAR (XCDR (boundaries))), SCHARS (string));
+      Lisp_Object prefix = Fsubstring (string, make_fixnum (0),
+				       make_fixnum (start));
+      string = Fsubstring (string, make_fixnum (start), Qnil);
+      strings = CALLN (Fvconcat, Fall_completions (prefix, collection,
+						   predicate, Qnil));
+      filtered = true;
+    }
+  else
+    flex_collect (collection, type, &strings, &elts);
+
+  ptrdiff_t n = ASIZE (strings);
+  USE_SAFE_ALLOCA;
+
+  /* Set up the query.  */
+  struct flex_query query = { .len = SCHARS (string) };
+  SAFE_NALLOCA (query.chars, 1, query.len);
+  for (ptrdiff_t k = 0, i = 0, i_byte = 0; k < query.len; k++)
+    {
+      int c;
+      FETCH_STRING_CHAR_AS_MULTIBYTE_ADVANCE (c, string, i, i_byte);
+      query.chars[k][0] = c;
+      query.chars[k][1] = completion_ignore_case ? downcase (c) : c;
+      query.chars[k][2] = completion_ignore_case ? upcase (c) : c;
+    }
+
+  /* Score the completions.  Nothing may move the strings meanwhile.  */
+  struct flex_text *texts;
+  struct flex_job job = { .query = &query, .ntexts = n };
+  SAFE_NALLOCA (texts, 1, n);
+  SAFE_NALLOCA (job.scores, 1, n);
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      Lisp_Object s = AREF (strings, i);
+      texts[i] = (struct flex_text) { SDATA (s), SBYTES (s),
+				      STRING_MULTIBYTE (s) };
+    }
+  job.texts = texts;
+  flex_score_all (&job);
+
+  /* Filter the matches through `completion-regexp-list' and PREDICATE,
+     unless that was done before, and sort them.  */
+  struct flex_result *results;
+  SAFE_NALLOCA (results, 1, n);
+  ptrdiff_t nresults = 0, bindcount = -1;
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      if (job.scores[i] == FLEX_NO_MATCH)
+	continue;
+      if (!filtered)
+	{
+	  Lisp_Object eltstring = AREF (strings, i), elt = AREF (elts, i);
+	  Lisp_Object regexps;
+	  for (regexps = Vcompletion_regexp_list; CONSP (regexps);
+	       regexps = XCDR (regexps))
+	    {
+	      if (bindcount < 0)
+		{
+		  bindcount = SPECPDL_INDEX ();
+		  specbind (Qcase_fold_search, ignore_case);
+		}
+	      if (NILP (Fstring_match (XCAR (regexps), eltstring,
+				       make_fixnum (0))))
+		break;
+	    }
+	  if (CONSP (regexps))
+	    continue;
+
+	  if (!NILP (predicate))
+	    {
+	      Lisp_Object tem;
+	      if (EQ (predicate, Qcommandp))
+		tem = Fcommandp (elt, Qnil);
+	      else
+		{
+		  if (bindcount >= 0)
+		    {
+		      unbind_to (bindcount, Qnil);
+		      bindcount = -1;
+		    }
+		  if (type == 3)
+		    {
+		      struct Lisp_Hash_Table *h = XHASH_TABLE (collection);
+		      ptrdiff_t idx = XFIXNUM (elt);
+		      tem = (idx < HASH_TABLE_SIZE (h)
+			     ? call2 (predicate, HASH_KEY (h, idx),
+				      HASH_VALUE (h, idx))
+			     : Qnil);
+		    }
+		  else
+		    tem = call1 (predicate, elt);
+		}
+	      if (NILP (tem))
+		continue;
+	    }
+	}
+      results[nresults++] = (struct flex_result) { job.scores[i], i };
+      rarely_quit (nresults);
+    }
+  if (bindcount >= 0)
+    unbind_to (bindcount, Qnil);
+
+  /* Remember the matches in a list, in its order.  */
+  if (type == 1)
+    {
+      Lisp_Object matches = make_nil_vector (nresults);
+      for (ptrdiff_t i = 0; i < nresults; i++)
+	ASET (matches, i, AREF (strings, results[i].index));
+      flex_cache = CALLN (Fvector, string, collection, predicate,
+			  ignore_case, Vcompletion_regexp_list, matches);
+    }
+
+  qsort (results, nresults, sizeof *results, flex_result_cmp);
+
+  /* Make the list of matches, with their positions.  */
+  Lisp_Object value = Qnil;
+  ptrdiff_t *pos;
+  SAFE_NALLOCA (pos, 1, max (query.len, 1));
+  int *buf = NULL;
+  ptrdiff_t size = 0;
+  record_unwind_protect_ptr (xfree, NULL);
+  ptrdiff_t buf_count = SPECPDL_INDEX () - 1;
+  for (ptrdiff_t i = nresults - 1; 0 <= i; i--)
+    {
+      Lisp_Object s = AREF (strings, results[i].index);
+      struct flex_text t = { SDATA (s), SBYTES (s), STRING_MULTIBYTE (s) };
+      ptrdiff_t nchars = flex_decode (&t, &buf, &size);
+      if (nchars < 0)
+	memory_full (SIZE_MAX);
+      set_unwind_protect_ptr (buf_count, xfree, buf);
+      flex_match (&query, buf, nchars, pos);
+      Lisp_Object positions = Qnil;
+      for (ptrdiff_t k = query.len - 1; 0 <= k; k--)
+	positions = Fcons (make_fixnum (pos[k]), positions);
+      value = Fcons (list3 (s, make_int (results[i].score), positions),
+		     value);
+    }
+
+  SAFE_FREE ();
+  return value;
+}
 
 DEFUN ("completing-read", Fcompleting_read, Scompleting_read, 2, 8, 0,
        doc: /* Read a string in the minibuffer, with completion.
@@ -1922,6 +2453,9 @@ syms_of_minibuf (void)
 
   staticpro (&last_minibuf_string);
 
+  /* [STRING COLLECTION PREDICATE IGNORE-CASE REGEXPS COUNT MATCHES]  */
+  staticpro (&flex_cache);
+
   DEFSYM (Qcustom_variable_history, "custom-variable-history");
   Fset (Qcustom_variable_history, Qnil);
 
@@ -1943,6 +2477,7 @@ syms_of_minibuf (void)
   DEFSYM (Qcase_fold_search, "case-fold-search");
   DEFSYM (Qmetadata, "metadata");
   DEFSYM (Qcycle_sort_function, "cycle-sort-function");
+  DEFSYM (Qboundaries, "boundaries");
 
   /* A frame parameter.  */
   DEFSYM (Qminibuffer_exit, "minibuffer-exit");
@@ -2002,6 +2537,12 @@ For buffer name completion, `read-buffer-completion-ignore-case'
 controls the behavior, rather than this variable.  */);
   completion_ignore_case = 0;
 
+  DEFVAR_INT ("completion-flex-threads", completion_flex_threads,
+	      doc: /* Number of helper threads for `all-flex-completions'.
+They help the calling thread with collections of many possible
+completions.  Zero means to do all the work in the calling thread.  */);
+  completion_flex_threads = 0;
+
   DEFVAR_BOOL ("enable-recursive-minibuffers", enable_recursive_minibuffers,
 	       doc: /* Non-nil means to allow minibuffer commands while in the minibuffer.
 This variable makes a difference whenever the minibuffer window is active.
@@ -2119,6 +2660,7 @@ uses to hide passwords.  */);
 
   defsubr (&Stry_completion);
   defsubr (&Sall_completions);
+  defsubr (&Sall_flex_completions);
   defsubr (&Stest_completion);
   defsubr (&Sassoc_string);
   defsubr (&Scompleting_read);
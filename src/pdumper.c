@@ -2038,7 +2038,7 @@ dump_interval_tree (struct dump_context *ctx,
                     INTERVAL tree,
                     dump_off parent_offset)
 {
-#if CHECK_STRUCTS && !defined (HASH_interval_1B38941C37)
+#if CHECK_STRUCTS && !defined (HASH_interval_FBD5627DE6)
 # error "interval changed. See CHECK_STRUCTS comment in config.h."
 #endif
   /* TODO: output tree breadth-first?  */
@@ -2064,6 +2064,7 @@ dump_interval_tree (struct dump_context *ctx,
   DUMP_FIELD_COPY (&out, tree, visible);
   DUMP_FIELD_COPY (&out, tree, front_sticky);
   DUMP_FIELD_COPY (&out, tree, rear_sticky);
+  DUMP_FIELD_COPY (&out, tree, priority);
   dump_field_lv (ctx, &out, tree, &tree->plist, WEIGHT_STRONG);
   dump_off offset = dump_object_finish (ctx, &out, sizeof (out));
   if (tree->left)
@@ -2079,6 +2080,30 @@ dump_interval_tree (struct dump_context *ctx,
   return offset;
 }
 
+/* Dump the marker index of BUFFER as an array of pointers to its
+   markers, without the gap.  It goes in the hot section, like the
+   interval tree, since the fixups of the pointers can't be in the
+   cold one.  */
+static dump_off
+dump_marker_index (struct dump_context *ctx, struct buffer *buffer)
+{
+  ptrdiff_t nmarkers = buf_markers_count (buffer);
+  dump_off nbytes = ptrdiff_t_to_dump_off (nmarkers
+					   * sizeof (struct Lisp_Marker *));
+  struct Lisp_Marker **markers = xnmalloc (nmarkers, sizeof *markers);
+  struct Lisp_Marker **out = xnmalloc (nmarkers, sizeof *out);
+  for (ptrdiff_t i = 0; i < nmarkers; i++)
+    markers[i] = buf_marker (buffer, i);
+  dump_object_start (ctx, out, nbytes);
+  for (ptrdiff_t i = 0; i < nmarkers; i++)
+    dump_field_lv_rawptr (ctx, out, markers, &markers[i],
+			  Lisp_Vectorlike, WEIGHT_STRONG);
+  dump_off offset = dump_object_finish (ctx, out, nbytes);
+  xfree (out);
+  xfree (markers);
+  return offset;
+}
+
 static dump_off
 dump_string (struct dump_context *ctx, const struct Lisp_String *string)
 {
@@ -2128,7 +2153,7 @@ dump_string (struct dump_context *ctx, const struct Lisp_String *string)
 static dump_off
 dump_marker (struct dump_context *ctx, const struct Lisp_Marker *marker)
 {
-#if CHECK_STRUCTS && !defined (HASH_Lisp_Marker_642DBAF866)
+#if CHECK_STRUCTS && !defined (HASH_Lisp_Marker_71EC46A539)
 # error "Lisp_Marker changed. See CHECK_STRUCTS comment in config.h."
 #endif
 
@@ -2136,14 +2161,14 @@ dump_marker (struct dump_context *ctx, const struct Lisp_Marker *marker)
   dump_pseudovector_lisp_fields (ctx, &out->header, &marker->header);
   DUMP_FIELD_COPY (out, marker, need_adjustment);
   DUMP_FIELD_COPY (out, marker, insertion_type);
+  DUMP_FIELD_COPY (out, marker, recyclable);
   if (marker->buffer)
     {
       dump_field_lv_rawptr (ctx, out, marker, &marker->buffer,
 			    Lisp_Vectorlike, WEIGHT_NORMAL);
-      dump_field_lv_rawptr (ctx, out, marker, &marker->next,
-			    Lisp_Vectorlike, WEIGHT_STRONG);
-      DUMP_FIELD_COPY (out, marker, charpos);
-      DUMP_FIELD_COPY (out, marker, bytepos);
+      DUMP_FIELD_COPY (out, marker, relative);
+      DUMP_FIELD_COPY (out, marker, charpos_);
+      DUMP_FIELD_COPY (out, marker, bytepos_);
     }
   return finish_dump_pvec (ctx, &out->header);
 }
@@ -2769,7 +2794,7 @@ dump_hash_table (struct dump_context *ctx,
 static dump_off
 dump_buffer (struct dump_context *ctx, const struct buffer *in_buffer)
 {
-#if CHECK_STRUCTS && !defined HASH_buffer_375A10F5E5
+#if CHECK_STRUCTS && !defined HASH_buffer_49C66E01FD
 # error "buffer changed. See CHECK_STRUCTS comment in config.h."
 #endif
   struct buffer munged_buffer = *in_buffer;
@@ -2833,8 +2858,11 @@ dump_buffer (struct dump_context *ctx, const struct buffer *in_buffer)
       DUMP_FIELD_COPY (out, buffer, own_text.overlay_unchanged_modified);
       if (buffer->own_text.intervals)
         dump_field_fixup_later (ctx, out, buffer, &buffer->own_text.intervals);
-      dump_field_lv_rawptr (ctx, out, buffer, &buffer->own_text.markers,
-                            Lisp_Vectorlike, WEIGHT_NORMAL);
+      /* The marker index is dumped after the buffer, without its
+         gap.  */
+      out->own_text.markers_size = buf_markers_count (buffer);
+      DUMP_FIELD_COPY (out, buffer, own_text.markers_gpt);
+      out->own_text.markers_gap_size = 0;
       DUMP_FIELD_COPY (out, buffer, own_text.inhibit_shrinking);
       DUMP_FIELD_COPY (out, buffer, own_text.redisplay);
     }
@@ -2878,6 +2906,10 @@ dump_buffer (struct dump_context *ctx, const struct buffer *in_buffer)
   out->newline_cache = NULL;
   out->width_run_cache = NULL;
   out->bidi_paragraph_cache = NULL;
+  out->syntax_ppss_cache = NULL;
+  out->column_cache = NULL;
+  out->undo_log = NULL;
+  out->suspended_undo_log = NULL;
 
   DUMP_FIELD_COPY (out, buffer, prevent_redisplay_optimizations_p);
   DUMP_FIELD_COPY (out, buffer, clip_changed);
@@ -2898,6 +2930,11 @@ dump_buffer (struct dump_context *ctx, const struct buffer *in_buffer)
       (ctx,
        offset + dump_offsetof (struct buffer, own_text.intervals),
        dump_interval_tree (ctx, buffer->own_text.intervals, 0));
+  if (!buffer->base_buffer && buf_markers_count (buffer) > 0)
+    dump_remember_fixup_ptr_raw
+      (ctx,
+       offset + dump_offsetof (struct buffer, own_text.markers),
+       dump_marker_index (ctx, buffer));
 
   return offset;
 }
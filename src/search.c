@@ -21,9 +21,19 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 
 #include <config.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
 #include "lisp.h"
 #include "character.h"
 #include "buffer.h"
+#include "coding.h"
 #include "syntax.h"
 #include "charset.h"
 #include "region-cache.h"
@@ -481,6 +491,21 @@ fast_string_match_internal (Lisp_Object regexp, Lisp_Object string,
   return val;
 }
 
+/* Match REGEXP against the LEN bytes of STRING using translation
+   table TABLE, and return the index of the match, or negative on
+   failure.  This does not clobber the match data.  STRING must
+   contain only ASCII characters.  */
+
+ptrdiff_t
+fast_c_string_match_internal (Lisp_Object regexp, const char *string,
+			      ptrdiff_t len, Lisp_Object table)
+{
+  struct re_pattern_buffer *bufp
+    = &compile_pattern (regexp, 0, table, 0, false)->buf;
+  re_match_object = Qt;
+  return re_search (bufp, string, len, 0, len, 0);
+}
+
 /* Match REGEXP against STRING, searching all of STRING ignoring case,
    and return the index of the match, or negative on failure.
    This does not clobber the match data.
@@ -1719,76 +1744,26 @@ simple_search (EMACS_INT n, unsigned char *pat,
     return n;
 }
 
-/* Do Boyer-Moore search N times for the string BASE_PAT,
-   whose length is LEN_BYTE,
-   from buffer position POS_BYTE until LIM_BYTE.
-   DIRECTION says which direction we search in.
-   TRT and INVERSE_TRT are translation tables.
-   Characters in PAT are already translated by TRT.
-
-   This kind of search works if all the characters in BASE_PAT that
-   have nontrivial translation are the same aside from the last byte.
-   This makes it possible to translate just the last byte of a
-   character, and do so after just a simple test of the context.
-   CHAR_BASE is nonzero if there is such a non-ASCII character.
-
-   If that criterion is not satisfied, do not call this function.  */
-
-static EMACS_INT
-boyer_moore (EMACS_INT n, unsigned char *base_pat,
-	     ptrdiff_t len_byte,
-	     Lisp_Object trt, Lisp_Object inverse_trt,
-	     ptrdiff_t pos_byte, ptrdiff_t lim_byte,
-             int char_base)
+/* Fill in BM_TAB, the table of strides of boyer_moore for the pattern
+   of LEN_BYTE bytes at BASE_PAT searched in DIRECTION, and
+   SIMPLE_TRANSLATE, which maps the last byte of each case equivalent
+   under TRT and INVERSE_TRT of a character of the pattern to the byte
+   in the pattern.  MULTIBYTE and CHAR_BASE are as in boyer_moore.
+   Return the stride to take when the last byte of the pattern matches
+   but the rest does not.  */
+
+static int
+boyer_moore_tables (unsigned char *base_pat, ptrdiff_t len_byte,
+		    int direction, Lisp_Object trt, Lisp_Object inverse_trt,
+		    bool multibyte, int char_base,
+		    int BM_tab[0400], unsigned char simple_translate[0400])
 {
-  int direction = ((n > 0) ? 1 : -1);
-  register ptrdiff_t dirlen;
-  ptrdiff_t limit;
+  ptrdiff_t dirlen = len_byte * direction;
+  unsigned char *pat_end = base_pat + len_byte;
   int stride_for_teases = 0;
-  int BM_tab[0400];
-  register unsigned char *cursor, *p_limit;
-  register ptrdiff_t i;
-  register int j;
-  unsigned char *pat, *pat_end;
-  bool multibyte = ! NILP (BVAR (current_buffer, enable_multibyte_characters));
-
-  unsigned char simple_translate[0400];
-  /* These are set to the preceding bytes of a byte to be translated
-     if char_base is nonzero.  As the maximum byte length of a
-     multibyte character is 5, we have to check at most four previous
-     bytes.  */
-  int translate_prev_byte1 = 0;
-  int translate_prev_byte2 = 0;
-  int translate_prev_byte3 = 0;
-
-  /* The general approach is that we are going to maintain that we know
-     the first (closest to the present position, in whatever direction
-     we're searching) character that could possibly be the last
-     (furthest from present position) character of a valid match.  We
-     advance the state of our knowledge by looking at that character
-     and seeing whether it indeed matches the last character of the
-     pattern.  If it does, we take a closer look.  If it does not, we
-     move our pointer (to putative last characters) as far as is
-     logically possible.  This amount of movement, which I call a
-     stride, will be the length of the pattern if the actual character
-     appears nowhere in the pattern, otherwise it will be the distance
-     from the last occurrence of that character to the end of the
-     pattern.  If the amount is zero we have a possible match.  */
-
-  /* Here we make a "mickey mouse" BM table.  The stride of the search
-     is determined only by the last character of the putative match.
-     If that character does not match, we will stride the proper
-     distance to propose a match that superimposes it on the last
-     instance of a character that matches it (per trt), or misses
-     it entirely if there is none. */
-
-  dirlen = len_byte * direction;
+  ptrdiff_t i;
+  int j;
 
-  /* Record position after the end of the pattern.  */
-  pat_end = base_pat + len_byte;
-  /* BASE_PAT points to a character that we start scanning from.
-     It is the first character in a forward search,
-     the last character in a backward search.  */
   if (direction < 0)
     base_pat = pat_end - 1;
 
@@ -1803,23 +1778,6 @@ boyer_moore (EMACS_INT n, unsigned char *base_pat,
   for (i = 0; i < 0400; i++)
     simple_translate[i] = i;
 
-  if (char_base)
-    {
-      /* Setup translate_prev_byte1/2/3/4 from CHAR_BASE.  Only a
-	 byte following them are the target of translation.  */
-      eassume (0x80 <= char_base && char_base <= MAX_CHAR);
-      unsigned char str[MAX_MULTIBYTE_LENGTH];
-      int cblen = CHAR_STRING (char_base, str);
-
-      translate_prev_byte1 = str[cblen - 2];
-      if (cblen > 2)
-	{
-	  translate_prev_byte2 = str[cblen - 3];
-	  if (cblen > 3)
-	    translate_prev_byte3 = str[cblen - 4];
-	}
-    }
-
   i = 0;
   while (i != dirlen)
     {
@@ -1895,6 +1853,102 @@ boyer_moore (EMACS_INT n, unsigned char *base_pat,
 	 for that character if the last character had been
 	 different.  */
     }
+  return stride_for_teases;
+}
+
+/* Do Boyer-Moore search N times for the string BASE_PAT,
+   whose length is LEN_BYTE,
+   from buffer position POS_BYTE until LIM_BYTE.
+   DIRECTION says which direction we search in.
+   TRT and INVERSE_TRT are translation tables.
+   Characters in PAT are already translated by TRT.
+
+   This kind of search works if all the characters in BASE_PAT that
+   have nontrivial translation are the same aside from the last byte.
+   This makes it possible to translate just the last byte of a
+   character, and do so after just a simple test of the context.
+   CHAR_BASE is nonzero if there is such a non-ASCII character.
+
+   If that criterion is not satisfied, do not call this function.  */
+
+static EMACS_INT
+boyer_moore (EMACS_INT n, unsigned char *base_pat,
+	     ptrdiff_t len_byte,
+	     Lisp_Object trt, Lisp_Object inverse_trt,
+	     ptrdiff_t pos_byte, ptrdiff_t lim_byte,
+             int char_base)
+{
+  int direction = ((n > 0) ? 1 : -1);
+  register ptrdiff_t dirlen;
+  ptrdiff_t limit;
+  int stride_for_teases;
+  int BM_tab[0400];
+  register unsigned char *cursor, *p_limit;
+  register ptrdiff_t i;
+  unsigned char *pat, *pat_end;
+  bool multibyte = ! NILP (BVAR (current_buffer, enable_multibyte_characters));
+
+  unsigned char simple_translate[0400];
+  /* These are set to the preceding bytes of a byte to be translated
+     if char_base is nonzero.  As the maximum byte length of a
+     multibyte character is 5, we have to check at most four previous
+     bytes.  */
+  int translate_prev_byte1 = 0;
+  int translate_prev_byte2 = 0;
+  int translate_prev_byte3 = 0;
+
+  /* The general approach is that we are going to maintain that we know
+     the first (closest to the present position, in whatever direction
+     we're searching) character that could possibly be the last
+     (furthest from present position) character of a valid match.  We
+     advance the state of our knowledge by looking at that character
+     and seeing whether it indeed matches the last character of the
+     pattern.  If it does, we take a closer look.  If it does not, we
+     move our pointer (to putative last characters) as far as is
+     logically possible.  This amount of movement, which I call a
+     stride, will be the length of the pattern if the actual character
+     appears nowhere in the pattern, otherwise it will be the distance
+     from the last occurrence of that character to the end of the
+     pattern.  If the amount is zero we have a possible match.  */
+
+  /* Here we make a "mickey mouse" BM table.  The stride of the search
+     is determined only by the last character of the putative match.
+     If that character does not match, we will stride the proper
+     distance to propose a match that superimposes it on the last
+     instance of a character that matches it (per trt), or misses
+     it entirely if there is none. */
+
+  dirlen = len_byte * direction;
+
+  /* Record position after the end of the pattern.  */
+  pat_end = base_pat + len_byte;
+  /* BASE_PAT points to a character that we start scanning from.
+     It is the first character in a forward search,
+     the last character in a backward search.  */
+  if (direction < 0)
+    base_pat = pat_end - 1;
+
+  if (char_base)
+    {
+      /* Setup translate_prev_byte1/2/3/4 from CHAR_BASE.  Only a
+	 byte following them are the target of translation.  */
+      eassume (0x80 <= char_base && char_base <= MAX_CHAR);
+      unsigned char str[MAX_MULTIBYTE_LENGTH];
+      int cblen = CHAR_STRING (char_base, str);
+
+      translate_prev_byte1 = str[cblen - 2];
+      if (cblen > 2)
+	{
+	  translate_prev_byte2 = str[cblen - 3];
+	  if (cblen > 3)
+	    translate_prev_byte3 = str[cblen - 4];
+	}
+    }
+
+  stride_for_teases = boyer_moore_tables (pat_end - len_byte, len_byte,
+					  direction, trt, inverse_trt,
+					  multibyte, char_base, BM_tab,
+					  simple_translate);
   pos_byte += dirlen - ((direction > 0) ? direction : 0);
   /* loop invariant - POS_BYTE points at where last char (first
      char if reverse) of pattern would align in a possible match.  */
@@ -2146,68 +2200,633 @@ boyer_moore (EMACS_INT n, unsigned char *base_pat,
   return BYTE_TO_CHAR (pos_byte);
 }
 
-/* Record beginning BEG_BYTE and end BEG_BYTE + NBYTES
-   for the overall match just found in the current buffer.
-   Also clear out the match data for registers 1 and up.  */
+/* String matchers: Aho-Corasick automata that look for any of a set of
+   literal strings in one pass over the text.
+
+   A string matcher is a record [string-matcher PATTERNS TABLE AUTOMATON].
+   PATTERNS is the vector of strings to look for, and TABLE the
+   translate table through which patterns and text are compared, or nil.
+   AUTOMATON is a unibyte string holding the int arrays described by
+   struct string_matcher; it works on the multibyte form of the
+   translated characters, byte by byte.  The states are numbered in
+   breadth-first order, so a state only has transitions to higher
+   numbers and a failure link to a lower one; this is checked as the
+   automaton is used, so that a corrupted AUTOMATON cannot make Emacs
+   loop or crash.  */
+
+struct string_matcher
+{
+  /* The numbers of states, of transitions and of patterns.  */
+  int nstates, nedges, npatterns;
+
+  /* The state reached from the start state by each byte.  */
+  int const *root;
+
+  /* The transitions of state S are EDGES[EDGE_START[S]] up to
+     EDGES[EDGE_START[S + 1]], each being a byte plus 256 times the
+     state it leads to, in increasing order of bytes.  */
+  int const *edge_start, *edges;
+
+  /* For each state, the state of its longest proper suffix, the index
+     of the longest pattern that it ends with or -1, and its length in
+     characters.  */
+  int const *fail, *out, *depth;
+
+  /* The length of each pattern in characters.  */
+  int const *length;
+
+  /* The translate table, and its values for ASCII characters.  */
+  Lisp_Object table;
+  int ascii[128];
+};
+
+/* The number of ints before the arrays of struct string_matcher in an
+   automaton, and the number of ints of the automaton of NSTATES states
+   for NPATTERNS patterns.  */
+
+enum { STRING_MATCHER_HEADER = 3 };
+
+static ptrdiff_t
+string_matcher_size (ptrdiff_t nstates, ptrdiff_t npatterns)
+{
+  return (STRING_MATCHER_HEADER + 256 + (nstates + 1) + (nstates - 1)
+	  + 3 * nstates + npatterns);
+}
+
+/* Point the arrays of M at the automaton in DATA.  */
 
 static void
-set_search_regs (ptrdiff_t beg_byte, ptrdiff_t nbytes)
+string_matcher_layout (struct string_matcher *m, int *data)
 {
-  ptrdiff_t i;
+  m->nstates = data[0];
+  m->nedges = data[1];
+  m->npatterns = data[2];
+  int *p = data + STRING_MATCHER_HEADER;
+  m->root = p, p += 256;
+  m->edge_start = p, p += m->nstates + 1;
+  m->edges = p, p += m->nedges;
+  m->fail = p, p += m->nstates;
+  m->out = p, p += m->nstates;
+  m->depth = p, p += m->nstates;
+  m->length = p;
+}
 
-  if (!NILP (Vinhibit_changing_match_data))
-    return;
+static bool
+string_matcher_p (Lisp_Object object)
+{
+  return (RECORDP (object) && PVSIZE (object) == 4
+	  && EQ (AREF (object, 0), Qstring_matcher)
+	  && VECTORP (AREF (object, 1))
+	  && (NILP (AREF (object, 2)) || CHAR_TABLE_P (AREF (object, 2)))
+	  && STRINGP (AREF (object, 3)) && !STRING_MULTIBYTE (AREF (object, 3)));
+}
 
-  /* Make sure we have registers in which to store
-     the match position.  */
-  if (search_regs.num_regs == 0)
-    {
-      search_regs.start = xmalloc (2 * sizeof *search_regs.start);
-      search_regs.end = xmalloc (2 * sizeof *search_regs.end);
-      search_regs.num_regs = 2;
-    }
+/* Set up M to use the string matcher MATCHER.  The automaton is used
+   in place, unless it is not aligned; then it is copied into memory
+   that is freed on unwinding.  */
 
-  /* Clear out the other registers.  */
-  for (i = 1; i < search_regs.num_regs; i++)
+static void
+string_matcher_decode (Lisp_Object matcher, struct string_matcher *m)
+{
+  CHECK_TYPE (string_matcher_p (matcher), Qstring_matcher_p, matcher);
+  Lisp_Object automaton = AREF (matcher, 3);
+  ptrdiff_t nbytes = SBYTES (automaton);
+  int header[STRING_MATCHER_HEADER];
+  if (nbytes < sizeof header)
+    wrong_type_argument (Qstring_matcher_p, matcher);
+  memcpy (header, SDATA (automaton), sizeof header);
+  if (! (0 < header[0] && header[1] == header[0] - 1 && 0 <= header[2]
+	 && (string_matcher_size (header[0], header[2]) * sizeof (int)
+	     == nbytes)))
+    wrong_type_argument (Qstring_matcher_p, matcher);
+
+  int *data = (int *) SDATA (automaton);
+  if ((uintptr_t) data % alignof (int) != 0)
     {
-      search_regs.start[i] = -1;
-      search_regs.end[i] = -1;
+      data = xmalloc (nbytes);
+      memcpy (data, SDATA (automaton), nbytes);
+      record_unwind_protect_ptr (xfree, data);
     }
+  string_matcher_layout (m, data);
 
-  search_regs.start[0] = BYTE_TO_CHAR (beg_byte);
-  search_regs.end[0] = BYTE_TO_CHAR (beg_byte + nbytes);
-  XSETBUFFER (last_thing_searched, current_buffer);
+  m->table = AREF (matcher, 2);
+  for (int c = 0; c < 128; c++)
+    m->ascii[c] = NILP (m->table) ? c : char_table_translate (m->table, c);
 }
-
-DEFUN ("search-backward", Fsearch_backward, Ssearch_backward, 1, 4,
-       "MSearch backward: ",
-       doc: /* Search backward from point for STRING.
-Set point to the beginning of the occurrence found, and return point.
-An optional second argument bounds the search; it is a buffer position.
-  The match found must not begin before that position.  A value of nil
-  means search to the beginning of the accessible portion of the buffer.
-Optional third argument, if t, means if fail just return nil (no error).
-  If not nil and not t, position at limit of search and return nil.
-Optional fourth argument COUNT, if a positive number, means to search
-  for COUNT successive occurrences.  If COUNT is negative, search
-  forward, instead of backward, for -COUNT occurrences.  A value of
-  nil means the same as 1.
-With COUNT positive, the match found is the COUNTth to last one (or
-  last, if COUNT is 1 or nil) in the buffer located entirely before
-  the origin of the search; correspondingly with COUNT negative.
 
-Search case-sensitivity is determined by the value of the variable
-`case-fold-search', which see.
+/* Return the state that M reaches from state S with byte B.  */
 
-See also the functions `match-beginning', `match-end' and `replace-match'.  */)
-  (Lisp_Object string, Lisp_Object bound, Lisp_Object noerror, Lisp_Object count)
+static int
+string_matcher_step (struct string_matcher const *m, int s, int b)
 {
-  return search_command (string, bound, noerror, count, -1, 0, 0);
+  while (0 < s && s < m->nstates)
+    {
+      int i = max (0, m->edge_start[s]);
+      int end = min (m->edge_start[s + 1], m->nedges);
+      for (; i < end; i++)
+	{
+	  int e = m->edges[i];
+	  if ((e & 0xff) == b)
+	    {
+	      int next = e >> 8;
+	      return s < next && next < m->nstates ? next : 0;
+	    }
+	  if (b < (e & 0xff))
+	    break;
+	}
+      int f = m->fail[s];
+      s = f < s ? f : 0;
+    }
+  int next = m->root[b];
+  return 0 <= next && next < m->nstates ? next : 0;
 }
 
-DEFUN ("search-forward", Fsearch_forward, Ssearch_forward, 1, 4, "MSearch: ",
-       doc: /* Search forward from point for STRING.
-Set point to the end of the occurrence found, and return point.
+/* The state of a search with a string matcher.  */
+
+struct string_matcher_scan
+{
+  /* The current state, and the number of characters seen so far.  */
+  int state;
+  ptrdiff_t chars;
+
+  /* The index of the pattern of the best match so far, or -1, and
+     where it starts and ends, in characters.  */
+  int best;
+  ptrdiff_t best_start, best_end;
+};
+
+/* Feed the LEN bytes at P, the multibyte form of a character, to the
+   search SC with M.  Return true if no better match can be found.
+   The best match is the one that starts first, and the longest among
+   those.  */
+
+static bool
+string_matcher_feed (struct string_matcher const *m,
+		     struct string_matcher_scan *sc,
+		     unsigned char const *p, int len)
+{
+  int s = sc->state;
+  for (int i = 0; i < len; i++)
+    s = string_matcher_step (m, s, p[i]);
+  sc->state = s;
+  sc->chars++;
+
+  int o = m->out[s];
+  if (0 <= o && o < m->npatterns)
+    {
+      ptrdiff_t start = max (0, sc->chars - m->length[o]);
+      if (sc->best < 0 || start <= sc->best_start)
+	{
+	  sc->best = o;
+	  sc->best_start = start;
+	  sc->best_end = sc->chars;
+	}
+    }
+  return 0 <= sc->best && sc->best_start < sc->chars - m->depth[s];
+}
+
+/* Feed the text from P to END to the search SC with M.  MULTIBYTE says
+   whether the text is multibyte.  Return true if no better match can
+   be found.  Quit now and then, as the text may be long.  */
+
+static bool
+string_matcher_scan (struct string_matcher const *m,
+		     struct string_matcher_scan *sc,
+		     unsigned char const *p, unsigned char const *end,
+		     bool multibyte)
+{
+  unsigned char str[MAX_MULTIBYTE_LENGTH];
+  unsigned short int quit_count = 0;
+  while (p < end)
+    {
+      int c, len;
+      rarely_quit (++quit_count);
+      if (ASCII_CHAR_P (*p))
+	{
+	  c = m->ascii[*p++];
+	  if (ASCII_CHAR_P (c))
+	    {
+	      str[0] = c;
+	      if (string_matcher_feed (m, sc, str, 1))
+		return true;
+	      continue;
+	    }
+	}
+      else if (!multibyte)
+	c = BYTE8_TO_CHAR (*p++);
+      else if (NILP (m->table))
+	{
+	  len = min (BYTES_BY_CHAR_HEAD (*p), end - p);
+	  p += len;
+	  if (string_matcher_feed (m, sc, p - len, len))
+	    return true;
+	  continue;
+	}
+      else
+	{
+	  c = STRING_CHAR_AND_LENGTH (p, len);
+	  p += len;
+	}
+      if (!NILP (m->table))
+	c = char_table_translate (m->table, c);
+      len = CHAR_STRING (c, str);
+      if (string_matcher_feed (m, sc, str, len))
+	return true;
+    }
+  return false;
+}
+
+/* A pattern being added to a new string matcher: the LEN bytes at
+   BYTES, NCHARS characters, of the pattern of index INDEX.  */
+
+struct string_matcher_pattern
+{
+  unsigned char const *bytes;
+  ptrdiff_t len, nchars, index;
+};
+
+static int
+string_matcher_pattern_cmp (void const *a, void const *b)
+{
+  struct string_matcher_pattern const *p = a, *q = b;
+  int cmp = memcmp (p->bytes, q->bytes, min (p->len, q->len));
+  if (cmp == 0)
+    cmp = (p->len > q->len) - (p->len < q->len);
+  if (cmp == 0)
+    cmp = (p->index > q->index) - (p->index < q->index);
+  return cmp;
+}
+
+DEFUN ("make-string-matcher", Fmake_string_matcher, Smake_string_matcher,
+       1, 2, 0,
+       doc: /* Return a matcher for any of the strings in PATTERNS.
+PATTERNS is a list or vector of non-empty strings.  The matcher can be
+used with `string-matcher-search-forward' and
+`string-matcher-string-match', which look for all the patterns in a
+single pass over the text, however many patterns there are.
+
+If CASE-FOLD is non-nil, the matcher ignores case according to the
+case table of the current buffer, as when `case-fold-search' is
+non-nil.  */)
+  (Lisp_Object patterns, Lisp_Object case_fold)
+{
+  patterns = Fvconcat (1, &patterns);
+  ptrdiff_t npatterns = ASIZE (patterns);
+  Lisp_Object table = (NILP (case_fold) ? Qnil
+		       : BVAR (current_buffer, case_canon_table));
+
+  /* Translate the patterns into one multibyte text.  */
+  ptrdiff_t total = 0;
+  for (ptrdiff_t i = 0; i < npatterns; i++)
+    {
+      Lisp_Object pattern = AREF (patterns, i);
+      CHECK_STRING (pattern);
+      if (SCHARS (pattern) == 0)
+	error ("Empty string in string matcher");
+      total += SCHARS (pattern) * MAX_MULTIBYTE_LENGTH;
+    }
+  if (min (INT_MAX >> 8, PTRDIFF_MAX / (4 * sizeof (int))) - 256 < total)
+    error ("Too many patterns for a string matcher");
+
+  USE_SAFE_ALLOCA;
+  unsigned char *text = SAFE_ALLOCA (total);
+  struct string_matcher_pattern *sorted;
+  SAFE_NALLOCA (sorted, 1, npatterns);
+  unsigned char *q = text;
+  for (ptrdiff_t i = 0; i < npatterns; i++)
+    {
+      Lisp_Object pattern = AREF (patterns, i);
+      sorted[i].bytes = q;
+      sorted[i].nchars = SCHARS (pattern);
+      sorted[i].index = i;
+      for (ptrdiff_t j = 0, j_byte = 0; j < SCHARS (pattern); )
+	{
+	  int c;
+	  FETCH_STRING_CHAR_AS_MULTIBYTE_ADVANCE (c, pattern, j, j_byte);
+	  if (!NILP (table))
+	    c = char_table_translate (table, c);
+	  q += CHAR_STRING (c, q);
+	}
+      sorted[i].len = q - sorted[i].bytes;
+    }
+  qsort (sorted, npatterns, sizeof *sorted, string_matcher_pattern_cmp);
+
+  /* Make a trie of the sorted patterns.  Its nodes are numbered in
+     depth-first order, and the children of each node are made in
+     increasing order of their bytes.  NODE[K] is the node of the first
+     K bytes of the previous pattern.  */
+  ptrdiff_t maxnodes = q - text + 1;
+  int *parent, *label, *terminal, *depth, *node;
+  SAFE_NALLOCA (parent, 1, maxnodes);
+  SAFE_NALLOCA (label, 1, maxnodes);
+  SAFE_NALLOCA (terminal, 1, maxnodes);
+  SAFE_NALLOCA (depth, 1, maxnodes);
+  SAFE_NALLOCA (node, 1, maxnodes);
+  int nnodes = 1;
+  parent[0] = -1;
+  terminal[0] = -1;
+  depth[0] = 0;
+  node[0] = 0;
+  for (ptrdiff_t i = 0; i < npatterns; i++)
+    {
+      struct string_matcher_pattern *p = &sorted[i];
+      ptrdiff_t k = 0;
+      if (0 < i)
+	{
+	  struct string_matcher_pattern *prev = &sorted[i - 1];
+	  while (k < min (p->len, prev->len) && p->bytes[k] == prev->bytes[k])
+	    k++;
+	}
+      for (; k < p->len; k++)
+	{
+	  int n = nnodes++;
+	  parent[n] = node[k];
+	  label[n] = p->bytes[k];
+	  terminal[n] = -1;
+	  depth[n] = depth[node[k]] + CHAR_HEAD_P (p->bytes[k]);
+	  node[k + 1] = n;
+	}
+      if (terminal[node[p->len]] < 0)
+	terminal[node[p->len]] = p->index;
+    }
+
+  /* List the children of each node, and renumber the nodes in
+     breadth-first order.  */
+  int *first_child, *order, *renum;
+  SAFE_NALLOCA (first_child, 1, nnodes + 1);
+  SAFE_NALLOCA (order, 1, nnodes);
+  SAFE_NALLOCA (renum, 1, nnodes);
+  memset (first_child, 0, (nnodes + 1) * sizeof *first_child);
+  for (int n = 1; n < nnodes; n++)
+    first_child[parent[n] + 1]++;
+  for (int n = 0; n < nnodes; n++)
+    first_child[n + 1] += first_child[n];
+  int norder = 0, *children = node;
+  order[norder++] = 0;
+  {
+    int *fill;
+    SAFE_NALLOCA (fill, 1, nnodes);
+    memcpy (fill, first_child, nnodes * sizeof *fill);
+    for (int n = 1; n < nnodes; n++)
+      children[fill[parent[n]]++] = n;
+  }
+  for (int i = 0; i < norder; i++)
+    {
+      int n = order[i];
+      renum[n] = i;
+      for (int j = first_child[n]; j < first_child[n + 1]; j++)
+	order[norder++] = children[j];
+    }
+
+  /* Lay out the automaton.  */
+  ptrdiff_t size = string_matcher_size (nnodes, npatterns);
+  int *data;
+  SAFE_NALLOCA (data, 1, size);
+  data[0] = nnodes;
+  data[1] = nnodes - 1;
+  data[2] = npatterns;
+  struct string_matcher m;
+  string_matcher_layout (&m, data);
+  int *root = (int *) m.root, *edge_start = (int *) m.edge_start;
+  int *edges = (int *) m.edges, *fail = (int *) m.fail;
+  int *out = (int *) m.out, *sdepth = (int *) m.depth;
+  int *length = (int *) m.length;
+
+  for (int b = 0; b < 256; b++)
+    root[b] = 0;
+  for (int j = first_child[0]; j < first_child[1]; j++)
+    root[label[children[j]]] = renum[children[j]];
+  for (ptrdiff_t i = 0; i < npatterns; i++)
+    length[sorted[i].index] = sorted[i].nchars;
+
+  int nedges = 0;
+  for (int s = 0; s < nnodes; s++)
+    {
+      int n = order[s];
+      edge_start[s] = nedges;
+      for (int j = first_child[n]; j < first_child[n + 1]; j++)
+	edges[nedges++] = label[children[j]] | renum[children[j]] << 8;
+      sdepth[s] = depth[n];
+      if (s == 0)
+	fail[s] = 0;
+      else if (parent[n] == 0)
+	fail[s] = 0;
+      else
+	{
+	  /* The failure links of shallower states are already known.  */
+	  m.nstates = s;
+	  fail[s] = string_matcher_step (&m, fail[renum[parent[n]]], label[n]);
+	}
+      out[s] = 0 <= terminal[n] ? terminal[n] : s == 0 ? -1 : out[fail[s]];
+    }
+  edge_start[nnodes] = nedges;
+
+  Lisp_Object automaton = make_unibyte_string ((char *) data,
+					       size * sizeof *data);
+  SAFE_FREE ();
+  return CALLN (Frecord, Qstring_matcher, patterns, table, automaton);
+}
+
+DEFUN ("string-matcher-p", Fstring_matcher_p, Sstring_matcher_p, 1, 1, 0,
+       doc: /* Return t if OBJECT is a string matcher.
+See `make-string-matcher'.  */)
+  (Lisp_Object object)
+{
+  return string_matcher_p (object) ? Qt : Qnil;
+}
+
+DEFUN ("string-matcher-patterns", Fstring_matcher_patterns,
+       Sstring_matcher_patterns, 1, 1, 0,
+       doc: /* Return the vector of the patterns of string matcher MATCHER.
+The values returned by `string-matcher-search-forward' and
+`string-matcher-string-match' are indices in this vector.  */)
+  (Lisp_Object matcher)
+{
+  CHECK_TYPE (string_matcher_p (matcher), Qstring_matcher_p, matcher);
+  return AREF (matcher, 1);
+}
+
+DEFUN ("string-matcher-search-forward", Fstring_matcher_search_forward,
+       Sstring_matcher_search_forward, 1, 3, 0,
+       doc: /* Search forward from point for any pattern of MATCHER.
+MATCHER is a string matcher made by `make-string-matcher'.  Of the
+occurrences of its patterns, find the one that starts first, and the
+longest of those that start there.  Set point to its end, set the match
+data to it, and return the index of its pattern in
+`string-matcher-patterns'.
+An optional second argument bounds the search; it is a buffer position.
+  The match found must not end after that position.  A value of nil
+  means search to the end of the accessible portion of the buffer.
+Optional third argument, if t, means if fail just return nil (no error).
+  If not nil and not t, move to limit of search and return nil.  */)
+  (Lisp_Object matcher, Lisp_Object bound, Lisp_Object noerror)
+{
+  ptrdiff_t lim, lim_byte;
+  if (NILP (bound))
+    lim = ZV, lim_byte = ZV_BYTE;
+  else
+    {
+      CHECK_FIXNUM_COERCE_MARKER (bound);
+      lim = XFIXNUM (bound);
+      if (lim < PT)
+	error ("Invalid search bound (wrong side of point)");
+      if (lim > ZV)
+	lim = ZV, lim_byte = ZV_BYTE;
+      else
+	lim_byte = CHAR_TO_BYTE (lim);
+    }
+
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct string_matcher m;
+  string_matcher_decode (matcher, &m);
+  struct string_matcher_scan sc = { .best = -1 };
+  bool multibyte = !NILP (BVAR (current_buffer, enable_multibyte_characters));
+  for (ptrdiff_t pos_byte = PT_BYTE; pos_byte < lim_byte; )
+    {
+      /* Characters do not straddle the gap.  */
+      ptrdiff_t end_byte = (pos_byte < GPT_BYTE ? min (GPT_BYTE, lim_byte)
+			    : lim_byte);
+      if (string_matcher_scan (&m, &sc, BYTE_POS_ADDR (pos_byte),
+			       BYTE_POS_ADDR (end_byte - 1) + 1, multibyte))
+	break;
+      pos_byte = end_byte;
+    }
+  unbind_to (count, Qnil);
+
+  if (sc.best < 0)
+    {
+      if (NILP (noerror))
+	xsignal1 (Qsearch_failed, matcher);
+      if (!EQ (noerror, Qt))
+	SET_PT_BOTH (lim, lim_byte);
+      return Qnil;
+    }
+
+  ptrdiff_t start_byte = CHAR_TO_BYTE (PT + sc.best_start);
+  ptrdiff_t end = PT + sc.best_end, end_byte = CHAR_TO_BYTE (end);
+  set_search_regs (start_byte, end_byte - start_byte);
+  SET_PT_BOTH (end, end_byte);
+  return make_fixnum (sc.best);
+}
+
+DEFUN ("string-matcher-string-match", Fstring_matcher_string_match,
+       Sstring_matcher_string_match, 2, 3, 0,
+       doc: /* Return the index of the first pattern of MATCHER found in STRING.
+MATCHER is a string matcher made by `make-string-matcher'.  Of the
+occurrences of its patterns in STRING, find the one that starts first,
+and the longest of those that start there.  Set the match data to it,
+and return the index of its pattern in `string-matcher-patterns', or
+nil if there is no occurrence.
+If third arg START is non-nil, start search at that index in STRING.  */)
+  (Lisp_Object matcher, Lisp_Object string, Lisp_Object start)
+{
+  if (running_asynch_code)
+    save_search_regs ();
+
+  CHECK_STRING (string);
+  ptrdiff_t pos = 0, pos_byte = 0;
+  if (!NILP (start))
+    {
+      ptrdiff_t len = SCHARS (string);
+      CHECK_FIXNUM (start);
+      pos = XFIXNUM (start);
+      if (pos < 0 && -pos <= len)
+	pos = len + pos;
+      else if (0 > pos || pos > len)
+	args_out_of_range (string, start);
+      pos_byte = string_char_to_byte (string, pos);
+    }
+
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct string_matcher m;
+  string_matcher_decode (matcher, &m);
+  struct string_matcher_scan sc = { .best = -1 };
+  string_matcher_scan (&m, &sc, SDATA (string) + pos_byte,
+		       SDATA (string) + SBYTES (string),
+		       STRING_MULTIBYTE (string));
+  unbind_to (count, Qnil);
+
+  if (sc.best < 0)
+    return Qnil;
+  if (NILP (Vinhibit_changing_match_data))
+    {
+      if (search_regs.num_regs == 0)
+	{
+	  search_regs.start = xmalloc (2 * sizeof *search_regs.start);
+	  search_regs.end = xmalloc (2 * sizeof *search_regs.end);
+	  search_regs.num_regs = 2;
+	}
+      for (ptrdiff_t i = 1; i < search_regs.num_regs; i++)
+	search_regs.start[i] = search_regs.end[i] = -1;
+      search_regs.start[0] = pos + sc.best_start;
+      search_regs.end[0] = pos + sc.best_end;
+      last_thing_searched = Qt;
+    }
+  return make_fixnum (sc.best);
+}
+
+/* Record beginning BEG_BYTE and end BEG_BYTE + NBYTES
+   for the overall match just found in the current buffer.
+   Also clear out the match data for registers 1 and up.  */
+
+static void
+set_search_regs (ptrdiff_t beg_byte, ptrdiff_t nbytes)
+{
+  ptrdiff_t i;
+
+  if (!NILP (Vinhibit_changing_match_data))
+    return;
+
+  /* Make sure we have registers in which to store
+     the match position.  */
+  if (search_regs.num_regs == 0)
+    {
+      search_regs.start = xmalloc (2 * sizeof *search_regs.start);
+      search_regs.end = xmalloc (2 * sizeof *search_regs.end);
+      search_regs.num_regs = 2;
+    }
+
+  /* Clear out the other registers.  */
+  for (i = 1; i < search_regs.num_regs; i++)
+    {
+      search_regs.start[i] = -1;
+      search_regs.end[i] = -1;
+    }
+
+  search_regs.start[0] = BYTE_TO_CHAR (beg_byte);
+  search_regs.end[0] = BYTE_TO_CHAR (beg_byte + nbytes);
+  XSETBUFFER (last_thing_searched, current_buffer);
+}
+
+DEFUN ("search-backward", Fsearch_backward, Ssearch_backward, 1, 4,
+       "MSearch backward: ",
+       doc: /* Search backward from point for STRING.
+Set point to the beginning of the occurrence found, and return point.
+An optional second argument bounds the search; it is a buffer position.
+  The match found must not begin before that position.  A value of nil
+  means search to the beginning of the accessible portion of the buffer.
+Optional third argument, if t, means if fail just return nil (no error).
+  If not nil and not t, position at limit of search and return nil.
+Optional fourth argument COUNT, if a positive number, means to search
+  for COUNT successive occurrences.  If COUNT is negative, search
+  forward, instead of backward, for -COUNT occurrences.  A value of
+  nil means the same as 1.
+With COUNT positive, the match found is the COUNTth to last one (or
+  last, if COUNT is 1 or nil) in the buffer located entirely before
+  the origin of the search; correspondingly with COUNT negative.
+
+Search case-sensitivity is determined by the value of the variable
+`case-fold-search', which see.
+
+See also the functions `match-beginning', `match-end' and `replace-match'.  */)
+  (Lisp_Object string, Lisp_Object bound, Lisp_Object noerror, Lisp_Object count)
+{
+  return search_command (string, bound, noerror, count, -1, 0, 0);
+}
+
+DEFUN ("search-forward", Fsearch_forward, Ssearch_forward, 1, 4, "MSearch: ",
+       doc: /* Search forward from point for STRING.
+Set point to the end of the occurrence found, and return point.
 An optional second argument bounds the search; it is a buffer position.
   The match found must not end after that position.  A value of nil
   means search to the end of the accessible portion of the buffer.
@@ -3326,6 +3945,648 @@ the buffer.  If the buffer doesn't have a cache, the value is nil.  */)
 }
 
 
+/* Searching files without visiting them.  Helper threads open, map and
+   validate the files ahead of the main thread.  A literal pattern whose
+   case equivalents are all ASCII is also searched for by the helpers;
+   other patterns are matched by the main thread, as the regexp engine
+   uses global state.  */
+
+/* A file to be searched.  */
+struct search_file
+{
+  /* The file name, as given and encoded.  */
+  Lisp_Object file;
+  char *encoded;
+
+  /* The contents, and whether they are mapped rather than allocated.  */
+  unsigned char *data;
+  ptrdiff_t size;
+  bool mapped;
+
+  /* Whether the contents are valid UTF-8, to be searched as multibyte
+     text.  */
+  bool multibyte;
+
+  /* For a literal pattern, the start offsets of its occurrences, and
+     whether a helper ran out of memory before finding all of them.  */
+  ptrdiff_t *matches;
+  ptrdiff_t nmatches, nalloc;
+  bool incomplete;
+
+  /* Whether a thread took the file, and whether it finished preparing
+     it.  */
+  bool started, done;
+};
+
+/* Helpers prepare at most this many files ahead of the main thread.  */
+enum { SEARCH_FILES_WINDOW = 32 };
+
+struct search_files
+{
+  struct search_file *files;
+  ptrdiff_t nfiles;
+
+  /* For a literal pattern, its bytes translated by the case table, and
+     the tables and the stride of boyer_moore to search for it.
+     LITERAL is null for other patterns.  */
+  unsigned char *literal;
+  ptrdiff_t literal_len;
+  int bm_tab[0400];
+  unsigned char simple_translate[0400];
+  int stride_for_teases;
+
+  /* Stop after this many matches.  */
+  ptrdiff_t limit;
+
+  /* The registers and the bounds of the matches of a regexp.  */
+  struct re_registers regs;
+  ptrdiff_t *starts, *ends, nalloc;
+
+  /* The tasks of the helper threads, and their number.  If it is
+     nonzero, the following synchronization objects were
+     initialized.  */
+  struct sys_task tasks[SYS_MAX_HELPERS];
+  int ntasks;
+
+  sys_mutex_t mutex;
+  sys_cond_t work_cond, done_cond;
+
+  /* The next file for a helper, and the number of files the main
+     thread is done with.  */
+  ptrdiff_t next, consumed;
+  bool stop;
+};
+
+/* Record in SF the occurrences of the literal pattern of S, searching
+   forward as boyer_moore does.  In a helper thread, as HELPER says,
+   just mark SF as incomplete if memory is exhausted, as signaling an
+   error is not possible there.  */
+
+static void
+search_file_literal (struct search_files *s, struct search_file *sf,
+		     bool helper)
+{
+  ptrdiff_t len = s->literal_len;
+  unsigned char const *pat = s->literal, *data = sf->data;
+  int const *bm_tab = s->bm_tab;
+
+  sf->nmatches = 0;
+  sf->incomplete = false;
+  for (ptrdiff_t pos = len - 1; pos < sf->size && sf->nmatches < s->limit; )
+    {
+      /* POS is where the last byte of a match would be.  */
+      int stride = bm_tab[data[pos]];
+      if (stride != 0)
+	{
+	  pos += stride;
+	  continue;
+	}
+      ptrdiff_t start = pos - len + 1, i = len - 1;
+      while (0 < i && s->simple_translate[data[start + i - 1]] == pat[i - 1])
+	i--;
+      if (i != 0)
+	{
+	  pos += s->stride_for_teases;
+	  continue;
+	}
+      if (sf->nmatches == sf->nalloc)
+	{
+	  if (!helper)
+	    sf->matches = xpalloc (sf->matches, &sf->nalloc, 1, -1,
+				   sizeof *sf->matches);
+	  else
+	    {
+	      ptrdiff_t nalloc;
+	      void *p = (INT_MULTIPLY_WRAPV (sf->nalloc, 2, &nalloc)
+			 || INT_ADD_WRAPV (nalloc, 64, &nalloc)
+			 || min (PTRDIFF_MAX, SIZE_MAX) / sizeof *sf->matches
+			    < nalloc
+			 ? NULL
+			 : realloc (sf->matches, nalloc * sizeof *sf->matches));
+	      if (!p)
+		{
+		  sf->incomplete = true;
+		  return;
+		}
+	      sf->matches = p;
+	      sf->nalloc = nalloc;
+	    }
+	}
+      sf->matches[sf->nmatches++] = start;
+      pos += len;
+    }
+}
+
+/* Release what SF holds.  */
+
+static void
+search_file_release (struct search_file *sf)
+{
+#ifdef HAVE_MMAP
+  if (sf->mapped)
+    {
+      unguard_file_mapping (sf->data);
+      munmap (sf->data, sf->size);
+    }
+  else
+#endif
+    free (sf->data);
+  free (sf->matches);
+  sf->data = NULL;
+  sf->matches = NULL;
+  sf->size = sf->nmatches = sf->nalloc = 0;
+  sf->mapped = sf->incomplete = false;
+}
+
+/* Check whether the contents of SF are valid UTF-8 if VALIDATE, and
+   search them for the literal pattern of S, if any; HELPER is as in
+   search_file_literal.  If the file of a mapping is truncated
+   meanwhile, give it up as a file that cannot be read.  */
+
+static void
+search_file_scan (struct search_files *s, struct search_file *sf,
+		  bool validate, bool helper)
+{
+  sigjmp_buf catch;
+
+  if (sf->mapped)
+    {
+      if (sigsetjmp (catch, 1) != 0)
+	{
+	  search_file_release (sf);
+	  return;
+	}
+      catch_file_mapping_faults (sf->data, &catch);
+    }
+
+  if (validate)
+    {
+      ptrdiff_t nchars = 0;
+      sf->multibyte = (utf_8_valid_prefix (sf->data, sf->data + sf->size,
+					   &nchars)
+		       == sf->data + sf->size);
+    }
+  if (s->literal)
+    search_file_literal (s, sf, helper);
+
+  if (sf->mapped)
+    catch_file_mapping_faults (sf->data, NULL);
+}
+
+/* Open, map and validate SF, and search it for a literal pattern.
+   This may run in a helper thread, as HELPER says, so it must not use
+   Lisp or signal errors; a file that cannot be read is left empty.  */
+
+static void
+search_file_prepare (struct search_files *s, struct search_file *sf,
+		     bool helper)
+{
+  int fd = emacs_open_noquit (sf->encoded, O_RDONLY, 0);
+  if (fd < 0)
+    return;
+
+  struct stat st;
+  if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && 0 < st.st_size
+      && st.st_size <= min (PTRDIFF_MAX, SIZE_MAX) - 1)
+    {
+      ptrdiff_t size = st.st_size;
+#ifdef HAVE_MMAP
+      /* Map the file only if the mapping can be guarded against the
+	 file being truncated meanwhile; see guard_file_mapping.  */
+      void *p = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED && !guard_file_mapping (p, size))
+	{
+	  munmap (p, size);
+	  p = MAP_FAILED;
+	}
+      if (p != MAP_FAILED)
+	{
+	  sf->data = p;
+	  sf->size = size;
+	  sf->mapped = true;
+	}
+      else
+#endif
+	{
+	  sf->data = malloc (size);
+	  while (sf->data && sf->size < size)
+	    {
+	      ssize_t n = read (fd, sf->data + sf->size,
+				min (size - sf->size, MAX_RW_COUNT));
+	      if (n == 0 || (n < 0 && errno != EINTR))
+		break;
+	      sf->size += max (n, 0);
+	    }
+	}
+    }
+  emacs_close (fd);
+
+  if (sf->size != 0)
+    search_file_scan (s, sf, true, helper);
+}
+
+/* Prepare the files of the search ARG ahead of the main thread, until
+   none are left or the search is stopped.  */
+
+static void
+search_files_helper (void *arg)
+{
+  struct search_files *s = arg;
+
+  sys_mutex_lock (&s->mutex);
+  while (!s->stop && s->next < s->nfiles)
+    {
+      if (s->consumed + SEARCH_FILES_WINDOW <= s->next)
+	{
+	  sys_cond_wait (&s->work_cond, &s->mutex);
+	  continue;
+	}
+      struct search_file *sf = &s->files[s->next++];
+      sf->started = true;
+      sys_mutex_unlock (&s->mutex);
+
+      search_file_prepare (s, sf, true);
+
+      sys_mutex_lock (&s->mutex);
+      sf->done = true;
+      sys_cond_broadcast (&s->done_cond);
+    }
+  sys_mutex_unlock (&s->mutex);
+}
+
+/* Make sure that the file SF of S has been prepared.  If no helper
+   has started on it, do it right away instead of waiting.  */
+
+static void
+search_files_await (struct search_files *s, struct search_file *sf)
+{
+  if (s->ntasks != 0)
+    {
+      sys_mutex_lock (&s->mutex);
+      bool started = sf->started;
+      if (!started)
+	{
+	  sf->started = true;
+	  s->next++;
+	}
+      else
+	while (!sf->done)
+	  sys_cond_wait (&s->done_cond, &s->mutex);
+      sys_mutex_unlock (&s->mutex);
+      if (started)
+	{
+	  /* Finish the search of a helper that ran out of memory.  */
+	  if (sf->incomplete)
+	    search_file_scan (s, sf, false, false);
+	  return;
+	}
+    }
+  search_file_prepare (s, sf, false);
+}
+
+/* Let the helpers of S know that the main thread is done with a
+   file.  */
+
+static void
+search_files_consumed (struct search_files *s)
+{
+  if (s->ntasks != 0)
+    {
+      sys_mutex_lock (&s->mutex);
+      s->consumed++;
+      sys_cond_broadcast (&s->work_cond);
+      sys_mutex_unlock (&s->mutex);
+    }
+}
+
+static void
+search_files_cleanup (void *arg)
+{
+  struct search_files *s = arg;
+
+  if (s->ntasks != 0)
+    {
+      sys_mutex_lock (&s->mutex);
+      s->stop = true;
+      sys_cond_broadcast (&s->work_cond);
+      sys_mutex_unlock (&s->mutex);
+      for (int i = 0; i < s->ntasks; i++)
+	sys_task_wait (&s->tasks[i]);
+      sys_cond_destroy (&s->work_cond);
+      sys_cond_destroy (&s->done_cond);
+      sys_mutex_destroy (&s->mutex);
+    }
+
+  for (ptrdiff_t i = 0; i < s->nfiles; i++)
+    {
+      search_file_release (&s->files[i]);
+      xfree (s->files[i].encoded);
+    }
+  xfree (s->files);
+  xfree (s->literal);
+  xfree (s->regs.start);
+  xfree (s->regs.end);
+  xfree (s->starts);
+  xfree (s->ends);
+}
+
+/* Set up S to search for REGEXP with the helper threads, if REGEXP is
+   literal and its case equivalents under TRT and INVERSE_TRT are
+   ASCII.  */
+
+static void
+search_files_setup_literal (struct search_files *s, Lisp_Object regexp,
+			    Lisp_Object trt, Lisp_Object inverse_trt)
+{
+  if (!trivial_regexp_p (regexp) || !NILP (Vsearch_spaces_regexp))
+    return;
+
+  unsigned char *literal = xmalloc (SBYTES (regexp));
+  ptrdiff_t len = 0;
+  for (ptrdiff_t i = 0; i < SBYTES (regexp); i++)
+    {
+      int c = SREF (regexp, i);
+      if (c == '\\')
+	c = SREF (regexp, ++i);
+      if (!ASCII_CHAR_P (c))
+	{
+	  xfree (literal);
+	  return;
+	}
+      if (!NILP (trt))
+	{
+	  /* All the case equivalents of C must be ASCII, as non-ASCII
+	     text is compared bytewise.  */
+	  int inverse;
+	  TRANSLATE (inverse, inverse_trt, c);
+	  while (inverse != c)
+	    {
+	      if (!ASCII_CHAR_P (inverse))
+		{
+		  xfree (literal);
+		  return;
+		}
+	      int next;
+	      TRANSLATE (next, inverse_trt, inverse);
+	      if (next == inverse)
+		break;
+	      inverse = next;
+	    }
+	}
+      if (!NILP (trt))
+	TRANSLATE (c, trt, c);
+      literal[len++] = c;
+    }
+  if (len == 0)
+    {
+      xfree (literal);
+      return;
+    }
+
+  s->literal = literal;
+  s->literal_len = len;
+  s->stride_for_teases = boyer_moore_tables (literal, len, 1, trt, inverse_trt,
+					     false, 0, s->bm_tab,
+					     s->simple_translate);
+}
+
+/* Return the (FILE LINE COLUMN MATCH) entries of the matches in SF of
+   S that start at the offsets in STARTS and end at the offsets in ENDS,
+   consed onto RESULT.  */
+
+static Lisp_Object
+search_file_results (struct search_file *sf, ptrdiff_t n,
+		     ptrdiff_t const *starts, ptrdiff_t const *ends,
+		     ptrdiff_t literal_len, Lisp_Object result)
+{
+  unsigned char const *data = sf->data;
+  ptrdiff_t line = 1, line_start = 0, scanned = 0;
+  ptrdiff_t column = 0, column_pos = 0;
+
+  for (ptrdiff_t i = 0; i < n; i++)
+    {
+      ptrdiff_t start = starts[i];
+      ptrdiff_t end = ends ? ends[i] : start + literal_len;
+
+      while (scanned < start)
+	{
+	  unsigned char const *nl = memchr (data + scanned, '\n',
+					    start - scanned);
+	  if (!nl)
+	    break;
+	  line++;
+	  scanned = line_start = nl - data + 1;
+	}
+      scanned = start;
+
+      if (column_pos < line_start)
+	column = 0, column_pos = line_start;
+      if (sf->multibyte)
+	{
+	  for (; column_pos < start; column_pos++)
+	    column += ! CHAR_HEAD_P (data[column_pos]) ? 0 : 1;
+	}
+      else
+	column += start - column_pos, column_pos = start;
+
+      Lisp_Object match
+	= (sf->multibyte
+	   ? make_string_from_bytes ((char const *) data + start,
+				     multibyte_chars_in_text (data + start,
+							      end - start),
+				     end - start)
+	   : make_unibyte_string ((char const *) data + start, end - start));
+      result = Fcons (list4 (sf->file, make_int (line), make_int (column),
+			     match),
+		      result);
+    }
+  return result;
+}
+
+static Lisp_Object
+search_file_matches_1 (struct search_files *s, struct search_file *sf,
+		       Lisp_Object regexp, Lisp_Object trt, ptrdiff_t limit,
+		       ptrdiff_t *nmatches)
+{
+  if (s->literal)
+    {
+      ptrdiff_t n = min (sf->nmatches, limit);
+      *nmatches = n;
+      return search_file_results (sf, n, sf->matches, NULL, s->literal_len,
+				  Qnil);
+    }
+  if (sf->size == 0)
+    return Qnil;
+
+  /* Collect the matches first, as making the results may
+     garbage-collect and shrink the compiled pattern.  */
+  ptrdiff_t n = 0;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct regexp_cache *cache_entry
+    = compile_pattern (regexp, &s->regs, trt, false, sf->multibyte);
+  freeze_pattern (cache_entry);
+  re_match_object = Qt;
+  for (ptrdiff_t pos = 0; pos <= sf->size && n < limit; )
+    {
+      ptrdiff_t found = re_search (&cache_entry->buf,
+				   (char const *) sf->data, sf->size,
+				   pos, sf->size - pos, &s->regs);
+      if (found < 0)
+	{
+	  if (found == -2)
+	    matcher_overflow ();
+	  break;
+	}
+      if (n == s->nalloc)
+	{
+	  s->starts = xpalloc (s->starts, &s->nalloc, 1, -1,
+			       sizeof *s->starts);
+	  s->ends = xrealloc (s->ends, s->nalloc * sizeof *s->ends);
+	}
+      s->starts[n] = found;
+      s->ends[n] = s->regs.end[0];
+      n++;
+      if (s->regs.end[0] > found)
+	pos = s->regs.end[0];
+      else if (found < sf->size)
+	{
+	  /* Step over an empty match.  */
+	  pos = found + 1;
+	  if (sf->multibyte)
+	    while (pos < sf->size && !CHAR_HEAD_P (sf->data[pos]))
+	      pos++;
+	}
+      else
+	break;
+    }
+  unbind_to (count, Qnil);
+  *nmatches = n;
+  return search_file_results (sf, n, s->starts, s->ends, 0, Qnil);
+}
+
+/* Return the (FILE LINE COLUMN MATCH) entries of at most LIMIT matches
+   in SF of S for REGEXP, translated by TRT, last match first, and set
+   *NMATCHES to their number.  If the file of a mapping is truncated
+   meanwhile, skip it.  */
+
+static Lisp_Object
+search_file_matches (struct search_files *s, struct search_file *sf,
+		     Lisp_Object regexp, Lisp_Object trt, ptrdiff_t limit,
+		     ptrdiff_t *nmatches)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  sigjmp_buf catch;
+
+  if (!sf->mapped)
+    return search_file_matches_1 (s, sf, regexp, trt, limit, nmatches);
+  if (sigsetjmp (catch, 1) != 0)
+    {
+      unbind_to (count, Qnil);
+      *nmatches = 0;
+      return Qnil;
+    }
+  catch_file_mapping_faults (sf->data, &catch);
+  Lisp_Object matches
+    = search_file_matches_1 (s, sf, regexp, trt, limit, nmatches);
+  catch_file_mapping_faults (sf->data, NULL);
+  return matches;
+}
+
+DEFUN ("search-files", Fsearch_files, Ssearch_files, 2, 3, 0,
+       doc: /* Search the files FILES for matches of REGEXP.
+Return a list of elements (FILE LINE COLUMN MATCH), one for each match
+of REGEXP, in the order of FILES and of the positions in each file.
+LINE counts from 1 and COLUMN, in characters, from 0; MATCH is the text
+matched.
+
+Files are read without visiting them and without decoding: a file that
+is valid UTF-8 is searched as multibyte text, and any other file as
+unibyte text.  Files that have a file name handler, or cannot be read,
+are skipped.  Case is ignored if `case-fold-search' is non-nil in the
+current buffer.
+
+If LIMIT is non-nil, it is the maximum number of matches to return.
+
+When `search-files-threads' is positive, that many helper threads read
+the files ahead of the search.  They also search the files when REGEXP
+is a literal string.  */)
+  (Lisp_Object regexp, Lisp_Object files, Lisp_Object limit)
+{
+  CHECK_STRING (regexp);
+  CHECK_LIST (files);
+  struct search_files s = { .limit = PTRDIFF_MAX };
+  if (!NILP (limit))
+    {
+      CHECK_FIXNAT (limit);
+      s.limit = min (XFIXNAT (limit), PTRDIFF_MAX);
+    }
+
+  bool fold = !NILP (BVAR (current_buffer, case_fold_search));
+  Lisp_Object trt = fold ? BVAR (current_buffer, case_canon_table) : Qnil;
+  Lisp_Object inverse_trt
+    = fold ? BVAR (current_buffer, case_eqv_table) : Qnil;
+
+  ptrdiff_t count = SPECPDL_INDEX ();
+  record_unwind_protect_ptr (search_files_cleanup, &s);
+
+  ptrdiff_t nfiles = list_length (files);
+  s.files = xzalloc (nfiles * sizeof *s.files);
+  for (Lisp_Object tail = files; CONSP (tail); tail = XCDR (tail))
+    {
+      Lisp_Object file = XCAR (tail);
+      CHECK_STRING (file);
+      Lisp_Object absname = Fexpand_file_name (file, Qnil);
+      if (!NILP (Ffind_file_name_handler (absname, Qinsert_file_contents)))
+	continue;
+      Lisp_Object encoded = ENCODE_FILE (absname);
+      struct search_file *sf = &s.files[s.nfiles++];
+      sf->file = file;
+      sf->encoded = xlispstrdup (encoded);
+    }
+
+  search_files_setup_literal (&s, regexp, trt, inverse_trt);
+
+  /* On MS-Windows, the emulation of file descriptors isn't
+     thread-safe.  */
+#if defined THREADS_ENABLED && !defined WINDOWSNT
+  if (0 < search_files_threads && 1 < s.nfiles)
+    {
+      sys_mutex_init (&s.mutex);
+      sys_cond_init (&s.work_cond);
+      sys_cond_init (&s.done_cond);
+      s.ntasks = min (search_files_threads, SYS_MAX_HELPERS);
+      for (int i = 0; i < s.ntasks; i++)
+	{
+	  s.tasks[i].func = search_files_helper;
+	  s.tasks[i].arg = &s;
+	  sys_task_start (&s.tasks[i]);
+	}
+    }
+#endif
+
+  Lisp_Object result = Qnil;
+  ptrdiff_t nresults = 0;
+
+  for (ptrdiff_t i = 0; i < s.nfiles && nresults < s.limit; i++)
+    {
+      struct search_file *sf = &s.files[i];
+      search_files_await (&s, sf);
+      maybe_quit ();
+
+      ptrdiff_t n;
+      Lisp_Object matches = search_file_matches (&s, sf, regexp, trt,
+						 s.limit - nresults, &n);
+      result = nconc2 (matches, result);
+      nresults += n;
+
+      search_file_release (sf);
+      search_files_consumed (&s);
+    }
+
+  unbind_to (count, Qnil);
+  return Fnreverse (result);
+}
+
 static void syms_of_search_for_pdumper (void);
 
 void
@@ -3341,6 +4602,9 @@ syms_of_search (void)
   /* Error condition used for failing searches.  */
   DEFSYM (Qsearch_failed, "search-failed");
 
+  DEFSYM (Qstring_matcher, "string-matcher");
+  DEFSYM (Qstring_matcher_p, "string-matcher-p");
+
   /* Error condition used for failing searches started by user, i.e.,
      where failure should not invoke the debugger.  */
   DEFSYM (Quser_search_failed, "user-search-failed");
@@ -3377,6 +4641,12 @@ numbering of existing capture groups in unexpected ways.  */);
   Vsearch_spaces_regexp = Qnil;
 
   DEFSYM (Qinhibit_changing_match_data, "inhibit-changing-match-data");
+  DEFVAR_INT ("search-files-threads", search_files_threads,
+	      doc: /* Number of helper threads reading ahead for `search-files'.
+If this is zero, or threads are not supported, as on MS-Windows,
+`search-files' reads each file when it gets to it.  */);
+  search_files_threads = 0;
+
   DEFVAR_LISP ("inhibit-changing-match-data", Vinhibit_changing_match_data,
       doc: /* Internal use only.
 If non-nil, the primitive searching and matching functions
@@ -3401,6 +4671,12 @@ is to bind it with `let' around a small expression.  */);
   defsubr (&Smatch_data);
   defsubr (&Sset_match_data);
   defsubr (&Sregexp_quote);
+  defsubr (&Smake_string_matcher);
+  defsubr (&Sstring_matcher_p);
+  defsubr (&Sstring_matcher_patterns);
+  defsubr (&Sstring_matcher_search_forward);
+  defsubr (&Sstring_matcher_string_match);
+  defsubr (&Ssearch_files);
   defsubr (&Snewline_cache_check);
 
   pdumper_do_now_and_after_load (syms_of_search_for_pdumper);
@@ -185,6 +185,7 @@ static void scan_sexps_forward (struct lisp_parse_state *,
                                 ptrdiff_t, ptrdiff_t, ptrdiff_t, EMACS_INT,
                                 bool, int);
 static void internalize_parse_state (Lisp_Object, struct lisp_parse_state *);
+static Lisp_Object externalize_parse_state (struct lisp_parse_state *);
 static bool in_classes (int, Lisp_Object);
 static void parse_sexp_propertize (ptrdiff_t charpos);
 
@@ -1916,6 +1917,15 @@ skip_chars (bool forwardp, Lisp_Object string, Lisp_Object lim,
 	}
     }
 
+  /* RUNMAP says which bytes are single characters that are surely
+     skipped, so that runs of them can be skipped without decoding
+     them.  In a multibyte range, these are the ASCII characters in
+     FASTMAP.  */
+  char runmap[0400];
+  memset (runmap, 0, sizeof runmap);
+  if (NILP (iso_classes))
+    memcpy (runmap, fastmap, multibyte ? 0200 : sizeof runmap);
+
   {
     ptrdiff_t start_point = PT;
     ptrdiff_t pos = PT;
@@ -1953,6 +1963,16 @@ skip_chars (bool forwardp, Lisp_Object string, Lisp_Object lim,
 		  p = GAP_END_ADDR;
 		  stop = endp;
 		}
+	      if (runmap[*p])
+		{
+		  unsigned char *q = p + 1;
+		  while (q < stop && runmap[*q])
+		    q++;
+		  pos += q - p, pos_byte += q - p;
+		  p = q;
+		  rarely_quit (pos);
+		  continue;
+		}
 	      c = STRING_CHAR_AND_LENGTH (p, nbytes);
 	      if (! NILP (iso_classes) && in_classes (c, iso_classes))
 		{
@@ -1995,6 +2015,17 @@ skip_chars (bool forwardp, Lisp_Object string, Lisp_Object lim,
 		  stop = endp;
 		}
 
+	      if (runmap[*p])
+		{
+		  unsigned char *q = p + 1;
+		  while (q < stop && runmap[*q])
+		    q++;
+		  pos += q - p, pos_byte += q - p;
+		  p = q;
+		  rarely_quit (pos);
+		  continue;
+		}
+
 	      if (!NILP (iso_classes) && in_classes (*p, iso_classes))
 		{
 		  if (negate)
@@ -2022,6 +2053,16 @@ skip_chars (bool forwardp, Lisp_Object string, Lisp_Object lim,
 		  p = GPT_ADDR;
 		  stop = endp;
 		}
+	      if (runmap[p[-1]])
+		{
+		  unsigned char *q = p - 1;
+		  while (q > stop && runmap[q[-1]])
+		    q--;
+		  pos -= p - q, pos_byte -= p - q;
+		  p = q;
+		  rarely_quit (pos);
+		  continue;
+		}
 	      unsigned char *prev_p = p;
 	      do
 		p--;
@@ -2063,6 +2104,17 @@ skip_chars (bool forwardp, Lisp_Object string, Lisp_Object lim,
 		  stop = endp;
 		}
 
+	      if (runmap[p[-1]])
+		{
+		  unsigned char *q = p - 1;
+		  while (q > stop && runmap[q[-1]])
+		    q--;
+		  pos -= p - q, pos_byte -= p - q;
+		  p = q;
+		  rarely_quit (pos);
+		  continue;
+		}
+
 	      if (! NILP (iso_classes) && in_classes (p[-1], iso_classes))
 		{
 		  if (negate)
@@ -2147,6 +2199,12 @@ skip_syntaxes (bool forwardp, Lisp_Object string, Lisp_Object lim)
     for (i = 0; i < sizeof fastmap; i++)
       fastmap[i] ^= 1;
 
+  /* RUNMAP records the single-byte characters found to be skipped
+     since the syntax table last changed, so that runs of them can be
+     skipped without looking up their syntax again.  */
+  char runmap[0400];
+  int runmap_limit = multibyte ? 0200 : 0400;
+
   {
     ptrdiff_t start_point = PT;
     ptrdiff_t pos = PT;
@@ -2154,6 +2212,7 @@ skip_syntaxes (bool forwardp, Lisp_Object string, Lisp_Object lim)
     unsigned char *p, *endp, *stop;
 
     SETUP_SYNTAX_TABLE (pos, forwardp ? 1 : -1);
+    memset (runmap, 0, sizeof runmap);
 
     if (forwardp)
       {
@@ -2174,12 +2233,31 @@ skip_syntaxes (bool forwardp, Lisp_Object string, Lisp_Object lim)
 		    p = GAP_END_ADDR;
 		    stop = endp;
 		  }
+		if (runmap[*p])
+		  {
+		    /* Don't go past the current syntax table.  */
+		    unsigned char *q = p + 1, *qlim = stop;
+		    if (parse_sexp_lookup_properties
+			&& gl_state.e_property - pos < stop - p)
+		      qlim = p + (gl_state.e_property - pos);
+		    if (q <= qlim)
+		      {
+			while (q < qlim && runmap[*q])
+			  q++;
+			pos += q - p, pos_byte += q - p;
+			p = q;
+			rarely_quit (pos);
+			continue;
+		      }
+		  }
 		if (multibyte)
 		  c = STRING_CHAR_AND_LENGTH (p, nbytes);
 		else
 		  c = *p, nbytes = 1;
 		if (! fastmap[SYNTAX (c)])
 		  goto done;
+		if (c < runmap_limit)
+		  runmap[c] = 1;
 		p += nbytes, pos++, pos_byte += nbytes;
 		rarely_quit (pos);
 	      }
@@ -2188,6 +2266,7 @@ skip_syntaxes (bool forwardp, Lisp_Object string, Lisp_Object lim)
 
 	    update_syntax_table_forward (pos + gl_state.offset,
 					 false, gl_state.object);
+	    memset (runmap, 0, sizeof runmap);
 	  }
       }
     else
@@ -2207,7 +2286,27 @@ skip_syntaxes (bool forwardp, Lisp_Object string, Lisp_Object lim)
 		    p = GPT_ADDR;
 		    stop = endp;
 		  }
+		if (runmap[p[-1]])
+		  {
+		    /* Don't go before the current syntax table.  */
+		    unsigned char *q = p - 1, *qlim = stop;
+		    if (parse_sexp_lookup_properties
+			&& pos - gl_state.b_property < p - stop)
+		      qlim = p - (pos - gl_state.b_property);
+		    if (q >= qlim)
+		      {
+			while (q > qlim && runmap[q[-1]])
+			  q--;
+			pos -= p - q, pos_byte -= p - q;
+			p = q;
+			rarely_quit (pos);
+			continue;
+		      }
+		  }
+		ptrdiff_t b_property = gl_state.b_property;
 		UPDATE_SYNTAX_TABLE_BACKWARD (pos - 1);
+		if (gl_state.b_property != b_property)
+		  memset (runmap, 0, sizeof runmap);
 
 		unsigned char *prev_p = p;
 		do
@@ -2217,6 +2316,8 @@ skip_syntaxes (bool forwardp, Lisp_Object string, Lisp_Object lim)
 		c = STRING_CHAR (p);
 		if (! fastmap[SYNTAX (c)])
 		  break;
+		if (c < runmap_limit)
+		  runmap[c] = 1;
 		pos--, pos_byte -= prev_p - p;
 		rarely_quit (pos);
 	      }
@@ -2232,9 +2333,31 @@ skip_syntaxes (bool forwardp, Lisp_Object string, Lisp_Object lim)
 		    p = GPT_ADDR;
 		    stop = endp;
 		  }
+		if (runmap[p[-1]])
+		  {
+		    /* Don't go before the current syntax table.  */
+		    unsigned char *q = p - 1, *qlim = stop;
+		    if (parse_sexp_lookup_properties
+			&& pos - gl_state.b_property < p - stop)
+		      qlim = p - (pos - gl_state.b_property);
+		    if (q >= qlim)
+		      {
+			while (q > qlim && runmap[q[-1]])
+			  q--;
+			pos -= p - q, pos_byte -= p - q;
+			p = q;
+			rarely_quit (pos);
+			continue;
+		      }
+		  }
+		ptrdiff_t b_property = gl_state.b_property;
 		UPDATE_SYNTAX_TABLE_BACKWARD (pos - 1);
-		if (! fastmap[SYNTAX (p[-1])])
+		if (gl_state.b_property != b_property)
+		  memset (runmap, 0, sizeof runmap);
+		c = p[-1];
+		if (! fastmap[SYNTAX (c)])
 		  break;
+		runmap[c] = 1;
 		p--, pos--, pos_byte--;
 		rarely_quit (pos);
 	      }
@@ -3526,6 +3649,41 @@ internalize_parse_state (Lisp_Object external, struct lisp_parse_state *state)
     }
 }
 
+/* Convert the internal parse state STATE to the list returned by
+   parse-partial-sexp.  */
+static Lisp_Object
+externalize_parse_state (struct lisp_parse_state *state)
+{
+  return
+    Fcons (make_fixnum (state->depth),
+	   Fcons (state->prevlevelstart < 0
+		  ? Qnil : make_fixnum (state->prevlevelstart),
+	     Fcons (state->thislevelstart < 0
+		    ? Qnil : make_fixnum (state->thislevelstart),
+	       Fcons (state->instring >= 0
+		      ? (state->instring == ST_STRING_STYLE
+			 ? Qt : make_fixnum (state->instring)) : Qnil,
+		 Fcons (state->incomment < 0 ? Qt :
+			(state->incomment == 0 ? Qnil :
+			 make_fixnum (state->incomment)),
+		   Fcons (state->quoted ? Qt : Qnil,
+		     Fcons (make_fixnum (state->mindepth),
+		       Fcons ((state->comstyle
+			       ? (state->comstyle == ST_COMMENT_STYLE
+				  ? Qsyntax_table
+				  : make_fixnum (state->comstyle))
+			       : Qnil),
+		         Fcons (((state->incomment
+                                  || (state->instring >= 0))
+                                 ? make_fixnum (state->comstr_start)
+                                 : Qnil),
+			   Fcons (state->levelstarts,
+                             Fcons (state->prev_syntax == Smax
+                                    ? Qnil
+                                    : make_fixnum (state->prev_syntax),
+                                Qnil)))))))))));
+}
+
 DEFUN ("parse-partial-sexp", Fparse_partial_sexp, Sparse_partial_sexp, 2, 6, 0,
        doc: /* Parse Lisp syntax starting at FROM until TO; return status of parse at TO.
 Parsing stops at TO or when certain criteria are met;
@@ -3587,36 +3745,244 @@ Sixth arg COMMENTSTOP non-nil means stop after the start of a comment.
 
   SET_PT_BOTH (state.location, state.location_byte);
 
-  return
-    Fcons (make_fixnum (state.depth),
-	   Fcons (state.prevlevelstart < 0
-		  ? Qnil : make_fixnum (state.prevlevelstart),
-	     Fcons (state.thislevelstart < 0
-		    ? Qnil : make_fixnum (state.thislevelstart),
-	       Fcons (state.instring >= 0
-		      ? (state.instring == ST_STRING_STYLE
-			 ? Qt : make_fixnum (state.instring)) : Qnil,
-		 Fcons (state.incomment < 0 ? Qt :
-			(state.incomment == 0 ? Qnil :
-			 make_fixnum (state.incomment)),
-		   Fcons (state.quoted ? Qt : Qnil,
-		     Fcons (make_fixnum (state.mindepth),
-		       Fcons ((state.comstyle
-			       ? (state.comstyle == ST_COMMENT_STYLE
-				  ? Qsyntax_table
-				  : make_fixnum (state.comstyle))
-			       : Qnil),
-		         Fcons (((state.incomment
-                                  || (state.instring >= 0))
-                                 ? make_fixnum (state.comstr_start)
-                                 : Qnil),
-			   Fcons (state.levelstarts,
-                             Fcons (state.prev_syntax == Smax
-                                    ? Qnil
-                                    : make_fixnum (state.prev_syntax),
-                                Qnil)))))))))));
+  return externalize_parse_state (&state);
 }
 
+/* The syntax-ppss cache.
+
+   syntax-ppss finds the parse state at a position by parsing from
+   the state at some earlier position.  The states it can start from
+   are kept here: one every SYNTAX_PPSS_INTERVAL characters or so from
+   BEGV, plus the state at the position it was last asked about.
+   Each cache is good for one syntax table and one value of BEGV, and
+   a buffer has at most SYNTAX_PPSS_MAX_CACHES of them, most recently
+   used first.  Since the state at a position only depends on the text
+   before it, a change of the text discards just the states after the
+   change (see invalidate_buffer_caches).  The caches hang off the
+   base buffer, whose text they describe.  */
+
+enum { SYNTAX_PPSS_INTERVAL = 512, SYNTAX_PPSS_MAX_CACHES = 4 };
+
+struct syntax_ppss_cache
+{
+  /* Next cache of the same buffer.  */
+  struct syntax_ppss_cache *next;
+
+  /* What the states depend on, besides the text.  */
+  Lisp_Object table;
+  ptrdiff_t begv;
+  bool_bf lookup_properties : 1;
+  bool_bf comment_end_can_be_escaped : 1;
+
+  /* True if LAST is the state at LAST.location.  */
+  bool_bf last_valid : 1;
+  struct lisp_parse_state last;
+
+  /* NSTATES states, in increasing order of location.  */
+  struct lisp_parse_state *states;
+  ptrdiff_t nstates, states_size;
+};
+
+/* Incremented whenever cached states are discarded, so that
+   Finternal__syntax_ppss can tell whether the cache changed while it
+   was parsing, e.g. because of syntax-propertize.  */
+static EMACS_UINT syntax_ppss_flushes;
+
+/* Return the number of states in cache C at or before POS.  */
+
+static ptrdiff_t
+syntax_ppss_states_upto (struct syntax_ppss_cache *c, ptrdiff_t pos)
+{
+  ptrdiff_t lo = 0, hi = c->nstates;
+  while (lo < hi)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      if (c->states[mid].location <= pos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* Return the cache of the base buffer B for the current buffer's
+   syntax table, restriction and settings, making it if needed.  */
+
+static struct syntax_ppss_cache *
+get_syntax_ppss_cache (struct buffer *b)
+{
+  Lisp_Object table = BVAR (current_buffer, syntax_table);
+  struct syntax_ppss_cache **p = &b->syntax_ppss_cache, *c;
+  int n = 0;
+
+  for (; (c = *p); p = &c->next)
+    {
+      if (EQ (c->table, table) && c->begv == BEGV
+	  && c->lookup_properties == parse_sexp_lookup_properties
+	  && (c->comment_end_can_be_escaped
+	      == Vcomment_end_can_be_escaped))
+	break;
+      if (++n == SYNTAX_PPSS_MAX_CACHES)
+	{
+	  /* Reuse the least recently used cache.  */
+	  c->table = table;
+	  c->begv = BEGV;
+	  c->lookup_properties = parse_sexp_lookup_properties;
+	  c->comment_end_can_be_escaped = Vcomment_end_can_be_escaped;
+	  c->last_valid = false;
+	  c->nstates = 0;
+	  break;
+	}
+    }
+
+  if (c)
+    *p = c->next;
+  else
+    {
+      c = xzalloc (sizeof *c);
+      c->table = table;
+      c->begv = BEGV;
+      c->lookup_properties = parse_sexp_lookup_properties;
+      c->comment_end_can_be_escaped = Vcomment_end_can_be_escaped;
+    }
+  c->next = b->syntax_ppss_cache;
+  b->syntax_ppss_cache = c;
+  return c;
+}
+
+/* Discard the syntax-ppss states of the base buffer B after POS.  */
+
+void
+invalidate_syntax_ppss_cache (struct buffer *b, ptrdiff_t pos)
+{
+  for (struct syntax_ppss_cache *c = b->syntax_ppss_cache; c; c = c->next)
+    {
+      c->nstates = syntax_ppss_states_upto (c, pos);
+      if (c->last_valid && c->last.location > pos)
+	c->last_valid = false;
+    }
+  syntax_ppss_flushes++;
+}
+
+/* Free the syntax-ppss caches of the base buffer B.  */
+
+void
+free_syntax_ppss_cache (struct buffer *b)
+{
+  struct syntax_ppss_cache *c, *next;
+  for (c = b->syntax_ppss_cache; c; c = next)
+    {
+      next = c->next;
+      xfree (c->states);
+      xfree (c);
+    }
+  b->syntax_ppss_cache = NULL;
+  syntax_ppss_flushes++;
+}
+
+/* Mark the Lisp objects in the syntax-ppss caches of B.  */
+
+void
+mark_syntax_ppss_cache (struct buffer *b)
+{
+  for (struct syntax_ppss_cache *c = b->syntax_ppss_cache; c; c = c->next)
+    {
+      mark_object (c->table);
+      if (c->last_valid)
+	mark_object (c->last.levelstarts);
+      for (ptrdiff_t i = 0; i < c->nstates; i++)
+	mark_object (c->states[i].levelstarts);
+    }
+}
+
+DEFUN ("internal--syntax-ppss", Finternal__syntax_ppss,
+       Sinternal__syntax_ppss, 1, 1, 0,
+       doc: /* Return the parse state at POS, parsing from the beginning of the buffer.
+The value is like that of `parse-partial-sexp' from `point-min' to
+POS, except that elements 2 and 6 cannot be relied upon.  Point is
+left at POS.
+
+States at some positions are cached for later calls.  Changes of the
+buffer text discard them as needed, but if anything else they depend
+on changes, such as `syntax-table' text properties set while
+`inhibit-modification-hooks' is non-nil, call
+`internal--syntax-ppss-flush'.
+This is the workhorse of `syntax-ppss', which should be used instead.  */)
+  (Lisp_Object pos)
+{
+  struct buffer *b = (current_buffer->base_buffer
+		      ? current_buffer->base_buffer : current_buffer);
+  EMACS_UINT flushes = syntax_ppss_flushes;
+  struct lisp_parse_state state;
+  ptrdiff_t to, i, known;
+
+  CHECK_FIXNUM_COERCE_MARKER (pos);
+  to = XFIXNUM (pos);
+  if (! (BEGV <= to && to <= ZV))
+    args_out_of_range (Fcurrent_buffer (), pos);
+
+  /* Start from the closest state before TO.  */
+  struct syntax_ppss_cache *c = get_syntax_ppss_cache (b);
+  i = syntax_ppss_states_upto (c, to);
+  if (c->last_valid && c->last.location <= to
+      && (i == 0 || c->states[i - 1].location <= c->last.location))
+    state = c->last;
+  else if (i > 0)
+    state = c->states[i - 1];
+  else
+    {
+      internalize_parse_state (Qnil, &state);
+      state.location = BEGV;
+      state.location_byte = BEGV_BYTE;
+    }
+
+  /* When parsing past the last cached state, cache more on the way.  */
+  known = c->nstates ? c->states[c->nstates - 1].location : BEGV;
+  while (state.location >= known
+	 && to - state.location > SYNTAX_PPSS_INTERVAL)
+    {
+      scan_sexps_forward (&state, state.location, state.location_byte,
+			  state.location + SYNTAX_PPSS_INTERVAL,
+			  TYPE_MINIMUM (EMACS_INT), false, 0);
+      if (syntax_ppss_flushes != flushes)
+	break;
+      if (c->nstates == c->states_size)
+	c->states = xpalloc (c->states, &c->states_size, 1, -1,
+			     sizeof *c->states);
+      c->states[c->nstates++] = state;
+      known = state.location;
+    }
+
+  scan_sexps_forward (&state, state.location, state.location_byte, to,
+		      TYPE_MINIMUM (EMACS_INT), false, 0);
+
+  /* The value is given to Lisp, which may modify it, so cache a copy
+     of its list of open parens.  */
+  Lisp_Object levelstarts = Fcopy_sequence (state.levelstarts);
+  if (syntax_ppss_flushes == flushes)
+    {
+      c->last = state;
+      c->last.levelstarts = levelstarts;
+      c->last_valid = true;
+    }
+
+  SET_PT_BOTH (state.location, state.location_byte);
+  return externalize_parse_state (&state);
+}
+
+DEFUN ("internal--syntax-ppss-flush", Finternal__syntax_ppss_flush,
+       Sinternal__syntax_ppss_flush, 1, 1, 0,
+       doc: /* Discard the states cached by `internal--syntax-ppss' after BEG.  */)
+  (Lisp_Object beg)
+{
+  CHECK_FIXNUM_COERCE_MARKER (beg);
+  invalidate_syntax_ppss_cache ((current_buffer->base_buffer
+				 ? current_buffer->base_buffer
+				 : current_buffer),
+				XFIXNUM (beg));
+  return Qnil;
+}
+
 void
 init_syntax_once (void)
 {
@@ -3799,4 +4165,6 @@ In both cases, LIMIT bounds the search. */);
   defsubr (&Sscan_sexps);
   defsubr (&Sbackward_prefix_chars);
   defsubr (&Sparse_partial_sexp);
+  defsubr (&Sinternal__syntax_ppss);
+  defsubr (&Sinternal__syntax_ppss_flush);
 }
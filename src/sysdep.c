@@ -107,6 +107,11 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 # include <memory.h>
 #endif
 
+#ifdef HAVE_MMAP
+# include <sys/mman.h>
+# include "getpagesize.h"
+#endif
+
 #include "keyboard.h"
 #include "frame.h"
 #include "termhooks.h"
@@ -1926,6 +1931,231 @@ init_sigsegv (void)
 
 #endif /* HAVE_STACK_OVERFLOW_HANDLING && !WINDOWSNT */
 
+#if defined HAVE_MMAP && defined SIGBUS && defined SA_SIGINFO \
+  && defined HAVE_STACK_OVERFLOW_HANDLING && !defined WINDOWSNT
+
+/* Memory mapped from files that may shrink while they are mapped,
+   which makes reading the pages past their new end raise SIGBUS.
+   Nothing can make such a page readable from a signal handler, so the
+   handler marks the mapping as truncated and jumps out: to the place
+   that catch_file_mapping_faults set for the mapping, if any, or else
+   back to the command loop, as handle_sigsegv does, which gives up the
+   text that is gone in the buffers mapping the file.  The handler
+   looks at the table without locking it, so an entry is filled in
+   before its START is set, and its START is cleared before the memory
+   is unmapped.  */
+
+enum { FILE_MAPPINGS_MAX = 256 };
+
+static struct file_mapping
+{
+  char *volatile start;
+  volatile size_t size;
+
+  /* Where to jump if the mapping faults, or null.  */
+  sigjmp_buf *volatile catch;
+
+  /* Whether the mapping faulted.  */
+  volatile sig_atomic_t truncated;
+} file_mappings[FILE_MAPPINGS_MAX];
+
+static sys_mutex_t file_mappings_mutex;
+static bool file_mappings_guarded;
+static size_t file_mappings_page_size;
+
+/* Guard the SIZE bytes at START, mapped from a file, against SIGBUS.
+   Return false if they can't be guarded; then the file should be read
+   rather than mapped.  This can be called from any thread.  */
+
+bool
+guard_file_mapping (void *start, size_t size)
+{
+  if (!file_mappings_guarded)
+    return false;
+  bool guarded = false;
+  sys_mutex_lock (&file_mappings_mutex);
+  for (int i = 0; i < FILE_MAPPINGS_MAX; i++)
+    if (!file_mappings[i].start)
+      {
+	file_mappings[i].size = size;
+	file_mappings[i].catch = NULL;
+	file_mappings[i].truncated = false;
+	file_mappings[i].start = start;
+	guarded = true;
+	break;
+      }
+  sys_mutex_unlock (&file_mappings_mutex);
+  return guarded;
+}
+
+/* Stop guarding the file mapping at START, before it is unmapped.  */
+
+void
+unguard_file_mapping (void *start)
+{
+  sys_mutex_lock (&file_mappings_mutex);
+  for (int i = 0; i < FILE_MAPPINGS_MAX; i++)
+    if (file_mappings[i].start == start)
+      {
+	file_mappings[i].start = NULL;
+	break;
+      }
+  sys_mutex_unlock (&file_mappings_mutex);
+}
+
+/* Return the entry of the guarded file mapping at START.  */
+
+static struct file_mapping *
+find_file_mapping (void *start)
+{
+  for (int i = 0; i < FILE_MAPPINGS_MAX; i++)
+    if (file_mappings[i].start == start)
+      return &file_mappings[i];
+  emacs_abort ();
+}
+
+/* Make a fault in the guarded file mapping at START jump to CATCH
+   with sigsetjmp returning 1, or stop doing so if CATCH is null.
+   Only the calling thread must read the mapping meanwhile.  */
+
+void
+catch_file_mapping_faults (void *start, sigjmp_buf *catch)
+{
+  find_file_mapping (start)->catch = catch;
+}
+
+/* Return true if the guarded file mapping at START has faulted.  */
+
+bool
+file_mapping_truncated (void *start)
+{
+  return find_file_mapping (start)->truncated;
+}
+
+/* Make the SIZE bytes at START, a guarded file mapping that has
+   faulted, readable again.  Return how many bytes at its start can
+   still be read from the file; map zeros over the rest.  */
+
+size_t
+repair_file_mapping (void *start, size_t size)
+{
+  char *text = start;
+  size_t volatile readable = 0;
+  sigjmp_buf catch;
+
+  if (sigsetjmp (catch, 1) == 0)
+    {
+      catch_file_mapping_faults (start, &catch);
+      for (; readable < size; readable += file_mappings_page_size)
+	{
+	  char volatile c = text[readable];
+	  (void) c;
+	}
+      readable = size;
+    }
+  catch_file_mapping_faults (start, NULL);
+
+  if (readable < size
+      && (mmap (text + readable, size - readable, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0)
+	  == MAP_FAILED))
+    emacs_abort ();
+  find_file_mapping (start)->truncated = false;
+  return readable;
+}
+
+static void
+handle_sigbus (int sig, siginfo_t *siginfo, void *arg)
+{
+  char *addr = siginfo ? siginfo->si_addr : NULL;
+  if (addr)
+    for (int i = 0; i < FILE_MAPPINGS_MAX; i++)
+      {
+	char *start = file_mappings[i].start;
+	if (start && start <= addr && addr < start + file_mappings[i].size)
+	  {
+	    file_mappings[i].truncated = true;
+	    sigjmp_buf *catch = file_mappings[i].catch;
+	    if (catch)
+	      siglongjmp (*catch, 1);
+
+	    bool fatal = gc_in_progress;
+#ifdef FORWARD_SIGNAL_TO_MAIN_THREAD
+	    if (!pthread_equal (pthread_self (), main_thread_id))
+	      fatal = true;
+#endif
+	    /* See command_loop.  */
+	    if (!fatal)
+	      siglongjmp (return_to_command_loop, 2);
+	    break;
+	  }
+      }
+
+  deliver_fatal_thread_signal (sig);
+}
+
+/* Return true if we have set up the SIGBUS handler that guards file
+   mappings.  Otherwise SIGBUS is fatal like the other signals.  */
+
+static bool
+init_sigbus (void)
+{
+  struct sigaction sa;
+
+  sys_mutex_init (&file_mappings_mutex);
+  file_mappings_page_size = getpagesize ();
+  sigfillset (&sa.sa_mask);
+  sa.sa_sigaction = handle_sigbus;
+  sa.sa_flags = SA_SIGINFO | emacs_sigaction_flags ();
+  if (sigaction (SIGBUS, &sa, NULL) < 0)
+    return false;
+
+  file_mappings_guarded = true;
+  return true;
+}
+
+#else /* not (HAVE_MMAP && SIGBUS && SA_SIGINFO
+	  && HAVE_STACK_OVERFLOW_HANDLING && !WINDOWSNT) */
+
+bool
+guard_file_mapping (void *start, size_t size)
+{
+  return false;
+}
+
+void
+unguard_file_mapping (void *start)
+{
+}
+
+void
+catch_file_mapping_faults (void *start, sigjmp_buf *catch)
+{
+}
+
+bool
+file_mapping_truncated (void *start)
+{
+  return false;
+}
+
+size_t
+repair_file_mapping (void *start, size_t size)
+{
+  return size;
+}
+
+# ifdef SIGBUS
+static bool
+init_sigbus (void)
+{
+  return false;
+}
+# endif
+
+#endif /* not (HAVE_MMAP && SIGBUS && SA_SIGINFO
+	  && HAVE_STACK_OVERFLOW_HANDLING && !WINDOWSNT) */
+
 static void
 deliver_arith_signal (int sig)
 {
@@ -2191,7 +2421,8 @@ init_signals (void)
   sigaction (SIGEMT, &thread_fatal_action, 0);
 #endif
 #ifdef SIGBUS
-  sigaction (SIGBUS, &thread_fatal_action, 0);
+  if (!init_sigbus ())
+    sigaction (SIGBUS, &thread_fatal_action, 0);
 #endif
   if (!init_sigsegv ())
     sigaction (SIGSEGV, &thread_fatal_action, 0);
@@ -2476,6 +2707,22 @@ emacs_open (const char *file, int oflags, int mode)
   return fd;
 }
 
+/* Open FILE as in emacs_open, but do not allow the user to quit, so
+   that threads that don't run Lisp can use this.  */
+
+int
+emacs_open_noquit (const char *file, int oflags, int mode)
+{
+  int fd;
+  if (! (oflags & O_TEXT))
+    oflags |= O_BINARY;
+  oflags |= O_CLOEXEC;
+  do
+    fd = open (file, oflags, mode);
+  while (fd < 0 && errno == EINTR);
+  return fd;
+}
+
 /* Open FILE as a stream for Emacs use, with mode MODE.
    Act like emacs_open with respect to threads, signals, and quits.  */
 
@@ -2573,17 +2820,6 @@ emacs_close (int fd)
     }
 }
 
-/* Maximum number of bytes to read or write in a single system call.
-   This works around a serious bug in Linux kernels before 2.6.16; see
-   <https://bugzilla.redhat.com/show_bug.cgi?format=multiple&id=612839>.
-   It's likely to work around similar bugs in other operating systems, so do it
-   on all platforms.  Round INT_MAX down to a page size, with the conservative
-   assumption that page sizes are at most 2**18 bytes (any kernel with a
-   page size larger than that shouldn't have the bug).  */
-#ifndef MAX_RW_COUNT
-#define MAX_RW_COUNT (INT_MAX >> 18 << 18)
-#endif
-
 /* Verify that MAX_RW_COUNT fits in the relevant standard types.  */
 #ifndef SSIZE_MAX
 # define SSIZE_MAX TYPE_MAXIMUM (ssize_t)
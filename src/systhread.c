@@ -44,6 +44,11 @@ sys_mutex_unlock (sys_mutex_t *m)
 {
 }
 
+void
+sys_mutex_destroy (sys_mutex_t *m)
+{
+}
+
 void
 sys_cond_init (sys_cond_t *c)
 {
@@ -144,6 +149,13 @@ sys_mutex_unlock (sys_mutex_t *mutex)
   eassert (error == 0);
 }
 
+void
+sys_mutex_destroy (sys_mutex_t *mutex)
+{
+  int error = pthread_mutex_destroy (mutex);
+  eassert (error == 0);
+}
+
 void
 sys_cond_init (sys_cond_t *cond)
 {
@@ -293,6 +305,12 @@ sys_mutex_unlock (sys_mutex_t *mutex)
   LeaveCriticalSection ((LPCRITICAL_SECTION)mutex);
 }
 
+void
+sys_mutex_destroy (sys_mutex_t *mutex)
+{
+  DeleteCriticalSection ((LPCRITICAL_SECTION)mutex);
+}
+
 void
 sys_cond_init (sys_cond_t *cond)
 {
@@ -534,3 +552,151 @@ sys_thread_yield (void)
 #error port me
 
 #endif
+
+
+/* Helper threads.  Primitives that do much work that needs no Lisp,
+   such as scanning text or reading files, can share it out to tasks
+   run by a pool of helper threads.  A helper thread is created when a
+   task is started and no idle one is left, up to SYS_MAX_HELPERS of
+   them; it then waits for later tasks rather than exit.  A task that
+   no helper thread has taken yet when it is waited for is run by the
+   waiting thread instead, so tasks get done even if no helper thread
+   can be created, as when Emacs is built without threads.
+
+   The variables that set how many helper threads a primitive uses,
+   such as `search-files-threads', count the helper threads that work
+   besides the calling thread, and are zero by default.  */
+
+enum { SYS_TASK_QUEUED, SYS_TASK_RUNNING, SYS_TASK_DONE };
+
+/* Whether the following have been initialized.  Only the thread that
+   runs Lisp starts tasks, so this needs no synchronization.  */
+static bool helpers_initialized;
+
+/* The lock for the following, and the conditions signaled when a task
+   is queued and when a task is done.  */
+static sys_mutex_t helper_mutex;
+static sys_cond_t helper_work_cond, helper_done_cond;
+
+/* The tasks that no helper thread has taken yet, oldest first, and
+   their number.  */
+static struct sys_task *helper_queue_head, *helper_queue_tail;
+static int helper_queued;
+
+/* The number of helper threads, and of those waiting for a task.  */
+static int helper_threads, helper_waiting;
+
+static void *
+helper_thread (void *arg)
+{
+  sys_thread_set_name ("emacs-helper");
+  sys_mutex_lock (&helper_mutex);
+  while (true)
+    {
+      helper_waiting++;
+      while (!helper_queue_head)
+	sys_cond_wait (&helper_work_cond, &helper_mutex);
+      helper_waiting--;
+
+      struct sys_task *task = helper_queue_head;
+      helper_queue_head = task->next;
+      if (!helper_queue_head)
+	helper_queue_tail = NULL;
+      helper_queued--;
+      task->state = SYS_TASK_RUNNING;
+      sys_mutex_unlock (&helper_mutex);
+
+      task->func (task->arg);
+
+      sys_mutex_lock (&helper_mutex);
+      task->state = SYS_TASK_DONE;
+      sys_cond_broadcast (&helper_done_cond);
+    }
+  return NULL;
+}
+
+/* Queue TASK for a helper thread, creating one if need be.  TASK must
+   then be waited for with sys_task_wait.  Return false if there is no
+   helper thread to take TASK, so that only sys_task_wait will run it.  */
+
+bool
+sys_task_start (struct sys_task *task)
+{
+  if (!helpers_initialized)
+    {
+      sys_mutex_init (&helper_mutex);
+      sys_cond_init (&helper_work_cond);
+      sys_cond_init (&helper_done_cond);
+      helpers_initialized = true;
+    }
+
+  sys_mutex_lock (&helper_mutex);
+  task->state = SYS_TASK_QUEUED;
+  task->next = NULL;
+  if (helper_queue_tail)
+    helper_queue_tail->next = task;
+  else
+    helper_queue_head = task;
+  helper_queue_tail = task;
+  helper_queued++;
+  if (helper_waiting < helper_queued && helper_threads < SYS_MAX_HELPERS)
+    {
+      sys_thread_t thread;
+      if (sys_thread_create (&thread, helper_thread, NULL))
+	helper_threads++;
+    }
+  bool taken = helper_threads != 0;
+  sys_cond_signal (&helper_work_cond);
+  sys_mutex_unlock (&helper_mutex);
+  return taken;
+}
+
+/* Wait until TASK is done.  If no helper thread has taken it yet, run
+   it in the calling thread.  TASK can then be waited for again.  */
+
+void
+sys_task_wait (struct sys_task *task)
+{
+  sys_mutex_lock (&helper_mutex);
+  if (task->state == SYS_TASK_QUEUED)
+    {
+      struct sys_task **p = &helper_queue_head, *prev = NULL;
+      while (*p != task)
+	{
+	  prev = *p;
+	  p = &prev->next;
+	}
+      *p = task->next;
+      if (helper_queue_tail == task)
+	helper_queue_tail = prev;
+      helper_queued--;
+      task->state = SYS_TASK_RUNNING;
+      sys_mutex_unlock (&helper_mutex);
+      task->func (task->arg);
+      task->state = SYS_TASK_DONE;
+      return;
+    }
+  while (task->state != SYS_TASK_DONE)
+    sys_cond_wait (&helper_done_cond, &helper_mutex);
+  sys_mutex_unlock (&helper_mutex);
+}
+
+/* Call FUNC with ARG in the calling thread and, at the same time, in
+   up to HELPERS helper threads, and return when all the calls have
+   returned.  FUNC must share out the work between the calls itself.  */
+
+void
+sys_run_helpers (void (*func) (void *), void *arg, intmax_t helpers)
+{
+  struct sys_task tasks[SYS_MAX_HELPERS];
+  int n = clip_to_bounds (0, helpers, SYS_MAX_HELPERS);
+  for (int i = 0; i < n; i++)
+    {
+      tasks[i].func = func;
+      tasks[i].arg = arg;
+      sys_task_start (&tasks[i]);
+    }
+  func (arg);
+  for (int i = 0; i < n; i++)
+    sys_task_wait (&tasks[i]);
+}
@@ -100,6 +100,7 @@ typedef void *(thread_creation_function) (void *);
 extern void sys_mutex_init (sys_mutex_t *);
 extern void sys_mutex_lock (sys_mutex_t *);
 extern void sys_mutex_unlock (sys_mutex_t *);
+extern void sys_mutex_destroy (sys_mutex_t *);
 
 extern void sys_cond_init (sys_cond_t *);
 extern void sys_cond_wait (sys_cond_t *, sys_mutex_t *);
@@ -119,4 +120,23 @@ extern bool sys_thread_create (sys_thread_t *, thread_creation_function *,
 extern void sys_thread_yield (void);
 extern void sys_thread_set_name (const char *);
 
+/* The most helper threads there can be, see below.  */
+enum { SYS_MAX_HELPERS = 64 };
+
+/* A task for a helper thread.  */
+struct sys_task
+{
+  /* The function to call, which must not use Lisp, and its argument.  */
+  void (*func) (void *);
+  void *arg;
+
+  /* The rest is private to systhread.c.  */
+  struct sys_task *next;
+  int state;
+};
+
+extern bool sys_task_start (struct sys_task *);
+extern void sys_task_wait (struct sys_task *);
+extern void sys_run_helpers (void (*) (void *), void *, intmax_t);
+
 #endif /* SYSTHREAD_H */
@@ -267,6 +267,10 @@ enum event_kind
   , FILE_NOTIFY_EVENT
 #endif
 
+  /* An asynchronous file operation finished.
+     .arg is a list (CALLBACK ARGS) to apply CALLBACK to ARGS.  */
+  , FILE_IO_EVENT
+
 };
 
 /* Bit width of an enum event_kind tag at the start of structs and unions.  */
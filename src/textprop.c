@@ -84,6 +84,12 @@ modify_text_properties (Lisp_Object buffer, Lisp_Object start, Lisp_Object end)
   set_buffer_internal (buf);
 
   prepare_to_modify_buffer_1 (b, e, NULL);
+  /* Properties such as `invisible' and `display' affect columns, and
+     `syntax-table' affects the syntax of the text.  */
+  struct buffer *base = buf->base_buffer ? buf->base_buffer : buf;
+  invalidate_column_cache (base, b);
+  if (base->syntax_ppss_cache)
+    invalidate_syntax_ppss_cache (base, b);
 
   BUF_COMPUTE_UNCHANGED (buf, b - 1, e);
   if (MODIFF <= SAVE_MODIFF)
@@ -311,6 +317,234 @@ property_value (Lisp_Object plist, Lisp_Object prop)
   return Qunbound;
 }
 
+/* The property index of a buffer text records, for each of the first
+   few properties listed in `text-property-index-properties', the runs
+   of text over which the value of that property is constant.  The
+   searches for property changes can then find their answer by binary
+   search rather than by walking the intervals one by one, which is
+   slow when there are many intervals where the property does not
+   change, as with the `fontified' property of fontified text.
+
+   A set of runs is built only after the searches have walked more
+   intervals than it takes to build it, and is thrown away whenever
+   the values of its property may have changed: when the text itself
+   changes, which is detected by comparing CHARS_MODIFF, or when
+   add_properties, remove_properties or set_properties changes that
+   property or the category of some text.  A property is not indexed
+   where its value may come from the plist of a `category' symbol,
+   which can be changed in place unnoticed.  */
+
+enum { PROPERTY_INDEX_SLOTS = 4 };
+
+/* How many intervals the searches walk before the runs are built
+   for the first time.  */
+
+enum { PROPERTY_RUNS_MIN_WALK = 1000 };
+
+struct property_run
+{
+  /* Where the run starts; it ends where the next one starts.  */
+  ptrdiff_t pos;
+
+  /* The value of the property in the run.  Since it is also in the
+     plist of some interval, it does not need to be marked.  */
+  Lisp_Object value;
+};
+
+struct property_runs
+{
+  /* The property of these runs, or nil.  */
+  Lisp_Object property;
+
+  /* True if the runs are valid as of CHARS_MODIFF.  CATEGORY is true
+     if the property cannot be indexed as of CHARS_MODIFF, because its
+     value may come from the plist of a category.  */
+  bool valid, category;
+  modiff_count chars_modiff;
+
+  /* Number of intervals walked by searches since the runs became
+     invalid, and number of intervals in the text when they were last
+     built.  */
+  ptrdiff_t walked, cost;
+
+  /* The runs, in order; the first starts at BEG.  */
+  struct property_run *run;
+  ptrdiff_t nruns, size;
+};
+
+struct text_property_index
+{
+  struct property_runs slot[PROPERTY_INDEX_SLOTS];
+};
+
+/* Note that the values of PROP may have changed in OBJECT; Qt means
+   that any property may have changed.  */
+
+static void
+property_index_changed (Lisp_Object object, Lisp_Object prop)
+{
+  if (!BUFFERP (object))
+    return;
+
+  struct text_property_index *index = XBUFFER (object)->text->property_index;
+  if (!index)
+    return;
+
+  for (int k = 0; k < PROPERTY_INDEX_SLOTS; k++)
+    if (EQ (prop, Qt) || EQ (prop, Qcategory)
+	|| EQ (prop, index->slot[k].property))
+      {
+	index->slot[k].valid = false;
+	index->slot[k].category = false;
+	index->slot[k].walked = 0;
+      }
+}
+
+/* Note that the text properties of buffer B may have changed in ways
+   that its CHARS_MODIFF does not show.  */
+
+void
+invalidate_text_property_index (struct buffer *b)
+{
+  Lisp_Object buffer;
+  XSETBUFFER (buffer, b);
+  property_index_changed (buffer, Qt);
+}
+
+/* Free the property index of the text of buffer B.  */
+
+void
+free_text_property_index (struct buffer *b)
+{
+  struct text_property_index *index = b->text->property_index;
+  if (index)
+    {
+      for (int k = 0; k < PROPERTY_INDEX_SLOTS; k++)
+	xfree (index->slot[k].run);
+      xfree (index);
+      b->text->property_index = NULL;
+    }
+}
+
+/* Build the runs R of the property PROP in the buffer text T, unless
+   the value of PROP in some text there may come from the plist of its
+   category.  */
+
+static void
+build_property_runs (struct property_runs *r, struct buffer_text *t,
+		     Lisp_Object prop)
+{
+  ptrdiff_t nintervals = 0;
+
+  r->nruns = 0;
+  r->category = false;
+  for (INTERVAL i = find_interval (t->intervals, BEG); i; i = next_interval (i))
+    {
+      Lisp_Object tail, value = Qnil;
+      bool category = false;
+
+      /* This is what textget does when PROP has no alias and no
+	 default value.  */
+      nintervals++;
+      for (tail = i->plist; CONSP (tail); tail = Fcdr (XCDR (tail)))
+	if (EQ (XCAR (tail), prop))
+	  {
+	    value = Fcar (XCDR (tail));
+	    category = false;
+	    break;
+	  }
+	else if (EQ (XCAR (tail), Qcategory) && SYMBOLP (Fcar (XCDR (tail))))
+	  category = true;
+      if (category)
+	{
+	  r->category = true;
+	  break;
+	}
+
+      if (r->nruns == 0 || !EQ (value, r->run[r->nruns - 1].value))
+	{
+	  if (r->nruns == r->size)
+	    r->run = xpalloc (r->run, &r->size, 1, -1, sizeof *r->run);
+	  r->run[r->nruns].pos = i->position;
+	  r->run[r->nruns].value = value;
+	  r->nruns++;
+	}
+    }
+
+  r->valid = r->nruns > 0 && !r->category;
+  r->chars_modiff = t->chars_modiff;
+  r->walked = 0;
+  r->cost = nintervals;
+}
+
+/* Return the runs of PROP in OBJECT, or NULL if PROP is not indexed
+   there.  The runs need not be valid; if they are not, the caller
+   should add the number of intervals it walks to their WALKED.  */
+
+static struct property_runs *
+property_runs (Lisp_Object object, Lisp_Object prop)
+{
+  if (!BUFFERP (object))
+    return NULL;
+
+  int k = 0;
+  Lisp_Object tail;
+  for (tail = Vtext_property_index_properties;
+       CONSP (tail) && !EQ (XCAR (tail), prop);
+       tail = XCDR (tail))
+    if (++k == PROPERTY_INDEX_SLOTS)
+      return NULL;
+  if (!CONSP (tail))
+    return NULL;
+
+  /* The runs record only the values in the plists.  */
+  if (!NILP (Fassq (prop, Vchar_property_alias_alist))
+      || !NILP (Fplist_get (Vdefault_text_properties, prop)))
+    return NULL;
+
+  struct buffer_text *t = XBUFFER (object)->text;
+  if (!t->property_index)
+    t->property_index = xzalloc (sizeof *t->property_index);
+
+  struct property_runs *r = &t->property_index->slot[k];
+  if (!EQ (r->property, prop))
+    {
+      r->property = prop;
+      r->valid = r->category = false;
+      r->walked = r->cost = 0;
+    }
+  else if ((r->valid || r->category) && r->chars_modiff != t->chars_modiff)
+    {
+      r->valid = r->category = false;
+      r->walked = 0;
+    }
+  if (r->category)
+    return NULL;
+
+  if (!r->valid && t->intervals
+      && r->walked >= r->cost + PROPERTY_RUNS_MIN_WALK)
+    build_property_runs (r, t, prop);
+  return r;
+}
+
+/* Return the index in R of the run containing POS.  */
+
+static ptrdiff_t
+property_run_at (struct property_runs *r, ptrdiff_t pos)
+{
+  ptrdiff_t lo = 0, hi = r->nruns;
+
+  while (hi - lo > 1)
+    {
+      ptrdiff_t mid = lo + (hi - lo) / 2;
+      if (r->run[mid].pos <= pos)
+	lo = mid;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
 /* Set the properties of INTERVAL to PROPERTIES,
    and record undo info for the previous values.
    OBJECT is the string or buffer that INTERVAL belongs to.  */
@@ -350,6 +584,7 @@ set_properties (Lisp_Object properties, INTERVAL interval, Lisp_Object object)
 
   /* Store new properties.  */
   set_interval_plist (interval, Fcopy_sequence (properties));
+  property_index_changed (object, Qt);
 }
 
 /* Add the properties of PLIST to the interval I, or set
@@ -435,6 +670,7 @@ add_properties (Lisp_Object plist, INTERVAL i, Lisp_Object object,
 		  Fsetcar (this_cdr, list2 (Fcar (this_cdr), val1));
 	      }
 	    }
+	    property_index_changed (object, sym1);
 	    changed = true;
 	    break;
 	  }
@@ -448,6 +684,7 @@ add_properties (Lisp_Object plist, INTERVAL i, Lisp_Object object,
 				      sym1, Qnil, object);
 	    }
 	  set_interval_plist (i, Fcons (sym1, Fcons (val1, i->plist)));
+	  property_index_changed (object, sym1);
 	  changed = true;
 	}
     }
@@ -485,6 +722,7 @@ remove_properties (Lisp_Object plist, Lisp_Object list, INTERVAL i, Lisp_Object
 				    object);
 
 	  current_plist = XCDR (XCDR (current_plist));
+	  property_index_changed (object, sym);
 	  changed = true;
 	}
 
@@ -500,6 +738,7 @@ remove_properties (Lisp_Object plist, Lisp_Object list, INTERVAL i, Lisp_Object
 					sym, XCAR (XCDR (this)), object);
 
 	      Fsetcdr (XCDR (tail2), XCDR (XCDR (this)));
+	      property_index_changed (object, sym);
 	      changed = true;
 	    }
 	  tail2 = this;
@@ -1018,6 +1257,7 @@ past position LIMIT; return LIMIT if nothing is found before LIMIT.  */)
 {
   register INTERVAL i, next;
   register Lisp_Object here_val;
+  ptrdiff_t next_pos, walked = 0;
 
   if (NILP (object))
     XSETBUFFER (object, current_buffer);
@@ -1029,23 +1269,42 @@ past position LIMIT; return LIMIT if nothing is found before LIMIT.  */)
   if (!i)
     return limit;
 
-  here_val = textget (i->plist, prop);
-  next = next_interval (i);
-  while (next
-	 && EQ (here_val, textget (next->plist, prop))
-	 && (NILP (limit) || next->position < XFIXNUM (limit)))
-    next = next_interval (next);
+  struct property_runs *r = property_runs (object, prop);
+  if (r && r->valid)
+    {
+      ptrdiff_t k = property_run_at (r, XFIXNUM (position)) + 1;
+      if (k == r->nruns)
+	return limit;
+      next_pos = r->run[k].pos;
+    }
+  else
+    {
+      here_val = textget (i->plist, prop);
+      next = next_interval (i);
+      while (next
+	     && EQ (here_val, textget (next->plist, prop))
+	     && (NILP (limit) || next->position < XFIXNUM (limit)))
+	{
+	  next = next_interval (next);
+	  walked++;
+	}
+      if (r)
+	r->walked += walked;
 
-  if (!next
-      || (next->position
-	  >= (FIXNUMP (limit)
-	      ? XFIXNUM (limit)
-	      : (STRINGP (object)
-		 ? SCHARS (object)
-		 : BUF_ZV (XBUFFER (object))))))
+      if (!next)
+	return limit;
+      next_pos = next->position;
+    }
+
+  if (next_pos
+      >= (FIXNUMP (limit)
+	  ? XFIXNUM (limit)
+	  : (STRINGP (object)
+	     ? SCHARS (object)
+	     : BUF_ZV (XBUFFER (object)))))
     return limit;
   else
-    return make_fixnum (next->position);
+    return make_fixnum (next_pos);
 }
 
 DEFUN ("previous-property-change", Fprevious_property_change,
@@ -1115,6 +1374,7 @@ back past position LIMIT; return LIMIT if nothing is found until LIMIT.  */)
 {
   register INTERVAL i, previous;
   register Lisp_Object here_val;
+  ptrdiff_t previous_end, walked = 0;
 
   if (NILP (object))
     XSETBUFFER (object, current_buffer);
@@ -1131,22 +1391,42 @@ back past position LIMIT; return LIMIT if nothing is found until LIMIT.  */)
   if (!i)
     return limit;
 
-  here_val = textget (i->plist, prop);
-  previous = previous_interval (i);
-  while (previous
-	 && EQ (here_val, textget (previous->plist, prop))
-	 && (NILP (limit)
-	     || (previous->position + LENGTH (previous) > XFIXNUM (limit))))
-    previous = previous_interval (previous);
+  struct property_runs *r = property_runs (object, prop);
+  if (r && r->valid)
+    {
+      ptrdiff_t k = property_run_at (r, XFIXNUM (position) - 1);
+      if (k == 0)
+	return limit;
+      previous_end = r->run[k].pos;
+    }
+  else
+    {
+      here_val = textget (i->plist, prop);
+      previous = previous_interval (i);
+      while (previous
+	     && EQ (here_val, textget (previous->plist, prop))
+	     && (NILP (limit)
+		 || (previous->position + LENGTH (previous)
+		     > XFIXNUM (limit))))
+	{
+	  previous = previous_interval (previous);
+	  walked++;
+	}
+      if (r)
+	r->walked += walked;
 
-  if (!previous
-      || (previous->position + LENGTH (previous)
-	  <= (FIXNUMP (limit)
-	      ? XFIXNUM (limit)
-	      : (STRINGP (object) ? 0 : BUF_BEGV (XBUFFER (object))))))
+      if (!previous)
+	return limit;
+      previous_end = previous->position + LENGTH (previous);
+    }
+
+  if (previous_end
+      <= (FIXNUMP (limit)
+	  ? XFIXNUM (limit)
+	  : (STRINGP (object) ? 0 : BUF_BEGV (XBUFFER (object)))))
     return limit;
   else
-    return make_fixnum (previous->position + LENGTH (previous));
+    return make_fixnum (previous_end);
 }
 
 /* Used by add-text-properties and add-face-text-property. */
@@ -1312,6 +1592,183 @@ markers).  If OBJECT is a string, START and END are 0-based indices into it.  */
   return Qnil;
 }
 
+/* Return true if I's plist has PROPERTY, and set *VALUE to its value.  */
+
+static bool
+interval_property (INTERVAL i, Lisp_Object property, Lisp_Object *value)
+{
+  for (Lisp_Object tail = i->plist; CONSP (tail); tail = Fcdr (XCDR (tail)))
+    if (EQ (XCAR (tail), property))
+      {
+	*value = Fcar (XCDR (tail));
+	return true;
+      }
+  return false;
+}
+
+/* Give PROPERTY the values of RUNS from START to END in OBJECT, as
+   described for put-text-property-runs.  POS has the start and end
+   of each run, in order.  I is the interval at START.  If APPLY,
+   make the changes, splitting intervals where they must differ and
+   merging neighbors that become equal; otherwise just check for any.
+   Return true if anything changes.  */
+
+static bool
+put_property_runs (INTERVAL i, ptrdiff_t start, ptrdiff_t end,
+		   Lisp_Object property, Lisp_Object runs,
+		   ptrdiff_t const *pos, Lisp_Object object, bool apply)
+{
+  ptrdiff_t nruns = ASIZE (runs);
+  INTERVAL prev = apply ? previous_interval (i) : NULL;
+  bool changed = false;
+
+  for (ptrdiff_t p = start, k = 0; p < end; )
+    {
+      while (k < nruns && pos[2 * k] == pos[2 * k + 1])
+	k++;
+      bool in_run = k < nruns && pos[2 * k] <= p;
+      ptrdiff_t seg_end = (in_run ? pos[2 * k + 1]
+			   : k < nruns ? pos[2 * k] : end);
+      Lisp_Object value = in_run ? Fcar (Fcdr (Fcdr (AREF (runs, k)))) : Qnil;
+      ptrdiff_t i_end = i->position + LENGTH (i);
+      ptrdiff_t lim = min (i_end, seg_end);
+
+      Lisp_Object old;
+      bool has = interval_property (i, property, &old);
+      if (in_run ? !has || !EQ (old, value) : has)
+	{
+	  if (!apply)
+	    return true;
+	  if (i->position < p)
+	    {
+	      INTERVAL unchanged = i;
+	      i = split_interval_right (unchanged, p - unchanged->position);
+	      copy_properties (unchanged, i);
+	      prev = unchanged;
+	    }
+	  if (lim < i_end)
+	    {
+	      INTERVAL unchanged = i;
+	      i = split_interval_left (unchanged, lim - p);
+	      copy_properties (unchanged, i);
+	    }
+	  if (in_run)
+	    {
+	      AUTO_LIST2 (properties, property, value);
+	      add_properties (properties, i, object, TEXT_PROPERTY_REPLACE,
+			      false);
+	    }
+	  else
+	    {
+	      AUTO_LIST1 (list, property);
+	      remove_properties (Qnil, list, i, object);
+	    }
+	  changed = true;
+	}
+
+      if (apply && prev && i->position == p && intervals_equal (prev, i))
+	i = merge_interval_left (i);
+
+      p = lim;
+      if (in_run && p == seg_end)
+	k++;
+      if (p == i->position + LENGTH (i))
+	{
+	  prev = i;
+	  i = next_interval (i);
+	}
+    }
+
+  /* Merge the interval after END too, if it has become equal.  */
+  if (apply && i && prev && i->position == end && intervals_equal (prev, i))
+    merge_interval_left (i);
+
+  return changed;
+}
+
+/* Callers note, this can GC when OBJECT is a buffer (or nil).  */
+
+DEFUN ("put-text-property-runs", Fput_text_property_runs,
+       Sput_text_property_runs, 4, 5, 0,
+       doc: /* Set one property of runs of the text from START to END.
+The third argument PROPERTY is the property to set.  The fourth
+argument RUNS is a vector of lists (BEG END VALUE), in increasing
+order of position, that do not overlap and lie within START and END.
+Give the text from each BEG to END the value VALUE for PROPERTY, and
+remove PROPERTY from the rest of the text from START to END.
+
+This is like removing PROPERTY from START to END and then calling
+`put-text-property' for each run, but it runs the modification hooks
+once, and splits and merges the intervals of the text in one pass.
+It is meant for applying many faces at once, as font-lock does.
+
+If the optional fifth argument OBJECT is a buffer (or nil, which means
+the current buffer), START, END and the positions of RUNS are buffer
+positions (integers or markers).  If OBJECT is a string, they are
+0-based indices into it.  Return t if any property value actually
+changed, nil otherwise.  */)
+  (Lisp_Object start, Lisp_Object end, Lisp_Object property,
+   Lisp_Object runs, Lisp_Object object)
+{
+  /* Run the modification hooks for the right buffer, as
+     add_text_properties_1 does.  */
+  if (BUFFERP (object) && XBUFFER (object) != current_buffer)
+    {
+      ptrdiff_t count = SPECPDL_INDEX ();
+      record_unwind_current_buffer ();
+      set_buffer_internal (XBUFFER (object));
+      return unbind_to (count, Fput_text_property_runs (start, end, property,
+							runs, object));
+    }
+
+  if (NILP (object))
+    XSETBUFFER (object, current_buffer);
+  CHECK_VECTOR (runs);
+
+  INTERVAL i = validate_interval_range (object, &start, &end, hard);
+  if (!i)
+    return Qnil;
+  ptrdiff_t s = XFIXNUM (start), e = XFIXNUM (end);
+
+  ptrdiff_t nruns = ASIZE (runs);
+  ptrdiff_t *pos;
+  USE_SAFE_ALLOCA;
+  SAFE_NALLOCA (pos, 2, nruns);
+  for (ptrdiff_t k = 0, prev_end = s; k < nruns; k++)
+    {
+      Lisp_Object run = AREF (runs, k);
+      CHECK_LIST (run);
+      Lisp_Object beg = Fcar (run), run_end = Fcar (Fcdr (run));
+      CHECK_FIXNUM_COERCE_MARKER (beg);
+      CHECK_FIXNUM_COERCE_MARKER (run_end);
+      if (! (prev_end <= XFIXNUM (beg) && XFIXNUM (beg) <= XFIXNUM (run_end)
+	     && XFIXNUM (run_end) <= e))
+	args_out_of_range (beg, run_end);
+      pos[2 * k] = XFIXNUM (beg);
+      pos[2 * k + 1] = prev_end = XFIXNUM (run_end);
+    }
+
+  Lisp_Object changed = Qnil;
+  if (put_property_runs (i, s, e, property, runs, pos, object, false))
+    {
+      if (BUFFERP (object))
+	{
+	  modify_text_properties (object, start, end);
+	  /* The modification hooks may have changed the intervals.  */
+	  i = validate_interval_range (object, &start, &end, hard);
+	}
+      if (i && put_property_runs (i, s, e, property, runs, pos, object, true))
+	{
+	  changed = Qt;
+	  if (BUFFERP (object))
+	    signal_after_change (s, e - s, e - s);
+	}
+    }
+
+  SAFE_FREE ();
+  return changed;
+}
+
 DEFUN ("set-text-properties", Fset_text_properties,
        Sset_text_properties, 3, 4, 0,
        doc: /* Completely replace properties of text from START to END.
@@ -1815,6 +2272,7 @@ markers).  If OBJECT is a string, START and END are 0-based indices into it.  */
 {
   register INTERVAL i;
   register ptrdiff_t e, pos;
+  ptrdiff_t walked = 0;
 
   if (NILP (object))
     XSETBUFFER (object, current_buffer);
@@ -1823,6 +2281,16 @@ markers).  If OBJECT is a string, START and END are 0-based indices into it.  */
     return (!NILP (value) || EQ (start, end) ? Qnil : start);
   e = XFIXNUM (end);
 
+  struct property_runs *r = property_runs (object, property);
+  if (r && r->valid)
+    {
+      for (ptrdiff_t k = property_run_at (r, XFIXNUM (start));
+	   k < r->nruns && r->run[k].pos < e; k++)
+	if (EQ (r->run[k].value, value))
+	  return make_fixnum (max (r->run[k].pos, XFIXNUM (start)));
+      return Qnil;
+    }
+
   while (i)
     {
       if (i->position >= e)
@@ -1832,10 +2300,15 @@ markers).  If OBJECT is a string, START and END are 0-based indices into it.  */
 	  pos = i->position;
 	  if (pos < XFIXNUM (start))
 	    pos = XFIXNUM (start);
+	  if (r)
+	    r->walked += walked;
 	  return make_fixnum (pos);
 	}
       i = next_interval (i);
+      walked++;
     }
+  if (r)
+    r->walked += walked;
   return Qnil;
 }
 
@@ -1851,6 +2324,7 @@ markers).  If OBJECT is a string, START and END are 0-based indices into it.  */
 {
   register INTERVAL i;
   register ptrdiff_t s, e;
+  ptrdiff_t walked = 0;
 
   if (NILP (object))
     XSETBUFFER (object, current_buffer);
@@ -1860,6 +2334,16 @@ markers).  If OBJECT is a string, START and END are 0-based indices into it.  */
   s = XFIXNUM (start);
   e = XFIXNUM (end);
 
+  struct property_runs *r = property_runs (object, property);
+  if (r && r->valid)
+    {
+      for (ptrdiff_t k = property_run_at (r, s);
+	   k < r->nruns && r->run[k].pos < e; k++)
+	if (! EQ (r->run[k].value, value))
+	  return make_fixnum (max (r->run[k].pos, s));
+      return Qnil;
+    }
+
   while (i)
     {
       if (i->position >= e)
@@ -1868,10 +2352,15 @@ markers).  If OBJECT is a string, START and END are 0-based indices into it.  */
 	{
 	  if (i->position > s)
 	    s = i->position;
+	  if (r)
+	    r->walked += walked;
 	  return make_fixnum (s);
 	}
       i = next_interval (i);
+      walked++;
     }
+  if (r)
+    r->walked += walked;
   return Qnil;
 }
 
@@ -2375,6 +2864,20 @@ the first non-nil value from the associated alternative properties is
 returned. */);
   Vchar_property_alias_alist = Qnil;
 
+  DEFVAR_LISP ("text-property-index-properties", Vtext_property_index_properties,
+	       doc: /* Text properties whose changes are indexed in buffers.
+Searches for changes of the values of these properties in a buffer,
+such as `next-single-property-change' and `text-property-any', use an
+index of the runs of text where the value is constant, rather than
+looking at each interval of the text in turn.  This makes a difference
+for properties that change much less often than the others, like
+`fontified' and `invisible' in fontified text.
+
+Only the first 4 elements are used.  An index is built only after some
+searches would have benefited from it, and dropped when the text or
+the values of its property change.  */);
+  Vtext_property_index_properties = list3 (Qfontified, Qface, Qinvisible);
+
   DEFVAR_LISP ("inhibit-point-motion-hooks", Vinhibit_point_motion_hooks,
 	       doc: /* If non-nil, don't run `point-left' and `point-entered' text properties.
 This also inhibits the use of the `intangible' text property.
@@ -2440,6 +2943,7 @@ inherits it if NONSTICKINESS is nil.  The `front-sticky' and
   defsubr (&Sprevious_single_property_change);
   defsubr (&Sadd_text_properties);
   defsubr (&Sput_text_property);
+  defsubr (&Sput_text_property_runs);
   defsubr (&Sset_text_properties);
   defsubr (&Sadd_face_text_property);
   defsubr (&Sremove_text_properties);
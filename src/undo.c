@@ -24,6 +24,270 @@ along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.  */
 #include "buffer.h"
 #include "keyboard.h"
 
+/* When undo-compact-log is non-nil, the insertions, the deletions of
+   text without properties, the positions of point and the boundaries
+   recorded for undo in a base buffer are written as bytes to its undo
+   log, rather than consed onto its undo list.  This makes much less
+   work for the garbage collector when a command changes a buffer many
+   times.  The log is logically at the front of the undo list.  Its
+   entries are turned into elements of the list by flush_undo_log
+   when the list is looked at, or before anything else is added to
+   it.  While the undo list is t, as when it is saved and undo is
+   turned off for a while, the log is left alone.  When the list is
+   let-bound to t, as by `with-silent-modifications', the log is set
+   aside until the binding is undone, so that the list need not be
+   looked at.  */
+
+enum undo_log_tag
+  {
+    UNDO_LOG_BOUNDARY,		/* nil */
+    UNDO_LOG_POINT,		/* POSITION */
+    UNDO_LOG_INSERT,		/* (BEG . END) */
+    UNDO_LOG_DELETE,		/* (TEXT . POSITION), TEXT unibyte */
+    UNDO_LOG_DELETE_MULTIBYTE	/* (TEXT . POSITION), TEXT multibyte */
+  };
+
+struct undo_log
+{
+  /* The entries, oldest first.  Each is a tag followed by its
+     arguments, as variable-length integers.  */
+  unsigned char *entries;
+  ptrdiff_t entries_bytes, entries_size;
+
+  /* Offset in ENTRIES of the last entry, and of the entry before
+     it, or -1 if that is not known.  */
+  ptrdiff_t last, prev;
+
+  /* The text of all the deletions in ENTRIES, one after the other.  */
+  unsigned char *text;
+  ptrdiff_t text_bytes, text_size;
+
+  /* The number of entries, and of boundaries among them.  */
+  ptrdiff_t count, boundaries;
+
+  /* While the log is set aside, the thread that bound the undo list
+     to t, and the index of that binding in its specpdl.  */
+  struct thread_state *thread;
+  ptrdiff_t binding;
+};
+
+/* The number of times an undo log was turned into list elements.  */
+static EMACS_INT undo_log_conversions;
+
+/* Return the undo log in which to record a change to the current
+   buffer, or NULL if the change must go to its undo list.  */
+static struct undo_log *
+recording_undo_log (void)
+{
+  if (!undo_compact_log || current_buffer->base_buffer)
+    return NULL;
+  if (!current_buffer->undo_log)
+    current_buffer->undo_log = xzalloc (sizeof (struct undo_log));
+  return current_buffer->undo_log;
+}
+
+/* Return the tag of the last entry of LOG, which must not be empty.  */
+static enum undo_log_tag
+last_undo_log_tag (struct undo_log *log)
+{
+  return log->entries[log->last];
+}
+
+/* Append the byte B to the entries of LOG.  */
+static void
+undo_log_byte (struct undo_log *log, unsigned char b)
+{
+  if (log->entries_bytes == log->entries_size)
+    log->entries = xpalloc (log->entries, &log->entries_size, 1, -1, 1);
+  log->entries[log->entries_bytes++] = b;
+}
+
+/* Append the nonnegative integer N to the entries of LOG, seven bits
+   to a byte, the last byte having its high bit clear.  */
+static void
+undo_log_uint (struct undo_log *log, EMACS_UINT n)
+{
+  for (; n >= 0x80; n >>= 7)
+    undo_log_byte (log, n | 0x80);
+  undo_log_byte (log, n);
+}
+
+/* Read an integer written by undo_log_uint at *P, and advance *P.  */
+static EMACS_UINT
+read_undo_log_uint (unsigned char **p)
+{
+  EMACS_UINT n = 0;
+  int shift = 0;
+  unsigned char b;
+  do
+    {
+      b = *(*p)++;
+      n |= (EMACS_UINT) (b & 0x7f) << shift;
+      shift += 7;
+    }
+  while (b & 0x80);
+  return n;
+}
+
+/* Start a new entry with tag TAG at the end of LOG.  */
+static void
+start_undo_log_entry (struct undo_log *log, enum undo_log_tag tag)
+{
+  log->prev = log->last;
+  log->last = log->entries_bytes;
+  log->count++;
+  if (tag == UNDO_LOG_BOUNDARY)
+    log->boundaries++;
+  undo_log_byte (log, tag);
+}
+
+/* Free the undo log of buffer B, whose entries are forgotten.  */
+void
+free_undo_log (struct buffer *b)
+{
+  struct undo_log *log = b->undo_log;
+  if (log)
+    {
+      b->undo_log = NULL;
+      xfree (log->entries);
+      xfree (log->text);
+      xfree (log);
+    }
+}
+
+/* Free the undo log of buffer B, and any log set aside, as when B is
+   killed.  */
+void
+free_undo_logs (struct buffer *b)
+{
+  free_undo_log (b);
+  b->undo_log = b->suspended_undo_log;
+  b->suspended_undo_log = NULL;
+  free_undo_log (b);
+}
+
+/* Turn the entries of the undo log of buffer B, if any, into elements
+   of its undo list, unless that is t.  */
+void
+flush_undo_log (struct buffer *b)
+{
+  struct undo_log *log = b->undo_log;
+  if (!log || EQ (BVAR (b, undo_list), Qt))
+    return;
+
+  /* Nothing may be added to the log until it is done.  */
+  b->undo_log = NULL;
+
+  Lisp_Object list = BVAR (b, undo_list);
+  unsigned char *p = log->entries, *end = p + log->entries_bytes;
+  unsigned char *text = log->text;
+  while (p < end)
+    {
+      enum undo_log_tag tag = *p++;
+      Lisp_Object elt;
+      switch (tag)
+	{
+	case UNDO_LOG_BOUNDARY:
+	  elt = Qnil;
+	  break;
+
+	case UNDO_LOG_POINT:
+	  elt = make_fixnum (read_undo_log_uint (&p));
+	  break;
+
+	case UNDO_LOG_INSERT:
+	  {
+	    EMACS_INT beg = read_undo_log_uint (&p);
+	    EMACS_INT end = read_undo_log_uint (&p);
+	    elt = Fcons (make_fixnum (beg), make_fixnum (end));
+	  }
+	  break;
+
+	case UNDO_LOG_DELETE:
+	case UNDO_LOG_DELETE_MULTIBYTE:
+	  {
+	    /* The position is negative if point was at the end of the
+	       deleted text; it is stored as twice its absolute value,
+	       plus one if negative.  */
+	    EMACS_UINT pos = read_undo_log_uint (&p);
+	    ptrdiff_t nchars = read_undo_log_uint (&p);
+	    ptrdiff_t nbytes = read_undo_log_uint (&p);
+	    Lisp_Object string
+	      = make_specified_string ((char *) text, nchars, nbytes,
+				       tag == UNDO_LOG_DELETE_MULTIBYTE);
+	    text += nbytes;
+	    elt = Fcons (string, make_fixnum (pos & 1
+					      ? - (EMACS_INT) (pos >> 1)
+					      : (EMACS_INT) (pos >> 1)));
+	  }
+	  break;
+
+	default:
+	  emacs_abort ();
+	}
+      list = Fcons (elt, list);
+    }
+
+  bset_undo_list (b, list);
+  b->undo_log = log;
+  free_undo_log (b);
+  undo_log_conversions++;
+}
+
+/* Called by specbind before it binds the undo list of the current
+   buffer to t, by the binding at index BINDING in the specpdl.  Set
+   the undo log of the buffer aside, so that the value the binding
+   saves need not include it, and return true.  Return false if
+   there is no log to set aside, or if one already is.  */
+bool
+suspend_undo_log (ptrdiff_t binding)
+{
+  struct undo_log *log = current_buffer->undo_log;
+  if (!log || current_buffer->suspended_undo_log
+      || EQ (BVAR (current_buffer, undo_list), Qt))
+    return false;
+  log->thread = current_thread;
+  log->binding = binding;
+  current_buffer->suspended_undo_log = log;
+  current_buffer->undo_log = NULL;
+  return true;
+}
+
+/* Called after the binding at index BINDING in the specpdl of the
+   undo list of buffer B is undone.  Give B back the undo log set
+   aside by that binding, if any.  */
+void
+resume_undo_log (struct buffer *b, ptrdiff_t binding)
+{
+  struct undo_log *log = b->suspended_undo_log;
+  if (log && log->thread == current_thread && log->binding == binding)
+    {
+      b->suspended_undo_log = NULL;
+      free_undo_log (b);
+      b->undo_log = log;
+    }
+}
+
+/* Return the number of bytes used by the undo log of buffer B.  */
+static ptrdiff_t
+undo_log_bytes (struct buffer *b)
+{
+  struct undo_log *log = b->undo_log;
+  return (log
+	  ? sizeof *log + log->entries_size + log->text_size
+	  : 0);
+}
+
+/* Add ENTRY to the front of the undo list of the current buffer,
+   after the entries of its undo log.  */
+static void
+push_undo_entry (Lisp_Object entry)
+{
+  flush_undo_log (current_buffer);
+  bset_undo_list (current_buffer,
+		  Fcons (entry, BVAR (current_buffer, undo_list)));
+}
+
 /* The first time a command records something for undo.
    it also allocates the undo-boundary object
    which will be added to the list at the end of the command.
@@ -57,8 +321,12 @@ record_point (ptrdiff_t beg)
   first change. FIXME: This check is currently dependent on being
   called before record_first_change, but could be made not to by
   ignoring timestamp undo entries */
-  at_boundary = ! CONSP (BVAR (current_buffer, undo_list))
-                || NILP (XCAR (BVAR (current_buffer, undo_list)));
+  struct undo_log *log = current_buffer->undo_log;
+  if (log && log->count > 0)
+    at_boundary = last_undo_log_tag (log) == UNDO_LOG_BOUNDARY;
+  else
+    at_boundary = ! CONSP (BVAR (current_buffer, undo_list))
+                  || NILP (XCAR (BVAR (current_buffer, undo_list)));
 
   /* If this is the first change since save, then record this.*/
   if (MODIFF <= SAVE_MODIFF)
@@ -73,9 +341,16 @@ record_point (ptrdiff_t beg)
   if (at_boundary
       && point_before_last_command_or_undo != beg
       && buffer_before_last_command_or_undo == current_buffer )
-    bset_undo_list (current_buffer,
-		    Fcons (make_fixnum (point_before_last_command_or_undo),
-			   BVAR (current_buffer, undo_list)));
+    {
+      log = recording_undo_log ();
+      if (log)
+	{
+	  start_undo_log_entry (log, UNDO_LOG_POINT);
+	  undo_log_uint (log, point_before_last_command_or_undo);
+	}
+      else
+	push_undo_entry (make_fixnum (point_before_last_command_or_undo));
+    }
 }
 
 /* Record an insertion that just happened or is about to happen,
@@ -97,7 +372,23 @@ record_insert (ptrdiff_t beg, ptrdiff_t length)
 
   /* If this is following another insertion and consecutive with it
      in the buffer, combine the two.  */
-  if (CONSP (BVAR (current_buffer, undo_list)))
+  struct undo_log *log = current_buffer->undo_log;
+  if (log && log->count > 0)
+    {
+      if (last_undo_log_tag (log) == UNDO_LOG_INSERT)
+	{
+	  unsigned char *p = log->entries + log->last + 1;
+	  EMACS_UINT last_beg = read_undo_log_uint (&p);
+	  if (read_undo_log_uint (&p) == beg)
+	    {
+	      log->entries_bytes = log->last + 1;
+	      undo_log_uint (log, last_beg);
+	      undo_log_uint (log, beg + length);
+	      return;
+	    }
+	}
+    }
+  else if (CONSP (BVAR (current_buffer, undo_list)))
     {
       Lisp_Object elt;
       elt = XCAR (BVAR (current_buffer, undo_list));
@@ -111,10 +402,18 @@ record_insert (ptrdiff_t beg, ptrdiff_t length)
 	}
     }
 
+  log = recording_undo_log ();
+  if (log)
+    {
+      start_undo_log_entry (log, UNDO_LOG_INSERT);
+      undo_log_uint (log, beg);
+      undo_log_uint (log, beg + length);
+      return;
+    }
+
   XSETFASTINT (lbeg, beg);
   XSETINT (lend, beg + length);
-  bset_undo_list (current_buffer,
-		  Fcons (Fcons (lbeg, lend), BVAR (current_buffer, undo_list)));
+  push_undo_entry (Fcons (lbeg, lend));
 }
 
 /* Record the fact that markers in the region of FROM, TO are about to
@@ -126,34 +425,47 @@ record_insert (ptrdiff_t beg, ptrdiff_t length)
 static void
 record_marker_adjustments (ptrdiff_t from, ptrdiff_t to)
 {
+  ptrdiff_t i, n;
+  Lisp_Object *markers;
+  USE_SAFE_ALLOCA;
+
   prepare_record ();
 
-  for (struct Lisp_Marker *m = BUF_MARKERS (current_buffer); m; m = m->next)
+  /* The markers are in order of position, so the ones in the region
+     are next to each other in the marker index.  Collect them first,
+     since consing can garbage collect and change the index.  */
+  i = marker_index_from (current_buffer, from);
+  n = marker_index_from (current_buffer, to + 1) - i;
+  SAFE_ALLOCA_LISP (markers, n);
+  for (ptrdiff_t j = 0; j < n; j++)
+    markers[j] = make_lisp_ptr (buf_marker (current_buffer, i + j),
+				Lisp_Vectorlike);
+
+  for (ptrdiff_t j = 0; j < n; j++)
     {
-      ptrdiff_t charpos = m->charpos;
-      eassert (charpos <= Z);
-
-      if (from <= charpos && charpos <= to)
-        {
-          /* insertion_type nil markers will end up at the beginning of
-             the re-inserted text after undoing a deletion, and must be
-             adjusted to move them to the correct place.
-
-             insertion_type t markers will automatically move forward
-             upon re-inserting the deleted text, so we have to arrange
-             for them to move backward to the correct position.  */
-	  ptrdiff_t adjustment = (m->insertion_type ? to : from) - charpos;
-
-          if (adjustment)
-            {
-	      Lisp_Object marker = make_lisp_ptr (m, Lisp_Vectorlike);
-              bset_undo_list
-                (current_buffer,
-                 Fcons (Fcons (marker, make_fixnum (adjustment)),
-                        BVAR (current_buffer, undo_list)));
-            }
-        }
+      struct Lisp_Marker *m = XMARKER (markers[j]);
+      ptrdiff_t charpos = marker_charpos (m);
+      eassert (from <= charpos && charpos <= to);
+
+      /* insertion_type nil markers will end up at the beginning of
+	 the re-inserted text after undoing a deletion, and must be
+	 adjusted to move them to the correct place.
+
+	 insertion_type t markers will automatically move forward
+	 upon re-inserting the deleted text, so we have to arrange
+	 for them to move backward to the correct position.  */
+      ptrdiff_t adjustment = (m->insertion_type ? to : from) - charpos;
+
+      if (adjustment)
+	{
+	  /* The marker is now visible to Lisp, so save-excursion or
+	     save-restriction must not reuse it (Bug#30931).  */
+	  m->recyclable = 0;
+	  push_undo_entry (Fcons (markers[j], make_fixnum (adjustment)));
+	}
     }
+
+  SAFE_FREE ();
 }
 
 /* Record that a deletion is about to take place, of the characters in
@@ -186,9 +498,28 @@ record_delete (ptrdiff_t beg, Lisp_Object string, bool record_markers)
   if (record_markers)
     record_marker_adjustments (beg, beg + SCHARS (string));
 
-  bset_undo_list
-    (current_buffer,
-     Fcons (Fcons (string, sbeg), BVAR (current_buffer, undo_list)));
+  struct undo_log *log
+    = string_intervals (string) ? NULL : recording_undo_log ();
+  if (log)
+    {
+      EMACS_INT pos = XFIXNUM (sbeg);
+      ptrdiff_t nbytes = SBYTES (string);
+      start_undo_log_entry (log, (STRING_MULTIBYTE (string)
+				  ? UNDO_LOG_DELETE_MULTIBYTE
+				  : UNDO_LOG_DELETE));
+      undo_log_uint (log, pos < 0 ? 2 * (EMACS_UINT) -pos + 1 : 2 * pos);
+      undo_log_uint (log, SCHARS (string));
+      undo_log_uint (log, nbytes);
+      if (log->text_size - log->text_bytes < nbytes)
+	log->text = xpalloc (log->text, &log->text_size,
+			     nbytes - (log->text_size - log->text_bytes),
+			     -1, 1);
+      memcpy (log->text + log->text_bytes, SDATA (string), nbytes);
+      log->text_bytes += nbytes;
+      return;
+    }
+
+  push_undo_entry (Fcons (string, sbeg));
 }
 
 /* Record that a replacement is about to take place,
@@ -217,9 +548,7 @@ record_first_change (void)
   if (base_buffer->base_buffer)
     base_buffer = base_buffer->base_buffer;
 
-  bset_undo_list (current_buffer,
-		  Fcons (Fcons (Qt, Fvisited_file_modtime ()),
-			 BVAR (current_buffer, undo_list)));
+  push_undo_entry (Fcons (Qt, Fvisited_file_modtime ()));
 }
 
 /* Record a change in property PROP (whose old value was VAL)
@@ -244,8 +573,7 @@ record_property_change (ptrdiff_t beg, ptrdiff_t length,
   XSETINT (lbeg, beg);
   XSETINT (lend, beg + length);
   entry = Fcons (Qnil, Fcons (prop, Fcons (value, Fcons (lbeg, lend))));
-  bset_undo_list (current_buffer,
-		  Fcons (entry, BVAR (current_buffer, undo_list)));
+  push_undo_entry (entry);
 }
 
 DEFUN ("undo-boundary", Fundo_boundary, Sundo_boundary, 0, 0, 0,
@@ -254,24 +582,33 @@ An undo command will stop at this point,
 but another undo command will undo to the previous boundary.  */)
   (void)
 {
-  Lisp_Object tem;
   if (EQ (BVAR (current_buffer, undo_list), Qt))
     return Qnil;
-  tem = Fcar (BVAR (current_buffer, undo_list));
-  if (!NILP (tem))
+  struct undo_log *log = current_buffer->undo_log;
+  if (log && log->count > 0
+      ? last_undo_log_tag (log) != UNDO_LOG_BOUNDARY
+      : !NILP (Fcar (BVAR (current_buffer, undo_list))))
     {
-      /* One way or another, cons nil onto the front of the undo list.  */
-      if (!NILP (pending_boundary))
+      log = recording_undo_log ();
+      if (log)
+	start_undo_log_entry (log, UNDO_LOG_BOUNDARY);
+      else
 	{
-	  /* If we have preallocated the cons cell to use here,
-	     use that one.  */
-	  XSETCDR (pending_boundary, BVAR (current_buffer, undo_list));
-	  bset_undo_list (current_buffer, pending_boundary);
-	  pending_boundary = Qnil;
+	  /* One way or another, cons nil onto the front of the undo
+	     list.  */
+	  flush_undo_log (current_buffer);
+	  if (!NILP (pending_boundary))
+	    {
+	      /* If we have preallocated the cons cell to use here,
+		 use that one.  */
+	      XSETCDR (pending_boundary, BVAR (current_buffer, undo_list));
+	      bset_undo_list (current_buffer, pending_boundary);
+	      pending_boundary = Qnil;
+	    }
+	  else
+	    bset_undo_list (current_buffer,
+			    Fcons (Qnil, BVAR (current_buffer, undo_list)));
 	}
-      else
-	bset_undo_list (current_buffer,
-			Fcons (Qnil, BVAR (current_buffer, undo_list)));
     }
 
   Fset (Qundo_auto__last_boundary_cause, Qexplicit);
@@ -281,6 +618,21 @@ but another undo command will undo to the previous boundary.  */)
   return Qnil;
 }
 
+/* Return the space occupied by the undo list element ELT and its chain
+   link.  */
+static intmax_t
+undo_elt_size (Lisp_Object elt)
+{
+  intmax_t size = sizeof (struct Lisp_Cons);
+  if (CONSP (elt))
+    {
+      size += sizeof (struct Lisp_Cons);
+      if (STRINGP (XCAR (elt)))
+	size += sizeof (struct Lisp_String) - 1 + SCHARS (XCAR (elt));
+    }
+  return size;
+}
+
 /* At garbage collection time, make an undo list shorter at the end,
    returning the truncated list.  How this is done depends on the
    variables undo-limit, undo-strong-limit and undo-outer-limit.
@@ -303,6 +655,14 @@ truncate_undo_list (struct buffer *b)
   record_unwind_current_buffer ();
   set_buffer_internal (b);
 
+  /* The entries of the undo log come first.  If they take more space
+     than undo-limit allows, make them list elements, which can be
+     dropped one by one.  */
+  if (undo_log_bytes (b) > undo_limit)
+    flush_undo_log (b);
+  struct undo_log *log = b->undo_log;
+  size_so_far = undo_log_bytes (b);
+
   list = BVAR (b, undo_list);
 
   prev = Qnil;
@@ -310,7 +670,7 @@ truncate_undo_list (struct buffer *b)
   last_boundary = Qnil;
 
   /* If the first element is an undo boundary, skip past it.  */
-  if (CONSP (next) && NILP (XCAR (next)))
+  if (!log && CONSP (next) && NILP (XCAR (next)))
     {
       /* Add in the space occupied by this element and its chain link.  */
       size_so_far += sizeof (struct Lisp_Cons);
@@ -324,22 +684,18 @@ truncate_undo_list (struct buffer *b)
      unless it is really horribly big.
 
      Skip, skip, skip the undo, skip, skip, skip the undo,
-     Skip, skip, skip the undo, skip to the undo bound'ry.  */
+     Skip, skip, skip the undo, skip to the undo bound'ry.
 
-  while (CONSP (next) && ! NILP (XCAR (next)))
+     If the log has a boundary, that record is all in the log.  */
+
+  while (! (log && log->boundaries > 0)
+	 && CONSP (next) && ! NILP (XCAR (next)))
     {
       Lisp_Object elt;
       elt = XCAR (next);
 
       /* Add in the space occupied by this element and its chain link.  */
-      size_so_far += sizeof (struct Lisp_Cons);
-      if (CONSP (elt))
-	{
-	  size_so_far += sizeof (struct Lisp_Cons);
-	  if (STRINGP (XCAR (elt)))
-	    size_so_far += (sizeof (struct Lisp_String) - 1
-			    + SCHARS (XCAR (elt)));
-	}
+      size_so_far += undo_elt_size (elt);
 
       /* Advance to next element.  */
       prev = next;
@@ -391,14 +747,7 @@ truncate_undo_list (struct buffer *b)
 	}
 
       /* Add in the space occupied by this element and its chain link.  */
-      size_so_far += sizeof (struct Lisp_Cons);
-      if (CONSP (elt))
-	{
-	  size_so_far += sizeof (struct Lisp_Cons);
-	  if (STRINGP (XCAR (elt)))
-	    size_so_far += (sizeof (struct Lisp_String) - 1
-			    + SCHARS (XCAR (elt)));
-	}
+      size_so_far += undo_elt_size (elt);
 
       /* Advance to next element.  */
       prev = next;
@@ -411,6 +760,15 @@ truncate_undo_list (struct buffer *b)
   /* Truncate at the boundary where we decided to truncate.  */
   else if (!NILP (last_boundary))
     XSETCDR (last_boundary, Qnil);
+  /* The elements before the first boundary of the list belong to
+     the oldest change group of the log, so the list can't be cleared
+     out without leaving part of that group.  Make the log list
+     elements too, and decide again.  */
+  else if (log && CONSP (list) && !NILP (XCAR (list)))
+    {
+      flush_undo_log (b);
+      truncate_undo_list (b);
+    }
   /* There's nothing we decided to keep, so clear it out.  */
   else
     bset_undo_list (b, Qnil);
@@ -419,6 +777,86 @@ truncate_undo_list (struct buffer *b)
 }
 
 
+DEFUN ("undo-needs-boundary-p", Fundo_needs_boundary_p,
+       Sundo_needs_boundary_p, 0, 0, 0,
+       doc: /* Return non-nil if the undo list doesn't start with a boundary.
+This is the case when changes have been recorded for undo in the
+current buffer since the last boundary.  Unlike looking at
+`buffer-undo-list', this leaves the compact undo log alone.  */)
+  (void)
+{
+  struct undo_log *log = current_buffer->undo_log;
+  if (log && !EQ (BVAR (current_buffer, undo_list), Qt))
+    return last_undo_log_tag (log) == UNDO_LOG_BOUNDARY ? Qnil : Qt;
+  return CONSP (BVAR (current_buffer, undo_list))
+	 && !NILP (XCAR (BVAR (current_buffer, undo_list))) ? Qt : Qnil;
+}
+
+DEFUN ("undo-remove-boundary", Fundo_remove_boundary,
+       Sundo_remove_boundary, 0, 0, 0,
+       doc: /* Remove the boundary at the start of the undo list, if any.
+Return non-nil if there was one.  This joins the changes recorded
+since the boundary to those before it, as for an amalgamating
+command.  Unlike changing `buffer-undo-list', this leaves the compact
+undo log alone.  */)
+  (void)
+{
+  if (EQ (BVAR (current_buffer, undo_list), Qt))
+    return Qnil;
+  struct undo_log *log = current_buffer->undo_log;
+  if (log && log->count > 0)
+    {
+      if (last_undo_log_tag (log) != UNDO_LOG_BOUNDARY)
+	return Qnil;
+      if (log->count == 1 || log->prev >= 0)
+	{
+	  log->entries_bytes = log->last;
+	  log->last = log->prev;
+	  log->prev = -1;
+	  log->count--;
+	  log->boundaries--;
+	  return Qt;
+	}
+      flush_undo_log (current_buffer);
+    }
+  Lisp_Object list = BVAR (current_buffer, undo_list);
+  if (! (CONSP (list) && NILP (XCAR (list))))
+    return Qnil;
+  bset_undo_list (current_buffer, XCDR (list));
+  return Qt;
+}
+
+DEFUN ("undo-memory-statistics", Fundo_memory_statistics,
+       Sundo_memory_statistics, 0, 1, 0,
+       doc: /* Return statistics about the memory used for undo in BUFFER.
+BUFFER defaults to the current buffer.  The value is a property list:
+
+:list-bytes   the space taken by the elements of `buffer-undo-list',
+              counted in the same way as for `undo-limit'.
+:log-entries  the number of changes recorded in the compact undo log
+              of BUFFER, that are not yet elements of the list.
+:log-bytes    the space taken by the compact undo log, deleted text
+              included.
+:conversions  how many times a compact undo log, in any buffer, has
+              been made into list elements.
+
+See `undo-compact-log'.  */)
+  (Lisp_Object buffer)
+{
+  struct buffer *b = decode_buffer (buffer);
+  intmax_t list_bytes = 0;
+
+  /* Don't use buffer-undo-list, which would flush the log.  */
+  for (Lisp_Object tail = BVAR (b, undo_list); CONSP (tail);
+       tail = XCDR (tail))
+    list_bytes += undo_elt_size (XCAR (tail));
+
+  return list (QClist_bytes, make_int (list_bytes),
+	       QClog_entries, make_int (b->undo_log ? b->undo_log->count : 0),
+	       QClog_bytes, make_int (undo_log_bytes (b)),
+	       QCconversions, make_int (undo_log_conversions));
+}
+
 void
 syms_of_undo (void)
 {
@@ -429,10 +867,20 @@ syms_of_undo (void)
   /* Marker for function call undo list elements.  */
   DEFSYM (Qapply, "apply");
 
+  DEFSYM (Qbuffer_undo_list, "buffer-undo-list");
+
   pending_boundary = Qnil;
   staticpro (&pending_boundary);
 
+  DEFSYM (QClist_bytes, ":list-bytes");
+  DEFSYM (QClog_entries, ":log-entries");
+  DEFSYM (QClog_bytes, ":log-bytes");
+  DEFSYM (QCconversions, ":conversions");
+
   defsubr (&Sundo_boundary);
+  defsubr (&Sundo_needs_boundary_p);
+  defsubr (&Sundo_remove_boundary);
+  defsubr (&Sundo_memory_statistics);
 
   DEFVAR_INT ("undo-limit", undo_limit,
 	      doc: /* Keep no more undo information once it exceeds this size.
@@ -487,4 +935,15 @@ so it must make sure not to do a lot of consing.  */);
   DEFVAR_BOOL ("undo-inhibit-record-point", undo_inhibit_record_point,
 	       doc: /* Non-nil means do not record `point' in `buffer-undo-list'.  */);
   undo_inhibit_record_point = false;
+
+  DEFVAR_BOOL ("undo-compact-log", undo_compact_log,
+	       doc: /* Non-nil means record undo information in compact form.
+Insertions, deletions of text without properties, positions of point
+and undo boundaries are then recorded in a log of bytes, rather than
+as elements of `buffer-undo-list', until that variable is looked at
+or something else is recorded; the log is then made into elements of
+the list.  This is much less work for garbage collection when a
+command makes many changes, as a keyboard macro run many times does.
+Indirect buffers don't use the log.  See `undo-memory-statistics'.  */);
+  undo_compact_log = false;
 }
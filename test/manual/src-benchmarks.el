@@ -0,0 +1,768 @@
+;;; src-benchmarks.el --- benchmarks for C primitives -*- lexical-binding: t -*-
+
+;; Copyright (C) 2021 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; These functions time primitives of the C files named in the section
+;; headings, usually with and without an optimization.  They take a
+;; while and their results depend on the machine, so they are not run
+;; with the tests; load this file and call them by hand, as in
+;;
+;;   emacs -Q --batch -l test/manual/src-benchmarks.el \
+;;     --eval '(print (src-benchmarks-buffer-get-buffer))'
+
+;;; Code:
+
+(require 'benchmark)
+
+(defmacro src-benchmarks--seconds (&rest body)
+  "Return the seconds BODY takes to run once."
+  (declare (indent 0) (debug t))
+  `(car (benchmark-run 1 ,@body)))
+
+(defmacro src-benchmarks--each (var values &rest body)
+  "Return the values of BODY with VAR bound to each of VALUES in turn."
+  (declare (indent 2) (debug (symbolp form body)))
+  (let ((value (make-symbol "value")))
+    `(mapcar (lambda (,value) (let ((,var ,value)) ,@body)) ,values)))
+
+(defun src-benchmarks--repeat (text size)
+  "Return a string of SIZE characters made of copies of TEXT."
+  (substring (apply #'concat (make-list (1+ (/ size (length text))) text))
+             0 size))
+
+(defun src-benchmarks--random-word (min max)
+  "Return a random word of MIN to MAX lowercase letters."
+  (let ((word (make-string (+ min (random (- max min -1))) ?a)))
+    (dotimes (i (length word))
+      (aset word i (+ ?a (random 26))))
+    word))
+
+(defun src-benchmarks--wait (predicate)
+  "Read events until PREDICATE returns non-nil, for at most 10 seconds."
+  (let ((end (+ (float-time) 10)))
+    (while (and (not (funcall predicate)) (< (float-time) end))
+      (read-event nil nil 0.05))))
+
+;;; buffer.c
+
+(defun src-benchmarks-buffer-get-buffer (&optional n)
+  "Create N buffers and look each of them up by name.
+N defaults to 100000.  Return the seconds taken by creating them, by
+looking them up, and by 100 calls of `generate-new-buffer-name'."
+  (let ((names (mapcar (lambda (i) (format " *src-benchmarks-%d*" i))
+                       (number-sequence 1 (or n 100000))))
+        (gc-cons-threshold 4000000)
+        (buffer-list-update-hook nil))
+    (unwind-protect
+        (list (src-benchmarks--seconds
+                (dolist (name names)
+                  (get-buffer-create name)))
+              (src-benchmarks--seconds
+                (dolist (name names)
+                  (unless (get-buffer name)
+                    (error "No buffer %s" name))))
+              (src-benchmarks--seconds
+                (dotimes (_ 100)
+                  (generate-new-buffer-name " *src-benchmarks-1*"))))
+      (dolist (name names)
+        (kill-buffer name)))))
+
+;;; casefiddle.c
+
+(defun src-benchmarks-casefiddle-region (&optional size)
+  "Time `upcase-region' and `downcase-region' on SIZE characters.
+SIZE defaults to 100000000.  Case a buffer of ASCII text, then one
+where some lines have non-ASCII text, and then `upcase' a string of
+the ASCII text.  Return the seconds taken for each."
+  (let ((ascii (src-benchmarks--repeat
+                "The quick brown fox jumps over the lazy dog 0123456789.\n"
+                (or size 100000000))))
+    (with-temp-buffer
+      (insert ascii)
+      (list (src-benchmarks--seconds
+              (upcase-region (point-min) (point-max))
+              (downcase-region (point-min) (point-max)))
+            (progn
+              (goto-char (point-min))
+              (while (search-forward "fox" nil t)
+                (when (zerop (random 4))
+                  (replace-match "fóx")))
+              (src-benchmarks--seconds
+                (upcase-region (point-min) (point-max))
+                (downcase-region (point-min) (point-max))))
+            (src-benchmarks--seconds
+              (ignore (upcase ascii)))))))
+
+;;; character.c
+
+(defun src-benchmarks-character-width (&optional size)
+  "Time counting characters and columns in text of SIZE bytes.
+SIZE defaults to 10000000.  Make a buffer of ASCII text and of text
+with some non-ASCII characters, and make it multibyte after reading it
+as unibyte, which counts its characters, 10 times.  Then take
+`string-width' of a line of it 100000 times.  Return the seconds taken
+for each kind of text."
+  (apply #'append
+         (src-benchmarks--each word '("abcd " "abcé ")
+           (let ((text (src-benchmarks--repeat word (or size 10000000))))
+             (list (with-temp-buffer
+                     (set-buffer-multibyte nil)
+                     (insert (encode-coding-string text 'utf-8))
+                     (src-benchmarks--seconds
+                       (dotimes (_ 10)
+                         (set-buffer-multibyte nil)
+                         (set-buffer-multibyte t))))
+                   (let ((line (substring text 0 200)))
+                     (src-benchmarks--seconds
+                       (dotimes (_ 100000)
+                         (string-width line)))))))))
+
+;;; coding.c
+
+(defun src-benchmarks-coding--file (bytes)
+  "Return the name of a new temporary file holding BYTES."
+  (let ((file (make-temp-file "src-benchmarks"))
+        (coding-system-for-write 'no-conversion))
+    (write-region bytes nil file nil 'silent)
+    file))
+
+(defun src-benchmarks-coding--decode (bytes coding settings)
+  "Time decoding BYTES in CODING 10 times.
+Decode them with `decode-coding-string' and `insert-file-contents',
+with `disable-ascii-optimization' bound to the car of each element of
+SETTINGS and `decode-coding-threads' to its cadr.  Return the seconds
+taken for each element."
+  (let ((file (src-benchmarks-coding--file bytes))
+        (gc-cons-threshold 4000000))
+    (unwind-protect
+        (src-benchmarks--each setting settings
+          (let ((disable-ascii-optimization (car setting))
+                (decode-coding-threads (cadr setting)))
+            (list setting
+                  (src-benchmarks--seconds
+                    (dotimes (_ 10)
+                      (decode-coding-string bytes coding)))
+                  (src-benchmarks--seconds
+                    (dotimes (_ 10)
+                      (with-temp-buffer
+                        (let ((coding-system-for-read coding))
+                          (insert-file-contents file))))))))
+      (delete-file file))))
+
+(defun src-benchmarks-coding-utf-8-decoder ()
+  "Time decoding 3 MB of UTF-8 text 10 times.
+Decode it with `decode-coding-string' and `insert-file-contents',
+without and with the ASCII optimization.  Return the seconds taken."
+  (src-benchmarks-coding--decode
+   (with-temp-buffer
+     (dotimes (i 100000)
+       (insert (format "Grüße, 世界 %d αβγ\n" i)))
+     (encode-coding-string (buffer-string) 'utf-8))
+   'utf-8-unix '((t 0) (nil 0))))
+
+(defun src-benchmarks-coding-utf-8-encoder ()
+  "Time encoding 3 MB of UTF-8 text 10 times.
+Encode it with `encode-coding-string' and `write-region', without and
+with the ASCII optimization.  Return the seconds taken."
+  (let ((file (make-temp-file "src-benchmarks"))
+        (gc-cons-threshold 4000000))
+    (unwind-protect
+        (with-temp-buffer
+          (dotimes (i 100000)
+            (insert (format "Grüße, 世界 %d αβγ\n" i)))
+          (src-benchmarks--each disable-ascii-optimization '(t nil)
+            (list disable-ascii-optimization
+                  (src-benchmarks--seconds
+                    (dotimes (_ 10)
+                      (encode-coding-string (buffer-string) 'utf-8-unix)))
+                  (src-benchmarks--seconds
+                    (dotimes (_ 10)
+                      (let ((coding-system-for-write 'utf-8-dos))
+                        (write-region nil nil file nil 'silent)))))))
+      (delete-file file))))
+
+(defun src-benchmarks-coding-single-byte-decoder ()
+  "Time decoding 3 MB of latin-1 text 10 times.
+Decode it with `decode-coding-string' and `insert-file-contents',
+without and with the ASCII optimization, and with it and
+`decode-coding-threads'.  Return the seconds taken."
+  (src-benchmarks-coding--decode
+   (with-temp-buffer
+     (dotimes (i 100000)
+       (insert (format "Grüße, café %d naïve résumé\n" i)))
+     (encode-coding-string (buffer-string) 'latin-1))
+   'latin-1 '((t 0) (nil 0) (nil 4))))
+
+;;; dired.c
+
+(defun src-benchmarks-dired-file-attributes-cache (&optional files repeat)
+  "Compare looking at a directory with and without the attribute cache.
+Make a directory with FILES files, default 1000, and list it with
+`directory-files-and-attributes' and query each file with
+`file-attributes' and `file-exists-p', REPEAT times, default 20.
+Return the seconds taken without and with the cache."
+  (let ((dir (make-temp-file "src-benchmarks" t)))
+    (unwind-protect
+        (progn
+          (dotimes (i (or files 1000))
+            (write-region "" nil (expand-file-name (format "f%d" i) dir)
+                          nil 'silent))
+          (let ((names (directory-files dir t)))
+            (src-benchmarks--each file-attributes-cache-ttl '(nil 60)
+              (src-benchmarks--seconds
+                (dotimes (_ (or repeat 20))
+                  (directory-files-and-attributes dir)
+                  (dolist (f names)
+                    (file-attributes f)
+                    (ignore (file-exists-p f))))))))
+      (file-attributes-cache-clear)
+      (delete-directory dir t))))
+
+(defun src-benchmarks-dired-directory-files-walk (&optional files)
+  "Compare ways of listing a tree of FILES files, default 1000000.
+The tree has 100 files per directory, and 10 subdirectories in each
+directory above.  Return the seconds taken by the Lisp implementation
+of `directory-files-recursively', and by `directory-files-walk'
+without and with threads."
+  (let ((dir (make-temp-file "src-benchmarks" t)))
+    (unwind-protect
+        (progn
+          (call-process
+           "sh" nil nil nil "-c"
+           (format "cd %s && n=0 && while [ $n -lt %d ]; do
+                      d=$(echo $((n / 100)) | sed 's/./&\\//g');
+                      mkdir -p $d && (cd $d && touch $(seq -f f%%g.el 100));
+                      n=$((n + 100)); done"
+                   (shell-quote-argument dir) (or files 1000000)))
+          (cons (src-benchmarks--seconds
+                  (directory-files-recursively--1 dir "\\.el\\'" nil nil nil))
+                (src-benchmarks--each directory-files-walk-threads '(0 4)
+                  (src-benchmarks--seconds
+                    (directory-files-walk dir "\\.el\\'")))))
+      (delete-directory dir t))))
+
+;;; editfns.c
+
+(defun src-benchmarks-editfns-save-excursion (&optional n)
+  "Run N nested `save-excursion' and `save-restriction' forms.
+N defaults to 1000000.  The buffer is narrowed, so that
+`save-restriction' needs markers.  Return the `benchmark-run' result
+and the number of markers consed."
+  (with-temp-buffer
+    (insert "Lorem ipsum dolor sit amet.\n")
+    (narrow-to-region 2 10)
+    (let ((consed excursion-markers-consed))
+      (list (benchmark-run 1
+              (dotimes (_ (or n 1000000))
+                (save-excursion
+                  (save-restriction
+                    (widen)
+                    (goto-char (point-max))))))
+            (- excursion-markers-consed consed)))))
+
+(defun src-benchmarks-editfns-replace-buffer-contents (&optional lines)
+  "Time `replace-buffer-contents' on a reformatted file of LINES lines.
+LINES defaults to 20000.  The file looks like C code; the new text
+reindents a fifth of its lines of code and renames an identifier on
+another fifth.  Return the seconds taken, whether the buffer was
+replaced without giving up the diff, and whether a marker on a
+comment line, which is never changed, stayed there."
+  (let ((lines (or lines 20000)))
+    (with-temp-buffer
+      (let ((source (current-buffer)))
+        (dotimes (i lines)
+          (insert (pcase (% i 5)
+                    (0 (format "  x%d = f (y%d, %d);\n" (% i 97) i i))
+                    (1 (format "    g_%d (x%d);\n" (% i 31) (% i 97)))
+                    (_ (format "  /* Line %d.  */\n" i)))))
+        (with-temp-buffer
+          (insert-buffer-substring source)
+          (with-current-buffer source
+            (goto-char (point-min))
+            (while (not (eobp))
+              (unless (looking-at "  /\\*")
+                (pcase (random 5)
+                  (0 (insert "\t") (delete-char 2))
+                  (1 (when (re-search-forward "x\\([0-9]+\\)"
+                                              (line-end-position) t)
+                       (replace-match "var_\\1")))))
+              (forward-line 1)))
+          (goto-char (point-min))
+          (forward-line (/ lines 2))
+          (while (not (looking-at "  /\\*"))
+            (forward-line 1))
+          (let* ((line (buffer-substring (point) (line-end-position)))
+                 (marker (point-marker))
+                 replaced
+                 (time (src-benchmarks--seconds
+                         (setq replaced (replace-buffer-contents source 60)))))
+            (list time replaced
+                  (progn (goto-char marker)
+                         (equal (buffer-substring (point) (line-end-position))
+                                line)))))))))
+
+(defun src-benchmarks-editfns-format (&optional n)
+  "Time N calls of `format' on typical format strings.
+N defaults to 1000000.  Return the `benchmark-run' results for a log
+line, a padded table row, and a `format-message' with quotes."
+  (setq n (or n 1000000))
+  (list (benchmark-run-compiled n
+          (format "%s: %d items in %s" "foo" 42 'bar))
+        (benchmark-run-compiled n
+          (format "%-10s|%5d|%s" "name" 42 "value"))
+        (let ((text-quoting-style 'grave))
+          (benchmark-run-compiled n
+            (format-message "Loading `%s'...done" "file")))))
+
+;;; fileio.c
+
+(defun src-benchmarks-fileio-write-region-async (&optional size delay)
+  "Compare how long write-region and write-region-async block Emacs.
+Write SIZE bytes, default 10000000, into a FIFO whose reader starts
+after DELAY seconds, default 1, standing in for a slow file system.
+Return the seconds write-region blocks, the seconds write-region-async
+blocks, and the seconds until write-region-async completes."
+  (let ((fifo (make-temp-name
+               (expand-file-name "src-benchmarks" temporary-file-directory)))
+        results)
+    (unless (eq (call-process "mkfifo" nil nil nil fifo) 0)
+      (error "Cannot make a FIFO"))
+    (unwind-protect
+        (with-temp-buffer
+          (insert (make-string (or size 10000000) ?x))
+          (dolist (async '(nil t))
+            (let ((reader (start-process
+                           "reader" nil "sh" "-c"
+                           (format "sleep %s; cat >/dev/null <%s"
+                                   (or delay 1) (shell-quote-argument fifo))))
+                  (start (float-time))
+                  done)
+              (if (not async)
+                  (write-region nil nil fifo nil 'silent)
+                (write-region-async nil nil fifo
+                                    (lambda (_) (setq done t)))
+                (push (- (float-time) start) results)
+                (src-benchmarks--wait (lambda () done)))
+              (push (- (float-time) start) results)
+              (while (process-live-p reader)
+                (accept-process-output reader 0.05)))))
+      (delete-file fifo))
+    (nreverse results)))
+
+;;; fns.c
+
+(defun src-benchmarks-fns-string-distance (&optional n)
+  "Time `string-distance' on N random candidates, default 100000.
+Return the seconds taken by calling `string-distance' on each
+candidate, by `string-distances', and by `string-distances' with a
+maximum distance of 2."
+  (let ((candidates (vconcat
+                     (mapcar (lambda (_) (src-benchmarks--random-word 3 17))
+                             (make-list (or n 100000) nil))))
+        (query "levenshtein"))
+    (list (src-benchmarks--seconds
+            (mapc (lambda (candidate) (string-distance query candidate))
+                  candidates))
+          (src-benchmarks--seconds
+            (string-distances query candidates))
+          (src-benchmarks--seconds
+            (string-distances query candidates nil 2)))))
+
+;;; indent.c
+
+(defun src-benchmarks-indent-long-lines (&optional lines size)
+  "Time moving up and down through LINES lines of SIZE characters.
+LINES defaults to 10 and SIZE to 1000000.  Go to the middle of the
+first line, and then to the same column of each line in turn, back
+and forth 10 times, finding the column with `current-column' and going
+to it with `move-to-column'.  Do that with `cache-long-scans' nil and
+non-nil, and return the seconds taken for each."
+  (let ((lines (or lines 10))
+        (size (or size 1000000)))
+    (with-temp-buffer
+      (let ((line (src-benchmarks--repeat "{\"key\": [1, 2, \"value\"]}, "
+                                          size)))
+        (dotimes (_ lines)
+          (insert line "\n")))
+      (src-benchmarks--each cache-long-scans '(nil t)
+        (goto-char (point-min))
+        (forward-char (/ size 2))
+        (src-benchmarks--seconds
+          (dotimes (i 10)
+            (dotimes (_ (1- lines))
+              (let ((col (current-column)))
+                (forward-line (if (zerop (% i 2)) 1 -1))
+                (move-to-column (+ col (random 100) -50))))))))))
+
+;;; marker.c
+
+(defun src-benchmarks-marker-edits (&optional n)
+  "Edit a buffer that has N markers.
+N defaults to 100000.  The markers are spread over the buffer, and
+the edits are insertions and deletions of single characters in its
+middle, like typing, followed by moving markers about.  Return the
+seconds taken by creating the markers, by the edits, and by moving
+the markers."
+  (let ((gc-cons-threshold 4000000)
+        (markers nil))
+    (with-temp-buffer
+      (dotimes (_ 10000)
+        (insert "Lorem ipsum dolor sit amet.\n"))
+      (let ((size (buffer-size)))
+        (list
+         (src-benchmarks--seconds
+           (dotimes (i (or n 100000))
+             (push (copy-marker (1+ (% (* i 7919) size))) markers)))
+         (src-benchmarks--seconds
+           (goto-char (/ size 2))
+           (dotimes (_ 10000)
+             (insert "x")
+             (insert "y")
+             (delete-char -1)))
+         (src-benchmarks--seconds
+           (let ((i 0))
+             (dolist (m markers)
+               (set-marker m (1+ (% (+ m i) size)))
+               (setq i (1+ i))))))))))
+
+;;; minibuf.c
+
+(defun src-benchmarks-minibuf-flex-completions (&optional n)
+  "Time flex completion over N random names, default 1000000.
+Complete \"fo\", then \"foo\" and \"foob\", as if typed.  Return the
+seconds taken by the flex completion style, then by
+`all-flex-completions' without threads, and with threads."
+  (let ((collection (let (names)
+                      (dotimes (_ (or n 1000000) names)
+                        (push (src-benchmarks--random-word 5 24) names))))
+        (inputs '("fo" "foo" "foob")))
+    (cons (src-benchmarks--seconds
+            (dolist (input inputs)
+              (completion-flex-all-completions input collection nil
+                                               (length input))))
+          (src-benchmarks--each completion-flex-threads '(0 4)
+            ;; Start afresh.
+            (all-flex-completions "" nil)
+            (src-benchmarks--seconds
+              (dolist (input inputs)
+                (all-flex-completions input collection)))))))
+
+;;; search.c
+
+(defun src-benchmarks-search--grep (regexp args dir)
+  "Run grep with ARGS on DIR and return its matches of REGEXP.
+Return them in the form `search-files' does."
+  (with-temp-buffer
+    (apply #'call-process "grep" nil t nil "-rnH" (append args (list dir)))
+    (goto-char (point-min))
+    (let (matches)
+      (while (re-search-forward "^\\(.*?\\):\\([0-9]+\\):\\(.*\\)$" nil t)
+        (let ((file (match-string 1))
+              (line (string-to-number (match-string 2)))
+              (text (match-string 3))
+              (start 0))
+          (while (string-match regexp text start)
+            (push (list file line (match-beginning 0) (match-string 0 text))
+                  matches)
+            (setq start (match-end 0)))))
+      (nreverse matches))))
+
+(defun src-benchmarks-search-search-files (&optional size)
+  "Compare `search-files' with running grep on a tree of SIZE bytes.
+SIZE defaults to 1000000000.  The tree consists of copies of the
+C sources of Emacs.  Search it for a literal string and for a regexp,
+with `search-files', and by running grep and parsing its output into
+the same form.  Return the seconds taken by `search-files' and grep
+for the literal string, and then for the regexp."
+  (let* ((dir (make-temp-file "src-benchmarks" t))
+         (src (expand-file-name "src" source-directory))
+         (copy-size (apply #'+ (mapcar (lambda (f)
+                                         (file-attribute-size
+                                          (file-attributes f)))
+                                       (directory-files src t "\\.[ch]\\'")))))
+    (unwind-protect
+        (progn
+          (dotimes (i (max 1 (/ (or size 1000000000) copy-size)))
+            (let ((copy (expand-file-name (format "src%d" i) dir)))
+              (make-directory copy)
+              (call-process "sh" nil nil nil "-c"
+                            (format "cp %s/*.[ch] %s"
+                                    (shell-quote-argument src)
+                                    (shell-quote-argument copy)))))
+          (let ((files (directory-files-recursively dir "\\.[ch]\\'"))
+                (case-fold-search nil))
+            (apply #'append
+                   (src-benchmarks--each patterns '(("make_fixnum" "-F")
+                                                    ("Fset_[a-z]+" "-E"))
+                     (list (src-benchmarks--seconds
+                             (search-files (car patterns) files))
+                           (src-benchmarks--seconds
+                             (src-benchmarks-search--grep
+                              (car patterns)
+                              (list (cadr patterns) (car patterns))
+                              dir)))))))
+      (delete-directory dir t))))
+
+(defun src-benchmarks-search-string-matcher (&optional size)
+  "Compare `make-string-matcher' with `regexp-opt' on SIZE bytes of text.
+SIZE defaults to 1000000.  Look for all the occurrences of 1000 and
+then 10000 random keywords in random text, with a regexp made by
+`regexp-opt' and with a string matcher.  Return a list of the
+number of keywords, the seconds taken by the regexp and by the
+string matcher, for each number of keywords; a regexp that is too
+big to compile counts as nil."
+  (with-temp-buffer
+    (while (< (buffer-size) (or size 1000000))
+      (insert (src-benchmarks--random-word 3 10) " "))
+    (src-benchmarks--each n '(1000 10000)
+      (let* ((keywords (let (words)
+                         (dotimes (_ n words)
+                           (push (src-benchmarks--random-word 3 10) words))))
+             (regexp (regexp-opt keywords))
+             (matcher (make-string-matcher keywords))
+             (case-fold-search nil))
+        (list n
+              (condition-case nil
+                  (src-benchmarks--seconds
+                    (goto-char (point-min))
+                    (while (re-search-forward regexp nil t)))
+                (invalid-regexp nil))
+              (src-benchmarks--seconds
+                (goto-char (point-min))
+                (while (string-matcher-search-forward matcher nil t))))))))
+
+;;; syntax.c
+
+(defun src-benchmarks-syntax-indent (&optional n)
+  "Indent a JSON file of N lines in `js-mode'.
+N defaults to 50000.  Return the `benchmark-run' result."
+  (require 'js)
+  (with-temp-buffer
+    (let ((i 0))
+      (while (< i (or n 50000))
+        (insert "{\n\"name\": \"item " (number-to-string i) "\",\n"
+                "\"tags\": [\"a\", \"b\", {\"c\": [1, 2, 3]}],\n"
+                "\"nested\": {\n\"value\": " (number-to-string i) "\n}\n}\n")
+        (setq i (+ i 7))))
+    (js-mode)
+    (benchmark-run 1 (indent-region (point-min) (point-max)))))
+
+(defun src-benchmarks-syntax-skip (&optional n)
+  "Skip over the lines, words and whitespace of N lines of code.
+N defaults to 100000.  Return a list of the `benchmark-run' results
+for skipping to the ends of lines with `skip-chars-forward', for
+skipping words and whitespace with `skip-syntax-forward' and
+`skip-syntax-backward', and for skipping them with
+`skip-chars-forward'."
+  (with-temp-buffer
+    (dotimes (i (or n 100000))
+      (insert "                (setq some_variable_name_" (number-to-string i)
+              "_and_some_more_words_here (another-function-call argument))\n"))
+    (list
+     (benchmark-run 10
+       (goto-char (point-min))
+       (while (not (eobp))
+         (skip-chars-forward "^\n")
+         (forward-char 1)))
+     (benchmark-run 10
+       (goto-char (point-min))
+       (while (not (eobp))
+         (skip-syntax-forward " ")
+         (skip-syntax-forward "^ ")))
+     (benchmark-run 10
+       (goto-char (point-max))
+       (while (not (bobp))
+         (skip-syntax-backward " ")
+         (skip-syntax-backward "^ ")))
+     (benchmark-run 10
+       (goto-char (point-min))
+       (while (not (eobp))
+         (skip-chars-forward " \t")
+         (skip-chars-forward "^ \t"))))))
+
+;;; textprop.c
+
+(defun src-benchmarks-textprop--fontify (file)
+  "Insert FILE, or else xdisp.c, and fontify it in C mode."
+  (insert-file-contents (or file (expand-file-name "src/xdisp.c"
+                                                   source-directory)))
+  (c-mode)
+  (font-lock-ensure))
+
+(defun src-benchmarks-textprop-put-text-property-runs (&optional file)
+  "Compare ways of applying the faces of a fontified C file FILE.
+FILE defaults to xdisp.c in the Emacs sources.  Fontify it in C mode
+and collect its runs of faces.  Then apply them again as font-lock
+does, removing the faces and calling `put-text-property' for each
+run; with `put-text-property-runs' on the text without faces; and
+with `put-text-property-runs' on the text that already has them, as
+when refontifying unchanged text.  Return the number of runs, and
+the seconds taken by each way."
+  (with-temp-buffer
+    (src-benchmarks-textprop--fontify file)
+    (let ((runs (let ((pos (point-min)) runs)
+                  (while (< pos (point-max))
+                    (let ((next (next-single-property-change pos 'face nil
+                                                             (point-max)))
+                          (face (get-text-property pos 'face)))
+                      (when face
+                        (push (list pos next face) runs))
+                      (setq pos next)))
+                  (vconcat (nreverse runs)))))
+      (with-silent-modifications
+        (list (length runs)
+              (src-benchmarks--seconds
+                (remove-text-properties (point-min) (point-max) '(face nil))
+                (mapc (lambda (run)
+                        (put-text-property (nth 0 run) (nth 1 run)
+                                           'face (nth 2 run)))
+                      runs))
+              (progn
+                (remove-text-properties (point-min) (point-max) '(face nil))
+                (src-benchmarks--seconds
+                  (put-text-property-runs (point-min) (point-max)
+                                          'face runs)))
+              (src-benchmarks--seconds
+                (put-text-property-runs (point-min) (point-max)
+                                        'face runs)))))))
+
+(defun src-benchmarks-textprop-property-index (&optional file)
+  "Compare the searches for property changes with and without index.
+FILE defaults to xdisp.c in the Emacs sources.  Fontify it in C mode.
+Then go through it a window of 50 lines at a time, searching as
+redisplay and jit-lock do for unfontified text and for changes of the
+`invisible' and `face' properties in the window; and go through it a
+hundred lines at a time, searching for the next change of `invisible'
+and for unfontified text to the end of the buffer, as line motion and
+stealth fontification do.  Return the number of intervals, and the seconds
+taken by each way of searching without and with the index."
+  (with-temp-buffer
+    (src-benchmarks-textprop--fontify file)
+    (let ((intervals (let ((pos (point-min)) (n 0))
+                       (while (setq pos (next-property-change pos))
+                         (setq n (1+ n)))
+                       n))
+          (windows
+           (lambda ()
+             (goto-char (point-min))
+             (while (not (eobp))
+               (let ((start (point))
+                     (end (progn (forward-line 50) (point))))
+                 (text-property-any start end 'fontified nil)
+                 (let ((pos start))
+                   (while (< pos end)
+                     (next-single-property-change pos 'invisible nil end)
+                     (setq pos (next-single-property-change pos 'face
+                                                            nil end))))))))
+          (lines
+           (lambda ()
+             (goto-char (point-min))
+             (while (not (eobp))
+               (next-single-property-change (point) 'invisible)
+               (text-property-not-all (point) (point-max) 'fontified t)
+               (forward-line 100)))))
+      (cons intervals
+            (src-benchmarks--each text-property-index-properties
+                (list nil text-property-index-properties)
+              (list (src-benchmarks--seconds (funcall windows))
+                    (src-benchmarks--seconds (funcall lines))))))))
+
+(defun src-benchmarks-textprop-intervals (&optional n)
+  "Time operations on a buffer made of N propertized chunks.
+N defaults to 1000000.  Insert the chunks one after the other at the
+end of a buffer, then look up a property at N random positions, copy
+the first 10000 characters 1000 times, insert N/10 chunks at random
+positions, and collect garbage.  Return the seconds taken by each."
+  (let ((n (or n 1000000))
+        (faces [bold italic])
+        (gc-cons-threshold most-positive-fixnum))
+    (with-temp-buffer
+      (list (src-benchmarks--seconds
+              (dotimes (i n)
+                (insert (propertize "chunk\n" 'face (aref faces (% i 2))))))
+            (src-benchmarks--seconds
+              (dotimes (_ n)
+                (get-text-property (1+ (random (buffer-size))) 'face)))
+            (src-benchmarks--seconds
+              (dotimes (_ 1000)
+                (buffer-substring (point-min) (min (point-max) 10000))))
+            (src-benchmarks--seconds
+              (dotimes (_ (/ n 10))
+                (goto-char (1+ (random (buffer-size))))
+                (insert (propertize "x" 'face 'underline))))
+            (src-benchmarks--seconds
+              (garbage-collect))))))
+
+;;; undo.c
+
+(defun src-benchmarks-undo-compact-log (&optional edits)
+  "Compare undo recording with and without `undo-compact-log'.
+Run a keyboard macro that makes EDITS changes, 100000 by default,
+in a buffer with as many lines, with undo limits high enough to
+keep them all.  Return, without and then with the compact log, the
+seconds taken by the macro and by a garbage collection after it, and
+the undo memory statistics of the buffer."
+  (let ((edits (or edits 100000))
+        (undo-limit most-positive-fixnum)
+        (undo-strong-limit most-positive-fixnum)
+        (undo-outer-limit nil))
+    (src-benchmarks--each undo-compact-log '(nil t)
+      (with-temp-buffer
+        (dotimes (_ edits)
+          (insert "some words on a line\n"))
+        (buffer-enable-undo)
+        (goto-char (point-min))
+        (switch-to-buffer (current-buffer))
+        (garbage-collect)
+        (list (src-benchmarks--seconds
+                (execute-kbd-macro (kbd "M-u C-n C-a") edits))
+              (src-benchmarks--seconds
+                (garbage-collect))
+              (undo-memory-statistics))))))
+
+(defun src-benchmarks-undo-compact-log-typing (&optional words)
+  "Compare undo recording of typing with and without `undo-compact-log'.
+Type WORDS words, 2000 by default, with a keyboard macro, so that
+`self-insert-command' amalgamates undo records, and with a change
+function that puts a face on the text under `with-silent-modifications',
+as font-lock does.  Return, without and then with the compact log,
+the seconds taken by the macro and by a garbage collection after it,
+and the undo memory statistics of the buffer."
+  (let ((words (or words 2000))
+        (undo-limit most-positive-fixnum)
+        (undo-strong-limit most-positive-fixnum)
+        (undo-outer-limit nil))
+    (src-benchmarks--each undo-compact-log '(nil t)
+      (with-temp-buffer
+        (buffer-enable-undo)
+        (add-hook 'after-change-functions
+                  (lambda (beg end _len)
+                    (with-silent-modifications
+                      (put-text-property beg end 'face 'bold)))
+                  nil t)
+        (switch-to-buffer (current-buffer))
+        (garbage-collect)
+        (list (src-benchmarks--seconds
+                (execute-kbd-macro "some words " words))
+              (src-benchmarks--seconds
+                (garbage-collect))
+              (undo-memory-statistics))))))
+
+;;; src-benchmarks.el ends here
@@ -1314,4 +1314,33 @@ with parameters from the *Messages* buffer modification."
         (ovshould nonempty-eob-end 4 5)
         (ovshould empty-eob        5 5)))))
 
+;; Test that `get-buffer' sees buffers through the buffer name index
+;; after they are created, renamed and killed.
+(ert-deftest buffer-tests-get-buffer-name-index ()
+  (let* ((name (generate-new-buffer-name "buffer-tests-index"))
+         (newname (concat name "-renamed"))
+         (buf (get-buffer-create name))
+         (indirect nil))
+    (unwind-protect
+        (progn
+          (should (eq (get-buffer name) buf))
+          (should (eq (get-buffer (propertize name 'face 'bold)) buf))
+          (should (eq (get-buffer-create name) buf))
+          (with-current-buffer buf
+            (rename-buffer newname))
+          (should-not (get-buffer name))
+          (should (eq (get-buffer newname) buf))
+          (should-not (equal (generate-new-buffer-name newname) newname))
+          (should (equal (generate-new-buffer-name name) name))
+          (setq indirect (make-indirect-buffer buf name))
+          (should (eq (get-buffer name) indirect))
+          (kill-buffer indirect)
+          (should-not (get-buffer name))
+          (kill-buffer buf)
+          (should-not (get-buffer newname))
+          (should (memq (get-buffer-create newname) (buffer-list))))
+      (dolist (b (list buf indirect (get-buffer newname)))
+        (when (buffer-live-p b)
+          (kill-buffer b))))))
+
 ;;; buffer-tests.el ends here
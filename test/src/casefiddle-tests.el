@@ -259,6 +259,84 @@
       (should (eq tc (capitalize ch)))
       (should (eq tc (upcase-initials ch))))))
 
+;; TEXT cased one character at a time by FN.
+(defun casefiddle-tests--case-by-char (text fn)
+  (mapconcat (lambda (c)
+               (funcall fn (if (multibyte-string-p text)
+                               (string c)
+                             (unibyte-string c))))
+             text ""))
+
+;; The indices (BEG . END) of the part of A that differs from B, which
+;; has the same length, or nil if none does.
+(defun casefiddle-tests--changed-span (a b)
+  (let ((beg 0) (end (length a)))
+    (while (and (< beg end) (eq (aref a beg) (aref b beg)))
+      (setq beg (1+ beg)))
+    (while (and (< beg end) (eq (aref a (1- end)) (aref b (1- end))))
+      (setq end (1- end)))
+    (and (< beg end) (cons beg end))))
+
+(ert-deftest casefiddle-tests-casing-ascii-runs ()
+  (let ((texts (list (make-string 1000 ?x)
+                     (concat (make-string 37 ?a) "Zażółć" (make-string 70 ?Q)
+                             "[@`{~] é" (make-string 9 ?m))
+                     (let ((s (make-string 3000 ?a)))
+                       (dotimes (i (length s) s)
+                         (aset s i (aref "aZ@[`{ 09ł\n" (random 11))))))))
+    (dolist (text texts)
+      (should (equal (upcase text)
+                     (casefiddle-tests--case-by-char text #'upcase)))
+      (should (equal (downcase text)
+                     (casefiddle-tests--case-by-char text #'downcase)))
+      (let ((unibyte (encode-coding-string text 'latin-1)))
+        (should (equal (upcase unibyte)
+                       (casefiddle-tests--case-by-char unibyte #'upcase))))
+      (dolist (gap '(nil 1 10 100))
+        (with-temp-buffer
+          (buffer-enable-undo)
+          (insert text)
+          (when gap
+            (goto-char (min gap (point-max)))
+            (insert "x")
+            (delete-char -1))
+          (setq buffer-undo-list nil)
+          (let (changes)
+            (add-hook 'after-change-functions
+                      (lambda (beg end len) (push (list beg end len) changes))
+                      nil t)
+            (upcase-region (point-min) (point-max))
+            (should (equal (buffer-string)
+                           (casefiddle-tests--case-by-char text #'upcase)))
+            ;; Only the part that changed is reported.
+            (let ((changed (casefiddle-tests--changed-span text
+                                                           (buffer-string))))
+              (when changed
+                (should (equal (car changes)
+                               (list (1+ (car changed)) (1+ (cdr changed))
+                                     (- (cdr changed) (car changed))))))))
+          (downcase-region (point-min) (point-max))
+          (should (equal (buffer-string)
+                         (casefiddle-tests--case-by-char text #'downcase)))
+          (primitive-undo 1 buffer-undo-list)
+          (should (equal (buffer-string) text)))))
+    ;; Case tables that change ASCII characters are obeyed.
+    (let ((table (copy-case-table (standard-case-table))))
+      (set-case-syntax-pair ?Q ?z table)
+      (with-temp-buffer
+        (set-case-table table)
+        (insert (make-string 100 ?Q))
+        (downcase-region (point-min) (point-max))
+        (should (equal (buffer-string) (make-string 100 ?z)))))
+    ;; The final sigma rule sees whether a run ends within a word.
+    (dolist (test `((,(concat (make-string 70 ?A) "Σ") . "aς")
+                    (,(concat "ΑΣ" (make-string 70 ?\s) "Σ") . " σ")))
+      (should (string-suffix-p (cdr test) (downcase (car test))))
+      (with-temp-buffer
+        (insert (car test))
+        (downcase-region (point-min) (point-max))
+        (should (string-suffix-p (cdr test) (buffer-string)))))))
+
 (defvar casefiddle-oldfunc region-extract-function)
 
 (defun casefiddle-loopfunc (method)
@@ -0,0 +1,73 @@
+;;; character-tests.el --- tests for character.c functions -*- lexical-binding: t -*-
+
+;; Copyright (C) 2021 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;; A random string of N characters from CHARS.
+(defun character-tests--random-string (n chars)
+  (let (list)
+    (dotimes (_ n (apply #'string list))
+      (push (aref chars (random (length chars))) list))))
+
+(ert-deftest character-tests-chars-in-text ()
+  ;; Characters of 1 to 5 bytes, and raw bytes.
+  (let ((chars (string ?a ?\n ?é ?中 ?😀 #x3fff80 #x3fffff #x10ffff ?z)))
+    (dotimes (n 50)
+      (let ((text (character-tests--random-string n chars)))
+        (with-temp-buffer
+          (set-buffer-multibyte nil)
+          (insert (string-as-unibyte text))
+          (goto-char (1+ (/ (buffer-size) 2)))
+          (insert "x")
+          (delete-char -1)
+          (set-buffer-multibyte t)
+          (should (equal (buffer-string) text))
+          (should (= (point-max) (1+ n))))
+        (should (equal (string-to-multibyte (read (prin1-to-string text)))
+                       text))))))
+
+(ert-deftest character-tests-string-width ()
+  (let ((chars (string ?a ?\s ?~ ?\t ?\n ?\0 ?\d ?é ?中 ?😀 #x3fff80)))
+    (dotimes (n 100)
+      (let ((text (character-tests--random-string n chars)))
+        (dolist (ctl-arrow '(t nil))
+          (with-temp-buffer
+            (setq ctl-arrow ctl-arrow)
+            (should (= (string-width text)
+                       (apply #'+ (mapcar #'char-width text))))
+            (let ((unibyte (string-to-unibyte
+                            (replace-regexp-in-string "[^\0-\d]" "b" text))))
+              (should (= (string-width unibyte)
+                         (apply #'+ (mapcar #'char-width unibyte)))))))))
+    ;; Precision stops before the character that doesn't fit.
+    (should (equal (format "%.5s" "abcdefgh") "abcde"))
+    (should (equal (format "%.5s" "abc中def") "abc中"))
+    (should (equal (format "%.4s" "abc中def") "abc"))
+    ;; Display tables and compositions are obeyed.
+    (with-temp-buffer
+      (setq buffer-display-table (make-display-table))
+      (aset buffer-display-table ?a (vector ?x ?y ?z))
+      (should (= (string-width (make-string 20 ?a)) 60)))
+    (let ((text (concat (make-string 20 ?b) "ab" (make-string 20 ?b))))
+      (compose-string text 20 22 ?中)
+      (should (= (string-width text) 42)))))
+
+;;; character-tests.el ends here
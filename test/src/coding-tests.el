@@ -375,6 +375,138 @@
 			 (with-temp-buffer (insert-file-contents (car file))))))
 	  (insert (format "%s: %s\n" (car file) result)))))))
 
+;; Return a unibyte string of mostly valid UTF-8 text in runs of
+;; various lengths, separated by invalid or truncated sequences and
+;; by CRs.
+(defun coding-tests-utf-8-random-bytes (nruns)
+  (let ((pieces ["a" "é" "世" "\U0001F600" "\n" "\r\n"])
+        (junk ["\377" "\300\200" "\355\240\200" "\342\202" "\r" "\360"])
+        (result nil))
+    (dotimes (_ nruns)
+      (dotimes (_ (random 600))
+        (push (encode-coding-string (aref pieces (random (length pieces)))
+                                    'utf-8)
+              result))
+      (push (string-to-unibyte (aref junk (random (length junk)))) result))
+    (apply #'concat (nreverse result))))
+
+(ert-deftest ert-test-coding-utf-8-direct ()
+  "Check that copying valid UTF-8 directly doesn't change the result."
+  (let ((file (make-temp-file "coding-tests-utf-8")))
+    (unwind-protect
+        (dotimes (i 20)
+          (let ((bytes (coding-tests-utf-8-random-bytes (1+ i)))
+                (coding-system-for-write 'no-conversion))
+            (write-region bytes nil file nil 'silent)
+            (dolist (coding '(utf-8-unix utf-8-dos utf-8-mac
+                              utf-8-with-signature-unix))
+              (let (results)
+                (dolist (disable-ascii-optimization '(t nil))
+                  (push (list (decode-coding-string bytes coding)
+                              (with-temp-buffer
+                                (let ((coding-system-for-read coding))
+                                  (insert "<>")
+                                  (goto-char 2)
+                                  (insert-file-contents file)
+                                  (buffer-string))))
+                        results))
+                (should (equal-including-properties (car results)
+                                                    (cadr results)))))))
+      (delete-file file))))
+
+(ert-deftest ert-test-coding-utf-8-direct-encode ()
+  "Check that copying text directly when encoding doesn't change the result."
+  (let ((pieces (vector "a" "é" "世" "\U0001F600" "\n" "\r" "\n\n" "\u3fff00"
+                        (string (unibyte-char-to-multibyte #x80))
+                        (string (unibyte-char-to-multibyte #xff)))))
+    (dotimes (i 20)
+      (let ((text (apply #'concat
+                         (mapcan (lambda (_)
+                                   (list (make-string (random 600) ?a)
+                                         (aref pieces
+                                               (random (length pieces)))))
+                                 (make-list (1+ i) nil)))))
+        (dolist (coding '(utf-8-unix utf-8-dos utf-8-mac
+                          utf-8-with-signature-dos))
+          (let (results)
+            (dolist (disable-ascii-optimization '(t nil))
+              (push (list (encode-coding-string text coding)
+                          (with-temp-buffer
+                            (insert "<>" text "<>")
+                            (encode-coding-region 3 (- (point-max) 2) coding)
+                            (buffer-string)))
+                    results))
+            (should (equal (car results) (cadr results)))))))))
+
+(ert-deftest ert-test-coding-single-byte-direct ()
+  "Check that decoding single-byte text directly doesn't change the result."
+  (let ((file (make-temp-file "coding-tests-single-byte")))
+    (unwind-protect
+        (dotimes (i 10)
+          (let ((bytes (apply #'concat
+                              (mapcar (lambda (_)
+                                        (pcase (random 20)
+                                          (0 "\r\n")
+                                          (1 "\n")
+                                          ((pred (< 13)) (unibyte-string
+                                                          (+ 128 (random 128))))
+                                          (_ (unibyte-string
+                                              (+ 32 (random 95))))))
+                                      (make-list (* 500 (1+ i)) nil))))
+                (coding-system-for-write 'no-conversion))
+            (write-region bytes nil file nil 'silent)
+            (dolist (coding '(latin-1 iso-latin-1-dos iso-8859-7-mac
+                              windows-1250 koi8-r cp437 tis-620 us-ascii))
+              (let (results)
+                (dolist (disable-ascii-optimization '(t nil))
+                  (push (list (decode-coding-string bytes coding)
+                              (with-temp-buffer
+                                (let ((coding-system-for-read coding))
+                                  (insert "<>")
+                                  (goto-char 2)
+                                  (insert-file-contents file)
+                                  (buffer-string))))
+                        results))
+                (should (equal-including-properties (car results)
+                                                    (cadr results)))))))
+      (delete-file file))))
+
+(ert-deftest ert-test-coding-single-byte-threads ()
+  "Check that decoding single-byte text with threads doesn't change the result."
+  ;; Printable bytes are of one charset in this coding system, and the
+  ;; others of another, so its text must be decoded by the sequential
+  ;; loop from the first chunk with both.
+  (define-coding-system 'coding-tests-two-charsets "For testing."
+    :coding-type 'charset
+    :mnemonic ?*
+    :charset-list '(latin-iso8859-1 iso-8859-7))
+  (let ((bytes (apply #'unibyte-string
+                      (mapcar (lambda (i)
+                                (if (and (< 700000 i) (zerop (random 3)))
+                                    (+ 128 (random 128))
+                                  (+ 32 (random 95))))
+                              (number-sequence 1 1500000))))
+        (file (make-temp-file "coding-tests-single-byte")))
+    (unwind-protect
+        (let ((coding-system-for-write 'no-conversion))
+          (write-region bytes nil file nil 'silent)
+          (dolist (coding '(latin-1 iso-latin-1-dos koi8-r
+                            coding-tests-two-charsets))
+            (let (results)
+              (dolist (threads '(0 4))
+                (let ((decode-coding-threads threads))
+                  (push (list (decode-coding-string bytes coding)
+                              (with-temp-buffer
+                                (let ((coding-system-for-read coding))
+                                  (insert "<>")
+                                  (goto-char 2)
+                                  (insert-file-contents file)
+                                  (buffer-string))))
+                        results)))
+              (should (equal-including-properties (car results)
+                                                  (cadr results))))))
+      (delete-file file))))
+
 ;; Local Variables:
 ;; byte-compile-warnings: (not obsolete)
 ;; End:
@@ -0,0 +1,113 @@
+;;; dired-tests.el --- unit tests for src/dired.c  -*- lexical-binding: t; -*-
+
+;; Copyright (C) 2021 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(defun dired-tests--cache-hits ()
+  (plist-get (file-attributes-cache-statistics) :hits))
+
+(ert-deftest dired-tests--file-attributes-cache ()
+  (let* ((dir (make-temp-file "dired-tests" t))
+         (a (expand-file-name "a" dir))
+         (sub (expand-file-name "sub" dir))
+         (file-attributes-cache-ttl 60))
+    (unwind-protect
+        (progn
+          (write-region "a" nil a nil 'silent)
+          (make-directory sub)
+          (should (equal (directory-files dir) '("." ".." "a" "sub")))
+          (should (= (file-attribute-size (file-attributes a)) 1))
+          ;; Asking again is answered from the cache.
+          (let ((hits (dired-tests--cache-hits)))
+            (should (equal (directory-files dir) '("." ".." "a" "sub")))
+            (should (= (file-attribute-size (file-attributes a)) 1))
+            (should (file-exists-p a))
+            (should (file-directory-p sub))
+            (should-not (file-directory-p a))
+            (should (< hits (dired-tests--cache-hits))))
+          ;; The values returned are copies.
+          (setcar (nthcdr 7 (file-attributes a)) 42)
+          (should (= (file-attribute-size (file-attributes a)) 1))
+          ;; Changes made by Emacs are seen at once.
+          (write-region "abc" nil a nil 'silent)
+          (should (= (file-attribute-size (file-attributes a)) 3))
+          (write-region "b" nil (expand-file-name "b" dir) nil 'silent)
+          (should (equal (directory-files dir) '("." ".." "a" "b" "sub")))
+          (delete-file (expand-file-name "b" dir))
+          (should-not (file-exists-p (expand-file-name "b" dir)))
+          (should (equal (directory-files dir) '("." ".." "a" "sub")))
+          (delete-directory sub)
+          (should-not (file-directory-p sub))
+          ;; So are changes made by others, if they can be watched.
+          (when (featurep 'inotify)
+            (call-process "sh" nil nil nil "-c"
+                          (format "echo hello >%s; mkdir %s"
+                                  (shell-quote-argument a)
+                                  (shell-quote-argument sub)))
+            (should (= (file-attribute-size (file-attributes a)) 6))
+            (should (file-directory-p sub))
+            (should (equal (directory-files dir) '("." ".." "a" "sub"))))
+          (should (< 0 (plist-get (file-attributes-cache-statistics)
+                                  :invalidations)))
+          (file-attributes-cache-clear)
+          (should (= (plist-get (file-attributes-cache-statistics)
+                                :directories)
+                     0)))
+      (file-attributes-cache-clear)
+      (delete-directory dir t))))
+
+(ert-deftest dired-tests--directory-files-walk ()
+  (let ((dir (make-temp-file "dired-tests" t)))
+    (unwind-protect
+        (progn
+          (dolist (d '("a/b" "a/.git/objects" "foo" "foo-bar" "c"))
+            (make-directory (expand-file-name d dir) t))
+          (dolist (f '("a/x.el" "a/b/y.el" "a/.git/objects/z.el" "c/Z.EL"
+                       "foo.c" "foo/q.el" "foo-bar/r.el" "\u00e9.el"))
+            (write-region "" nil (expand-file-name f dir) nil 'silent))
+          (make-symbolic-link (expand-file-name "a" dir)
+                              (expand-file-name "link" dir))
+          (dolist (args `(("\\.el\\'")
+                          ("\\.el\\'" t)
+                          ("" t)
+                          ("\\.el\\'" nil nil t)
+                          ("o" t ,(lambda (d) (not (string-suffix-p "/a" d))))))
+            (dolist (directory-files-walk-threads '(0 4))
+              (should (equal (apply #'directory-files-walk dir args)
+                             (directory-files-recursively--1
+                              dir (nth 0 args) (nth 1 args) (nth 2 args)
+                              (nth 3 args))))))
+          (should (equal (directory-files-walk dir "\\.el\\'" nil nil nil
+                                               '(".git" "foo"))
+                         (mapcar (lambda (f) (expand-file-name f dir))
+                                 '("a/b/y.el" "a/x.el" "c/Z.EL" "foo-bar/r.el"
+                                   "\u00e9.el"))))
+          (let (batches)
+            (should-not (directory-files-walk dir "" t nil nil nil
+                                              (lambda (b) (push b batches))))
+            (should (equal (apply #'append (nreverse batches))
+                           (directory-files-walk dir "" t))))
+          (should-error (directory-files-walk
+                         (expand-file-name "missing" dir) "")
+                        :type 'file-missing))
+      (delete-directory dir t))))
+
+;;; dired-tests.el ends here
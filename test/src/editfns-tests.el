@@ -239,6 +239,44 @@
                  '(error "Invalid format operation %$")))
   (should (equal (format "%1$c %1$s" ?±) "± 177")))
 
+(ert-deftest format-cached ()
+  ;; Each format is used twice, to use its compiled form.
+  (dotimes (_ 2)
+    ;; The result is a new string, even of just "%s".
+    (let ((s "x"))
+      (should (equal (format "%s" s) s))
+      (should-not (eq (format "%s" s) s))
+      (should-not (eq (format "%s" 'foo) (symbol-name 'foo))))
+    (let ((f "no directives"))
+      (should (eq (format f) f)))
+    (should (equal (format "%s|%S|%d|%c|%%" "a" "b" -12 ?z) "a|\"b\"|-12|z|%"))
+    (should (equal (format "%5s|%-5s|%05d|%-5d|%3c" "ab" 'cd -42 7 ?x)
+                   "   ab|cd   |-0042|7    |  x"))
+    (should (equal (format "%s %S" 1.5 '(a "b")) "1.5 (a \"b\")"))
+    ;; Widths count columns.
+    (should (equal (format "%4s|" "一") "  一|"))
+    (should (multibyte-string-p (format "%s" (string-to-multibyte "a"))))
+    (should (multibyte-string-p (format "%d" 1 "é")))
+    (should (equal (format "%s" (string-to-unibyte "\377"))
+                   (string-to-unibyte "\377")))
+    (should (equal (format "é%s" (string-to-unibyte "\377"))
+                   (string ?é (unibyte-char-to-multibyte ?\377))))
+    (should (equal-including-properties
+             (format "<%s>" (propertize "a" 'face 'bold))
+             #("<a>" 1 2 (face bold))))
+    (let ((text-quoting-style 'curve))
+      (should (equal (format-message "`%s'" "a") "‘a’")))
+    (let ((text-quoting-style 'grave))
+      (should (equal (format-message "`%s'" "a") "`a'")))
+    (should-error (format "%d" "a"))
+    (should-error (format "%s %s" 1)))
+  ;; A format that changes is compiled again.
+  (let ((f (copy-sequence "%s-%d")))
+    (should (equal (format f "a" 1) "a-1"))
+    (aset f 1 ?d)
+    (aset f 4 ?s)
+    (should (equal (format f 1 "a") "1-a"))))
+
 (ert-deftest replace-buffer-contents-1 ()
   (with-temp-buffer
     (insert #("source" 2 4 (prop 7)))
@@ -281,6 +319,59 @@
   (should (equal (buffer-substring-no-properties (point-min) (point-max))
                  (concat (string (char-from-name "SMILE")) "1234"))))
 
+(ert-deftest replace-buffer-contents-lines ()
+  "Check the line diff that `replace-buffer-contents' does first."
+  (let ((lines (let (l)
+                 (dotimes (i 200 (vconcat (nreverse l)))
+                   (push (cond ((= i 150) "kept line\n")
+                               ((= 0 (% i 3)) "}\n")
+                               (t (format "%s line %d\n"
+                                          (if (= 0 (% i 7)) "é" "x") i)))
+                         l)))))
+    (dotimes (round 20)
+      (let ((new (let (l)
+                   (dotimes (i (length lines) (apply #'concat (nreverse l)))
+                     (pcase (if (= i 150) 9 (random 10))
+                       (0 nil)
+                       (1 (push "new\n" l) (push (aref lines i) l))
+                       (2 (push (upcase (aref lines i)) l))
+                       (_ (push (aref lines i) l))))))
+            (narrow (= 0 (% round 2))))
+        (with-temp-buffer
+          (let ((source (current-buffer)))
+            (insert "head\n" new "no newline")
+            (when narrow
+              (narrow-to-region 6 (- (point-max) 10)))
+            ;; Move the gap into the text.
+            (goto-char (/ (point-max) 2))
+            (insert "z")
+            (delete-char -1)
+            (with-temp-buffer
+              (insert "head\n" (apply #'concat (append lines nil)) "tail")
+              (when narrow
+                (narrow-to-region 6 (- (point-max) 4)))
+              (goto-char (/ (point-max) 3))
+              (insert "z")
+              (delete-char -1)
+              (goto-char (point-min))
+              (search-forward "kept line")
+              (let ((marker (copy-marker (match-beginning 0))))
+                (should (replace-buffer-contents source))
+                (should (equal (buffer-string)
+                               (with-current-buffer source (buffer-string))))
+                ;; The marker stays at its line, which was kept.
+                (goto-char marker)
+                (should (looking-at "kept line$")))))))))
+  ;; Buffers that differ in multibyteness are diffed by characters.
+  (with-temp-buffer
+    (set-buffer-multibyte nil)
+    (insert "a\nb\nc\n")
+    (let ((source (current-buffer)))
+      (with-temp-buffer
+        (insert "a\nc\n")
+        (should (replace-buffer-contents source))
+        (should (equal (buffer-string) "a\nb\nc\n"))))))
+
 (ert-deftest delete-region-undo-markers-1 ()
   "Make sure we don't end up with freed markers reachable from Lisp."
   ;; https://debbugs.gnu.org/cgi/bugreport.cgi?bug=30931#40
@@ -332,6 +423,50 @@
     (should (eq (type-of (car (nth 4 buffer-undo-list))) 'marker))
     (garbage-collect)))
 
+(ert-deftest save-excursion-recycled-markers ()
+  "Check that `save-excursion' and `save-restriction' reuse markers."
+  (with-temp-buffer
+    (insert "1234567890")
+    (narrow-to-region 2 8)
+    (goto-char 2)
+    (save-excursion (save-restriction (widen)))
+    (let ((gc-cons-threshold most-positive-fixnum)
+          (consed excursion-markers-consed)
+          (recycled excursion-markers-recycled))
+      (dotimes (_ 10)
+        (save-excursion
+          (goto-char 4)
+          (save-restriction
+            (widen)
+            (insert "x")))
+        (should (= (point) 2)))
+      (should (= excursion-markers-consed consed))
+      (should (= excursion-markers-recycled (+ recycled 30)))
+      (should (= (point-max) 18))
+      (widen)
+      (should (equal (buffer-string) "123xxxxxxxxxx4567890")))))
+
+(ert-deftest save-restriction-undo-markers-not-recycled ()
+  "Markers that get into the undo list must not be reused."
+  (with-temp-buffer
+    (insert "1234567890")
+    (setq buffer-undo-list nil)
+    (narrow-to-region 2 5)
+    (save-restriction
+      (widen)
+      (delete-region 1 6))
+    (let ((m1 (car (nth 1 buffer-undo-list)))
+          (m2 (car (nth 2 buffer-undo-list))))
+      (should (markerp m1))
+      (should (markerp m2))
+      (dotimes (_ 10)
+        (narrow-to-region 1 3)
+        (save-excursion
+          (save-restriction
+            (widen))))
+      (should-not (marker-buffer m1))
+      (should-not (marker-buffer m2)))))
+
 (ert-deftest format-bignum ()
   (let* ((s1 "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF")
          (v1 (read (concat "#x" s1)))
@@ -156,3 +156,199 @@ Also check that an encoding error can appear in a symlink."
     (write-region "hello\n" nil f nil 'silent)
     (should-error (insert-file-contents f) :type 'circular-list)
     (delete-file f)))
+
+(ert-deftest fileio-tests--insert-file-contents-mapped ()
+  "Test insert-file-contents-mapped."
+  (let ((f (make-temp-file "fileio"))
+        (text (concat "abc\né中\U0001F600\n"
+                      (make-string 5000 ?x) "\né")))
+    (unwind-protect
+        (progn
+          (let ((coding-system-for-write 'utf-8-unix))
+            (write-region text nil f nil 'silent))
+          (with-temp-buffer
+            (let ((n (insert-file-contents-mapped f)))
+              ;; Some platforms cannot map files.
+              (when n
+                (should (= n (length text)))
+                (should (equal (buffer-string) text))
+                (goto-char (point-min))
+                (should (search-forward "\U0001F600" nil t))
+                (should (= (point) 8))
+                ;; Changing the buffer does not change the file.
+                (insert "y")
+                (delete-region (point-min) (1+ (point-min)))
+                (should (equal (buffer-substring 1 9)
+                               "bc\né中\U0001F600y\n"))
+                (should (equal (with-temp-buffer
+                                 (set-buffer-multibyte nil)
+                                 (insert-file-contents-literally f)
+                                 (buffer-string))
+                               (encode-coding-string text 'utf-8-unix))))))
+          (with-temp-buffer
+            (set-buffer-multibyte nil)
+            (when (insert-file-contents-mapped f)
+              (should (equal (buffer-string)
+                             (encode-coding-string text 'utf-8-unix)))
+              (erase-buffer)
+              (should (= (buffer-size) 0))))
+          (with-temp-buffer
+            (insert "x")
+            (should-error (insert-file-contents-mapped f)))
+          ;; Invalid UTF-8 is not mapped into a multibyte buffer.
+          (let ((coding-system-for-write 'no-conversion))
+            (write-region "a\351b" nil f nil 'silent))
+          (with-temp-buffer
+            (should-not (insert-file-contents-mapped f))
+            (should (= (buffer-size) 0)))
+          (with-temp-buffer
+            (should-not (insert-file-contents-mapped
+                         temporary-file-directory))))
+      (delete-file f))))
+
+(ert-deftest fileio-tests--insert-file-contents-mapped-truncated ()
+  "Test a file truncated while it is mapped into a buffer."
+  (skip-unless (eq system-type 'gnu/linux))
+  (let ((f (make-temp-file "fileio"))
+        (form
+         '(progn
+            (write-region (make-string 100000 ?a) nil f nil 'silent)
+            (set-buffer (get-buffer-create "mapped"))
+            (unless (insert-file-contents-mapped f)
+              (kill-emacs 0))
+            ;; This runs once the command loop has recovered.
+            (run-with-timer 0 nil
+                            (lambda ()
+                              (set-buffer "mapped")
+                              (princ (format "size %d %S\n" (buffer-size)
+                                             (buffer-substring 1 3)))
+                              (kill-emacs 0)))
+            (write-region (make-string 5000 ?b) nil f nil 'silent)
+            (buffer-substring 90000 90010)
+            (princ "not reached\n"))))
+    (unwind-protect
+        (with-temp-buffer
+          (should (eq 0 (call-process
+                         (expand-file-name invocation-name
+                                           invocation-directory)
+                         nil t nil "-Q" "--batch" "--eval"
+                         (prin1-to-string `(let ((f ,f)) ,form)))))
+          (goto-char (point-min))
+          (when (re-search-forward "^size \\([0-9]+\\) \\(.*\\)$" nil t)
+            (should (<= 5000 (string-to-number (match-string 1)) 99999))
+            (should (equal (match-string 2) "\"bb\""))
+            (should (search-backward "truncated" nil t))
+            (should-not (search-forward "not reached" nil t))))
+      (delete-file f))))
+
+(defun fileio-tests--wait (predicate)
+  "Read events until PREDICATE returns non-nil, for at most 10 seconds."
+  (let ((end (+ (float-time) 10)))
+    (while (and (not (funcall predicate)) (< (float-time) end))
+      (read-event nil nil 0.05))))
+
+(ert-deftest fileio-tests--write-region-async ()
+  "Test write-region-async."
+  (let ((f (make-temp-file "fileio"))
+        (text "héllo\n")
+        done)
+    (unwind-protect
+        (with-temp-buffer
+          (insert text)
+          (let ((coding-system-for-write 'utf-8-unix))
+            (should (write-region-async (point-min) (point-max) f
+                                        (lambda (err) (setq done (list err)))
+                                        nil t)))
+          (should (buffer-modified-p))
+          (insert "more")
+          (fileio-tests--wait (lambda () done))
+          (should (equal done '(nil)))
+          (should (equal buffer-file-name f))
+          ;; The buffer was changed after the snapshot was taken.
+          (should (buffer-modified-p))
+          (should (verify-visited-file-modtime))
+          (should (equal (with-temp-buffer
+                           (set-buffer-multibyte nil)
+                           (insert-file-contents-literally f)
+                           (buffer-string))
+                         (encode-coding-string text 'utf-8-unix)))
+          (setq done nil)
+          (write-region-async (point-min) (point-max) f
+                              (lambda (err) (setq done (list err)))
+                              nil t)
+          (fileio-tests--wait (lambda () done))
+          (should-not (buffer-modified-p))
+          (setq done nil)
+          (write-region-async (point-min) (point-max)
+                              (concat f "-missing/file")
+                              (lambda (err) (setq done (list err))))
+          (fileio-tests--wait (lambda () done))
+          (should (eq (car-safe (car done)) 'file-missing))
+          (set-buffer-modified-p nil))
+      (delete-file f))))
+
+(ert-deftest fileio-tests--file-io-async-callbacks ()
+  "Check that each of several asynchronous jobs calls back once."
+  (let ((files (list (make-temp-file "fileio") (make-temp-file "fileio")
+                     (make-temp-file "fileio")))
+        (calls nil))
+    (unwind-protect
+        (progn
+          (with-temp-buffer
+            (dolist (f files)
+              (erase-buffer)
+              (insert f)
+              (should (write-region-async
+                       (point-min) (point-max) f
+                       (lambda (err) (push (list 'write f err) calls))))))
+          ;; The callbacks are called from the command loop, not by
+          ;; the functions that start the jobs.
+          (should-not calls)
+          (fileio-tests--wait
+           (lambda () (= (length calls) (length files))))
+          (dolist (f files)
+            (should (read-file-async
+                     f (lambda (contents err)
+                         (push (list 'read f err contents) calls)))))
+          (fileio-tests--wait
+           (lambda () (= (length calls) (* 2 (length files)))))
+          (read-event nil nil 0.1)
+          (should (= (length calls) (* 2 (length files))))
+          (dolist (f files)
+            (should (member (list 'write f nil) calls))
+            (should (member (list 'read f nil (encode-coding-string
+                                                f 'utf-8-unix))
+                            calls))))
+      (mapc #'delete-file files))))
+
+(ert-deftest fileio-tests--insert-file-contents-async ()
+  "Test insert-file-contents-async and read-file-async."
+  (let ((f (make-temp-file "fileio"))
+        (text (concat "héllo\n" (make-string 70000 ?x)))
+        done)
+    (unwind-protect
+        (progn
+          (let ((coding-system-for-write 'utf-8-unix))
+            (write-region text nil f nil 'silent))
+          (with-temp-buffer
+            (insert "ab")
+            (goto-char 2)
+            (insert-file-contents-async
+             f (lambda (n err) (setq done (list n err))))
+            (insert "c")
+            (fileio-tests--wait (lambda () done))
+            (should (equal done (list (length text) nil)))
+            (should (equal (buffer-string) (concat "a" text "cb"))))
+          (setq done nil)
+          (read-file-async f (lambda (contents err)
+                               (setq done (list contents err))))
+          (fileio-tests--wait (lambda () done))
+          (should (equal done (list (encode-coding-string text 'utf-8-unix)
+                                    nil)))
+          (setq done nil)
+          (read-file-async (concat f "-missing")
+                           (lambda (contents err)
+                             (setq done (list contents err))))
+          (fileio-tests--wait (lambda () done))
+          (should (eq (car-safe (nth 1 done)) 'file-missing)))
+      (delete-file f))))
@@ -786,6 +786,45 @@
   (should (equal 1 (string-distance "ab" "a我b")))
   (should (equal 1 (string-distance "我" "她"))))
 
+(defun fns-tests--string-distance (s1 s2)
+  "Return the Levenshtein distance between S1 and S2, the slow way."
+  (let ((column (vconcat (number-sequence 0 (length s1)))))
+    (dotimes (x (length s2))
+      (let ((new (make-vector (1+ (length s1)) (1+ x))))
+        (dotimes (y (length s1))
+          (aset new (1+ y)
+                (min (1+ (aref column (1+ y))) (1+ (aref new y))
+                     (+ (aref column y)
+                        (if (eq (aref s1 y) (aref s2 x)) 0 1)))))
+        (setq column new)))
+    (aref column (length s1))))
+
+(ert-deftest test-string-distance-bit-parallel ()
+  "Test `string-distance' and `string-distances' on longer strings."
+  (let ((random-string
+         (lambda (n)
+           (let ((s (make-string n ?a t)))
+             (dotimes (i n s)
+               (aset s i (aref "abcé我" (random 5))))))))
+    (dotimes (_ 50)
+      (let* ((s1 (funcall random-string (random 150)))
+             (s2 (funcall random-string (random 150)))
+             (d (fns-tests--string-distance s1 s2)))
+        (should (equal (string-distance s1 s2) d))
+        (should (equal (string-distance s2 s1) d))
+        (should (equal (string-distance s1 s2 nil d) d))
+        (should-not (and (< 0 d) (string-distance s1 s2 nil (1- d))))
+        (should (equal (string-distance s1 s2 t)
+                       (fns-tests--string-distance
+                        (encode-coding-string s1 'utf-8-emacs)
+                        (encode-coding-string s2 'utf-8-emacs))))
+        (should (equal (string-distances s1 (vector s2 s1 "" s2) nil d)
+                       (vector d 0 (if (<= (length s1) d) (length s1)) d))))))
+  (should (equal (string-distances "" ["" "abc"]) [0 3]))
+  (should (equal (string-distances "ab" ["ab我她" "a我b"] t) [6 3]))
+  (should (equal (string-distances "ab" ["ab我她" "a我b"]) [2 1]))
+  (should (equal (string-distances "ab" ["abcd" "xy"] nil 1) [nil nil])))
+
 (ert-deftest test-bignum-eql ()
   "Test that `eql' works for bignums."
   (let ((x (+ most-positive-fixnum 1))
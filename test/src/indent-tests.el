@@ -0,0 +1,114 @@
+;;; indent-tests.el --- tests for indent.c functions -*- lexical-binding: t -*-
+
+;; Copyright (C) 2021 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+;; The column at POS and where `move-to-column' to GOAL from POS goes,
+;; with and without the caches.
+(defun indent-tests--columns (pos goal)
+  (let (result)
+    (dolist (cache-long-scans '(t nil) result)
+      (goto-char pos)
+      (push (list (current-column) (move-to-column goal) (point)) result))))
+
+;; Check the columns at COUNT random positions of the current buffer,
+;; and the positions of random columns.
+(defun indent-tests--check-columns (count)
+  (dotimes (_ count)
+    (let ((columns (indent-tests--columns
+                    (+ (point-min) (random (1+ (buffer-size))))
+                    (random 40000))))
+      (should (equal (car columns) (cadr columns))))))
+
+(ert-deftest indent-tests-column-cache ()
+  (with-temp-buffer
+    (let ((chars (string ?a ?b ?\s ?\t ?\0 ?é ?中)))
+      (dotimes (_ 20000)
+        (insert (aref chars (random (length chars))))))
+    (insert "\n" (make-string 9000 ?x) "\n")
+    (indent-tests--check-columns 200)
+    ;; Changes of the text.
+    (goto-char 5000)
+    (insert "\t\t中")
+    (indent-tests--check-columns 50)
+    (delete-region 100 300)
+    (indent-tests--check-columns 50)
+    (goto-char 10000)
+    (insert "\n")
+    (indent-tests--check-columns 50)
+    ;; Changes of text properties and overlays.
+    (put-text-property 2000 2100 'invisible t)
+    (indent-tests--check-columns 50)
+    (put-text-property 8000 8001 'display '(space :width 50))
+    (indent-tests--check-columns 50)
+    (overlay-put (make-overlay 12000 13000) 'invisible t)
+    (indent-tests--check-columns 50)
+    (remove-text-properties (point-min) (point-max) '(invisible nil))
+    (indent-tests--check-columns 50)
+    ;; Changes of the variables.
+    (setq tab-width 3)
+    (indent-tests--check-columns 50)
+    (setq ctl-arrow nil)
+    (indent-tests--check-columns 50)
+    (setq buffer-display-table (make-display-table))
+    (aset buffer-display-table ?a (vector ?x ?y))
+    (indent-tests--check-columns 50)
+    ;; Narrowing within a line.
+    (narrow-to-region 6000 (point-max))
+    (indent-tests--check-columns 50)
+    (widen)
+    (indent-tests--check-columns 50)))
+
+(ert-deftest indent-tests-move-to-column-force ()
+  (with-temp-buffer
+    (insert (make-string 5000 ?a) "\tb")
+    (dolist (cache-long-scans '(t nil))
+      (goto-char (point-max))
+      (should (= (current-column) 5009))
+      (goto-char (point-min))
+      (should (= (move-to-column 4998) 4998))
+      ;; Going into the tab splits it.
+      (should (= (move-to-column 5002 t) 5002))
+      (should (= (point) 5003))
+      (should (equal (buffer-substring 5001 (point-max)) "  \tb"))
+      (delete-region 5001 (point-max))
+      (insert "\tb"))))
+
+(ert-deftest indent-tests-column-cache-indirect ()
+  ;; An indirect buffer shares the cache with its base buffer, but not
+  ;; the overlays.
+  (let ((base (generate-new-buffer " *indent-tests*")))
+    (unwind-protect
+        (let ((indirect (make-indirect-buffer base " *indent-tests-indirect*")))
+          (with-current-buffer base
+            (should cache-long-scans)
+            (insert (make-string 20000 ?x))
+            (overlay-put (make-overlay 100 10000) 'invisible t))
+          (with-current-buffer indirect
+            (goto-char 15000)
+            (should (= (current-column) 14999)))
+          (with-current-buffer base
+            (goto-char 15000)
+            (should (= (current-column) 5099)))
+          (kill-buffer indirect))
+      (kill-buffer base))))
+
+;;; indent-tests.el ends here
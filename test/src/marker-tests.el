@@ -57,4 +57,101 @@
     (set-marker marker-2 marker-1)
     (should (goto-char marker-2))))
 
+;; The markers of a buffer are kept in an index ordered by position,
+;; where the markers after the index's gap record their distance from
+;; the end of the buffer.  Check that random edits move them as the
+;; plain list of markers used to.
+(defun marker-tests--check (markers positions)
+  (let ((i 0))
+    (dolist (m markers)
+      (should (eq (marker-buffer m) (current-buffer)))
+      (should (= (marker-position m) (aref positions i)))
+      (should (buffer-has-markers-at (aref positions i)))
+      (setq i (1+ i)))))
+
+(ert-deftest marker-tests-index-random-edits ()
+  (with-temp-buffer
+    (insert (make-string 200 ?a) "αβγ" (make-string 200 ?b))
+    (random "marker-tests")
+    (let* ((n 100)
+           (markers nil)
+           (positions (make-vector n 0)))
+      (dotimes (i n)
+        (let ((m (copy-marker (1+ (random (point-max))) (= 0 (% i 3)))))
+          (push m markers)))
+      (setq markers (nreverse markers))
+      (let ((i 0))
+        (dolist (m markers)
+          (aset positions i (marker-position m))
+          (setq i (1+ i))))
+      (dotimes (_ 300)
+        (let ((pos (1+ (random (point-max))))
+              (op (random 4)))
+          (cond
+           ((< op 2)
+            ;; Insertion, possibly before markers.
+            (let ((len (1+ (random 5)))
+                  (before (= op 1))
+                  (i 0))
+              (goto-char pos)
+              (if before
+                  (insert-before-markers (make-string len ?é))
+                (insert (make-string len ?x)))
+              (dolist (m markers)
+                (let ((p (aref positions i)))
+                  (when (or (> p pos)
+                            (and (= p pos)
+                                 (or before (marker-insertion-type m))))
+                    (aset positions i (+ p len))))
+                (setq i (1+ i)))))
+           ((= op 2)
+            ;; Deletion.
+            (let ((end (min (point-max) (+ pos (random 10))))
+                  (i 0))
+              (delete-region pos end)
+              (dolist (_ markers)
+                (let ((p (aref positions i)))
+                  (cond ((> p end) (aset positions i (- p (- end pos))))
+                        ((> p pos) (aset positions i pos))))
+                (setq i (1+ i)))))
+           (t
+            ;; Move a marker somewhere else.
+            (let ((i (random n)))
+              (set-marker (nth i markers) pos)
+              (aset positions i pos)))))
+        (marker-tests--check markers positions)
+        ;; Byte positions are computed from the nearest markers, so
+        ;; they check the markers' byte positions.
+        (let ((p (1+ (random (point-max)))))
+          (should (= (position-bytes p)
+                     (1+ (string-bytes (buffer-substring (point-min) p)))))
+          (should (= (byte-to-position (position-bytes p)) p))))
+      (dolist (m markers)
+        (set-marker m nil)))))
+
+(ert-deftest marker-tests-index-transpose-and-multibyte ()
+  (with-temp-buffer
+    (insert "aaaXbbbbbYccc")
+    (let ((ma (copy-marker 2))
+          (mx (copy-marker 4))
+          (mb (copy-marker 6))
+          (mc (copy-marker 12)))
+      (transpose-regions 1 4 5 10)
+      (should (equal (buffer-string) "bbbbbXaaaYccc"))
+      (should (= ma 8))
+      (should (= mx 6))
+      (should (= mb 2))
+      (should (= mc 12))
+      (goto-char 3)
+      (insert "é")
+      (set-buffer-multibyte nil)
+      (should (= mb 2))
+      (should (= ma 10))
+      (should (= mc 14))
+      (set-buffer-multibyte t)
+      (should (= mb 2))
+      (should (= ma 9))
+      (should (= mc 13))
+      (should (= (position-bytes ma) 10)))))
+
 ;;; marker-tests.el ends here.
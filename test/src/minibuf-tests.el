@@ -411,4 +411,107 @@
                    (try-completion "baz" '("baz" "bAz"))))))
 
 
+
+;; The flex matches of STRING in COLLECTION as computed in Lisp, as
+;; (COMPLETION . POSITIONS) in the order of COLLECTION.
+(defun minibuf-tests--flex-matches (string collection)
+  (let ((regexp (mapconcat (lambda (c) (regexp-quote (string c))) string
+                           ".*")))
+    (delq nil
+          (mapcar (lambda (completion)
+                    (when (let ((case-fold-search completion-ignore-case))
+                            (string-match regexp completion))
+                      (cons completion
+                            (nth 2 (assoc completion
+                                          (all-flex-completions
+                                           string (list completion)))))))
+                  collection))))
+
+(ert-deftest test-all-flex-completions ()
+  (let ((collection '("foobar" "fxxb" "barfoo" "foo-bar" "fooBar" "xyz"
+                      "été" "FOO")))
+    (should (equal (all-flex-completions "fb" collection)
+                   '(("foo-bar" 42 (0 4)) ("fxxb" 36 (0 3))
+                     ("foobar" 35 (0 3)))))
+    (let ((all (all-flex-completions "" collection)))
+      (should (equal (sort (mapcar #'car all) #'string<)
+                     (sort (copy-sequence collection) #'string<)))
+      (should (equal (mapcar #'cadr all)
+                     (sort (mapcar #'cadr all) #'>))))
+    (should (equal (all-flex-completions "ét" collection)
+                   '(("été" 44 (0 1)))))
+    ;; Extending the previous string.
+    (should (equal (mapcar #'car (all-flex-completions "fo" collection))
+                   '("foobar" "foo-bar" "fooBar" "barfoo")))
+    (should (equal (all-flex-completions "fob" collection)
+                   '(("foo-bar" 63 (0 1 4)) ("foobar" 57 (0 1 3)))))
+    (let ((completion-ignore-case t))
+      (should (equal (mapcar #'car (all-flex-completions "fob" collection))
+                     '("fooBar" "foo-bar" "foobar")))
+      (should (equal (mapcar #'car (all-flex-completions "fOo" collection))
+                     '("foobar" "fooBar" "FOO" "foo-bar" "barfoo")))))
+  ;; Other kinds of collections, predicates and regexps.
+  (let ((alist '(("abc" . 1) ("axbxc" . 2) ("cba" . 3)))
+        (table (make-hash-table :test #'equal)))
+    (dolist (elt alist)
+      (puthash (car elt) (cdr elt) table))
+    (dolist (collection (list alist table (lambda (s p a)
+                                            (all-completions s alist p))))
+      (should (equal (mapcar #'car (all-flex-completions "ac" collection))
+                     '("abc" "axbxc")))
+      (should (equal (mapcar #'car
+                             (all-flex-completions
+                              "ac" collection
+                              (if (hash-table-p collection)
+                                  (lambda (_ v) (= v 2))
+                                (lambda (e) (equal e '("axbxc" . 2))))))
+                     '("axbxc")))
+      (let ((completion-regexp-list '("x")))
+        (should (equal (mapcar #'car (all-flex-completions "a" collection))
+                       '("axbxc"))))))
+  ;; Obarrays and hash tables changed since the previous call.
+  (let ((ob (make-vector 7 0))
+        (table (make-hash-table :test #'equal)))
+    (intern "abc" ob)
+    (puthash "abc" t table)
+    (dolist (collection (list ob table))
+      (should (equal (mapcar #'car (all-flex-completions "a" collection))
+                     '("abc")))
+      (if (vectorp collection)
+          (intern "axbc" collection)
+        (puthash "axbc" t table)
+        (puthash "zzz" t table)
+        (remhash "zzz" table))
+      (should (equal (sort (mapcar #'car (all-flex-completions "ab" collection))
+                           #'string<)
+                     '("abc" "axbc")))))
+  ;; A function collection with completion boundaries.
+  (let ((dir (make-temp-file "minibuf-tests" t)))
+    (unwind-protect
+        (progn
+          (dolist (file '("foobar" "bazfb" "xyz"))
+            (write-region "" nil (expand-file-name file dir)))
+          (should (equal (sort (mapcar #'car
+                                       (all-flex-completions
+                                        (concat (file-name-as-directory dir)
+                                                "fb")
+                                        #'completion-file-name-table))
+                               #'string<)
+                         '("bazfb" "foobar"))))
+      (delete-directory dir t)))
+  (let ((matches (all-flex-completions "minibuffer-dep" obarray #'fboundp)))
+    (should (equal (mapcar #'car (list (nth 0 matches) (nth 1 matches)))
+                   '("minibuffer-depth" "minibuffer-depth-indicate-mode")))
+    (should (seq-every-p (lambda (m) (fboundp (intern (car m)))) matches)))
+  ;; Many completions, with and without threads.
+  (let ((collection (let (names)
+                      (dotimes (i 20000 (nreverse names))
+                        (push (format "name-%d-%x" i (* i 7)) names)))))
+    (dolist (completion-flex-threads '(0 4))
+      (should (equal (sort (mapcar (lambda (m) (cons (car m) (nth 2 m)))
+                                   (all-flex-completions "1a3" collection))
+                           (lambda (a b) (string< (car a) (car b))))
+                     (sort (minibuf-tests--flex-matches "1a3" collection)
+                           (lambda (a b) (string< (car a) (car b)))))))))
+
 ;;; minibuf-tests.el ends here
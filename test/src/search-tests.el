@@ -0,0 +1,162 @@
+;;; search-tests.el --- tests for search.c functions -*- lexical-binding: t -*-
+
+;; Copyright (C) 2021 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <https://www.gnu.org/licenses/>.
+
+;;; Code:
+
+(require 'ert)
+
+(ert-deftest search-tests--search-files ()
+  (let* ((dir (make-temp-file "search-tests" t))
+         (a (expand-file-name "a" dir))
+         (b (expand-file-name "b" dir))
+         (files (list a b (expand-file-name "missing" dir))))
+    (unwind-protect
+        (progn
+          (let ((coding-system-for-write 'utf-8-unix))
+            (write-region "foo bar\nBar baz\n  xbar\n" nil a nil 'silent)
+            (write-region "été bar\n" nil b nil 'silent))
+          (dolist (threads '(0 4))
+            (let ((search-files-threads threads)
+                  (case-fold-search nil))
+              (should (equal (search-files "bar" files)
+                             `((,a 1 4 "bar") (,a 3 3 "bar") (,b 1 4 "bar"))))
+              (should (equal (search-files "ba[rz]" files 2)
+                             `((,a 1 4 "bar") (,a 2 4 "baz"))))
+              (should (equal (search-files "é." files)
+                             `((,b 1 0 "ét") (,b 1 2 "é "))))
+              (should (equal (search-files "^" (list a))
+                             `((,a 1 0 "") (,a 2 0 "") (,a 3 0 "")
+                               (,a 4 0 "")))))
+            (let ((search-files-threads threads)
+                  (case-fold-search t))
+              (should (equal (search-files "bar" files)
+                             `((,a 1 4 "bar") (,a 2 0 "Bar") (,a 3 3 "bar")
+                               (,b 1 4 "bar"))))
+              (should (equal (search-files "ÉT" files)
+                             `((,b 1 0 "ét")))))))
+      (delete-directory dir t))))
+
+(ert-deftest search-tests--search-files-literal ()
+  "Check literal searches of `search-files' against `search-forward'."
+  (let* ((file (make-temp-file "search-tests"))
+         (text (concat (apply #'concat (make-list 100 "abAbaBabab x\n"))
+                       "aab aaab")))
+    (unwind-protect
+        (progn
+          (let ((coding-system-for-write 'utf-8-unix))
+            (write-region text nil file nil 'silent))
+          (dolist (threads '(0 4))
+            (dolist (case-fold-search '(nil t))
+              (dolist (pattern '("abab" "bab" "aab" "b" "ab x"))
+                (let ((search-files-threads threads)
+                      expected)
+                  (with-temp-buffer
+                    (insert text)
+                    (goto-char (point-min))
+                    (while (search-forward pattern nil t)
+                      (push (list file (line-number-at-pos (match-beginning 0))
+                                  (save-excursion
+                                    (goto-char (match-beginning 0))
+                                    (current-column))
+                                  (match-string 0))
+                            expected)))
+                  (should (equal (search-files pattern (list file))
+                                 (nreverse expected))))))))
+      (delete-file file))))
+
+;; The first occurrence of one of PATTERNS in TEXT from START, as
+;; (INDEX BEG END), the longest of those starting first.
+(defun search-tests--first-pattern (patterns text start case-fold)
+  (let ((case-fold-search case-fold)
+        best)
+    (dotimes (i (length patterns))
+      (let ((pos (string-match (regexp-quote (aref patterns i)) text start)))
+        (when (and pos
+                   (or (not best) (< pos (nth 1 best))
+                       (and (= pos (nth 1 best)) (> (match-end 0) (nth 2 best)))))
+          (setq best (list i pos (match-end 0))))))
+    best))
+
+(ert-deftest search-tests--string-matcher ()
+  (let ((patterns ["he" "she" "his" "hers" "é" "ÉTÉ" "abcd" "bc" "h"]))
+    (dolist (case-fold '(nil t))
+      (let ((m (make-string-matcher patterns case-fold)))
+        (should (string-matcher-p m))
+        (should (equal (string-matcher-patterns m) patterns))
+        (dolist (text '("ushers" "xhisx" "abcd" "abc" "été" "Été x ÉTÉ"
+                        "nothing" "" "SHE"))
+          (dotimes (start (1+ (length text)))
+            (let ((ref (search-tests--first-pattern patterns text start
+                                                    case-fold)))
+              (should (equal (string-matcher-string-match m text start)
+                             (car ref)))
+              (when ref
+                (should (equal (list (match-beginning 0) (match-end 0))
+                               (cdr ref)))))
+            (with-temp-buffer
+              (insert text)
+              (goto-char (1+ start))
+              (let ((ref (search-tests--first-pattern patterns text start
+                                                      case-fold)))
+                (should (equal (string-matcher-search-forward m nil t)
+                               (car ref)))
+                (if ref
+                    (should (equal (list (1- (match-beginning 0))
+                                         (1- (match-end 0))
+                                         (1- (point)))
+                                   (list (nth 1 ref) (nth 2 ref)
+                                         (nth 2 ref))))
+                  (should (= (point) (1+ start))))))))))
+    (let ((m (make-string-matcher '("ab" "bcd"))))
+      (with-temp-buffer
+        (insert "xabcd")
+        (goto-char (point-min))
+        (should-not (string-matcher-search-forward m 3 t))
+        (should-not (string-matcher-search-forward m 3 'move))
+        (should (= (point) 3))
+        (goto-char (point-min))
+        (should (eq (string-matcher-search-forward m 4) 0))
+        ;; A match across the gap.
+        (goto-char 4)
+        (insert "y")
+        (delete-char -1)
+        (goto-char 3)
+        (should (eq (string-matcher-search-forward m) 1))
+        (should-error (string-matcher-search-forward m)
+                      :type 'search-failed)))
+    ;; Many overlapping patterns over a small alphabet.
+    (let* ((random-string (lambda (n)
+                            (let ((s (make-string n ?a)))
+                              (dotimes (i n s)
+                                (aset s i (aref "abc" (random 3)))))))
+           (patterns (let (p)
+                       (dotimes (_ 40 (vconcat p))
+                         (push (funcall random-string (1+ (random 6))) p))))
+           (text (funcall random-string 300))
+           (m (make-string-matcher patterns)))
+      (dotimes (start (length text))
+        (let ((ref (search-tests--first-pattern patterns text start nil)))
+          (should (equal (string-matcher-string-match m text start)
+                         (car ref)))
+          (should (equal (list (match-beginning 0) (match-end 0))
+                         (cdr ref))))))
+    (should-error (make-string-matcher '("a" "")))
+    (should-error (string-matcher-search-forward [string-matcher]))))
+
+;;; search-tests.el ends here
@@ -20,6 +20,7 @@
 ;;; Code:
 
 (require 'ert)
+(require 'cl-lib)
 
 (ert-deftest parse-partial-sexp-continue-over-comment-marker ()
   "Continue a parse that stopped in the middle of a comment marker."
@@ -82,4 +83,148 @@ also has open paren syntax (see Bug#24870)."
       (should (equal (parse-partial-sexp pointC pointX nil nil ppsC)
                      ppsX)))))
 
+;;; Tests for skip-chars and skip-syntax.
+
+(defun syntax-tests--skip-chars-reference (spec forward lim)
+  "Skip the chars in SPEC one at a time, like `skip-chars-forward'."
+  (let ((re (concat "[" spec "]"))
+        (start (point)))
+    (if forward
+        (while (and (< (point) lim)
+                    (string-match-p re (string (char-after))))
+          (forward-char))
+      (while (and (> (point) lim)
+                  (string-match-p re (string (char-before))))
+        (backward-char)))
+    (- (point) start)))
+
+(defun syntax-tests--skip-syntax-reference (spec forward lim)
+  "Skip the syntaxes in SPEC one at a time, like `skip-syntax-forward'."
+  (let* ((negate (string-prefix-p "^" spec))
+         (classes (mapcar (lambda (c) (car (string-to-syntax (string c))))
+                          (if negate (substring spec 1) spec)))
+         (start (point)))
+    (cl-flet ((skip-p (pos)
+                (let ((class (syntax-class (syntax-after pos))))
+                  (if negate
+                      (not (memq class classes))
+                    (memq class classes)))))
+      (if forward
+          (while (and (< (point) lim) (skip-p (point)))
+            (forward-char))
+        (while (and (> (point) lim) (skip-p (1- (point))))
+          (backward-char))))
+    (- (point) start)))
+
+(ert-deftest skip-chars-and-syntax-runs ()
+  "Check skipping over runs of characters against a simple loop."
+  (with-temp-buffer
+    (let ((chars "abcxyz_  \t\n()\"é中"))
+      (random "syntax-tests")
+      (dotimes (_ 3000)
+        (insert (make-string (1+ (random 20))
+                             (aref chars (random (length chars))))))
+      ;; Give some characters a different syntax by text property.
+      (dotimes (_ 50)
+        (let ((pos (1+ (random (1- (buffer-size))))))
+          (put-text-property pos (1+ pos) 'syntax-table
+                             (string-to-syntax "."))))
+      (dolist (lookup '(nil t))
+        (setq-local parse-sexp-lookup-properties lookup)
+        (dolist (multibyte '(t nil))
+          (set-buffer-multibyte multibyte)
+          (dotimes (_ 300)
+            (let* ((from (1+ (random (buffer-size))))
+                   (forward (zerop (random 2)))
+                   (lim (if forward (point-max) (point-min)))
+                   (spec (nth (random 5) '("a-z_" "^a-z" " \t\n" "^ \n"
+                                           "a-zé中")))
+                   (syntax (nth (random 4) '("w_" "^w_" " " "^ "))))
+              (goto-char from)
+              (should (= (if forward (skip-chars-forward spec lim)
+                           (skip-chars-backward spec lim))
+                         (progn (goto-char from)
+                                (syntax-tests--skip-chars-reference
+                                 spec forward lim))))
+              (goto-char from)
+              (should (= (if forward (skip-syntax-forward syntax lim)
+                           (skip-syntax-backward syntax lim))
+                         (progn (goto-char from)
+                                (syntax-tests--skip-syntax-reference
+                                 syntax forward lim)))))))))))
+
+;;; Tests for the syntax-ppss cache.
+
+(defun syntax-tests--ppss-equal (pos)
+  "Check `internal--syntax-ppss' at POS against `parse-partial-sexp'."
+  (let ((ppss (internal--syntax-ppss pos))
+        (expected (save-excursion (parse-partial-sexp (point-min) pos))))
+    (should (= (point) pos))
+    ;; Elements 2 and 6 depend on where parsing started.
+    (setf (nth 2 ppss) nil (nth 6 ppss) nil
+          (nth 2 expected) nil (nth 6 expected) nil)
+    (should (equal ppss expected))))
+
+(ert-deftest syntax-ppss-cache-random-edits ()
+  "Check the syntax-ppss cache through random edits and narrowing."
+  (with-temp-buffer
+    (let ((tables (list (with-syntax-table (make-syntax-table)
+                          (modify-syntax-entry ?/ ". 124b")
+                          (modify-syntax-entry ?* ". 23")
+                          (modify-syntax-entry ?\n "> b")
+                          (syntax-table))
+                        (let ((table (make-syntax-table)))
+                          (modify-syntax-entry ?\; "<" table)
+                          (modify-syntax-entry ?\n ">" table)
+                          table)))
+          (chars "()[]\"\\/*;'\nab  "))
+      (random "syntax-tests")
+      (dotimes (_ 20000)
+        (insert (aref chars (random (length chars)))))
+      (set-syntax-table (car tables))
+      (dotimes (i 300)
+        (let ((pos (+ (point-min) (random (- (point-max) (point-min) -1)))))
+          (pcase (random 10)
+            (0 (goto-char pos)
+               (insert (aref chars (random (length chars)))))
+            (1 (delete-region pos (min (point-max) (+ pos (random 5)))))
+            (2 (widen)
+               (narrow-to-region pos (min (point-max) (+ pos 5000))))
+            (3 (widen))
+            (4 (set-syntax-table (nth (random 2) tables)))
+            (_ (syntax-tests--ppss-equal pos))))
+        (when (zerop (% i 50))
+          (syntax-tests--ppss-equal (point-max)))))))
+
+(ert-deftest syntax-ppss-cache-text-properties ()
+  "Check that changes of text properties flush the syntax-ppss cache."
+  (with-temp-buffer
+    (setq-local parse-sexp-lookup-properties t)
+    (insert "(a b) (c d)")
+    (syntax-tests--ppss-equal 3)
+    (syntax-tests--ppss-equal 9)
+    (put-text-property 1 2 'syntax-table (string-to-syntax "."))
+    (syntax-tests--ppss-equal 3)
+    (should (= (car (internal--syntax-ppss 3)) 0))
+    (with-silent-modifications
+      (remove-text-properties 1 2 '(syntax-table nil)))
+    (should (= (car (internal--syntax-ppss 3)) 1))
+    (syntax-tests--ppss-equal 9)))
+
+(ert-deftest syntax-ppss-cache-flush ()
+  "Check that the cache follows `syntax-table' properties."
+  (with-temp-buffer
+    (insert (make-string 5000 ?a) "\"" (make-string 5000 ?b))
+    (syntax-tests--ppss-equal (point-max))
+    (let ((inhibit-modification-hooks t))
+      (put-text-property 5001 5002 'syntax-table '(1)))
+    (setq-local parse-sexp-lookup-properties t)
+    (syntax-tests--ppss-equal (point-max))
+    (should-not (nth 3 (internal--syntax-ppss (point-max))))
+    (let ((inhibit-modification-hooks t))
+      (remove-text-properties 5001 5002 '(syntax-table nil)))
+    (internal--syntax-ppss-flush 5001)
+    (syntax-tests--ppss-equal (point-max))
+    (should (nth 3 (internal--syntax-ppss (point-max))))))
+
 ;;; syntax-tests.el ends here
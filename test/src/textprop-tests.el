@@ -23,6 +23,7 @@
 ;;; Code:
 
 (require 'ert)
+(require 'seq)
 
 (ert-deftest textprop-tests-format ()
   "Test `format' with text properties."
@@ -68,5 +69,211 @@
     (should (and (equal-including-properties (pop stack) string)
 		 (null stack)))))
 
+(defun textprop-tests--random-runs (start end values)
+  "Return a vector of random runs from START to END with VALUES."
+  (let ((p start) runs)
+    (while (< p end)
+      (let* ((beg (+ p (random (min 4 (- end p)))))
+             (run-end (min end (+ beg (random 6)))))
+        (push (list beg run-end (nth (random (length values)) values)) runs)
+        (setq p (max (1+ beg) run-end))))
+    (vconcat (nreverse runs))))
+
+(ert-deftest textprop-tests-put-text-property-runs ()
+  (let ((values '(bold italic (bold italic) nil)))
+    (dotimes (_ 200)
+      (let* ((text (let ((s (make-string 40 ?x)))
+                     (dotimes (_ 10 s)
+                       (let ((beg (random 40)))
+                         (put-text-property beg (min 40 (+ beg (random 10)))
+                                            (nth (random 2) '(face mouse-face))
+                                            (nth (random 4) values) s)))))
+             (start (random 20))
+             (end (+ 20 (random 21)))
+             (runs (textprop-tests--random-runs start end values))
+             (expected (copy-sequence text))
+             (actual (copy-sequence text)))
+        (remove-text-properties start end '(face nil) expected)
+        (mapc (lambda (run)
+                (put-text-property (nth 0 run) (nth 1 run) 'face (nth 2 run)
+                                   expected))
+              runs)
+        (should (eq (put-text-property-runs start end 'face runs actual)
+                    (not (equal-including-properties text expected))))
+        (should (equal-including-properties actual expected))
+        ;; Neighbors with equal properties have been merged.
+        (let ((pos start))
+          (while (and (setq pos (next-property-change pos actual))
+                      (<= pos end))
+            (should-not (equal (text-properties-at (1- pos) actual)
+                               (text-properties-at pos actual))))))))
+  ;; In a buffer, the hooks run once, and undo reverts the change.
+  (with-temp-buffer
+    (buffer-enable-undo)
+    (insert "foo bar baz")
+    (put-text-property 1 4 'face 'italic)
+    (undo-boundary)
+    (let* ((changes 0)
+           (after-change-functions (list (lambda (&rest _)
+                                           (setq changes (1+ changes))))))
+      (should (put-text-property-runs 1 12 'face
+                                      [(1 4 bold) (5 8 bold) (9 12 nil)]))
+      (should (= changes 1))
+      (should (equal-including-properties
+               (buffer-string)
+               #("foo bar baz" 0 3 (face bold) 4 7 (face bold) 8 11 (face nil))))
+      (should-not (put-text-property-runs 1 12 'face
+                                          [(1 4 bold) (5 8 bold) (9 12 nil)]))
+      (should (= changes 1)))
+    (primitive-undo 1 buffer-undo-list)
+    (should (equal (mapcar (lambda (pos) (get-text-property pos 'face))
+                           '(1 3 4 5 9))
+                   '(italic italic nil nil nil))))
+  (with-temp-buffer
+    (insert "foo bar")
+    (should-error (put-text-property-runs 1 8 'face [(4 6 bold) (2 3 bold)])
+                  :type 'args-out-of-range)
+    (should-error (put-text-property-runs 1 5 'face [(4 6 bold)])
+                  :type 'args-out-of-range)
+    (should-error (put-text-property-runs 1 8 'face '((1 2 bold))))))
+
+;; The results of the searches for changes of PROP from some positions
+;; of the current buffer, with and without limits.
+(defun textprop-tests--property-searches (prop)
+  (let (results)
+    (dotimes (i (1+ (/ (buffer-size) 13)))
+      (let ((pos (+ (point-min) (* i 13)))
+            (limit (+ (point-min) (% (* i 7919) (1+ (buffer-size))))))
+        (push (list (next-single-property-change pos prop)
+                    (next-single-property-change pos prop nil limit)
+                    (previous-single-property-change pos prop)
+                    (previous-single-property-change pos prop nil limit)
+                    (text-property-any pos limit prop nil)
+                    (text-property-any pos limit prop 'bold)
+                    (text-property-not-all pos limit prop nil)
+                    (text-property-not-all pos limit prop 'bold))
+              results)))
+    results))
+
+(ert-deftest textprop-tests-property-index ()
+  (with-temp-buffer
+    (insert (make-string 1000 ?x))
+    (dotimes (i 500)
+      (put-text-property (+ 1 (* 2 i)) (+ 2 (* 2 i)) 'mouse-face (% i 7)))
+    (put 'textprop-tests--category 'face 'italic)
+    (let ((changes
+           (list
+            (lambda (beg end)
+              (put-text-property beg end (nth (random 3)
+                                              '(face invisible fontified))
+                                 (nth (random 3) '(nil bold t))))
+            (lambda (beg end)
+              (remove-text-properties beg end '(face nil invisible nil)))
+            (lambda (beg end)
+              (add-face-text-property beg end 'bold))
+            (lambda (beg end)
+              (set-text-properties beg end '(mouse-face highlight)))
+            (lambda (beg end)
+              (put-text-property beg end 'category 'textprop-tests--category))
+            (lambda (beg _end)
+              (goto-char beg)
+              (insert (propertize "ab" 'face 'bold)))
+            (lambda (beg end)
+              (delete-region beg (min end (+ beg 3)))))))
+      (dotimes (_ 30)
+        (let* ((beg (+ (point-min) (random (buffer-size))))
+               (end (min (point-max) (+ beg 1 (random 100)))))
+          (funcall (nth (random (length changes)) changes) beg end))
+        (dolist (prop '(face invisible fontified))
+          (let ((indexed (textprop-tests--property-searches prop)))
+            ;; Search twice, so that the index is built if needed.
+            (setq indexed (textprop-tests--property-searches prop))
+            (should (equal indexed
+                           (let ((text-property-index-properties nil))
+                             (textprop-tests--property-searches prop))))))))
+    ;; Values that come from elsewhere than the plists.
+    (remove-text-properties (point-min) (point-max) '(category nil))
+    (put-text-property 10 20 'face 'bold)
+    (dotimes (_ 2) (textprop-tests--property-searches 'face))
+    (should (equal (next-single-property-change 1 'face) 10))
+    (let ((char-property-alias-alist '((face mouse-face))))
+      (should (equal (next-single-property-change 1 'face) 2)))
+    (let ((default-text-properties '(face italic)))
+      (should (equal (text-property-any 1 30 'face 'italic) 1)))
+    (put-text-property 1 5 'category 'textprop-tests--category)
+    (dotimes (_ 2) (textprop-tests--property-searches 'face))
+    (should (equal (next-single-property-change 1 'face) 5))
+    (put 'textprop-tests--category 'face nil)
+    (should (equal (next-single-property-change 1 'face) 10))
+    (set-buffer-multibyte nil)
+    (should (equal (next-single-property-change 1 'face) 10))
+    ;; The plist of a category can change in place.
+    (dotimes (_ 2) (textprop-tests--property-searches 'face))
+    (plist-put (symbol-plist 'textprop-tests--category) 'face 'bold)
+    (should (equal (next-single-property-change 1 'face) 5))))
+
+;; The values of `face' at each position of the buffer, and of the
+;; string STRING if non-nil.
+(defun textprop-tests--faces (&optional string)
+  (let ((faces nil))
+    (if string
+        (dotimes (i (length string))
+          (push (get-text-property i 'face string) faces))
+      (dotimes (i (buffer-size))
+        (push (get-text-property (1+ i) 'face) faces)))
+    (nreverse faces)))
+
+(ert-deftest textprop-tests-interval-tree ()
+  "Check properties after many changes to the tree of intervals."
+  (with-temp-buffer
+    (let ((faces [bold italic underline nil])
+          (expected nil)
+          (random-state 0))
+      (dotimes (i 300)
+        (let ((face (aref faces (% i 4))))
+          (insert (propertize "ab" 'face face))
+          (setq expected (append expected (list face face)))))
+      (dotimes (i 300)
+        (setq random-state (% (+ (* random-state 7919) 104729) 1000003))
+        (let* ((pos (% random-state (buffer-size)))
+               (len (% random-state 60))
+               (end (min (buffer-size) (+ pos len))))
+          (pcase (% i 4)
+            ;; Copy a piece of the buffer elsewhere in it.
+            (0 (let ((copy (buffer-substring (1+ pos) (1+ end)))
+                     (at (% (* random-state 31) (1+ (buffer-size)))))
+                 (should (equal (textprop-tests--faces copy)
+                                (seq-subseq expected pos end)))
+                 (goto-char (1+ at))
+                 (insert copy)
+                 (setq expected (append (seq-take expected at)
+                                        (seq-subseq expected pos end)
+                                        (nthcdr at expected)))))
+            ;; Change the properties of a piece.
+            (1 (put-text-property (1+ pos) (1+ end) 'face 'bold)
+               (dotimes (k (- end pos))
+                 (setcar (nthcdr (+ pos k) expected) 'bold)))
+            ;; Delete a piece.
+            (2 (when (> (buffer-size) 200)
+                 (delete-region (1+ pos) (1+ end))
+                 (setq expected (append (seq-take expected pos)
+                                        (nthcdr end expected)))))
+            ;; Insert plain text in the middle of an interval.
+            (3 (goto-char (1+ pos))
+               (insert "xyz")
+               (setq expected (append (seq-take expected pos)
+                                      (list nil nil nil)
+                                      (nthcdr pos expected))))))
+        (should (equal (textprop-tests--faces) expected)))
+      ;; Copy the whole buffer into a string and back.
+      (let ((copy (buffer-string)))
+        (should (equal (textprop-tests--faces copy) expected))
+        (erase-buffer)
+        (insert "--")
+        (goto-char 2)
+        (insert copy)
+        (should (equal (textprop-tests--faces)
+                       (append '(nil) expected '(nil))))))))
+
 (provide 'textprop-tests)
 ;; textprop-tests.el ends here.
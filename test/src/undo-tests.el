@@ -437,6 +437,115 @@ Demonstrates bug 16818."
 
     (should (string= (buffer-string) "aaaFirst line\nSecond line\nbbb"))))
 
+;; Make changes to the current buffer, with undo boundaries between
+;; some of them, and return its undo list.
+(defun undo-test--changes ()
+  (buffer-enable-undo)
+  (insert "abc\ndéf\nghi\n")
+  (undo-boundary)
+  (dotimes (i 200)
+    (let ((pos (1+ (% (* i 7919) (max 1 (buffer-size))))))
+      (goto-char pos)
+      (pcase (% i 7)
+        (0 (insert "xy") (insert "z"))
+        (1 (delete-region pos (min (point-max) (+ pos 3))))
+        (2 (delete-region (max (point-min) (- pos 2)) pos))
+        (3 (insert "é"))
+        (4 (put-text-property pos (min (point-max) (+ pos 2)) 'face 'bold))
+        (5 (delete-char (min 2 (- (point-max) pos))))
+        (6 (undo-boundary)))))
+  buffer-undo-list)
+
+(ert-deftest undo-test-compact-log ()
+  "Test that the compact undo log records what the undo list does."
+  (let ((lists nil))
+    (dolist (undo-compact-log '(nil t))
+      (with-temp-buffer
+        (push (undo-test--changes) lists)
+        ;; Once looked at, the log is in the list.
+        (should (= (plist-get (undo-memory-statistics) :log-entries) 0))
+        (should (> (plist-get (undo-memory-statistics) :list-bytes) 0))))
+    (should (equal-including-properties (nth 0 lists) (nth 1 lists))))
+  (with-temp-buffer
+    (let ((undo-compact-log t))
+      (undo-test--changes)
+      (insert "more")
+      (undo-boundary)
+      (should (> (plist-get (undo-memory-statistics) :log-entries) 0))
+      (should (> (plist-get (undo-memory-statistics) :log-bytes) 0))
+      ;; Undo everything.
+      (let ((conversions (plist-get (undo-memory-statistics) :conversions)))
+        (while buffer-undo-list
+          (primitive-undo 1 buffer-undo-list)
+          (setq buffer-undo-list (cdr (memq nil buffer-undo-list))))
+        (should (< conversions
+                   (plist-get (undo-memory-statistics) :conversions))))
+      (should (equal (buffer-string) ""))
+      ;; Setting the list forgets the log.
+      (insert "abc")
+      (setq buffer-undo-list nil)
+      (should (= (plist-get (undo-memory-statistics) :log-entries) 0))
+      (should-not buffer-undo-list)
+      ;; Binding it too.
+      (let ((buffer-undo-list nil))
+        (insert "def"))
+      (should-not buffer-undo-list))))
+
+(ert-deftest undo-test-compact-log-truncate ()
+  "Test that truncating the undo list keeps change groups whole."
+  (with-temp-buffer
+    (let ((undo-compact-log t))
+      (insert (make-string 100000 ?a))
+      (buffer-enable-undo)
+      (insert "x")
+      (undo-boundary)
+      (delete-region 1 50001)
+      ;; Looking at the list puts the log in it; the insertion of "b"
+      ;; goes in the log, in the same change group as the deletion.
+      (should (assoc (make-string 50000 ?a) buffer-undo-list))
+      (goto-char (point-min))
+      (insert "b")
+      (undo-boundary)
+      (insert "c")
+      (let ((undo-limit 1000)
+            (undo-strong-limit 2000))
+        (garbage-collect))
+      (should (eq (and (member '(1 . 2) buffer-undo-list) t)
+                  (and (assoc (make-string 50000 ?a) buffer-undo-list)
+                       t))))))
+
+(ert-deftest undo-test-compact-log-bindings ()
+  "Test that binding the undo list to t leaves the compact log alone."
+  (let ((lists nil))
+    (dolist (undo-compact-log '(nil t))
+      (with-temp-buffer
+        (buffer-enable-undo)
+        (insert "abc")
+        (undo-boundary)
+        (insert "def")
+        (undo-boundary)
+        ;; As an amalgamating command does.
+        (should (undo-remove-boundary))
+        (should-not (undo-remove-boundary))
+        (insert "g")
+        (let ((conversions (plist-get (undo-memory-statistics)
+                                      :conversions)))
+          (with-silent-modifications
+            (put-text-property 1 3 'face 'bold)
+            (should (eq buffer-undo-list t)))
+          (should (= (plist-get (undo-memory-statistics) :conversions)
+                     conversions)))
+        (should (eq (> (plist-get (undo-memory-statistics) :log-entries) 0)
+                    undo-compact-log))
+        ;; What is recorded while the list is bound stays in the binding.
+        (let ((buffer-undo-list t))
+          (setq buffer-undo-list nil)
+          (insert "h")
+          (should (equal (car buffer-undo-list) '(8 . 9))))
+        (push buffer-undo-list lists)))
+    (should (equal (nth 0 lists) (nth 1 lists)))
+    (should (equal (nth 0 lists) '((4 . 8) nil (1 . 4) (t . 0))))))
+
 (defun undo-test-all (&optional interactive)
   "Run all tests for \\[undo]."
   (interactive "p")